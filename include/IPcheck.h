@@ -13,6 +13,21 @@
 struct Client;
 struct irc_in_addr;
 
+/** Size and occupancy of the IP registry, from IPcheck_stats(). */
+struct IPcheckStats {
+  unsigned int entries;     /**< Per-address entries. */
+  unsigned int idle;        /**< Entries with no connected clients. */
+  unsigned int buckets;     /**< Buckets in the per-address table. */
+  unsigned int used;        /**< Non-empty per-address buckets. */
+  unsigned int max_chain;   /**< Longest per-address hash chain. */
+  unsigned int entries48;   /**< IPv6 /48 entries. */
+  unsigned int buckets48;   /**< Buckets in the /48 table. */
+  unsigned int used48;      /**< Non-empty /48 buckets. */
+  unsigned int max_chain48; /**< Longest /48 hash chain. */
+  unsigned int expired;     /**< Entries expired since startup. */
+  size_t bytes;             /**< Memory used by entries and tables. */
+};
+
 /*
  * Prototypes
  */
@@ -25,5 +40,6 @@ extern void IPcheck_connect_succeeded(struct Client *cptr);
 extern int IPcheck_remote_connect(struct Client *cptr, int is_burst);
 extern void IPcheck_disconnect(struct Client *cptr);
 extern unsigned short IPcheck_nr(struct Client* cptr);
+extern void IPcheck_stats(struct IPcheckStats* stats);
 
 #endif /* INCLUDED_ipcheck_h */
@@ -204,6 +204,20 @@ struct Membership {
   unsigned short     oplevel;		/**< Op level */
 };
 
+/** Length at which a channel's member list or a user's channel list
+ * gets a MemberHash.  The hash is dropped again below half this. */
+#define MEMBER_HASH_MIN     32
+
+/** Open-addressed (linear probing) hash of one side of the membership
+ * matrix: a channel's members keyed by client, or a user's channels
+ * keyed by channel.  Only long lists have one; see find_member_link().
+ */
+struct MemberHash {
+  unsigned int       mask;		/**< Number of slots, minus one */
+  unsigned int       count;		/**< Number of memberships held */
+  struct Membership* slots[1];		/**< Slots; NULL if empty */
+};
+
 #define MAXOPLEVELDIGITS    3
 #define MAXOPLEVEL          999
 
@@ -222,23 +236,31 @@ struct Membership {
 #define IsDelayedJoin(x)    ((x)->status & CHFL_DELAYED)
 #define IsDelayedTarget(x)  ((x)->status & CHFL_DELAYED_TARGET)
 
+/* SetZombie(), SetDelayedJoin() and ClearDelayedJoin() also keep the
+ * channel's zombie and delayed-join counts up to date. */
 #define SetBanned(x)        ((x)->status |= CHFL_BANNED)
 #define SetBanValid(x)      ((x)->status |= CHFL_BANVALID)
 #define SetDeopped(x)       ((x)->status |= CHFL_DEOPPED)
 #define SetServOpOk(x)      ((x)->status |= CHFL_SERVOPOK)
 #define SetBurstJoined(x)   ((x)->status |= CHFL_BURST_JOINED)
-#define SetZombie(x)        ((x)->status |= CHFL_ZOMBIE)
+#define SetZombie(x)        ((void)(IsZombie(x) || \
+                                    ((x)->status |= CHFL_ZOMBIE, \
+                                     ++(x)->channel->zombies)))
 #define SetChannelManager(x) ((x)->status |= CHFL_CHANNEL_MANAGER)
 #define SetOpLevel(x, v)    (void)((x)->oplevel = (v))
 #define SetUserParting(x)   ((x)->status |= CHFL_USER_PARTING)
-#define SetDelayedJoin(x)   ((x)->status |= CHFL_DELAYED)
+#define SetDelayedJoin(x)   ((void)(IsDelayedJoin(x) || \
+                                    ((x)->status |= CHFL_DELAYED, \
+                                     ++(x)->channel->delayed)))
 
 #define ClearBanned(x)      ((x)->status &= ~CHFL_BANNED)
 #define ClearBanValid(x)    ((x)->status &= ~CHFL_BANVALID)
 #define ClearDeopped(x)     ((x)->status &= ~CHFL_DEOPPED)
 #define ClearServOpOk(x)    ((x)->status &= ~CHFL_SERVOPOK)
 #define ClearBurstJoined(x) ((x)->status &= ~CHFL_BURST_JOINED)
-#define ClearDelayedJoin(x) ((x)->status &= ~CHFL_DELAYED)
+#define ClearDelayedJoin(x) ((void)(IsDelayedJoin(x) && \
+                                    ((x)->status &= ~CHFL_DELAYED, \
+                                     (x)->channel->delayed--)))
 #define ClearDelayedTarget(x) ((x)->status &= ~CHFL_DELAYED_TARGET)
 
 /** Mode information for a channel */
@@ -266,8 +288,14 @@ struct Ban {
   unsigned short flags;       /**< modifier flags for the ban */
   unsigned char nu_len;       /**< length of nick!user part of banstr */
   unsigned char addrbits;     /**< netmask length for BAN_IPMASK bans */
+  unsigned char host_cmask;   /**< offset of compiled host part in cmask */
+  short nu_minlen;            /**< minimum length matched by nick!user part,
+                                 or -1 if that part is not compiled */
+  short host_minlen;          /**< minimum length matched by host part,
+                                 or -1 if that part is not compiled */
   char who[NICKLEN+1];        /**< name of client that set the ban */
   char banstr[NICKLEN+USERLEN+HOSTLEN+3];  /**< hostmask that the ban matches */
+  char cmask[NICKLEN+USERLEN+HOSTLEN+3];   /**< banstr compiled by matchcomp() */
 };
 
 /** Information about a channel */
@@ -280,6 +308,9 @@ struct Channel {
   time_t             topic_time;   /**< Modification time of the topic */
   unsigned int       users;	   /**< Number of clients on this channel */
   struct Membership* members;	   /**< Pointer to the clients on this channel*/
+  struct MemberHash* member_hash;  /**< Members by client, if there are many */
+  unsigned int       delayed;	   /**< Number of join-delayed members */
+  unsigned int       zombies;	   /**< Number of zombie members */
   struct SLink*      invites;	   /**< List of invites on this channel */
   struct Ban*        banlist;      /**< List of bans on this channel */
   struct Mode        mode;	   /**< This channels mode */
@@ -385,6 +416,7 @@ extern int sub1_from_channel(struct Channel* chptr);
 extern int destruct_channel(struct Channel* chptr);
 extern void add_user_to_channel(struct Channel* chptr, struct Client* who,
                                 unsigned int flags, int oplevel);
+extern void reserve_channel_members(struct Channel* chptr, unsigned int count);
 extern void make_zombie(struct Membership* member, struct Client* who,
                         struct Client* cptr, struct Client* sptr,
                         struct Channel* chptr);
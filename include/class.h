@@ -50,6 +50,21 @@ struct ConnectionClass {
   unsigned int            max_flood;      /**< Client flood limit in bytes. */
   unsigned int            max_links;      /**< Maximum connections allowed. */
   unsigned int            ref_count;      /**< Number of references to class. */
+  unsigned int            write_budget;   /**< Bytes the write scheduler may
+                                             send per loop iteration (0 for
+                                             no limit). */
+  unsigned int            write_left;     /**< Bytes left in this iteration's
+                                             budget. */
+  unsigned int            write_round;    /**< Scheduler iteration that
+                                             ConnectionClass::write_left
+                                             belongs to. */
+  unsigned long           write_bytes;    /**< Bytes sent by the write
+                                             scheduler. */
+  unsigned long           write_sends;    /**< Connections written to by the
+                                             write scheduler. */
+  unsigned long           write_deferred; /**< Connections left with queued
+                                             data because the budget ran
+                                             out. */
   unsigned short          ping_freq;      /**< Ping frequency for clients. */
   unsigned short          conn_freq;      /**< Auto-connect frequency. */
   unsigned char           valid;          /**< Valid flag (cleared after this
@@ -76,6 +91,8 @@ struct ConnectionClass {
 #define Links(x)        ((x)->ref_count)
 /** Get default usermode for \a x. */
 #define CCUmode(x)      ((x)->default_umode)
+/** Get per-iteration write budget for \a x. */
+#define WriteBudget(x)  ((x)->write_budget)
 
 /** Get class name for ConfItem \a x. */
 #define ConfClass(x)    ((x)->conn_class->cc_name)
@@ -113,11 +130,14 @@ extern void free_class(struct ConnectionClass * tmp);
 extern char *get_conf_class(const struct ConfItem *aconf);
 extern int get_conf_ping(const struct ConfItem *aconf);
 extern char *get_client_class(struct Client *acptr);
+extern struct ConnectionClass *class_resolve(struct Client *cptr);
 extern void add_class(char *name, unsigned int ping,
                       unsigned int confreq, unsigned int maxfl,
                       unsigned int maxli, unsigned int sendq);
 extern void report_classes(struct Client *sptr, const struct StatDesc *sd,
                            char *param);
+extern void report_class_writes(struct Client *sptr,
+                                const struct StatDesc *sd, char *param);
 extern unsigned int get_sendq(struct Client* cptr);
 extern unsigned int find_max_flood(struct Client* cptr);
 
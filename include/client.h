@@ -49,9 +49,12 @@
 #define INCLUDED_sys_types_h
 #endif
 
+struct AdmitWait;
 struct ConfItem;
 struct Listener;
 struct ListingArgs;
+struct BurstState;
+struct ZipState;
 struct SLink;
 struct Server;
 struct User;
@@ -152,6 +155,7 @@ enum Flag
     FLAG_HUB,                       /**< server is a hub */
     FLAG_IPV6,                      /**< server understands P10 IPv6 addrs */
     FLAG_SERVICE,                   /**< server is a service */
+    FLAG_COMPRESS,                  /**< server offered link compression */
     FLAG_GOTID,                     /**< successful ident lookup achieved */
     FLAG_NONL,                      /**< No \n in buffer */
     FLAG_TS8,                       /**< Why do you want to know? */
@@ -163,6 +167,7 @@ enum Flag
     FLAG_IAUTH_STATS,               /**< Wanted IAuth statistics */
     FLAG_NEGOTIATING_TLS,           /**< TLS negotation ongoing */
     FLAG_EXEMPT_THROTTLE,           /**< exempt from input throttling (raised-maxflood class) */
+    FLAG_ADMITTED,                  /**< holds an admission slot */
 
     FLAG_LOCOP,                     /**< Local operator -- SRB */
     FLAG_SERVNOTICE,                /**< server notices such as kill */
@@ -203,6 +208,8 @@ struct Connection
   unsigned long       con_magic;     /**< magic number */
   struct Connection*  con_next;      /**< Next connection with queued data */
   struct Connection** con_prev_p;    /**< What points to us */
+  unsigned int        con_deficit;   /**< Bytes the write scheduler still
+                                        owes the connection */
   struct Client*      con_client;    /**< Client associated with connection */
   unsigned int        con_count;     /**< Amount of data in buffer */
   int                 con_freeflag;  /**< indicates if connection can be freed */
@@ -230,6 +237,8 @@ struct Connection
                                         from. */
   struct SLink*       con_confs;     /**< Associated configuration records. */
   struct ListingArgs* con_listing;   /**< Current LIST status. */
+  struct BurstState*  con_burst;     /**< Outgoing net.burst in progress. */
+  struct ZipState*    con_zip;       /**< Link compression state. */
   unsigned int        con_max_sendq; /**< cached max send queue for client */
   unsigned int        con_max_flood; /**< cached client flood limit */
   unsigned int        con_ping_freq; /**< cached ping freq */
@@ -262,6 +271,7 @@ struct Connection
   capset_t            con_capab;     /**< Client capabilities (from us) */
   capset_t            con_active;    /**< Active capabilities (to us) */
   struct AuthRequest* con_auth;      /**< Auth request for client */
+  struct AdmitWait*   con_admit;     /**< Admission queue entry, if waiting */
   const struct wline* con_wline;     /**< WebIRC authorization for client */
   uint64_t            con_sasl;      /**< SASL session cookie */
   struct Timer        con_sasl_timer; /**< SASL timeout timer */
@@ -286,6 +296,12 @@ struct Client {
                                      server, XXX if this is a user */
   time_t         cli_firsttime;   /**< time client was created */
   time_t         cli_lastnick;    /**< TimeStamp on nick */
+  uint64_t       cli_serial;      /**< Serial assigned when added to
+                                     GlobalClientList */
+  uint64_t       cli_announced;   /**< Serial assigned when the client
+                                     was announced to other servers */
+  uint64_t       cli_maskserial;  /**< Serial assigned when the client's
+                                     nick, host or account last changed */
   int            cli_marker;      /**< /who processing marker */
   struct Flags   cli_flags;       /**< client flags */
   unsigned int   cli_hopcount;    /**< number of servers to this 0 = local */
@@ -330,6 +346,12 @@ struct Client {
 #define cli_firsttime(cli)	((cli)->cli_firsttime)
 /** Get time client last changed nickname. */
 #define cli_lastnick(cli)	((cli)->cli_lastnick)
+/** Get serial number of the client's place in GlobalClientList. */
+#define cli_serial(cli)		((cli)->cli_serial)
+/** Get serial number at which the client was announced to servers. */
+#define cli_announced(cli)	((cli)->cli_announced)
+/** Get serial keying cached silence verdicts about the client. */
+#define cli_maskserial(cli)	((cli)->cli_maskserial)
 /** Get WHO marker for client. */
 #define cli_marker(cli)		((cli)->cli_marker)
 /** Get flags flagset for client. */
@@ -393,6 +415,10 @@ struct Client {
 #define cli_handler(cli)	con_handler(cli_connect(cli))
 /** Get LIST status for client. */
 #define cli_listing(cli)	con_listing(cli_connect(cli))
+/** Get outgoing burst status for client. */
+#define cli_burst(cli)		con_burst(cli_connect(cli))
+/** Get link compression state for client. */
+#define cli_zip(cli)		con_zip(cli_connect(cli))
 /** Get cached max SendQ for client. */
 #define cli_max_sendq(cli)	con_max_sendq(cli_connect(cli))
 /** Get cached flood limit for client. */
@@ -417,6 +443,8 @@ struct Client {
 #define cli_proc(cli)		con_proc(cli_connect(cli))
 /** Get auth request for client. */
 #define cli_auth(cli)		con_auth(cli_connect(cli))
+/** Get admission queue entry for client. */
+#define cli_admit(cli)		con_admit(cli_connect(cli))
 /** Get WebIRC authorization for client. */
 #define cli_wline(cli)          con_wline(cli_connect(cli))
 /** Get sentalong marker for client. */
@@ -436,6 +464,8 @@ struct Client {
 #define con_next(con)		((con)->con_next)
 /** Get global previous connection. */
 #define con_prev_p(con)		((con)->con_prev_p)
+/** Get bytes the write scheduler still owes connection. */
+#define con_deficit(con)	((con)->con_deficit)
 /** Get locally connected client for connection. */
 #define con_client(con)		((con)->con_client)
 /** Get number of unprocessed data bytes from connection. */
@@ -478,6 +508,10 @@ struct Client {
 #define con_handler(con)	((con)->con_handler)
 /** Get the LIST status for the connection. */
 #define con_listing(con)	((con)->con_listing)
+/** Get the outgoing burst status for the connection. */
+#define con_burst(con)		((con)->con_burst)
+/** Get the link compression state for the connection. */
+#define con_zip(con)		((con)->con_zip)
 /** Get the maximum permitted SendQ size for the connection. */
 #define con_max_sendq(con)	((con)->con_max_sendq)
 /** Get the flood limit for the connection. */
@@ -508,6 +542,8 @@ struct Client {
 #define con_active(con)         ((con)->con_active)
 /** Get the auth request for the connection. */
 #define con_auth(con)		((con)->con_auth)
+/** Get the admission queue entry for the connection. */
+#define con_admit(con)		((con)->con_admit)
 /** Get the WebIRC block (if any) used by the connection. */
 #define con_wline(con)          ((con)->con_wline)
 /** Get the SASL session cookie for the connection. */
@@ -647,6 +683,8 @@ struct Client {
 #define IsIPv6(x)               HasFlag(x, FLAG_IPV6)
 /** Return non-zero if the client claims to be a services server. */
 #define IsService(x)            HasFlag(x, FLAG_SERVICE)
+/** Return non-zero if the server offered to compress our link. */
+#define IsCompress(x)           HasFlag(x, FLAG_COMPRESS)
 /** Return non-zero if the client has an account stamp. */
 #define IsAccount(x)            HasFlag(x, FLAG_ACCOUNT)
 /** Return non-zero if the client has set mode +x (hidden host). */
@@ -709,6 +747,8 @@ struct Client {
 #define SetIPv6(x)              SetFlag(x, FLAG_IPV6)
 /** Mark a client as being a services server. */
 #define SetService(x)           SetFlag(x, FLAG_SERVICE)
+/** Mark a server as offering link compression. */
+#define SetCompress(x)          SetFlag(x, FLAG_COMPRESS)
 /** Mark a client as having an account stamp. */
 #define SetAccount(x)           SetFlag(x, FLAG_ACCOUNT)
 /** Mark a client as having mode +x (hidden host). */
@@ -851,5 +891,7 @@ extern void client_add_sendq(struct Connection* con,
 extern void client_set_privs(struct Client *client, struct ConfItem *oper,
 			     int forceOper);
 extern int client_report_privs(struct Client* to, struct Client* client);
+extern const char *client_priv_name(unsigned int priv);
+extern int client_priv_find(const char *name);
 
 #endif /* INCLUDED_client_h */
@@ -34,6 +34,7 @@
 #endif
 
 struct Client;
+struct MatchMask;
 struct StatDesc;
 
 #define GLINE_MAX_EXPIRE 604800	/**< max expire: 7 days */
@@ -51,6 +52,8 @@ struct Gline {
   struct Gline**gl_prev_p;	/**< Previous pointer to this G-line. */
   char	       *gl_user;	/**< Username mask (or channel/realname mask). */
   char	       *gl_host;	/**< Host portion of mask. */
+  struct MatchMask *gl_umask;	/**< Compiled user (or realname) mask. */
+  struct MatchMask *gl_hmask;	/**< Compiled host mask. */
   char	       *gl_reason;	/**< Reason for G-line. */
   time_t	gl_expire;	/**< Expiration timestamp. */
   time_t	gl_lastmod;	/**< Last modification timestamp. */
@@ -41,6 +41,7 @@ struct Daemon
 extern void server_die(const char* message);
 extern void server_panic(const char* message);
 extern void server_restart(const char* message);
+extern void server_upgrade(const char* message);
 
 extern struct Client  me;
 extern time_t         CurrentTime;
@@ -31,6 +31,7 @@
 #define INCLUDED_sys_types_h
 #endif
 
+struct Client;
 struct Event;
 
 /** Generic callback for event activity. */
@@ -66,6 +67,23 @@ enum EventType {
   ET_DESTROY		/**< The generator is being destroyed */
 };
 
+/** Number of buckets in the loop iteration histogram.  Bucket 0 counts
+ * iterations that took less than a microsecond, bucket \a n those that
+ * took at least 2^(n-1) microseconds; the last bucket is open-ended.
+ */
+#define LOOP_BUCKETS	24
+
+/** Event loop iteration statistics.  Times are in nanoseconds. */
+struct LoopTimes {
+  unsigned int	     iterations;  /**< number of completed iterations */
+  unsigned long long wait;	  /**< total time waiting for events */
+  unsigned long long events;	  /**< total time processing I/O events */
+  unsigned long long timers;	  /**< total time in timer_run() */
+  unsigned long long max;	  /**< longest iteration, excluding the wait */
+  unsigned int	     buckets[LOOP_BUCKETS]; /**< iteration histogram */
+  unsigned int	     slow;	  /**< callbacks over SLOW_CALLBACK_MSEC */
+};
+
 /** Common header for event generators. */
 struct GenHeader {
   struct GenHeader*  gh_next;	/**< linked list of generators */
@@ -300,6 +318,12 @@ void socket_events(struct Socket* sock, unsigned int events);
 
 const char* engine_name(void);
 
+void event_wait_begin(void);
+void event_wait_end(void);
+const struct LoopTimes* event_loop_times(void);
+void event_stats_reset(void);
+void event_stats_report(struct Client* to);
+
 #ifdef DEBUGMODE
 /* These routines pretty-print names for states and types for debug printing */
 
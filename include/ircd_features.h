@@ -60,6 +60,7 @@ enum Feature {
   FEAT_LOCAL_CHANNELS,
   FEAT_TOPIC_BURST,
   FEAT_AWAY_BURST,
+  FEAT_BURST_SENDQ,
   FEAT_DISABLE_GLINES,
   FEAT_DISABLE_SLINES,
   FEAT_JOIN_TARGET,
@@ -92,20 +93,33 @@ enum Feature {
   FEAT_MPATH,
   FEAT_RPATH,
   FEAT_PPATH,
+  FEAT_UPATH,
 
   /* Networking features */
   FEAT_TOS_SERVER,
   FEAT_TOS_CLIENT,
   FEAT_POLLS_PER_LOOP,
+  FEAT_WRITE_QUANTUM,
+  FEAT_SLOW_CALLBACK_MSEC,
+  FEAT_LOG_BUFFER,
   FEAT_IRCD_RES_RETRIES,
   FEAT_IRCD_RES_TIMEOUT,
   FEAT_DNS_TCP_MAXCONN,
+  FEAT_DNS_CACHE_SIZE,
+  FEAT_DNS_CACHE_MAXTTL,
+  FEAT_DNS_CACHE_NEGTTL,
   FEAT_AUTH_TIMEOUT,
+  FEAT_ADMIT_MAX_PENDING,
+  FEAT_ADMIT_PORT_PENDING,
+  FEAT_ADMIT_QUEUE_TIMEOUT,
   FEAT_WEBSOCKET_KEEPALIVE,
   FEAT_WEBSOCKET_ALLOWED_ORIGINS,
   FEAT_ANNOUNCE_INVITES,
   FEAT_TLS_CIPHERS,
   FEAT_TLS_SYSTEMCA,
+  FEAT_TLS_SESSION_CACHE,
+  FEAT_TLS_SESSION_TIMEOUT,
+  FEAT_TLS_TICKET_ROTATE,
   FEAT_NETWORK_FEATURES,
   FEAT_NETWORK_TIME,
 
@@ -169,6 +183,9 @@ enum Feature {
   FEAT_HIS_STATS_y,
   FEAT_HIS_STATS_z,
   FEAT_HIS_STATS_IAUTH,
+  FEAT_HIS_STATS_WRITES,
+  FEAT_HIS_STATS_ADMISSION,
+  FEAT_HIS_STATS_TLS,
   FEAT_HIS_WEBIRC,
   FEAT_HIS_WHOIS_SERVERNAME,
   FEAT_HIS_WHOIS_IDLETIME,
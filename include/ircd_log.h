@@ -72,6 +72,8 @@ extern void log_debug_init(int usetty);
 extern void log_init(const char *process_name);
 extern void log_reopen(void);
 extern void log_close(void);
+extern void log_buffer_resize(void);
+extern unsigned long log_dropped(void);
 
 extern void log_write(enum LogSys subsys, enum LogLevel severity,
 		      unsigned int flags, const char *fmt, ...);
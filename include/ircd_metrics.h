@@ -0,0 +1,34 @@
+/*
+ * IRC - Internet Relay Chat, include/ircd_metrics.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Prometheus metrics exporter.
+ *
+ * A Port block with metrics = yes accepts HTTP connections instead of
+ * IRC clients, and answers GET /metrics with the server's counters in
+ * the Prometheus text exposition format.
+ */
+#ifndef INCLUDED_ircd_metrics_h
+#define INCLUDED_ircd_metrics_h
+
+struct irc_sockaddr;
+struct Listener;
+
+extern void metrics_accept(struct Listener *listener, int fd,
+                           const struct irc_sockaddr *peer);
+
+#endif /* INCLUDED_ircd_metrics_h */
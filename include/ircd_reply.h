@@ -26,9 +26,24 @@
 
 struct Client;
 
+/** A numeric reply whose parameters are formatted once and then sent
+ * to many clients; only the prefix and target differ per recipient.
+ */
+struct ReplyTemplate {
+  int		reply;	/**< Numeric to send. */
+  unsigned int	len;	/**< Length of ReplyTemplate::text. */
+  char*		text;	/**< Parameters after the target, with a leading
+			   space, or NULL if not rendered. */
+};
+
+extern void reply_init(void);
 extern int protocol_violation(struct Client* cptr, const char* pattern, ...);
 extern int need_more_params(struct Client* cptr, const char* cmd);
 extern int send_reply(struct Client* to, int reply, ...);
+extern void reply_template_set(struct ReplyTemplate* rt, int reply, ...);
+extern void reply_template_clear(struct ReplyTemplate* rt);
+extern int send_reply_template(struct Client* to,
+                               const struct ReplyTemplate* rt);
 
 #define SND_EXPLICIT	0x40000000	/**< first arg is a pattern to use */
 
@@ -54,6 +54,7 @@ extern int ircd_snprintf(struct Client *dest, char *buf, size_t buf_len,
 			 const char *format, ...);
 extern int ircd_vsnprintf(struct Client *dest, char *buf, size_t buf_len,
 			  const char *format, va_list args);
+extern int ircd_format_compile(const char *format);
 
 /** @fn int ircd_snprintf(struct Client *dest, char *buf, size_t
 			 buf_len, const char *format, ...)
@@ -45,6 +45,7 @@ struct ConfItem;
 struct Listener;
 struct MsgQ;
 struct Socket;
+struct StatDesc;
 
 /** Timeout for TLS handshake in seconds */
 #define TLS_HANDSHAKE_TIMEOUT 5
@@ -218,6 +219,17 @@ IOResult ircd_tls_recv(struct Client *cptr, char *buf,
 IOResult ircd_tls_sendv(struct Client *cptr, struct MsgQ *buf,
                         unsigned int *count_in, unsigned int *count_out);
 
+/** ircd_tls_report_stats() reports TLS session resumption statistics
+ * for inbound connections: how many handshakes were resumed, and how
+ * the session cache and session tickets are being used.
+ *
+ * @param[in] sptr Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void ircd_tls_report_stats(struct Client *sptr, const struct StatDesc *sd,
+                           char *param);
+
 /** Compute base64(SHA1(\a data)) into \a out.
  * Used for RFC 6455 WebSocket handshakes and similar protocols.
  * \returns 0 on success, -1 on failure.
@@ -0,0 +1,35 @@
+/*
+ * IRC - Internet Relay Chat, include/ircd_upgrade.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Hot upgrade: restart the server without dropping its users.
+ *
+ * Before the new binary is exec()ed, the state of every local user
+ * that can survive the restart is written to the upgrade file and its
+ * socket is left open.  The new process reads the file back, keeps
+ * those sockets out of close_connections(), and rebuilds the users and
+ * their channels before it enters the event loop.
+ */
+#ifndef INCLUDED_ircd_upgrade_h
+#define INCLUDED_ircd_upgrade_h
+
+extern int upgrade_save(const char *path);
+extern int upgrade_load(const char *path);
+extern int upgrade_inherited(int fd);
+extern void upgrade_restore(void);
+
+#endif /* INCLUDED_ircd_upgrade_h */
@@ -0,0 +1,56 @@
+/*
+ * IRC - Internet Relay Chat, include/ircd_zip.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Stream compression for server links.
+ *
+ * A compressed link carries one zlib stream in each direction.  It
+ * sits between the P10 parser and the socket (or TLS) layer: outgoing
+ * messages are compressed as they are queued, and incoming data is
+ * inflated before it is split into lines.
+ */
+#ifndef INCLUDED_ircd_zip_h
+#define INCLUDED_ircd_zip_h
+
+#ifndef INCLUDED_stdint_h
+#include <stdint.h>
+#define INCLUDED_stdint_h
+#endif
+
+struct Client;
+struct MsgBuf;
+
+/** Running totals for one compressed link. */
+struct ZipStats {
+  uint64_t raw_out;     /**< Bytes handed to the compressor. */
+  uint64_t zip_out;     /**< Compressed bytes queued for the peer. */
+  uint64_t zip_in;      /**< Compressed bytes received from the peer. */
+  uint64_t raw_in;      /**< Bytes produced by the decompressor. */
+  uint64_t nsec;        /**< Time spent inside zlib, in nanoseconds. */
+};
+
+extern int zip_supported(void);
+extern int zip_start(struct Client *cptr);
+extern void zip_free(struct Client *cptr);
+extern int zip_send(struct Client *cptr, struct MsgBuf *mb);
+extern int zip_flush(struct Client *cptr);
+extern int zip_pending(struct Client *cptr);
+extern void zip_input(struct Client *cptr, const char *buf, unsigned int length);
+extern int zip_inflate(struct Client *cptr, char *buf, unsigned int size);
+extern const struct ZipStats *zip_stats(struct Client *cptr);
+
+#endif /* INCLUDED_ircd_zip_h */
@@ -8,6 +8,10 @@
 #include <sys/types.h>         /* time_t, size_t */
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_stdint_h
+#include <stdint.h>            /* uint64_t */
+#define INCLUDED_stdint_h
+#endif
 
 struct Client;
 struct Connection;
@@ -54,6 +58,7 @@ extern void free_client(struct Client *cptr);
 extern struct Server *make_server(struct Client *cptr);
 extern void remove_client_from_list(struct Client *cptr);
 extern void add_client_to_list(struct Client *cptr);
+extern uint64_t client_serial_next(void);
 extern struct DLink *add_dlink(struct DLink **lpp, struct Client *cp);
 extern void remove_dlink(struct DLink **lpp, struct DLink *lp);
 extern struct ConfItem *make_conf(int type);
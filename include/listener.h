@@ -38,6 +38,7 @@
 #define INCLUDED_sys_types_h
 #endif
 
+struct AdmitWait;
 struct Client;
 struct StatDesc;
 
@@ -60,6 +61,8 @@ enum ListenerFlag {
   LISTEN_WEBSOCKET,
   /** Port is behind Cloudflare; trust CF-Connecting-IP on websocket handshakes. */
   LISTEN_CLOUDFLARE,
+  /** Port serves Prometheus metrics over HTTP instead of IRC. */
+  LISTEN_METRICS,
   /** Sentinel for counting listener flags. */
   LISTEN_LAST_FLAG
 };
@@ -79,6 +82,10 @@ struct Listener {
   unsigned char    mask_bits;          /**< number of bits in mask address */
   int              index;              /**< index into poll array */
   time_t           last_accept;        /**< last time listener accepted */
+  unsigned int     admit_pending;      /**< connections doing their checks */
+  unsigned int     admit_queued[2];    /**< connections waiting for admission */
+  struct AdmitWait* admit_head[2];     /**< admission queues (see s_admit.c) */
+  struct AdmitWait* admit_tail[2];     /**< last entries of admit_head */
   char*            tls_ciphers;        /**< ciphers to use for TLS */
   char*            tls_cacertfile;     /**< CA certificate file for TLS */
   char*            tls_cacertdir;      /**< CA certificate directory for TLS */
@@ -97,10 +104,13 @@ struct Listener {
 #define listener_tls(LISTENER)    FlagHas(&(LISTENER)->flags, LISTEN_TLS)
 #define listener_websocket(LISTENER) FlagHas(&(LISTENER)->flags, LISTEN_WEBSOCKET)
 #define listener_cloudflare(LISTENER) FlagHas(&(LISTENER)->flags, LISTEN_CLOUDFLARE)
+#define listener_metrics(LISTENER) FlagHas(&(LISTENER)->flags, LISTEN_METRICS)
 /** Return non-zero if \a CLI accepted a Cloudflare websocket listener. */
 #define IsCloudflarePort(CLI) \
   (cli_listener(CLI) && listener_cloudflare(cli_listener(CLI)))
 
+extern struct Listener* ListenerPollList;
+
 extern void        add_listener(int port, const char* vaddr_ip, 
                                 const char* mask,
                                 const char* tls_ciphers,
@@ -112,6 +122,8 @@ extern void        add_listener(int port, const char* vaddr_ip,
 extern void        close_listener(struct Listener* listener);
 extern void        close_listeners(void);
 extern void        count_listener_memory(int* count_out, size_t* size_out);
+extern struct Listener* find_listener(int port,
+                                     const struct irc_in_addr *addr);
 extern const char* get_listener_name(const struct Listener* listener);
 extern void        mark_listeners_closing(void);
 extern void        show_ports(struct Client* client, const struct StatDesc* sd,
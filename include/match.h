@@ -12,6 +12,13 @@
 #include "res.h"
 #endif
 
+/** A mask compiled by matchmask_make(). */
+struct MatchMask {
+  int  minlen;   /**< Length of the shortest matching string, or -1
+                  if #cmask holds a mask matchcomp() could not compile. */
+  char cmask[1]; /**< Compiled mask text (see @ref compiledmasks). */
+};
+
 /*
  * Prototypes
  */
@@ -27,6 +34,8 @@ extern char *collapse(char *pattern);
 extern int matchcomp(char *cmask, int *minlen, int *charset, const char *mask);
 extern int matchexec(const char *string, const char *cmask, int minlen);
 extern int matchdecomp(char *mask, const char *cmask);
+extern struct MatchMask *matchmask_make(const char *mask);
+extern int matchmask(const struct MatchMask *mm, const char *string);
 extern int mmexec(const char *wcm, int wminlen, const char *rcm, int rminlen);
 
 extern int ipmask_check(const struct irc_in_addr *addr, const struct irc_in_addr *mask, unsigned char bits);
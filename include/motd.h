@@ -38,6 +38,7 @@
 #endif
 
 struct Client;
+struct ReplyTemplate;
 struct TRecord;
 struct StatDesc;
 
@@ -79,6 +80,7 @@ struct MotdCache {
   int			maxcount; /**< Number of lines allocated for message. */
   struct tm		modtime;  /**< Last modification time from file. */
   int			count;    /**< Actual number of lines used in message. */
+  struct ReplyTemplate*	replies;  /**< Date line and body as RPL_MOTD. */
   char			motd[1][MOTD_LINESIZE]; /**< Message body. */
 };
 
@@ -406,10 +406,25 @@ struct Client;
                                          * mptr->extra be passed in
                                          * parv[1]. */
 
+/** Number of buckets in a command latency histogram.  Bucket 0 counts
+ * handler calls that took less than a microsecond; bucket \a n counts
+ * calls that took at least 2^(n-1) microseconds, and the last bucket
+ * also counts everything slower than that.
+ */
+#define MSG_TIME_BUCKETS 16
+
 /*
  * Structures
  */
 
+/** Time spent in one handler of a message. */
+struct MessageTimes {
+  unsigned int calls;         /**< number of handler invocations */
+  unsigned long long total;   /**< total handler time, in nanoseconds */
+  unsigned long long max;     /**< slowest invocation, in nanoseconds */
+  unsigned int buckets[MSG_TIME_BUCKETS]; /**< latency histogram */
+};
+
 /** Information on how to parse a message. */
 struct Message {
   char *cmd;                  /**< command string */
@@ -429,8 +444,11 @@ struct Message {
    * UNREGISTERED, CLIENT, SERVER, OPER, SERVICE, LAST
    */
   MessageHandler handlers[LAST_HANDLER_TYPE];
+  /** Handler latency, indexed like #handlers. */
+  struct MessageTimes times[LAST_HANDLER_TYPE];
 };
 
 extern struct Message msgtab[];
+extern const char *msg_handler_names[LAST_HANDLER_TYPE];
 
 #endif /* INCLUDED_msg_h */
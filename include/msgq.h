@@ -95,6 +95,7 @@ extern void msgq_add(struct MsgQ *mq, struct MsgBuf *mb, int prio);
 extern void msgq_excise(struct MsgQ *mq, const char *buf, unsigned int len);
 extern void msgq_count_memory(struct Client *cptr,
                               size_t *msg_alloc, size_t *msg_used);
+extern void msgq_memory(size_t *msg_alloc, size_t *msgbuf_alloc);
 extern void msgq_histogram(struct Client *cptr, const struct StatDesc *sd,
                            char *param);
 extern unsigned int msgq_bufleft(struct MsgBuf *mb);
@@ -35,6 +35,7 @@ typedef struct Numeric {
  */
 extern char* rpl_str(int numeric);
 extern const struct Numeric* get_error_numeric(int err);
+extern void init_numerics(void);
 
 /*
  * References:
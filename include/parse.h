@@ -18,6 +18,7 @@ extern int parse_server(struct Client *cptr, char *buffer, char *bufend);
 /** Tags parsed from the current input line (valid only during handler). */
 extern struct MsgTag *parse_tags(void);
 extern void initmsgtree(void);
+extern void msg_times_reset(void);
 
 extern int register_mapping(struct s_map *map);
 extern int unregister_mapping(struct s_map *map);
@@ -1,12 +1,24 @@
 /** @file random.h
- * @brief 32-bit pseudo-random number generator interface.
+ * @brief Pseudo-random number generator interface.
  * @version $Id$
  */
 #ifndef INCLUDED_random_h
 #define INCLUDED_random_h
 
+#ifndef INCLUDED_stdint_h
+#include <stdint.h>
+#define INCLUDED_stdint_h
+#endif
+#ifndef INCLUDED_sys_types_h
+#include <sys/types.h>
+#define INCLUDED_sys_types_h
+#endif
+
 struct Client;
 
+/** Size of one ChaCha20 keystream block, in bytes. */
+#define CHACHA20_BLOCK 64
+
 /*
  * Proto types
  */
@@ -15,5 +27,8 @@ extern int random_seed_set(struct Client* from, const char* const* fields,
 			   int count);
 
 extern unsigned int ircrandom(void);
+extern void random_bytes(void *buf, size_t len);
+extern void chacha20_block(unsigned char *out, const unsigned char *key,
+                           uint32_t counter, const unsigned char *nonce);
 
 #endif /* INCLUDED_random_h */
@@ -0,0 +1,37 @@
+/*
+ * IRC - Internet Relay Chat, include/s_admit.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Registration admission queue.
+ *
+ * Limits how many client connections may be running their DNS, ident
+ * and iauth checks at once, so a flood of reconnecting clients is let
+ * in at a steady rate instead of all at the same time.
+ */
+#ifndef INCLUDED_s_admit_h
+#define INCLUDED_s_admit_h
+
+struct Client;
+struct StatDesc;
+
+extern void admit_init(void);
+extern void admit_client(struct Client *cptr);
+extern void admit_done(struct Client *cptr);
+extern void admit_report(struct Client *sptr, const struct StatDesc *sd,
+                         char *param);
+
+#endif /* INCLUDED_s_admit_h */
@@ -33,6 +33,9 @@ struct Client;
 struct AuthRequest;
 struct StatDesc;
 
+/** Most IAuth worker processes one IAuth block may run. */
+#define IAUTH_MAX_WORKERS 16
+
 extern void start_auth(struct Client *);
 extern void start_dns_ident(struct Client *client);
 extern int auth_ping_timeout(struct Client *);
@@ -46,7 +49,7 @@ extern int auth_cap_done(struct AuthRequest *auth);
 extern int auth_spoof_user(struct AuthRequest *auth, const char *username, const char *hostname, const char *ip);
 extern void destroy_auth_request(struct AuthRequest *req);
 
-extern int auth_spawn(int argc, char *argv[]);
+extern int auth_spawn(int argc, char *argv[], int workers);
 extern void auth_send_exit(struct Client *cptr);
 extern void auth_send_xreply(struct Client *sptr, const char *routing, const char *reply);
 extern void auth_mark_closing(void);
@@ -64,6 +64,8 @@ extern int connect_server(struct ConfItem* aconf, struct Client* by);
 extern int  net_close_unregistered_connections(struct Client* source);
 extern void close_connection(struct Client *cptr);
 extern void add_connection(struct Listener* listener, int fd);
+extern struct Client* adopt_connection(struct Listener* listener, int fd);
+extern void schedule_recvq(struct Client* cptr);
 extern int  read_message(time_t delay);
 extern void init_server_identity(void);
 extern void close_connections(int close_stderr);
@@ -20,6 +20,7 @@
 struct Client;
 struct SLink;
 struct Message;
+struct MatchMask;
 
 /*
  * General defines
@@ -38,6 +39,7 @@ struct Message;
 /* These flags apply to Connect blocks: */
 #define CONF_AUTOCONNECT        0x0001     /**< Autoconnect to a server */
 #define CONF_CONNECT_TLS        0x0002     /**< Server connection uses TLS */
+#define CONF_CONNECT_COMPRESS   0x0004     /**< Offer link compression */
 
 /* These flags apply to Port blocks: */
 #define CONF_PORT_TLS           0x0001     /**< Port should use TLS */
@@ -117,6 +119,9 @@ struct DenyConf {
   char*               message;  /**< Message to send to denied users. */
   char*               usermask; /**< Mask for client's username. */
   char*               realmask; /**< Mask for realname. */
+  struct MatchMask*   hostcomp; /**< Compiled form of hostmask. */
+  struct MatchMask*   usercomp; /**< Compiled form of usermask. */
+  struct MatchMask*   realcomp; /**< Compiled form of realmask. */
   struct irc_in_addr  address;  /**< Address for IP-based denies. */
   unsigned int        flags;    /**< Interpretation flags for the above.  */
   unsigned char       bits;     /**< Number of bits for ipkills */
@@ -85,6 +85,8 @@ struct ServerStatistics {
   unsigned int is_abad;         /**< bad auth requests */
   unsigned int is_loc;          /**< local connections made */
   unsigned int uping_recv;      /**< UDP Pings received */
+  unsigned int is_sil_hit;      /**< silence checks answered from cache */
+  unsigned int is_sil_miss;     /**< silence checks that walked the list */
 };
 
 /*
@@ -8,9 +8,34 @@
 #include <sys/types.h>
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_stdint_h
+#include <stdint.h>            /* uint64_t */
+#define INCLUDED_stdint_h
+#endif
 
 struct ConfItem;
 struct Client;
+struct Channel;
+
+/** Phases of an outgoing net.burst. */
+enum BurstPhase {
+  BURST_USERS,      /**< Sending NICKs for known users. */
+  BURST_CHANNELS    /**< Sending BURSTs for known channels. */
+};
+
+/** Describes an outgoing net.burst that is sent a slice at a time,
+ * as the link's sendQ drains.
+ */
+struct BurstState {
+  struct BurstState* next;    /**< Next burst in progress. */
+  struct BurstState* prev;    /**< Previous burst in progress. */
+  struct Client*     link;    /**< Server link receiving the burst. */
+  enum BurstPhase    phase;   /**< What is currently being sent. */
+  uint64_t           serial;  /**< Client serial when the burst began. */
+  struct Client*     user;    /**< Next client to consider sending. */
+  struct Channel*    channel; /**< Next channel to consider sending. */
+  int                introduce; /**< Scratch flag for burst_user_introduce(). */
+};
 
 extern unsigned int max_connection_count;
 extern unsigned int max_client_count;
@@ -22,6 +47,14 @@ extern int exit_new_server(struct Client* cptr, struct Client* sptr,
                            const char* host, time_t timestamp, const char* fmt, ...);
 extern int a_kills_b_too(struct Client *a, struct Client *b);
 extern int server_estab(struct Client *cptr, struct ConfItem *aconf);
+extern void server_burst_next(struct Client *cptr);
+extern void server_burst_free(struct Client *cptr);
+extern int burst_user_pending(struct Client *link, struct Client *acptr);
+extern void burst_user_introduce(struct Client *acptr);
+extern void burst_introduce_targets(struct Client *link, const char *msg,
+                                    unsigned int len);
+extern void burst_client_removed(struct Client *cptr);
+extern void burst_channel_removed(struct Channel *chptr);
 extern void compute_secure_path_groups(void);
 extern int is_secure_path(struct Client *c1, struct Client *c2);
 extern int get_secure_group_id(struct Client *cli);
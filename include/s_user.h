@@ -83,6 +83,7 @@ extern int hide_hostmask(struct Client *cptr, unsigned int flags);
 extern int set_user_mode(struct Client *cptr, struct Client *sptr,
                          int parc, char *parv[], int allow_modes);
 extern int is_silenced(struct Client *sptr, struct Client *acptr);
+extern void silence_changed(struct Client *cptr);
 extern int hunt_server_cmd(struct Client *from, const char *cmd,
 			   const char *tok, struct Client *one,
 			   int MustBeOper, const char *pattern, int server,
@@ -103,6 +104,7 @@ extern void add_target(struct Client *sptr, void *target);
 extern unsigned int umode_make_snomask(unsigned int oldmask, char *arg,
                                        int what);
 extern int send_supported(struct Client *cptr);
+extern void supported_changed(void);
 
 int should_block_unauth_user(struct Client *source, struct Client *dest);
 int send_reply_blocked_unauth_user(struct Client *source, struct Client *dest);
@@ -29,6 +29,7 @@ struct TagSendCache;
  */
 extern struct SLink *opsarray[];
 
+extern void send_init(void);
 extern void send_buffer(struct Client* to, struct Client* from, struct MsgBuf* buf,
                         int prio, const struct MsgTagCtx *ctx,
                         struct TagSendCache *cache);
@@ -38,8 +39,14 @@ extern void send_raw_buffer(struct Client *to, struct MsgBuf *mb, int prio);
 
 extern void kill_highest_sendq(int servers_too);
 extern void flush_connections(struct Client* cptr);
+extern void flush_scheduled_connections(void);
 extern void send_queued(struct Client *to);
 
+/** Test whether writes to a connection skip the write scheduler's
+ * budgets: server links and connections that are becoming one.
+ */
+#define WritePriority(x) (IsServer(x) || IsHandshake(x) || IsConnecting(x))
+
 /* Send a raw message to one client; USE ONLY IF YOU MUST SEND SOMETHING
  * WITHOUT A PREFIX!
  */
@@ -75,6 +75,19 @@ struct Sline {
   regex_t       sl_regex;     /**< Precompiled regex for this pattern. */
 };
 
+/** Statistics counters for S-line operations. */
+struct SlineCounters {
+  unsigned int sline_hits;          /**< Number of times S-lines matched messages */
+  unsigned int messages_held;       /**< Total number of messages held */
+  unsigned int messages_released;   /**< Number of messages released (XREPLY YES) */
+  unsigned int messages_blocked;    /**< Number of messages blocked (XREPLY NO + timeout) */
+  unsigned int xreply_accepted;     /**< Number of XREPLY YES responses */
+  unsigned int xreply_rejected;     /**< Number of XREPLY NO responses */
+  unsigned int timeout_expired;     /**< Number of messages expired due to timeout */
+};
+
+extern struct SlineCounters sline_stats_counters;
+
 extern int sline_add(struct Client *cptr, struct Client *sptr, char *pattern,
                      time_t lastmod, time_t expire, sl_msgtype_t msgtype, sl_flagtype_t flags);
 extern void sline_modify(struct Client *sptr, struct Sline *sline, time_t lastmod,
@@ -40,6 +40,7 @@ struct DLink;
 struct Client;
 struct User;
 struct Membership;
+struct MemberHash;
 struct SLink;
 
 /** Describes a server on the network. */
@@ -68,10 +69,20 @@ struct Server {
   int  sid;                     /**< Secure group ID - servers with secure paths share same sid */
 };
 
+/** Number of silence verdicts remembered for each user. */
+#define SILENCE_CACHE 4
+
+/** Result of checking one sender against a user's silence list. */
+struct SilenceVerdict {
+  uint64_t    sender; /**< Client::cli_maskserial of the sender, or 0. */
+  struct Ban* found;  /**< Matching silence, or NULL if not silenced. */
+};
+
 /** Describes a user on the network. */
 struct User {
   struct Client*     server;         /**< client structure of server */
   struct Membership* channel;        /**< chain of channel pointer blocks */
+  struct MemberHash* channel_hash;   /**< channel blocks by channel, if on many */
   struct SLink*      invited;        /**< chain of invite pointer blocks */
   struct Ban*        silence;        /**< chain of silence pointer blocks */
   char*              away;           /**< pointer to away message */
@@ -90,6 +101,9 @@ struct User {
   char               account[ACCOUNTLEN + 1]; /**< IRC account name */
   uint64_t	     acc_id;                  /**< IRC account id */
   uint64_t           acc_flags;               /**< IRC account flags */
+  /** Recent verdicts of is_silenced() for this user. */
+  struct SilenceVerdict silence_cache[SILENCE_CACHE];
+  unsigned int       silence_next;            /**< Next silence_cache slot to reuse */
 };
 
 #endif /* INCLUDED_struct_h */
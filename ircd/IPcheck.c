@@ -50,6 +50,8 @@ struct IPTargetEntry {
 /** Stores recent information about a particular IP address. */
 struct IPRegistryEntry {
   struct IPRegistryEntry*  next;   /**< Next entry in the hash chain. */
+  struct IPRegistryEntry*  idle_next; /**< Next entry on an idle list. */
+  struct IPRegistryEntry*  idle_prev; /**< Previous entry on an idle list. */
   struct IPTargetEntry*    target; /**< Recent targets, if any. */
   struct irc_in_addr       addr;   /**< IP address for this user. */
   int		           last_connect; /**< Last connection attempt timestamp. */
@@ -60,17 +62,26 @@ struct IPRegistryEntry {
 /** Stores information about an IPv6/48 block's recent connections. */
 struct IPRegistry48 {
   struct IPRegistry48* next;     /**< Next entry in the hash chain. */
+  struct IPRegistry48* lru_next; /**< Next (more recently used) entry. */
+  struct IPRegistry48* lru_prev; /**< Previous (less recently used) entry. */
   int              last_connect; /**< Last connection attempt timestamp. */
   uint16_t             addr[3];  /**< 48 MSBs of IP address. */
   unsigned short       attempts; /**< Number of recent connection attempts. */
 };
 
-/** Size of hash table (must be a power of two). */
-#define IP_REGISTRY_TABLE_SIZE 0x10000
+/** Log2 of the smallest size of each hash table. */
+#define IP_REGISTRY_MIN_BITS 10
 /** Report current time for tracking in IPRegistryEntry::last_connect. */
 #define NOW ((unsigned short)(CurrentTime & 0xffff))
-/** Time from \a x until now, in seconds. */
-#define CONNECTED_SINCE(x) (NOW - (x))
+/** Time from \a x until now, in seconds.  This is computed modulo
+ * 2**16 like #NOW, so it stays right when the clock wraps. */
+#define CONNECTED_SINCE(x) ((unsigned short)(NOW - (x)))
+/** Seconds after the last client leaves that an entry's free targets
+ * are forgotten. */
+#define IP_REGISTRY_TARGET_EXPIRE 120
+/** Seconds after the last client leaves that an entry is forgotten.
+ * Don't touch this number, it has statistical significance. */
+#define IP_REGISTRY_EXPIRE 600
 
 /** Macro for easy access to configured IPcheck clone limit. */
 #define IPCHECK_CLONE_LIMIT feature_int(FEAT_IPCHECK_CLONE_LIMIT)
@@ -84,9 +95,23 @@ struct IPRegistry48 {
 #define IPCHECK_CLONE_DELAY feature_int(FEAT_IPCHECK_CLONE_DELAY)
 
 /** Hash table for storing IPRegistryEntry entries. */
-static struct IPRegistryEntry* hashTable[IP_REGISTRY_TABLE_SIZE];
+static struct IPRegistryEntry** hashTable;
+/** Log2 of the number of buckets in #hashTable. */
+static unsigned int hashBits;
 /** Hash table for storing IPRegistry48 entries. */
-static struct IPRegistry48* hashTable48[IP_REGISTRY_TABLE_SIZE];
+static struct IPRegistry48** hashTable48;
+/** Log2 of the number of buckets in #hashTable48. */
+static unsigned int hashBits48;
+/** Entries with no connected clients, in the order their last client
+ * left; only these can have free targets to expire. */
+static struct IPRegistryEntry idleList = { 0, &idleList, &idleList };
+/** Entries with no connected clients whose free targets have been
+ * expired, in the order their last client left. */
+static struct IPRegistryEntry staleList = { 0, &staleList, &staleList };
+/** IPRegistry48 entries, least recently used first. */
+static struct IPRegistry48 lruList48 = { 0, &lruList48, &lruList48 };
+/** Occupancy counters reported by IPcheck_stats(). */
+static struct IPcheckStats ipStats;
 /** List of allocated but unused IPRegistryEntry structs. */
 static struct IPRegistryEntry* freeList;
 /** List of allocated but unused IPRegistry48 structs. */
@@ -129,11 +154,12 @@ static void ip_registry_canonicalize(struct irc_in_addr *out, const struct irc_i
  */
 static unsigned int ip_registry_hash(const struct irc_in_addr *ip)
 {
-  unsigned int res;
+  uint64_t res;
   /* Only use the first 64 bits of address, since the last 64 bits
    * tend to be under user control. */
-  res = ip->in6_16[0] ^ ip->in6_16[1] ^ ip->in6_16[2] ^ ip->in6_16[3];
-  return res & (IP_REGISTRY_TABLE_SIZE - 1);
+  res = ((uint64_t)ip->in6_16[0] << 48) | ((uint64_t)ip->in6_16[1] << 32)
+    | ((uint64_t)ip->in6_16[2] << 16) | ip->in6_16[3];
+  return (res * 0x9e3779b97f4a7c15ull) >> (64 - hashBits);
 }
 
 /** Find an IP registry entry if one exists for the IP address.
@@ -160,12 +186,39 @@ static struct IPRegistryEntry* ip_registry_find(const struct irc_in_addr *ip)
   return entry;
 }
 
+/** Move every IP registry entry into a hash table of a new size.
+ * @param[in] bits Log2 of the new number of buckets.
+ */
+static void ip_registry_resize(unsigned int bits)
+{
+  struct IPRegistryEntry** old = hashTable;
+  struct IPRegistryEntry* entry;
+  unsigned int ii, bucket, size = 1u << hashBits;
+
+  hashTable = MyCalloc(1u << bits, sizeof(*hashTable));
+  hashBits = bits;
+  for (ii = 0; old && ii < size; ++ii) {
+    while ((entry = old[ii])) {
+      old[ii] = entry->next;
+      bucket = ip_registry_hash(&entry->addr);
+      entry->next = hashTable[bucket];
+      hashTable[bucket] = entry;
+    }
+  }
+  MyFree(old);
+}
+
 /** Add an IP registry entry to the hash table.
+ * The table doubles in size when it holds more entries than buckets.
  * @param[in] entry Registry entry to add.
  */
 static void ip_registry_add(struct IPRegistryEntry* entry)
 {
-  unsigned int bucket = ip_registry_hash(&entry->addr);
+  unsigned int bucket;
+
+  if (++ipStats.entries > (1u << hashBits))
+    ip_registry_resize(hashBits + 1);
+  bucket = ip_registry_hash(&entry->addr);
   entry->next = hashTable[bucket];
   hashTable[bucket] = entry;
 }
@@ -176,6 +229,7 @@ static void ip_registry_add(struct IPRegistryEntry* entry)
 static void ip_registry_remove(struct IPRegistryEntry* entry)
 {
   unsigned int bucket = ip_registry_hash(&entry->addr);
+  --ipStats.entries;
   if (hashTable[bucket] == entry)
     hashTable[bucket] = entry->next;
   else {
@@ -189,6 +243,46 @@ static void ip_registry_remove(struct IPRegistryEntry* entry)
   }
 }
 
+/** Take an IP registry entry off whichever idle list holds it.
+ * @param[in] entry Registry entry to unlink.
+ */
+static void ip_registry_idle_unlink(struct IPRegistryEntry* entry)
+{
+  if (!entry->idle_next)
+    return;
+  entry->idle_prev->idle_next = entry->idle_next;
+  entry->idle_next->idle_prev = entry->idle_prev;
+  entry->idle_next = entry->idle_prev = 0;
+  --ipStats.idle;
+}
+
+/** Append an IP registry entry to an idle list.
+ * @param[in] list Head of #idleList or #staleList.
+ * @param[in] entry Registry entry to append.
+ */
+static void ip_registry_idle_append(struct IPRegistryEntry* list,
+                                    struct IPRegistryEntry* entry)
+{
+  entry->idle_prev = list->idle_prev;
+  entry->idle_next = list;
+  list->idle_prev->idle_next = entry;
+  list->idle_prev = entry;
+  ++ipStats.idle;
+}
+
+/** Keep \a entry on the idle list exactly when it has no clients.
+ * Call this whenever IPRegistryEntry::connected or
+ * IPRegistryEntry::last_connect changes; an idle entry moves to the
+ * end of #idleList so the list stays in expiry order.
+ * @param[in] entry Registry entry that changed.
+ */
+static void ip_registry_touch(struct IPRegistryEntry* entry)
+{
+  ip_registry_idle_unlink(entry);
+  if (0 == entry->connected)
+    ip_registry_idle_append(&idleList, entry);
+}
+
 /** Allocate a new IP registry entry.
  * For members that have a sensible default value, that is used.
  * @return Newly allocated registry entry.
@@ -237,43 +331,67 @@ static unsigned int ip_registry_update_free_targets(struct IPRegistryEntry* entr
   return free_targets;
 }
 
-/** Check whether all or part of \a entry needs to be expired.
- * If the entry is at least 600 seconds stale, free the entire thing.
- * If it is at least 120 seconds stale, expire its free targets list.
- * @param[in] entry Registry entry to check for expiration.
+/** Calculate hash value for an IP address's /48 block.
+ * @param[in] ip Address to hash; must be an IPv6 address.
+ * @return Hash value for address.
  */
-static void ip_registry_expire_entry(struct IPRegistryEntry* entry)
+static unsigned int ip_48_hash(const struct irc_in_addr *ip)
 {
-  /*
-   * Don't touch this number, it has statistical significance
-   * XXX - blah blah blah
-   */
-  if (CONNECTED_SINCE(entry->last_connect) > 600) {
-    /*
-     * expired
-     */
-    Debug((DEBUG_DNS, "IPcheck expiring registry for %s (no clients connected).", ircd_ntoa(&entry->addr)));
-    ip_registry_remove(entry);
-    ip_registry_delete_entry(entry);
-  }
-  else if (CONNECTED_SINCE(entry->last_connect) > 120 && 0 != entry->target) {
-    /*
-     * Expire storage of targets
-     */
-    MyFree(entry->target);
-    entry->target = 0;
+  uint64_t res;
+  res = ((uint64_t)ip->in6_16[0] << 32) | ((uint64_t)ip->in6_16[1] << 16)
+    | ip->in6_16[2];
+  return (res * 0x9e3779b97f4a7c15ull) >> (64 - hashBits48);
+}
+
+/** Calculate hash value for a /48 registry entry.
+ * @param[in] entry Entry to hash.
+ * @return Hash value for the entry's address.
+ */
+static unsigned int ip_48_entry_hash(const struct IPRegistry48* entry)
+{
+  struct irc_in_addr addr;
+
+  addr.in6_16[0] = entry->addr[0];
+  addr.in6_16[1] = entry->addr[1];
+  addr.in6_16[2] = entry->addr[2];
+  return ip_48_hash(&addr);
+}
+
+/** Move every /48 entry into a hash table of a new size.
+ * @param[in] bits Log2 of the new number of buckets.
+ */
+static void ip_48_resize(unsigned int bits)
+{
+  struct IPRegistry48** old = hashTable48;
+  struct IPRegistry48* entry;
+  unsigned int ii, bucket, size = 1u << hashBits48;
+
+  hashTable48 = MyCalloc(1u << bits, sizeof(*hashTable48));
+  hashBits48 = bits;
+  for (ii = 0; old && ii < size; ++ii) {
+    while ((entry = old[ii])) {
+      old[ii] = entry->next;
+      bucket = ip_48_entry_hash(entry);
+      entry->next = hashTable48[bucket];
+      hashTable48[bucket] = entry;
+    }
   }
+  MyFree(old);
 }
 
-/** Calculate hash value for an IP address's /48 block.
- * @param[in] ip Address to hash; must be an IPv6 address.
- * @return Hash value for address.
+/** Move a /48 entry to the most recently used end of #lruList48.
+ * @param[in] entry Entry that was just used.
  */
-static unsigned int ip_48_hash(const struct irc_in_addr *ip)
+static void ip_48_touch(struct IPRegistry48* entry)
 {
-  unsigned int res;
-  res = ip->in6_16[0] ^ ip->in6_16[1] ^ ip->in6_16[2];
-  return res & (IP_REGISTRY_TABLE_SIZE - 1);
+  if (entry->lru_next) {
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+  }
+  entry->lru_prev = lruList48.lru_prev;
+  entry->lru_next = &lruList48;
+  lruList48.lru_prev->lru_next = entry;
+  lruList48.lru_prev = entry;
 }
 
 /** Find or create an IPv6 /48 entry for the IP address.
@@ -294,6 +412,11 @@ static struct IPRegistry48* ip_48_find(const struct irc_in_addr *ip)
       goto done;
   }
 
+  if (++ipStats.entries48 > (1u << hashBits48)) {
+    ip_48_resize(hashBits48 + 1);
+    idx = ip_48_hash(ip);
+  }
+
   /* Where do we get the next entry? */
   entry = freeList48;
   if (entry)
@@ -307,56 +430,124 @@ static struct IPRegistry48* ip_48_find(const struct irc_in_addr *ip)
   entry->addr[1]  = ip->in6_16[1];
   entry->addr[2]  = ip->in6_16[2];
   entry->attempts = 0;
+  entry->lru_next = entry->lru_prev = 0;
 
   /* Link it into the hash table. */
   entry->next = hashTable48[idx];
   hashTable48[idx] = entry;
 
 done:
+  ip_48_touch(entry);
   return entry;
 }
 
 /** Periodic timer callback to check for expired registry entries.
+ * The idle lists are in expiry order, so this only looks at entries
+ * that are due, plus one that is not.
  * @param[in] ev Timer event (ignored).
  */
 static void ip_registry_expire(struct Event* ev)
 {
-  int i;
   struct IPRegistryEntry* entry;
-  struct IPRegistryEntry* entry_next;
+  struct IPRegistry48* entry_48;
+  struct IPRegistry48** prev_p;
 
   assert(ET_EXPIRE == ev_type(ev));
   assert(0 != ev_timer(ev));
 
-  for (i = 0; i < IP_REGISTRY_TABLE_SIZE; ++i) {
-    for (entry = hashTable[i]; entry; entry = entry_next) {
-      entry_next = entry->next;
-      if (0 == entry->connected)
-        ip_registry_expire_entry(entry);
+  /* Forget free targets of entries idle for a while.  Entries idle
+   * long enough to expire outright are freed straight away. */
+  while ((entry = idleList.idle_next) != &idleList
+         && CONNECTED_SINCE(entry->last_connect) > IP_REGISTRY_TARGET_EXPIRE) {
+    ip_registry_idle_unlink(entry);
+    if (entry->target) {
+      MyFree(entry->target);
+      entry->target = 0;
     }
+    if (CONNECTED_SINCE(entry->last_connect) > IP_REGISTRY_EXPIRE) {
+      Debug((DEBUG_DNS, "IPcheck expiring registry for %s (no clients connected).", ircd_ntoa(&entry->addr)));
+      ip_registry_remove(entry);
+      ip_registry_delete_entry(entry);
+      ++ipStats.expired;
+    } else
+      ip_registry_idle_append(&staleList, entry);
   }
 
-  for (i = 0; i < IP_REGISTRY_TABLE_SIZE; ++i) {
-    struct IPRegistry48** prev_p;
-    struct IPRegistry48* entry;
+  while ((entry = staleList.idle_next) != &staleList
+         && CONNECTED_SINCE(entry->last_connect) > IP_REGISTRY_EXPIRE) {
+    Debug((DEBUG_DNS, "IPcheck expiring registry for %s (no clients connected).", ircd_ntoa(&entry->addr)));
+    ip_registry_idle_unlink(entry);
+    ip_registry_remove(entry);
+    ip_registry_delete_entry(entry);
+    ++ipStats.expired;
+  }
 
-    for (prev_p = &hashTable48[i]; (entry = *prev_p); ) {
-      if (CONNECTED_SINCE(entry->last_connect) > 600) {
-        *prev_p = entry->next;
-        entry->next = freeList48;
-        freeList48 = entry;
-      } else
-        prev_p = &entry->next;
-    }
+  while ((entry_48 = lruList48.lru_next) != &lruList48
+         && CONNECTED_SINCE(entry_48->last_connect) > IP_REGISTRY_EXPIRE) {
+    entry_48->lru_prev->lru_next = entry_48->lru_next;
+    entry_48->lru_next->lru_prev = entry_48->lru_prev;
+    for (prev_p = &hashTable48[ip_48_entry_hash(entry_48)];
+         *prev_p != entry_48; prev_p = &(*prev_p)->next)
+      assert(0 != *prev_p);
+    *prev_p = entry_48->next;
+    entry_48->next = freeList48;
+    freeList48 = entry_48;
+    --ipStats.entries48;
   }
+
+  /* Give back buckets once the tables are mostly empty. */
+  if (hashBits > IP_REGISTRY_MIN_BITS
+      && ipStats.entries < (1u << hashBits) / 4)
+    ip_registry_resize(hashBits - 1);
+  if (hashBits48 > IP_REGISTRY_MIN_BITS
+      && ipStats.entries48 < (1u << hashBits48) / 4)
+    ip_48_resize(hashBits48 - 1);
 }
 
 /** Initialize the IPcheck subsystem. */
 void IPcheck_init(void)
 {
+  ip_registry_resize(IP_REGISTRY_MIN_BITS);
+  ip_48_resize(IP_REGISTRY_MIN_BITS);
   timer_add(timer_init(&expireTimer), ip_registry_expire, 0, TT_PERIODIC, 60);
 }
 
+/** Report the size and occupancy of the IP registry.
+ * @param[out] stats Receives the current counters.
+ */
+void IPcheck_stats(struct IPcheckStats* stats)
+{
+  struct IPRegistryEntry* entry;
+  struct IPRegistry48* entry_48;
+  unsigned int ii, len;
+
+  *stats = ipStats;
+  stats->buckets = 1u << hashBits;
+  stats->buckets48 = 1u << hashBits48;
+  stats->used = stats->used48 = 0;
+  stats->max_chain = stats->max_chain48 = 0;
+  for (ii = 0; ii < stats->buckets; ++ii) {
+    for (len = 0, entry = hashTable[ii]; entry; entry = entry->next)
+      ++len;
+    if (len)
+      ++stats->used;
+    if (len > stats->max_chain)
+      stats->max_chain = len;
+  }
+  for (ii = 0; ii < stats->buckets48; ++ii) {
+    for (len = 0, entry_48 = hashTable48[ii]; entry_48; entry_48 = entry_48->next)
+      ++len;
+    if (len)
+      ++stats->used48;
+    if (len > stats->max_chain48)
+      stats->max_chain48 = len;
+  }
+  stats->bytes = stats->entries * sizeof(struct IPRegistryEntry)
+    + stats->entries48 * sizeof(struct IPRegistry48)
+    + stats->buckets * sizeof(*hashTable)
+    + stats->buckets48 * sizeof(*hashTable48);
+}
+
 /** Reset IPcheck configurable settings. */
 void IPcheck_clear_config(void)
 {
@@ -490,6 +681,7 @@ static int ip_registry_check_local(const struct irc_in_addr *addr, time_t* next_
     Debug((DEBUG_DNS, "IPcheck refusing local connection from %s: counter overflow.", ircd_ntoa(&entry->addr)));
     return 0;
   }
+  ip_registry_touch(entry);
 
   if (CONNECTED_SINCE(entry->last_connect) > IPCHECK_CLONE_PERIOD)
     entry->attempts = 0;
@@ -514,6 +706,7 @@ reject:
     {
       assert(entry->connected > 0);
       --entry->connected;
+      ip_registry_touch(entry);
     }
     Debug((DEBUG_DNS, "IPcheck refusing local connection from %s: too fast.", ircd_ntoa(addr)));
     return 0;
@@ -572,6 +765,7 @@ static int ip_registry_check_remote(struct Client* cptr, int is_burst)
     Debug((DEBUG_DNS, "IPcheck refusing remote connection from %s: counter overflow.", ircd_ntoa(&entry->addr)));
     return 0;
   }
+  ip_registry_touch(entry);
   if (CONNECTED_SINCE(entry->last_connect) > IPCHECK_CLONE_PERIOD)
     entry->attempts = 0;
   if (!is_burst) {
@@ -612,6 +806,7 @@ static void ip_registry_connect_fail(const struct irc_in_addr *addr, int disconn
     if (disconnect) {
       assert(entry->connected > 0);
       entry->connected--;
+      ip_registry_touch(entry);
     }
   }
 }
@@ -669,6 +864,7 @@ static void ip_registry_disconnect(struct Client *cptr)
     }
     ip_registry_update_free_targets(entry);
     entry->last_connect = NOW;
+    ip_registry_touch(entry);
   }
   if (MyConnect(cptr)) {
     unsigned int free_targets;
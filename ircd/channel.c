@@ -141,6 +141,31 @@ static void CheckChannelTLS(struct Channel *chan)
   }
 }
 
+#ifdef DEBUGMODE
+/** Check a channel's member, zombie and delayed-join counts against
+ * its member list.
+ * @param[in] chptr Channel to check.
+ * @return Non-zero if all the counts are right.
+ */
+static int member_counts_ok(const struct Channel *chptr)
+{
+  const struct Membership *member;
+  unsigned int users = 0, zombies = 0, delayed = 0;
+
+  for (member = chptr->members; member; member = member->next_member) {
+    ++users;
+    if (IsZombie(member))
+      ++zombies;
+    if (IsDelayedJoin(member))
+      ++delayed;
+  }
+  return users == chptr->users && zombies == chptr->zombies
+    && delayed == chptr->delayed;
+}
+#else
+#define member_counts_ok(chptr) 1
+#endif
+
 #if !defined(NDEBUG)
 /** return the length (>=0) of a chain of links.
  * @param lp	pointer to the start of the linked list
@@ -164,6 +189,7 @@ static void
 set_ban_mask(struct Ban *ban, const char *banstr)
 {
   char *sep;
+  int minlen;
   assert(banstr != NULL);
   ircd_strncpy(ban->banstr, banstr, sizeof(ban->banstr) - 1);
   sep = strrchr(banstr, '@');
@@ -172,6 +198,20 @@ set_ban_mask(struct Ban *ban, const char *banstr)
     if (ipmask_parse(sep + 1, &ban->address, &ban->addrbits))
       ban->flags |= BAN_IPMASK;
   }
+
+  /* Compile both halves once so find_ban() never backtracks.  A half
+   * that matchcomp() cannot compile is left as it is, with a minimum
+   * length of -1, so matchexec() hands it to match(). */
+  memcpy(ban->cmask, ban->banstr, sizeof(ban->cmask));
+  sep = strrchr(ban->cmask, '@');
+  if (sep) {
+    *sep++ = '\0';
+    ban->host_cmask = sep - ban->cmask;
+    ban->host_minlen = matchcomp(sep, &minlen, NULL, sep) < 0 ? -1 : minlen;
+  } else
+    ban->cmask[0] = '\0';
+  ban->nu_minlen = matchcomp(ban->cmask, &minlen, NULL, ban->cmask) < 0
+    ? -1 : minlen;
 }
 
 /** Allocate a new Ban structure.
@@ -220,6 +260,153 @@ void bans_send_meminfo(struct Client *cptr)
 	     bans_inuse, bans_inuse * sizeof(*ban), num_free, bans_alloc);
 }
 
+/** MemberHash keyed by client, as attached to a channel. */
+#define MH_CLIENT   0
+/** MemberHash keyed by channel, as attached to a user. */
+#define MH_CHANNEL  1
+
+/** Key of \a m in a MemberHash of kind \a kind. */
+#define MH_KEY(m, kind) \
+  ((kind) == MH_CLIENT ? (const void *)(m)->user : (const void *)(m)->channel)
+
+/** Find the home slot of a key in a MemberHash.
+ * @param[in] mh Hash table.
+ * @param[in] key Client or channel pointer.
+ * @return Slot index.
+ */
+static unsigned int member_hash_slot(const struct MemberHash *mh,
+                                     const void *key)
+{
+  return ((uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ull >> 32) & mh->mask;
+}
+
+/** Look up a membership in a MemberHash.
+ * @param[in] mh Hash table.
+ * @param[in] key Client or channel to look for.
+ * @param[in] kind MH_CLIENT or MH_CHANNEL.
+ * @return Matching membership, or NULL.
+ */
+static struct Membership *member_hash_find(const struct MemberHash *mh,
+                                           const void *key, int kind)
+{
+  struct Membership *m;
+  unsigned int ii;
+
+  for (ii = member_hash_slot(mh, key); (m = mh->slots[ii]);
+       ii = (ii + 1) & mh->mask)
+    if (MH_KEY(m, kind) == key)
+      return m;
+  return NULL;
+}
+
+/** Put a membership into a MemberHash that has room for it.
+ * @param[in,out] mh Hash table.
+ * @param[in] member Membership to insert.
+ * @param[in] kind MH_CLIENT or MH_CHANNEL.
+ */
+static void member_hash_put(struct MemberHash *mh, struct Membership *member,
+                            int kind)
+{
+  unsigned int ii;
+
+  for (ii = member_hash_slot(mh, MH_KEY(member, kind)); mh->slots[ii];
+       ii = (ii + 1) & mh->mask)
+    ;
+  mh->slots[ii] = member;
+  mh->count++;
+}
+
+/** Move a MemberHash to a table with \a size slots.
+ * @param[in] old Hash table to copy, or NULL.  It is freed.
+ * @param[in] size New number of slots (a power of two).
+ * @param[in] kind MH_CLIENT or MH_CHANNEL.
+ * @return New hash table.
+ */
+static struct MemberHash *member_hash_resize(struct MemberHash *old,
+                                             unsigned int size, int kind)
+{
+  struct MemberHash *mh;
+  unsigned int ii;
+
+  mh = MyCalloc(1, sizeof(*mh) + (size - 1) * sizeof(mh->slots[0]));
+  mh->mask = size - 1;
+  if (old) {
+    for (ii = 0; ii <= old->mask; ii++)
+      if (old->slots[ii])
+        member_hash_put(mh, old->slots[ii], kind);
+    MyFree(old);
+  }
+  return mh;
+}
+
+/** Record a new membership in a channel's or user's MemberHash,
+ * creating the hash when the list becomes long enough.
+ * @param[in,out] mhp Hash table pointer.
+ * @param[in] list Head of the list \a member was just linked into.
+ * @param[in] member New membership.
+ * @param[in] length Length of \a list, including \a member.
+ * @param[in] kind MH_CLIENT (channel's list) or MH_CHANNEL (user's list).
+ */
+static void member_hash_add(struct MemberHash **mhp, struct Membership *list,
+                            struct Membership *member, unsigned int length,
+                            int kind)
+{
+  struct Membership *m;
+
+  if (*mhp) {
+    /* keep the table at most half full */
+    if (2 * ((*mhp)->count + 1) > (*mhp)->mask + 1)
+      *mhp = member_hash_resize(*mhp, 2 * ((*mhp)->mask + 1), kind);
+    member_hash_put(*mhp, member, kind);
+  } else if (length >= MEMBER_HASH_MIN) {
+    *mhp = member_hash_resize(NULL, 4 * MEMBER_HASH_MIN, kind);
+    for (m = list; m; m = (kind == MH_CLIENT) ? m->next_member : m->next_channel)
+      member_hash_put(*mhp, m, kind);
+  }
+}
+
+/** Remove a membership from a channel's or user's MemberHash, if it
+ * has one, and shrink or drop the hash as the list gets shorter.
+ * @param[in,out] mhp Hash table pointer.
+ * @param[in] member Membership being removed.
+ * @param[in] kind MH_CLIENT or MH_CHANNEL.
+ */
+static void member_hash_del(struct MemberHash **mhp, struct Membership *member,
+                            int kind)
+{
+  struct MemberHash *mh = *mhp;
+  unsigned int ii, jj, home;
+
+  if (!mh)
+    return;
+  if (mh->count <= MEMBER_HASH_MIN / 2) {
+    MyFree(*mhp);
+    return;
+  }
+
+  for (ii = member_hash_slot(mh, MH_KEY(member, kind)); mh->slots[ii] != member;
+       ii = (ii + 1) & mh->mask)
+    assert(0 != mh->slots[ii]);
+  mh->count--;
+
+  /* Close the gap by moving back later entries that may live in it. */
+  for (jj = ii; ; ) {
+    mh->slots[ii] = NULL;
+    do {
+      jj = (jj + 1) & mh->mask;
+      if (!mh->slots[jj])
+        goto removed;
+      home = member_hash_slot(mh, MH_KEY(mh->slots[jj], kind));
+    } while (ii <= jj ? (ii < home && home <= jj) : (ii < home || home <= jj));
+    mh->slots[ii] = mh->slots[jj];
+    ii = jj;
+  }
+
+removed:
+  if (8 * mh->count < mh->mask + 1 && mh->mask + 1 > 4 * MEMBER_HASH_MIN)
+    *mhp = member_hash_resize(mh, (mh->mask + 1) / 2, kind);
+}
+
 /** return the struct Membership* that represents a client on a channel
  * This function finds a struct Membership* which holds the state about
  * a client on a specific channel.  The code is smart enough to iterate
@@ -243,7 +430,13 @@ struct Membership* find_member_link(struct Channel* chptr, const struct Client*
   /* Servers don't have member links */
   if (IsServer(cptr)||IsMe(cptr))
      return 0;
-  
+
+  /* Long lists on either side are hashed. */
+  if ((cli_user(cptr))->channel_hash)
+    return member_hash_find((cli_user(cptr))->channel_hash, chptr, MH_CHANNEL);
+  if (chptr->member_hash)
+    return member_hash_find(chptr->member_hash, cptr, MH_CLIENT);
+
   /* +k users are typically on a LOT of channels.  So we iterate over who
    * is in the channel.  X/W are +k and are in about 5800 channels each.
    * however there are typically no more than 1000 people in a channel
@@ -335,7 +528,7 @@ int sub1_from_channel(struct Channel* chptr)
    * then we try to be kind to them and remove possible
    * limiting modes.
    */
-  chptr->mode.mode &= ~MODE_INVITEONLY;
+  chptr->mode.mode &= ~(MODE_INVITEONLY | MODE_WASDELJOINS);
   chptr->mode.limit = 0;
   /*
    * We do NOT reset a possible key or bans because when
@@ -387,6 +580,9 @@ int destruct_channel(struct Channel* chptr)
   struct Ban *ban, *next;
 
   assert(0 == chptr->members);
+  /* reserve_channel_members() may have sized a hash nobody joined */
+  assert(0 == chptr->member_hash || 0 == chptr->member_hash->count);
+  MyFree(chptr->member_hash);
 
   /*
    * Now, find all invite links from channel structure
@@ -405,6 +601,11 @@ int destruct_channel(struct Channel* chptr)
    */
   sline_cleanup_channel(chptr);
 
+  /*
+   * Move any outgoing burst positioned on this channel past it
+   */
+  burst_channel_removed(chptr);
+
   if (chptr->prev)
     chptr->prev->next = chptr->next;
   else
@@ -469,23 +670,21 @@ struct Ban *find_ban(struct Client *cptr, struct Ban *banlist)
 
   /* Walk through ban list. */
   for (found = NULL; banlist; banlist = banlist->next) {
-    int res;
+    int minlen;
     /* If we have found a positive ban already, only consider exceptions. */
     if (found && !(banlist->flags & BAN_EXCEPTION))
       continue;
     /* Compare nick!user portion of ban. */
-    banlist->banstr[banlist->nu_len] = '\0';
-    res = match(banlist->banstr, nu);
-    banlist->banstr[banlist->nu_len] = '@';
-    if (res)
+    if (matchexec(nu, banlist->cmask, banlist->nu_minlen))
       continue;
     /* Compare host portion of ban. */
-    hostmask = banlist->banstr + banlist->nu_len + 1;
+    hostmask = banlist->cmask + banlist->host_cmask;
+    minlen = banlist->host_minlen;
     if (!((banlist->flags & BAN_IPMASK)
          && ipmask_check(&cli_ip(cptr), &banlist->address, banlist->addrbits))
-        && match(hostmask, cli_user(cptr)->host)
-        && match(hostmask, iphost)
-        && !(sr && !match(hostmask, sr)))
+        && matchexec(cli_user(cptr)->host, hostmask, minlen)
+        && matchexec(iphost, hostmask, minlen)
+        && !(sr && !matchexec(sr, hostmask, minlen)))
         continue;
     /* If an exception matches, no ban can match. */
     if (banlist->flags & BAN_EXCEPTION)
@@ -549,6 +748,10 @@ void add_user_to_channel(struct Channel* chptr, struct Client* who,
     member->channel      = chptr;
     member->status       = flags;
     SetOpLevel(member, oplevel);
+    if (IsDelayedJoin(member))
+      ++chptr->delayed;
+    if (IsZombie(member))
+      ++chptr->zombies;
 
     member->next_member  = chptr->members;
     if (member->next_member)
@@ -567,11 +770,41 @@ void add_user_to_channel(struct Channel* chptr, struct Client* who,
     ++chptr->users;
     ++((cli_user(who))->joined);
 
+    member_hash_add(&chptr->member_hash, chptr->members, member,
+                    chptr->users, MH_CLIENT);
+    member_hash_add(&(cli_user(who))->channel_hash, (cli_user(who))->channel,
+                    member, (cli_user(who))->joined, MH_CHANNEL);
+
     /* Check if the channel needs to be updated for TLS */
     CheckChannelTLS(chptr);
   }
 }
 
+/** Make room in a channel's member hash for a batch of new members.
+ * A netburst can add hundreds of users to one channel; sizing the hash
+ * once up front saves rebuilding it each time it fills up.
+ * @param[in,out] chptr Channel about to gain members.
+ * @param[in] count Upper bound on the number of members to be added.
+ */
+void reserve_channel_members(struct Channel* chptr, unsigned int count)
+{
+  struct MemberHash *mh = chptr->member_hash;
+  struct Membership *m;
+  unsigned int size;
+
+  if (chptr->users + count < MEMBER_HASH_MIN)
+    return;
+  /* same load factor member_hash_add() keeps */
+  for (size = 4 * MEMBER_HASH_MIN; size < 2 * (chptr->users + count); size <<= 1)
+    ;
+  if (mh && size <= mh->mask + 1)
+    return;
+  chptr->member_hash = member_hash_resize(mh, size, MH_CLIENT);
+  if (!mh)
+    for (m = chptr->members; m; m = m->next_member)
+      member_hash_put(chptr->member_hash, m, MH_CLIENT);
+}
+
 /** Remove a person from a channel, given their Membership*
  *
  * @param member A member of a channel.
@@ -581,8 +814,10 @@ void add_user_to_channel(struct Channel* chptr, struct Client* who,
 static int remove_member_from_channel(struct Membership* member)
 {
   struct Channel* chptr;
+  int delayed;
   assert(0 != member);
   chptr = member->channel;
+  delayed = IsDelayedJoin(member);
   /*
    * unlink channel member list
    */
@@ -593,11 +828,10 @@ static int remove_member_from_channel(struct Membership* member)
   else
     member->channel->members = member->next_member; 
 
-  /*
-   * If this is the last delayed-join user, may have to clear WASDELJOINS.
-   */
-  if (IsDelayedJoin(member))
-    CheckDelayedJoins(chptr);
+  if (IsZombie(member))
+    --chptr->zombies;
+  if (delayed)
+    --chptr->delayed;
 
   /*
    * unlink client channel list
@@ -611,13 +845,25 @@ static int remove_member_from_channel(struct Membership* member)
 
   --(cli_user(member->user))->joined;
 
+  member_hash_del(&chptr->member_hash, member, MH_CLIENT);
+  member_hash_del(&(cli_user(member->user))->channel_hash, member, MH_CHANNEL);
+
   /* Check if the channel needs to be updated for TLS */
   CheckChannelTLS(chptr);
 
   member->next_member = membershipFreeList;
   membershipFreeList = member;
 
-  return sub1_from_channel(chptr);
+  if (!sub1_from_channel(chptr))
+    return 0;
+
+  /*
+   * If this was the last delayed-join user, may have to clear WASDELJOINS.
+   * Not before the member count is right, though.
+   */
+  if (delayed)
+    CheckDelayedJoins(chptr);
+  return 1;
 }
 
 /** Check if all the remaining members on the channel are zombies
@@ -627,13 +873,8 @@ static int remove_member_from_channel(struct Membership* member)
  */
 static int channel_all_zombies(struct Channel* chptr)
 {
-  struct Membership* member;
-
-  for (member = chptr->members; member; member = member->next_member) {
-    if (!IsZombie(member))
-      return 0;
-  }
-  return 1;
+  assert(member_counts_ok(chptr));
+  return chptr->zombies == chptr->users;
 }
       
 
@@ -1553,15 +1794,9 @@ void make_zombie(struct Membership* member, struct Client* who,
  */
 int number_of_zombies(struct Channel *chptr)
 {
-  struct Membership* member;
-  int                count = 0;
-
   assert(0 != chptr);
-  for (member = chptr->members; member; member = member->next_member) {
-    if (IsZombie(member))
-      ++count;
-  }
-  return count;
+  assert(member_counts_ok(chptr));
+  return chptr->zombies;
 }
 
 /** Concatenate some strings together.
@@ -1599,11 +1834,8 @@ build_string(char *strptr, int *strptr_i, const char *str1,
 static int
 find_delayed_joins(const struct Channel *chan)
 {
-  const struct Membership *memb;
-  for (memb = chan->members; memb; memb = memb->next_member)
-    if (IsDelayedJoin(memb))
-      return 1;
-  return 0;
+  assert(member_counts_ok(chan));
+  return chan->delayed != 0;
 }
 
 /** Flush out the modes
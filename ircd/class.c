@@ -273,6 +273,24 @@ report_classes(struct Client *sptr, const struct StatDesc *sd,
                Links(cltmp) - 1, CCUmode(cltmp) ? CCUmode(cltmp) : "+");
 }
 
+/** Report write scheduler statistics for each connection class.
+ * @param[in] sptr Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void
+report_class_writes(struct Client *sptr, const struct StatDesc *sd,
+                    char *param)
+{
+  struct ConnectionClass *cltmp;
+
+  for (cltmp = connClassList; cltmp; cltmp = cltmp->next)
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":%s budget %u bytes %lu sends %lu deferred %lu",
+               ConClass(cltmp), WriteBudget(cltmp), cltmp->write_bytes,
+               cltmp->write_sends, cltmp->write_deferred);
+}
+
 /** Return the connection class that applies to opers without an
  * attached Operator block (opers granted remotely, e.g. via OPMODE).
  * The class must exist and have PRIV_PROPAGATE explicitly set to be
@@ -294,7 +312,7 @@ find_remote_oper_class(void)
  * @param[in] cptr Client to check.
  * @return Connection class, or NULL if defaults apply.
  */
-static struct ConnectionClass *
+struct ConnectionClass *
 class_resolve(struct Client *cptr)
 {
   struct SLink *tmp;
@@ -274,3 +274,33 @@ client_report_privs(struct Client *to, struct Client *client)
 
   return 0;
 }
+
+/** Get the name of an operator privilege.
+ * @param[in] priv Privilege to look up.
+ * @return Name of \a priv, or NULL if it has none.
+ */
+const char *
+client_priv_name(unsigned int priv)
+{
+  int i;
+
+  for (i = 0; privtab[i].name; i++)
+    if (privtab[i].priv == priv)
+      return privtab[i].name;
+  return NULL;
+}
+
+/** Look up an operator privilege by name.
+ * @param[in] name Privilege name, as listed by /PRIVS.
+ * @return The privilege, or -1 if \a name is not recognized.
+ */
+int
+client_priv_find(const char *name)
+{
+  int i;
+
+  for (i = 0; privtab[i].name; i++)
+    if (!ircd_strcmp(privtab[i].name, name))
+      return privtab[i].priv;
+  return -1;
+}
@@ -29,6 +29,7 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "s_debug.h"
+#include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
@@ -298,6 +299,7 @@ engine_loop(struct Generators* gen)
   polls = (struct pollfd *)MyMalloc(sizeof(struct pollfd) * polls_count);
 
   while (running) {
+    flush_scheduled_connections();
     if ((i = feature_int(FEAT_POLLS_PER_LOOP)) >= 20 && i != polls_count) {
       polls = (struct pollfd *)MyRealloc(polls, sizeof(struct pollfd) * i);
       polls_count = i;
@@ -314,7 +316,9 @@ engine_loop(struct Generators* gen)
 	   CurrentTime, dopoll.dp_timeout));
 
     /* check for active files */
+    event_wait_begin();
     polls_used = ioctl(devpoll_fd, DP_POLL, &dopoll);
+    event_wait_end();
 
     CurrentTime = time(0); /* set current time... */
 
@@ -28,6 +28,7 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "s_debug.h"
+#include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
@@ -210,6 +211,7 @@ engine_loop(struct Generators *gen)
     events_count = 20;
   events = MyMalloc(sizeof(events[0]) * events_count);
   while (running) {
+    flush_scheduled_connections();
     if ((tmp = feature_int(FEAT_POLLS_PER_LOOP)) >= 20 && tmp != events_count) {
       events = MyRealloc(events, sizeof(events[0]) * tmp);
       events_count = tmp;
@@ -218,7 +220,9 @@ engine_loop(struct Generators *gen)
     wait = timer_next(gen) ? (timer_next(gen) - CurrentTime) * 1000 : -1;
     Debug((DEBUG_ENGINE, "epoll: delay: %d (%d) %d", timer_next(gen),
            CurrentTime, wait));
+    event_wait_begin();
     events_used = epoll_wait(epoll_fd, events, events_count, wait);
+    event_wait_end();
     CurrentTime = time(0);
 
     if (events_used < 0) {
@@ -29,6 +29,7 @@
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "s_debug.h"
+#include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
@@ -318,6 +319,7 @@ engine_loop(struct Generators* gen)
   events = (struct kevent *)MyMalloc(sizeof(struct kevent) * events_count);
 
   while (running) {
+    flush_scheduled_connections();
     if ((i = feature_int(FEAT_POLLS_PER_LOOP)) >= 20 && i != events_count) {
       events = (struct kevent *)MyRealloc(events, sizeof(struct kevent) * i);
       events_count = i;
@@ -331,8 +333,10 @@ engine_loop(struct Generators* gen)
 	   CurrentTime, wait.tv_sec));
 
     /* check for active events */
+    event_wait_begin();
     events_used = kevent(kqueue_id, 0, 0, events, events_count,
                          wait.tv_sec < 0 ? 0 : &wait);
+    event_wait_end();
 
     CurrentTime = time(0); /* set current time... */
 
@@ -28,6 +28,7 @@
 #include "ircd_alloc.h"
 #include "ircd_log.h"
 #include "s_debug.h"
+#include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
@@ -282,13 +283,16 @@ engine_loop(struct Generators* gen)
   struct Socket *sock;
 
   while (running) {
+    flush_scheduled_connections();
     wait = timer_next(gen) ? (timer_next(gen) - CurrentTime) * 1000 : -1;
 
     Debug((DEBUG_INFO, "poll: delay: %Tu (%Tu) %d", timer_next(gen),
 	   CurrentTime, wait));
 
     /* check for active files */
+    event_wait_begin();
     nfds = poll(pollfdList, poll_count, wait);
+    event_wait_end();
 
     CurrentTime = time(0); /* set current time... */
 
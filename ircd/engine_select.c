@@ -34,6 +34,7 @@
 #include "ircd.h"
 #include "ircd_log.h"
 #include "s_debug.h"
+#include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <errno.h>
@@ -269,6 +270,7 @@ engine_loop(struct Generators* gen)
   struct Socket *sock;
 
   while (running) {
+    flush_scheduled_connections();
     read_set = global_read_set; /* all hail structure copy!! */
     write_set = global_write_set;
 
@@ -280,8 +282,10 @@ engine_loop(struct Generators* gen)
 	   CurrentTime, wait.tv_sec));
 
     /* check for active files */
+    event_wait_begin();
     nfds = select(highest_fd + 1, &read_set, &write_set, 0,
 		  wait.tv_sec < 0 ? 0 : &wait);
+    event_wait_end();
 
     CurrentTime = time(0); /* set current time... */
 
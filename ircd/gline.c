@@ -161,6 +161,7 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
   if (flags & GLINE_BADCHAN) { /* set a BADCHAN gline */
     DupString(gline->gl_user, user); /* first, remember channel */
     gline->gl_host = NULL;
+    gline->gl_umask = gline->gl_hmask = NULL;
 
     gline->gl_next = BadChanGlineList; /* then link it into list */
     gline->gl_prev_p = &BadChanGlineList;
@@ -177,6 +178,10 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
     if (*user != '$' && ipmask_parse(host, &gline->gl_addr, &gline->gl_bits))
       gline->gl_flags |= GLINE_IPMASK;
 
+    /* compile the masks once; they are checked against every client */
+    gline->gl_umask = matchmask_make(GlineIsRealName(gline) ? user + 2 : user);
+    gline->gl_hmask = gline->gl_host ? matchmask_make(gline->gl_host) : NULL;
+
     gline->gl_next = GlobalGlineList; /* then link it into list */
     gline->gl_prev_p = &GlobalGlineList;
     if (GlobalGlineList)
@@ -220,11 +225,11 @@ do_gline(struct Client *cptr, struct Client *sptr, struct Gline *gline)
       if (GlineIsRealName(gline)) { /* Realname Gline */
 	Debug((DEBUG_DEBUG,"Realname Gline: %s %s",(cli_info(acptr)),
 					gline->gl_user+2));
-        if (match(gline->gl_user+2, cli_info(acptr)) != 0)
+        if (matchmask(gline->gl_umask, cli_info(acptr)) != 0)
             continue;
         Debug((DEBUG_DEBUG,"Matched!"));
       } else { /* Host/IP gline */
-        if (match(gline->gl_user, (cli_user(acptr))->username) != 0)
+        if (matchmask(gline->gl_umask, (cli_user(acptr))->username) != 0)
           continue;
 
         if (GlineIsIpMask(gline)) {
@@ -232,7 +237,7 @@ do_gline(struct Client *cptr, struct Client *sptr, struct Gline *gline)
             continue;
         }
         else {
-          if (match(gline->gl_host, cli_sockhost(acptr)) != 0)
+          if (matchmask(gline->gl_hmask, cli_sockhost(acptr)) != 0)
             continue;
         }
       }
@@ -395,20 +400,18 @@ static int
 count_realnames(const char *mask)
 {
   struct Client *acptr;
-  int minlen;
+  struct MatchMask *mm;
   int count;
-  char cmask[BUFSIZE];
 
   count = 0;
-  matchcomp(cmask, &minlen, NULL, mask);
+  mm = matchmask_make(mask);
   for (acptr = GlobalClientList; acptr; acptr = cli_next(acptr)) {
     if (!IsUser(acptr))
       continue;
-    if (strlen(cli_info(acptr)) < minlen)
-      continue;
-    if (!matchexec(cli_info(acptr), cmask, minlen))
+    if (!matchmask(mm, cli_info(acptr)))
       count++;
   }
+  MyFree(mm);
   return count;
 }
 
@@ -1004,11 +1007,11 @@ gline_lookup(struct Client *cptr, unsigned int flags)
 
     if (GlineIsRealName(gline)) {
       Debug((DEBUG_DEBUG,"realname gline: '%s' '%s'",gline->gl_user,cli_info(cptr)));
-      if (match(gline->gl_user+2, cli_info(cptr)) != 0)
+      if (matchmask(gline->gl_umask, cli_info(cptr)) != 0)
         continue;
     }
     else {
-      if (match(gline->gl_user, (cli_user(cptr))->username) != 0)
+      if (matchmask(gline->gl_umask, (cli_user(cptr))->username) != 0)
         continue;
 
       if (GlineIsIpMask(gline)) {
@@ -1016,7 +1019,7 @@ gline_lookup(struct Client *cptr, unsigned int flags)
           continue;
       }
       else {
-        if (match(gline->gl_host, (cli_user(cptr))->realhost) != 0)
+        if (matchmask(gline->gl_hmask, (cli_user(cptr))->realhost) != 0)
           continue;
       }
     }
@@ -1044,6 +1047,8 @@ gline_free(struct Gline *gline)
   MyFree(gline->gl_user); /* free up the memory */
   if (gline->gl_host)
     MyFree(gline->gl_host);
+  MyFree(gline->gl_umask);
+  MyFree(gline->gl_hmask);
   MyFree(gline->gl_reason);
   MyFree(gline);
 }
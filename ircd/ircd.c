@@ -39,6 +39,7 @@
 #include "ircd_string.h"
 #include "ircd_crypt.h"
 #include "ircd_tls.h"
+#include "ircd_upgrade.h"
 #include "jupe.h"
 #include "list.h"
 #include "match.h"
@@ -49,6 +50,7 @@
 #include "opercmds.h"
 #include "parse.h"
 #include "res.h"
+#include "s_admit.h"
 #include "s_auth.h"
 #include "s_bsd.h"
 #include "s_conf.h"
@@ -119,6 +121,7 @@ char          *ircd_tls_keyfile;          /**< Private key file for TLS */
 char          *ircd_tls_certfile;         /**< Public key file for TLS */
 static char   *dpath             = DPATH; /**< Working directory for daemon */
 static char   *dbg_client;                /**< Client specifier for chkconf */
+static char   *upgradefile;               /**< State left by a hot upgrade */
 
 static struct Timer connect_timer; /**< timer structure for try_connections() */
 static struct Timer ping_timer; /**< timer structure for check_pings() */
@@ -142,6 +145,7 @@ void server_die(const char *message)
   /* log_write will send out message to both log file and as server notice */
   log_write(LS_SYSTEM, L_CRIT, 0, "Server terminating: %s", message);
   flush_connections(0);
+  log_close();
   close_connections(1);
   running = 0;
 }
@@ -202,6 +206,47 @@ void server_restart(const char *message)
 }
 
 
+/*----------------------------------------------------------------------------
+ * API: server_upgrade
+ *--------------------------------------------------------------------------*/
+/** Restart the server, keeping the connections of local users.
+ * The state of those users is saved to the upgrade file named by
+ * FEAT_UPATH, and the new binary is started with "-U" so that it picks
+ * them up again.  If the state cannot be saved, nothing happens.
+ * @param[in] message Message to log and send to operators.
+ */
+void server_upgrade(const char *message)
+{
+  const char *path = feature_str(FEAT_UPATH);
+  char **argv;
+  int i, j;
+
+  if (upgrade_save(path)) {
+    sendto_opmask_butone(0, SNO_OLDSNO, "Unable to save state to %s; "
+                         "not upgrading", path);
+    return;
+  }
+
+  /* Pass the upgrade file on the command line, dropping any "-U"
+   * left over from an earlier upgrade.
+   */
+  argv = (char **) MyMalloc((thisServer.argc + 3) * sizeof(char *));
+  for (i = j = 0; i < thisServer.argc; i++) {
+    if (!strcmp(thisServer.argv[i], "-U") && i + 1 < thisServer.argc) {
+      i++;
+      continue;
+    }
+    argv[j++] = thisServer.argv[i];
+  }
+  argv[j++] = "-U";
+  argv[j++] = (char *) path;
+  argv[j] = 0;
+  thisServer.argv = argv;
+
+  server_restart(message);
+}
+
+
 /*----------------------------------------------------------------------------
  * outofmemory:  Handler for out of memory conditions...
  *--------------------------------------------------------------------------*/
@@ -493,7 +538,7 @@ static void check_pings(struct Event* ev) {
  * @param[in,out] argv Command-lne arguments.
  */
 static void parse_command_line(int argc, char** argv) {
-  const char *options = "d:f:h:nktvx:c:";
+  const char *options = "d:f:h:nktvx:c:U:";
   int opt;
 
   if (thisServer.euid != thisServer.uid)
@@ -511,6 +556,7 @@ static void parse_command_line(int argc, char** argv) {
     case 'd':  dpath      = optarg;                    break;
     case 'f':  configfile = optarg;                    break;
     case 'h':  ircd_strncpy(cli_name(&me), optarg, HOSTLEN); break;
+    case 'U':  upgradefile = optarg;                   break;
     case 'v':
       printf("ircd %s\n", version);
       printf("Event engines: ");
@@ -556,6 +602,7 @@ static void parse_command_line(int argc, char** argv) {
              "\n -c clispec\t search for client/kill blocks matching client"
              "\n\t\t clispec is comma-separated list of user@host,"
              "\n\t\t user@ip, $Rrealname, and port number"
+             "\n -U file\t resume from the state saved by RESTART UPGRADE"
              "\n\nServer not started.\n");
       exit(1);
     }
@@ -692,6 +739,12 @@ int main(int argc, char **argv) {
   if (!init_connection_limits())
     return 9;
 
+  /* Must come first: it tells close_connections() which descriptors
+   * belong to users inherited from before a hot upgrade.
+   */
+  if (upgradefile)
+    upgrade_load(upgradefile);
+
   close_connections(!(thisServer.bootopt & (BOOT_DEBUG | BOOT_TTY | BOOT_CHKCONF)));
 
   /* daemon_init() must be before event_init() because kqueue() FDs
@@ -729,6 +782,8 @@ int main(int argc, char **argv) {
   init_class();
   initwhowas();
   initmsgtree();
+  send_init();
+  reply_init();
   initstats();
   sasl_init();
 
@@ -769,6 +824,7 @@ int main(int argc, char **argv) {
   stats_init();
 
   IPcheck_init();
+  admit_init();
   sline_init();
   timer_add(timer_init(&connect_timer), try_connections, 0, TT_RELATIVE, 1);
   timer_add(timer_init(&ping_timer), check_pings, 0, TT_RELATIVE, 1);
@@ -803,10 +859,15 @@ int main(int argc, char **argv) {
   write_pidfile();
   init_counters();
 
+  /* After init_counters(): restoring users updates UserStats. */
+  upgrade_restore();
+
   Debug((DEBUG_NOTICE, "Server ready..."));
   log_write(LS_SYSTEM, L_NOTICE, 0, "Server Ready");
 
   event_loop();
 
+  log_close(); /* write out any buffered log entries */
+
   return 0;
 }
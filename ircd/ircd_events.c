@@ -26,13 +26,19 @@
 
 #include "ircd.h"
 #include "ircd_alloc.h"
+#include "ircd_features.h"
 #include "ircd_log.h"
+#include "ircd_reply.h"
 #include "ircd_snprintf.h"
+#include "numeric.h"
 #include "s_debug.h"
+#include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define SIGS_PER_SOCK	10	/**< number of signals to process per socket
@@ -143,6 +149,98 @@ gen_init(struct GenHeader* gen, EventCallBack call, void* data,
   }
 }
 
+/** Number of distinct callbacks whose times are kept separately. */
+#define CALLBACK_SLOTS	64
+
+/** Cumulative time spent in one kind of event callback. */
+struct EventTimes {
+  EventCallBack		call;	/**< callback (for per-callback entries) */
+  unsigned int		count;	/**< number of calls */
+  unsigned long long	total;	/**< total time, in nanoseconds */
+  unsigned long long	max;	/**< slowest call, in nanoseconds */
+};
+
+/** Event loop timing statistics. */
+static struct {
+  unsigned long long wait_start;  /**< clock when the engine began waiting */
+  unsigned long long wait_end;	  /**< clock when the engine stopped waiting */
+  unsigned long long iter_timers; /**< timer_run() time this iteration */
+  struct LoopTimes   loop;	  /**< iteration totals and histogram */
+  struct EventTimes  types[ET_DESTROY + 1]; /**< times by event type */
+  struct EventTimes  calls[CALLBACK_SLOTS]; /**< times by callback */
+  struct EventTimes  other;	  /**< callbacks that found no free slot */
+  time_t	     slow_notice; /**< last slow callback notice */
+} loopStats;
+
+/** Names of event types, for event_stats_report(). */
+static const char *event_names[ET_DESTROY + 1] = {
+  "read", "write", "accept", "connect", "eof", "error", "signal", "expire",
+  "destroy"
+};
+
+/** Read the monotonic clock used for event loop statistics.
+ * @return Current time in nanoseconds.
+ */
+static unsigned long long
+event_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Add one call to an EventTimes record.
+ * @param[in,out] et Record to update.
+ * @param[in] elapsed Duration of the call, in nanoseconds.
+ */
+static void
+event_times_add(struct EventTimes* et, unsigned long long elapsed)
+{
+  et->count++;
+  et->total += elapsed;
+  if (elapsed > et->max)
+    et->max = elapsed;
+}
+
+/** Record the time taken by one event callback.
+ * @param[in] type Type of event that was delivered.
+ * @param[in] call Callback that handled it.
+ * @param[in] fd File descriptor of the socket, or -1.
+ * @param[in] elapsed Duration of the callback, in nanoseconds.
+ */
+static void
+event_record(enum EventType type, EventCallBack call, int fd,
+	     unsigned long long elapsed)
+{
+  struct EventTimes* et;
+  unsigned int slot, ii;
+  int limit;
+
+  event_times_add(&loopStats.types[type], elapsed);
+
+  slot = ((unsigned long) call >> 4) % CALLBACK_SLOTS;
+  for (ii = 0; ii < CALLBACK_SLOTS; ii++) {
+    et = &loopStats.calls[(slot + ii) % CALLBACK_SLOTS];
+    if (et->call == call || !et->call)
+      break;
+  }
+  if (ii == CALLBACK_SLOTS)
+    et = &loopStats.other;
+  else
+    et->call = call;
+  event_times_add(et, elapsed);
+
+  if ((limit = feature_int(FEAT_SLOW_CALLBACK_MSEC)) > 0
+      && elapsed >= (unsigned long long) limit * 1000000) {
+    loopStats.loop.slow++;
+    sendto_opmask_butone_ratelimited(0, SNO_OLDSNO, &loopStats.slow_notice,
+                                     "Slow %s callback %p (fd %d) took %u ms",
+                                     event_names[type], (void*) call, fd,
+                                     (unsigned int) (elapsed / 1000000));
+  }
+}
+
 /** Execute an event.
  * Optimizations should inline this.
  * @param[in] event Event to execute.
@@ -150,6 +248,10 @@ gen_init(struct GenHeader* gen, EventCallBack call, void* data,
 static void
 event_execute(struct Event* event)
 {
+  EventCallBack call;
+  unsigned long long start;
+  int fd = -1;
+
   assert(0 != event);
   assert(0 == event->ev_prev_p); /* must be off queue first */
   assert(event->ev_gen.gen_header->gh_flags & GEN_ACTIVE);
@@ -159,7 +261,15 @@ event_execute(struct Event* event)
   if (event->ev_type == ET_ERROR) /* turn on error flag before callback */
     event->ev_gen.gen_header->gh_flags |= GEN_ERROR;
 
-  (*event->ev_gen.gen_header->gh_call)(event); /* execute the event */
+  /* the generator may be gone once the callback returns */
+  call = event->ev_gen.gen_header->gh_call;
+  if (event->ev_type != ET_EXPIRE && event->ev_type != ET_SIGNAL
+      && event->ev_type != ET_DESTROY)
+    fd = s_fd(event->ev_gen.gen_socket);
+
+  start = event_clock();
+  (*call)(event); /* execute the event */
+  event_record(event->ev_type, call, fd, event_clock() - start);
 
   /* The logic here is very careful; if the event was an ET_DESTROY,
    * then we must assume the generator is now invalid; fortunately, we
@@ -546,6 +656,7 @@ void
 timer_run(void)
 {
   struct Timer* ptr;
+  unsigned long long start = event_clock();
 
   /* go through queue... */
   while ((ptr = (struct Timer*)evInfo.gens.g_timer)) {
@@ -569,6 +680,7 @@ timer_run(void)
       ptr->t_header.gh_flags &= ~GEN_READD;
     }
   }
+  loopStats.iter_timers += event_clock() - start;
 }
 
 /** Adds a signal to the event callback system.
@@ -740,6 +852,134 @@ engine_name(void)
   return evInfo.engine->eng_name;
 }
 
+/** Note that the engine is about to wait for events.
+ * This ends the current loop iteration.  Engines call this right before
+ * their epoll_wait(), poll() or similar call.
+ */
+void
+event_wait_begin(void)
+{
+  unsigned long long busy, usec;
+  unsigned int bucket;
+
+  loopStats.wait_start = event_clock();
+  if (!loopStats.wait_end) /* first time through the loop */
+    return;
+
+  busy = loopStats.wait_start - loopStats.wait_end;
+  for (usec = busy / 1000, bucket = 0;
+       usec && bucket < LOOP_BUCKETS - 1;
+       usec >>= 1)
+    bucket++;
+  loopStats.loop.buckets[bucket]++;
+  loopStats.loop.iterations++;
+  if (busy > loopStats.loop.max)
+    loopStats.loop.max = busy;
+  loopStats.loop.timers += loopStats.iter_timers;
+  loopStats.loop.events += busy > loopStats.iter_timers ?
+    busy - loopStats.iter_timers : 0;
+  loopStats.iter_timers = 0;
+}
+
+/** Note that the engine has finished waiting for events.
+ * Engines call this right after their wait returns.
+ */
+void
+event_wait_end(void)
+{
+  loopStats.wait_end = event_clock();
+  loopStats.loop.wait += loopStats.wait_end - loopStats.wait_start;
+}
+
+/** Get the event loop iteration statistics.
+ * @return Totals since startup or the last event_stats_reset().
+ */
+const struct LoopTimes*
+event_loop_times(void)
+{
+  return &loopStats.loop;
+}
+
+/** Clear the event loop statistics. */
+void
+event_stats_reset(void)
+{
+  unsigned long long wait_start = loopStats.wait_start;
+  unsigned long long wait_end = loopStats.wait_end;
+  time_t slow_notice = loopStats.slow_notice;
+
+  memset(&loopStats, 0, sizeof(loopStats));
+  loopStats.wait_start = wait_start;
+  loopStats.wait_end = wait_end;
+  loopStats.slow_notice = slow_notice;
+}
+
+/** Compare two EventTimes by total time, largest first.
+ * @param[in] a_ Pointer to a struct EventTimes.
+ * @param[in] b_ Pointer to a struct EventTimes.
+ * @return Less than, equal to, or greater than zero.
+ */
+static int
+event_times_cmp(const void* a_, const void* b_)
+{
+  const struct EventTimes* a = a_;
+  const struct EventTimes* b = b_;
+
+  return (a->total < b->total) - (a->total > b->total);
+}
+
+/** Report event loop statistics to a client.
+ * Times are in microseconds.  Callback times include any callbacks run
+ * from inside them.
+ * @param[in] to Client requesting statistics.
+ */
+void
+event_stats_report(struct Client* to)
+{
+  struct EventTimes calls[CALLBACK_SLOTS];
+  char hist[LOOP_BUCKETS * 11 + 1];
+  size_t len = 0;
+  int ii;
+
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG, ":Loop: %u iterations, "
+             "%qu wait, %qu events, %qu timers, %qu max", loopStats.loop.iterations,
+             loopStats.loop.wait / 1000, loopStats.loop.events / 1000,
+             loopStats.loop.timers / 1000, loopStats.loop.max / 1000);
+  for (ii = 0; ii < LOOP_BUCKETS; ii++)
+    len += ircd_snprintf(0, hist + len, sizeof(hist) - len, "%s%u",
+                         ii ? " " : "", loopStats.loop.buckets[ii]);
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Loop histogram (<1us <2us <4us ...): %s", hist);
+
+  for (ii = 0; ii <= ET_DESTROY; ii++)
+    if (loopStats.types[ii].count)
+      send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+                 ":Event %s: %u calls, %qu total, %qu max", event_names[ii],
+                 loopStats.types[ii].count, loopStats.types[ii].total / 1000,
+                 loopStats.types[ii].max / 1000);
+
+  /* On a position-independent binary, the callback addresses can be
+   * matched to "nm ircd" output by their distance from event_loop(). */
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Callbacks by total time (event_loop is at %p):",
+             (void*) event_loop);
+  memcpy(calls, loopStats.calls, sizeof(calls));
+  qsort(calls, CALLBACK_SLOTS, sizeof(calls[0]), event_times_cmp);
+  for (ii = 0; ii < CALLBACK_SLOTS && calls[ii].count; ii++)
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Callback %p: %u calls, %qu total, %qu max",
+               (void*) calls[ii].call, calls[ii].count,
+               calls[ii].total / 1000, calls[ii].max / 1000);
+  if (loopStats.other.count)
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Callback other: %u calls, %qu total, %qu max",
+               loopStats.other.count, loopStats.other.total / 1000,
+               loopStats.other.max / 1000);
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Slow callbacks: %u (SLOW_CALLBACK_MSEC %d)", loopStats.loop.slow,
+             feature_int(FEAT_SLOW_CALLBACK_MSEC));
+}
+
 #ifdef DEBUGMODE
 /* These routines pretty-print names for states and types for debug printing */
 
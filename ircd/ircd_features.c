@@ -39,10 +39,12 @@
 #include "numeric.h"
 #include "numnicks.h"
 #include "random.h"	/* random_seed_set */
+#include "res.h"	/* dns_cache_resize */
 #include "s_bsd.h"
 #include "s_debug.h"
 #include "s_misc.h"
 #include "s_stats.h"
+#include "s_user.h"	/* supported_changed */
 #include "send.h"
 #include "struct.h"
 #include "sys.h"    /* FALSE bleah */
@@ -169,6 +171,7 @@ static void
 feature_notify_clienttagdeny(void)
 {
   msg_tag_clienttagdeny_rebuild();
+  supported_changed();
 }
 
 /** Handle an update to FEAT_HIS_SERVERNAME. */
@@ -328,22 +331,23 @@ static struct FeatureDesc {
   F_S(HIDDEN_HOST, FEAT_CASE, "users.undernet.org", 0),
   F_S(HIDDEN_IP, 0, "127.0.0.1", 0),
   F_B(CONNEXIT_NOTICES, 0, 0, 0),
-  F_B(OPLEVELS, 0, 0, 0),
+  F_B(OPLEVELS, 0, 0, supported_changed),
   F_B(ZANNELS, 0, 0, 0),
-  F_B(LOCAL_CHANNELS, 0, 1, 0),
+  F_B(LOCAL_CHANNELS, 0, 1, supported_changed),
   F_B(TOPIC_BURST, 0, 1, 0),
   F_B(AWAY_BURST, 0, 1, 0),
+  F_I(BURST_SENDQ, 0, 65536, 0),
   F_B(DISABLE_GLINES, 0, 0, 0),
   F_B(DISABLE_SLINES, 0, 0, 0),
   F_B(JOIN_TARGET, 0, 0, 0),
 
   /* features that probably should not be touched */
   F_I(KILLCHASETIMELIMIT, 0, 30, 0),
-  F_I(MAXCHANNELSPERUSER, 0, 10, 0),
-  F_I(NICKLEN, 0, 12, 0),
+  F_I(MAXCHANNELSPERUSER, 0, 10, supported_changed),
+  F_I(NICKLEN, 0, 12, supported_changed),
   F_I(AVBANLEN, 0, 40, 0),
-  F_I(MAXBANS, 0, 100, 0),
-  F_I(MAXSILES, 0, 25, 0),
+  F_I(MAXBANS, 0, 100, supported_changed),
+  F_I(MAXSILES, 0, 25, supported_changed),
   F_I(HANGONGOODLINK, 0, 300, 0),
   F_I(HANGONRETRYDELAY, 0, 10, 0),
   F_I(CONNECTTIMEOUT, 0, 90, 0),
@@ -358,27 +362,40 @@ static struct FeatureDesc {
   F_I(IPCHECK_48_CLONE_LIMIT, 0, 50, 0),
   F_I(IPCHECK_48_CLONE_PERIOD, 0, 10, 0),
   F_I(IPCHECK_CLONE_DELAY, 0, 600, 0),
-  F_I(CHANNELLEN, 0, 200, 0),
+  F_I(CHANNELLEN, 0, 200, supported_changed),
   F_B(STRICT_USERNAME, 0, 0, 0),
 
   /* Some misc. default paths */
   F_S(MPATH, FEAT_CASE | FEAT_MYOPER, "ircd.motd", motd_init),
   F_S(RPATH, FEAT_CASE | FEAT_MYOPER, "remote.motd", motd_init),
   F_S(PPATH, FEAT_CASE | FEAT_MYOPER | FEAT_READ, "ircd.pid", 0),
+  F_S(UPATH, FEAT_CASE | FEAT_MYOPER, "ircd.upgrade", 0),
 
   /* Networking features */
   F_I(TOS_SERVER, 0, 0x08, 0),
   F_I(TOS_CLIENT, 0, 0x08, 0),
   F_I(POLLS_PER_LOOP, 0, 200, 0),
+  F_I(WRITE_QUANTUM, 0, 4096, 0),
+  F_I(SLOW_CALLBACK_MSEC, 0, 500, 0),
+  F_I(LOG_BUFFER, 0, 65536, log_buffer_resize),
   F_I(IRCD_RES_RETRIES, 0, 2, 0),
   F_I(IRCD_RES_TIMEOUT, 0, 4, 0),
   F_I(DNS_TCP_MAXCONN, 0, 256, 0),
+  F_I(DNS_CACHE_SIZE, 0, 1048576, dns_cache_resize),
+  F_I(DNS_CACHE_MAXTTL, 0, 3600, 0),
+  F_I(DNS_CACHE_NEGTTL, 0, 60, 0),
   F_I(AUTH_TIMEOUT, 0, 9, 0),
+  F_I(ADMIT_MAX_PENDING, 0, 0, 0),
+  F_I(ADMIT_PORT_PENDING, 0, 0, 0),
+  F_I(ADMIT_QUEUE_TIMEOUT, 0, 30, 0),
   F_I(WEBSOCKET_KEEPALIVE, 0, 0, 0),
   F_S(WEBSOCKET_ALLOWED_ORIGINS, FEAT_NULL, 0, 0),
   F_B(ANNOUNCE_INVITES, 0, 0, 0),
   F_S(TLS_CIPHERS, FEAT_NULL | FEAT_CASE | FEAT_OPER, 0, 0),
   F_B(TLS_SYSTEMCA, 0, 1, 0),
+  F_I(TLS_SESSION_CACHE, 0, 16384, 0),
+  F_I(TLS_SESSION_TIMEOUT, 0, 7200, 0),
+  F_I(TLS_TICKET_ROTATE, 0, 3600, 0),
   F_B(NETWORK_FEATURES, 0, 1, 0),
   F_B(NETWORK_TIME, 0, 1, 0),
 
@@ -443,6 +460,9 @@ static struct FeatureDesc {
   F_B(HIS_STATS_y, 0, 1, 0),
   F_B(HIS_STATS_z, 0, 1, 0),
   F_B(HIS_STATS_IAUTH, 0, 1, 0),
+  F_B(HIS_STATS_WRITES, 0, 1, 0),
+  F_B(HIS_STATS_ADMISSION, 0, 1, 0),
+  F_B(HIS_STATS_TLS, 0, 1, 0),
   F_B(HIS_WEBIRC, 0, 1, 0),
   F_B(HIS_WHOIS_SERVERNAME, 0, 1, 0),
   F_B(HIS_WHOIS_IDLETIME, 0, 1, 0),
@@ -460,7 +480,7 @@ static struct FeatureDesc {
   F_S(HIS_URLSERVERS, 0, "http://www.undernet.org/servers.php", 0),
 
   /* Misc. random stuff */
-  F_S(NETWORK, 0, "UnderNet", 0),
+  F_S(NETWORK, 0, "UnderNet", supported_changed),
   F_S(URL_CLIENTS, 0, "ftp://ftp.undernet.org/pub/irc/clients", 0),
   F_S(URLREG, 0, "http://cservice.undernet.org/live/", 0),
 
@@ -77,6 +77,7 @@ static const struct lexer_token tokens[] = {
   { "class", CLASS },
   { "client", CLIENT },
   { "cloudflare", CLOUDFLARE },
+  { "compress", COMPRESS },
   { "connect", CONNECT },
   { "connectfreq", CONNECTFREQ },
   { "contact", CONTACT },
@@ -132,6 +133,7 @@ static const struct lexer_token tokens[] = {
   { "mb", MBYTES },
   { "mbytes", MBYTES },
   { "megabytes", MBYTES },
+  { "metrics", METRICS },
   { "minutes", MINUTES },
   { "mode_lchan", TPRIV_MODE_LCHAN },
   { "months", MONTHS },
@@ -183,6 +185,8 @@ static const struct lexer_token tokens[] = {
   { "weeks", WEEKS },
   { "whox", TPRIV_WHOX },
   { "wide_gline", TPRIV_WIDE_GLINE },
+  { "workers", WORKERS },
+  { "writebudget", WRITEBUDGET },
   { "years", YEARS },
   { "yes", YES },
   { NULL, 0 }
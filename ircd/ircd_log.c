@@ -29,6 +29,8 @@
 #include "ircd_log.h"
 #include "client.h"
 #include "ircd_alloc.h"
+#include "ircd_events.h"
+#include "ircd_features.h"
 #include "ircd_reply.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
@@ -175,6 +177,10 @@ struct LogFile {
   int		   fd;	   /**< file's descriptor-- -1 if not open */
   int		   ref;	   /**< how many things refer to us? */
   char		  *file;   /**< file name */
+  char		  *buf;	   /**< entries waiting to be written */
+  size_t	   len;	   /**< bytes used in LogFile::buf */
+  size_t	   size;   /**< bytes allocated for LogFile::buf */
+  unsigned int	   dropped; /**< entries lost since the last write */
 };
 
 /** Modifiable static information. */
@@ -184,7 +190,12 @@ static struct {
   int		  facility; /**< default facility */
   const char	 *procname; /**< process's name */
   struct LogFile *dbfile;   /**< debug file */
-} logInfo = { 0, 0, LOG_USER, "ircd", 0 };
+  int		  buffered; /**< non-zero once file entries may be buffered */
+  unsigned long	  dropped;  /**< entries lost to failed writes */
+} logInfo = { 0, 0, LOG_USER, "ircd", 0, 0, 0 };
+
+/** Timer that writes out buffered log entries. */
+static struct Timer log_flush_timer;
 
 /** Helper routine to open a log file if needed.
  * If the log file is already open, do nothing.
@@ -200,6 +211,167 @@ log_open(struct LogFile *lf)
   }
 }
 
+/** Format the timestamp that starts each log file entry.
+ * The text is only rebuilt when the second changes.
+ * @param[out] len_out Receives the length of the timestamp.
+ * @return The timestamp, including a trailing space.
+ */
+static const char *
+log_timestamp(size_t *len_out)
+{
+  /* 1234567890123456789012 3 */
+  /* [2000-11-28 16:11:20] \0 */
+  static char timebuf[23];
+  static size_t timelen;
+  static time_t last;
+  struct tm *tstamp;
+  time_t curtime;
+
+  curtime = TStime();
+  if (!timelen || curtime != last) {
+    tstamp = localtime(&curtime); /* build the timestamp */
+    timelen =
+      ircd_snprintf(0, timebuf, sizeof(timebuf), "[%d-%d-%d %d:%02d:%02d] ",
+		    tstamp->tm_year + 1900, tstamp->tm_mon + 1,
+		    tstamp->tm_mday, tstamp->tm_hour, tstamp->tm_min,
+		    tstamp->tm_sec);
+    last = curtime;
+  }
+
+  *len_out = timelen;
+  return timebuf;
+}
+
+/** Write out the entries buffered for a log file.
+ * Entries that cannot be written are discarded and counted in
+ * LogFile::dropped; once a later write succeeds, a line saying how
+ * many were lost is appended.
+ * @param[in,out] lf Log file to flush.
+ */
+static void
+log_file_flush(struct LogFile *lf)
+{
+  const char *ts;
+  char note[80];
+  size_t off = 0, tslen;
+  ssize_t res;
+  int len;
+
+  while (off < lf->len) {
+    res = write(lf->fd, lf->buf + off, lf->len - off);
+    if (res > 0)
+      off += res;
+    else if (res < 0 && errno == EINTR)
+      continue;
+    else
+      break;
+  }
+
+  if (off < lf->len) { /* count the entries we are about to throw away */
+    for (; off < lf->len; off++)
+      if (lf->buf[off] == '\n')
+	lf->dropped++;
+  } else if (lf->dropped && lf->fd >= 0) {
+    ts = log_timestamp(&tslen);
+    len = ircd_snprintf(0, note, sizeof(note), "%s%u log entries dropped\n",
+			ts, lf->dropped);
+    if (write(lf->fd, note, len) == len) {
+      logInfo.dropped += lf->dropped;
+      lf->dropped = 0;
+    }
+  }
+
+  lf->len = 0;
+}
+
+/** Write out the buffered entries of every log file. */
+static void
+log_flush_all(void)
+{
+  struct LogFile *ptr;
+
+  for (ptr = logInfo.filelist; ptr; ptr = ptr->next)
+    if (ptr->len)
+      log_file_flush(ptr);
+}
+
+/** Periodic timer callback to write out buffered log entries.
+ * @param[in] ev Timer event (ignored).
+ */
+static void
+log_flush_callback(struct Event *ev)
+{
+  assert(ET_EXPIRE == ev_type(ev));
+  log_flush_all();
+}
+
+/** Append an entry to a log file's buffer, writing the buffer out
+ * first if the entry does not fit.
+ * @param[in,out] lf Log file to append to.
+ * @param[in] vector Timestamp, message and newline to append.
+ * @param[in] count Number of elements in \a vector.
+ * @return Zero if the entry was buffered, non-zero if the caller
+ * must write it directly.
+ */
+static int
+log_file_append(struct LogFile *lf, const struct iovec *vector, int count)
+{
+  size_t need = 0, size;
+  int i;
+
+  for (i = 0; i < count; i++)
+    need += vector[i].iov_len;
+
+  size = feature_int(FEAT_LOG_BUFFER);
+  if (!lf->buf && size) {
+    lf->buf = (char*) MyMalloc(size);
+    lf->size = size;
+  }
+
+  if (lf->len + need > lf->size)
+    log_file_flush(lf);
+  if (need > lf->size)
+    return 1;
+
+  for (i = 0; i < count; i++) {
+    memcpy(lf->buf + lf->len, vector[i].iov_base, vector[i].iov_len);
+    lf->len += vector[i].iov_len;
+  }
+  return 0;
+}
+
+/** Apply a new LOG_BUFFER setting.
+ * Buffered entries are written out and the buffers released; they are
+ * allocated again, at the new size, by the next entry to each file.
+ */
+void
+log_buffer_resize(void)
+{
+  struct LogFile *ptr;
+
+  for (ptr = logInfo.filelist; ptr; ptr = ptr->next) {
+    if (ptr->len)
+      log_file_flush(ptr);
+    MyFree(ptr->buf);
+    ptr->buf = 0;
+    ptr->size = 0;
+  }
+}
+
+/** Get the number of log file entries lost to failed writes.
+ * @return Entries dropped since the server started.
+ */
+unsigned long
+log_dropped(void)
+{
+  unsigned long count = logInfo.dropped;
+  struct LogFile *ptr;
+
+  for (ptr = logInfo.filelist; ptr; ptr = ptr->next)
+    count += ptr->dropped;
+  return count;
+}
+
 #ifdef DEBUGMODE
 
 /** Reopen debug log file. */
@@ -248,6 +420,10 @@ log_debug_init(int usetty)
   logInfo.dbfile->prev_p = 0;
   logInfo.dbfile->fd = -1;
   logInfo.dbfile->ref = 1;
+  logInfo.dbfile->buf = 0; /* never buffered */
+  logInfo.dbfile->len = 0;
+  logInfo.dbfile->size = 0;
+  logInfo.dbfile->dropped = 0;
 
   if (usetty) /* store pathname to use */
     logInfo.dbfile->file = 0;
@@ -298,6 +474,11 @@ log_init(const char *process_name)
 
   /* ok, open syslog; default facility: LOG_USER */
   openlog(logInfo.procname, LOG_PID | LOG_NDELAY, logInfo.facility);
+
+  /* from here on, the event loop writes buffered log entries out */
+  timer_add(timer_init(&log_flush_timer), log_flush_callback, 0,
+	    TT_PERIODIC, 1);
+  logInfo.buffered = 1;
 }
 
 /** Reopen log files (so admins can do things like rotate log files). */
@@ -323,6 +504,8 @@ log_close(void)
   closelog(); /* close syslog */
 
   for (ptr = logInfo.filelist; ptr; ptr = ptr->next) {
+    if (ptr->len)
+      log_file_flush(ptr); /* write out what we have buffered... */
     if (ptr->fd >= 0)
       close(ptr->fd); /* close all the files... */
 
@@ -368,13 +551,9 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
   struct VarData vd;
   struct LogDesc *desc;
   struct LevelData *ldata;
-  struct tm *tstamp;
+  struct LogFile *lf;
   struct iovec vector[3];
-  time_t curtime;
   char buf[LOG_BUFSIZE];
-  /* 1234567890123456789012 3 */
-  /* [2000-11-28 16:11:20] \0 */
-  char timebuf[23];
 
   /* check basic assumptions */
   assert(-1 < (int)subsys);
@@ -426,24 +605,25 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
 
   /* if we have something to write to... */
   if (flags & LOG_DOFILELOG) {
-    curtime = TStime();
-    tstamp = localtime(&curtime); /* build the timestamp */
-
-    vector[0].iov_len =
-      ircd_snprintf(0, timebuf, sizeof(timebuf), "[%d-%d-%d %d:%02d:%02d] ",
-		    tstamp->tm_year + 1900, tstamp->tm_mon + 1,
-		    tstamp->tm_mday, tstamp->tm_hour, tstamp->tm_min,
-		    tstamp->tm_sec);
+    lf = desc->file;
 
     /* set up the remaining parts of the writev vector... */
-    vector[0].iov_base = timebuf;
+    vector[0].iov_base = (void*) log_timestamp(&vector[0].iov_len);
     vector[1].iov_base = buf;
 
     vector[2].iov_base = (void*) "\n"; /* terminate lines with a \n */
     vector[2].iov_len = 1;
 
-    /* write it out to the log file */
-    writev(desc->file->fd, vector, 3);
+    /* Buffer the entry unless it is critical, is for the debug log, or
+     * comes before the event loop exists to write it out; those are
+     * written at once, after anything already buffered for the file.
+     */
+    if (!logInfo.buffered || severity == L_CRIT || lf == logInfo.dbfile
+	|| log_file_append(lf, vector, 3)) {
+      if (lf->len)
+	log_file_flush(lf);
+      writev(lf->fd, vector, 3); /* write it out to the log file */
+    }
   }
 
   /* oh yeah, syslog it too... */
@@ -503,6 +683,10 @@ log_file_create(const char *file)
 
   tmp->fd = -1; /* initialize the structure */
   tmp->ref = 1;
+  tmp->buf = 0;
+  tmp->len = 0;
+  tmp->size = 0;
+  tmp->dropped = 0;
   DupString(tmp->file, file);
 
   tmp->next = logInfo.filelist; /* link it into the list... */
@@ -530,10 +714,14 @@ log_file_destroy(struct LogFile *lf)
     *lf->prev_p = lf->next;
 
     lf->prev_p = 0; /* we won't use it for the free list */
+    if (lf->len)
+      log_file_flush(lf);
+    logInfo.dropped += lf->dropped;
     if (lf->fd >= 0)
       close(lf->fd);
     lf->fd = -1;
     MyFree(lf->file); /* free the file name */
+    MyFree(lf->buf); /* and its buffer */
 
     lf->next = logInfo.freelist; /* stack it onto the free list */
     logInfo.freelist = lf;
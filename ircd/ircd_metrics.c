@@ -0,0 +1,848 @@
+/*
+ * IRC - Internet Relay Chat, ircd/ircd_metrics.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Prometheus metrics exporter.
+ * @version $Id$
+ *
+ * Each scrape is a small state machine on its own socket.  The request
+ * is read until the end of its headers; the response is then produced
+ * by a list of section renderers, each of which emits one item (a
+ * metric family, a connection class, a range of file descriptors...)
+ * per call.  Renderers only run while the output buffer is below its
+ * low-water mark, and only when the socket is writable, so a large or
+ * slow scrape is spread over many event loop iterations.
+ */
+#include "config.h"
+
+#include "ircd_metrics.h"
+#include "IPcheck.h"
+#include "class.h"
+#include "client.h"
+#include "dbuf.h"
+#include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_events.h"
+#include "ircd_log.h"
+#include "ircd_osdep.h"
+#include "ircd_snprintf.h"
+#include "listener.h"
+#include "msg.h"
+#include "msgq.h"
+#include "querycmds.h"
+#include "res.h"
+#include "s_bsd.h"
+#include "s_conf.h"
+#include "s_debug.h"
+#include "s_misc.h"
+#include "sline.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Maximum number of scrapes served at once. */
+#define METRICS_MAXCONN		16
+/** Maximum size of an HTTP request, headers included. */
+#define METRICS_REQLEN		2048
+/** Size of the per-scrape output buffer. */
+#define METRICS_BUFSIZE		8192
+/** Render more output once fewer than this many bytes are pending.
+ * Every renderer item must fit in METRICS_BUFSIZE - METRICS_LOWATER.
+ */
+#define METRICS_LOWATER		4096
+/** Seconds a scrape may take before it is dropped. */
+#define METRICS_TIMEOUT		30
+/** File descriptors walked per call when totalling sendQs. */
+#define METRICS_FD_CHUNK	512
+
+/** State of a scrape connection. */
+enum MetricsState {
+  MS_REQUEST,		/**< reading the request headers */
+  MS_RESPONSE,		/**< sending the response */
+  MS_DRAIN,		/**< response sent; discarding input until EOF */
+  MS_CLOSED		/**< closed; waiting for the socket to be destroyed */
+};
+
+/** One HTTP connection to a metrics port. */
+struct MetricsConn {
+  struct MetricsConn*	next;		/**< next connection in #metrics_list */
+  struct Socket		socket;		/**< socket for the connection */
+  enum MetricsState	state;		/**< where the connection is */
+  time_t		started;	/**< when the connection was accepted */
+  unsigned int		section;	/**< renderer in #metrics_sections */
+  unsigned int		item;		/**< renderer's position */
+  unsigned long long	sendq_bytes;	/**< running sendQ total */
+  unsigned int		sendq_max;	/**< largest sendQ seen */
+  unsigned int		sendq_count;	/**< connections with queued data */
+  unsigned int		reqlen;		/**< bytes in #req */
+  unsigned int		outlen;		/**< bytes in #out */
+  unsigned int		outpos;		/**< bytes of #out already sent */
+  char			req[METRICS_REQLEN]; /**< request being read */
+  char			out[METRICS_BUFSIZE]; /**< response being sent */
+};
+
+/** Open scrape connections. */
+static struct MetricsConn* metrics_list;
+/** Number of entries in #metrics_list. */
+static unsigned int metrics_count;
+/** Timer that drops scrapes taking longer than #METRICS_TIMEOUT. */
+static struct Timer metrics_timer;
+
+/** Append formatted text to a scrape's output buffer.
+ * @param[in] mc Scrape connection.
+ * @param[in] fmt Format string (see ircd_snprintf()).
+ */
+static void
+metrics_printf(struct MetricsConn* mc, const char* fmt, ...)
+{
+  size_t space = sizeof(mc->out) - mc->outlen;
+  va_list vl;
+  int len;
+
+  va_start(vl, fmt);
+  len = ircd_vsnprintf(0, mc->out + mc->outlen, space, fmt, vl);
+  va_end(vl);
+  if (len < 0)
+    return;
+  if ((size_t) len >= space) /* truncated; should not happen */
+    len = space - 1;
+  mc->outlen += len;
+}
+
+/** Emit the HELP and TYPE lines for a metric family.
+ * @param[in] mc Scrape connection.
+ * @param[in] name Metric family name.
+ * @param[in] type Prometheus metric type.
+ * @param[in] help Description of the metric.
+ */
+static void
+metrics_family(struct MetricsConn* mc, const char* name, const char* type,
+               const char* help)
+{
+  metrics_printf(mc, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/** Emit a metric family with a single unlabelled sample.
+ * @param[in] mc Scrape connection.
+ * @param[in] name Metric family name.
+ * @param[in] type Prometheus metric type.
+ * @param[in] help Description of the metric.
+ * @param[in] value Sample value.
+ */
+static void
+metrics_value(struct MetricsConn* mc, const char* name, const char* type,
+              const char* help, unsigned long long value)
+{
+  metrics_family(mc, name, type, help);
+  metrics_printf(mc, "%s %qu\n", name, value);
+}
+
+/** Format a time in nanoseconds as seconds.
+ * @param[out] buf Output buffer.
+ * @param[in] len Length of \a buf.
+ * @param[in] nsec Time to format.
+ * @return \a buf.
+ */
+static const char*
+metrics_seconds(char* buf, size_t len, unsigned long long nsec)
+{
+  ircd_snprintf(0, buf, len, "%qu.%09qu", nsec / 1000000000,
+                nsec % 1000000000);
+  return buf;
+}
+
+/** Copy a string into a label value, escaping as Prometheus requires.
+ * @param[out] buf Output buffer.
+ * @param[in] len Length of \a buf.
+ * @param[in] str String to escape.
+ * @return \a buf.
+ */
+static const char*
+metrics_label(char* buf, size_t len, const char* str)
+{
+  size_t pos = 0;
+
+  for (; *str && pos + 2 < len; str++) {
+    if (*str == '\\' || *str == '"')
+      buf[pos++] = '\\';
+    else if (*str == '\n') {
+      buf[pos++] = '\\';
+      buf[pos++] = 'n';
+      continue;
+    }
+    buf[pos++] = *str;
+  }
+  buf[pos] = '\0';
+  return buf;
+}
+
+/** Render user and connection counts.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_users(struct MetricsConn* mc)
+{
+  metrics_value(mc, "ircd_local_clients", "gauge",
+                "Registered users connected to this server.",
+                UserStats.local_clients);
+  metrics_value(mc, "ircd_local_servers", "gauge",
+                "Servers directly linked to this server.",
+                UserStats.local_servers);
+  metrics_value(mc, "ircd_unregistered_connections", "gauge",
+                "Local connections that have not registered yet.",
+                UserStats.unknowns);
+  metrics_value(mc, "ircd_clients", "gauge",
+                "Registered users on the network.", UserStats.clients);
+  metrics_value(mc, "ircd_invisible_clients", "gauge",
+                "Invisible users on the network.", UserStats.inv_clients);
+  metrics_value(mc, "ircd_opers", "gauge",
+                "IRC operators on the network.", UserStats.opers);
+  metrics_value(mc, "ircd_servers", "gauge",
+                "Servers on the network, including this one.",
+                UserStats.servers);
+  metrics_value(mc, "ircd_channels", "gauge",
+                "Channels on the network.", UserStats.channels);
+  return 1;
+}
+
+/** Render connection and traffic counters from ServerStats.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_traffic(struct MetricsConn* mc)
+{
+  static const char name[] = "ircd_connections_closed_total";
+
+  metrics_value(mc, "ircd_connections_accepted_total", "counter",
+                "IRC connections accepted.", ServerStats->is_ac);
+  metrics_family(mc, name, "counter", "Closed connections, by type.");
+  metrics_printf(mc, "%s{type=\"client\"} %u\n", name, ServerStats->is_cl);
+  metrics_printf(mc, "%s{type=\"server\"} %u\n", name, ServerStats->is_sv);
+  metrics_printf(mc, "%s{type=\"unknown\"} %u\n", name, ServerStats->is_ni);
+
+  metrics_family(mc, "ircd_sent_bytes_total", "counter",
+                 "Bytes sent on closed connections, by type.");
+  metrics_printf(mc, "ircd_sent_bytes_total{type=\"client\"} %qu\n"
+                 "ircd_sent_bytes_total{type=\"server\"} %qu\n",
+                 (unsigned long long) ServerStats->is_cbs,
+                 (unsigned long long) ServerStats->is_sbs);
+  metrics_family(mc, "ircd_received_bytes_total", "counter",
+                 "Bytes received on closed connections, by type.");
+  metrics_printf(mc, "ircd_received_bytes_total{type=\"client\"} %qu\n"
+                 "ircd_received_bytes_total{type=\"server\"} %qu\n",
+                 (unsigned long long) ServerStats->is_cbr,
+                 (unsigned long long) ServerStats->is_sbr);
+
+  metrics_value(mc, "ircd_unknown_commands_total", "counter",
+                "Messages with an unknown command.", ServerStats->is_unco);
+  metrics_value(mc, "ircd_wrong_direction_total", "counter",
+                "Messages that arrived from the wrong direction.",
+                ServerStats->is_wrdi);
+  metrics_value(mc, "ircd_collision_kills_total", "counter",
+                "Kills generated for nick collisions.", ServerStats->is_kill);
+  metrics_family(mc, "ircd_ident_requests_total", "counter",
+                 "Ident lookups, by result.");
+  metrics_printf(mc, "ircd_ident_requests_total{result=\"success\"} %u\n"
+                 "ircd_ident_requests_total{result=\"failure\"} %u\n",
+                 ServerStats->is_asuc, ServerStats->is_abad);
+  metrics_family(mc, "ircd_silence_checks_total", "counter",
+                 "Silence list checks, by whether the verdict was cached.");
+  metrics_printf(mc, "ircd_silence_checks_total{cache=\"hit\"} %u\n"
+                 "ircd_silence_checks_total{cache=\"miss\"} %u\n",
+                 ServerStats->is_sil_hit, ServerStats->is_sil_miss);
+  metrics_value(mc, "ircd_log_dropped_total", "counter",
+                "Log file entries lost to failed writes.", log_dropped());
+  return 1;
+}
+
+/** Render rejected connection counters from ServerStats.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_rejected(struct MetricsConn* mc)
+{
+  static const struct {
+    const char* reason;
+    size_t offset;
+  } reasons[] = {
+#define R(reason, field) { reason, offsetof(struct ServerStatistics, field) }
+    R("inactive_port", is_inactive),
+    R("all_in_use", is_all_inuse),
+    R("bad_ip", is_bad_ip),
+    R("registration_collision", is_reg_collided),
+    R("bad_username", is_bad_username),
+    R("banned", is_k_lined),
+    R("bad_password", is_bad_password),
+    R("no_client_block", is_no_client),
+    R("class_full", is_class_full),
+    R("ip_full", is_ip_full),
+    R("socket_error", is_bad_socket),
+    R("throttled", is_throttled),
+    R("bad_fingerprint", is_bad_fingerprint),
+    R("not_hub", is_not_hub),
+    R("crule", is_crule_fail),
+    R("no_connect_block", is_not_server),
+    R("bad_server_password", is_bad_server),
+    R("bad_server_fingerprint", is_wrong_server)
+#undef R
+  };
+  static const char name[] = "ircd_rejected_connections_total";
+  unsigned int ii;
+
+  metrics_family(mc, name, "counter", "Rejected connections, by reason.");
+  for (ii = 0; ii < sizeof(reasons) / sizeof(reasons[0]); ii++)
+    metrics_printf(mc, "%s{reason=\"%s\"} %u\n", name, reasons[ii].reason,
+                   *(unsigned int*) ((char*) ServerStats + reasons[ii].offset));
+  return 1;
+}
+
+/** Render memory use and S-line counters.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_memory(struct MetricsConn* mc)
+{
+  static const char sline[] = "ircd_sline_events_total";
+  size_t msg_alloc, msgbuf_alloc, dbuf_alloc, dbuf_used;
+  struct IPcheckStats ipc;
+
+  msgq_memory(&msg_alloc, &msgbuf_alloc);
+  dbuf_count_memory(&dbuf_alloc, &dbuf_used);
+  metrics_family(mc, "ircd_msgq_allocated_bytes", "gauge",
+                 "Memory allocated for outgoing messages.");
+  metrics_printf(mc, "ircd_msgq_allocated_bytes{type=\"msg\"} %zu\n"
+                 "ircd_msgq_allocated_bytes{type=\"msgbuf\"} %zu\n",
+                 msg_alloc, msgbuf_alloc);
+  metrics_family(mc, "ircd_dbuf_bytes", "gauge",
+                 "Memory in data buffers, by state.");
+  metrics_printf(mc, "ircd_dbuf_bytes{state=\"allocated\"} %zu\n"
+                 "ircd_dbuf_bytes{state=\"used\"} %zu\n",
+                 dbuf_alloc, dbuf_used);
+
+  IPcheck_stats(&ipc);
+  metrics_family(mc, "ircd_ipcheck_entries", "gauge",
+                 "IP registry entries, by table.");
+  metrics_printf(mc, "ircd_ipcheck_entries{table=\"address\"} %u\n"
+                 "ircd_ipcheck_entries{table=\"ipv6_48\"} %u\n",
+                 ipc.entries, ipc.entries48);
+  metrics_value(mc, "ircd_ipcheck_idle_entries", "gauge",
+                "IP registry entries with no connected clients.", ipc.idle);
+  metrics_family(mc, "ircd_ipcheck_buckets", "gauge",
+                 "IP registry hash buckets, by table and state.");
+  metrics_printf(mc, "ircd_ipcheck_buckets{table=\"address\",state=\"used\"} %u\n"
+                 "ircd_ipcheck_buckets{table=\"address\",state=\"empty\"} %u\n"
+                 "ircd_ipcheck_buckets{table=\"ipv6_48\",state=\"used\"} %u\n"
+                 "ircd_ipcheck_buckets{table=\"ipv6_48\",state=\"empty\"} %u\n",
+                 ipc.used, ipc.buckets - ipc.used,
+                 ipc.used48, ipc.buckets48 - ipc.used48);
+  metrics_value(mc, "ircd_ipcheck_expired_total", "counter",
+                "IP registry entries expired.", ipc.expired);
+
+  metrics_family(mc, sline, "counter", "S-line activity, by event.");
+  metrics_printf(mc, "%s{event=\"hit\"} %u\n%s{event=\"held\"} %u\n"
+                 "%s{event=\"released\"} %u\n%s{event=\"blocked\"} %u\n"
+                 "%s{event=\"xreply_accepted\"} %u\n"
+                 "%s{event=\"xreply_rejected\"} %u\n"
+                 "%s{event=\"timeout\"} %u\n",
+                 sline, sline_stats_counters.sline_hits,
+                 sline, sline_stats_counters.messages_held,
+                 sline, sline_stats_counters.messages_released,
+                 sline, sline_stats_counters.messages_blocked,
+                 sline, sline_stats_counters.xreply_accepted,
+                 sline, sline_stats_counters.xreply_rejected,
+                 sline, sline_stats_counters.timeout_expired);
+  return 1;
+}
+
+/** Render one metric family per connection class, one class per call.
+ * The class list is walked again on each call, since it may change
+ * between calls; it is short.
+ * @param[in] mc Scrape connection.
+ * @param[in] name Metric family name.
+ * @param[in] help Description of the metric.
+ * @param[in] max Non-zero to report the class limit rather than its use.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_class_family(struct MetricsConn* mc, const char* name,
+                     const char* help, int max)
+{
+  const struct ConnectionClass* cl;
+  char label[64];
+  unsigned int ii;
+
+  if (mc->item == 0)
+    metrics_family(mc, name, "gauge", help);
+  for (cl = get_class_list(), ii = 0; cl && ii < mc->item; cl = cl->next)
+    ii++;
+  if (!cl)
+    return 1;
+  if (cl->valid)
+    metrics_printf(mc, "%s{class=\"%s\"} %u\n", name,
+                   metrics_label(label, sizeof(label), ConClass(cl)),
+                   max ? MaxLinks(cl) : Links(cl));
+  return !cl->next;
+}
+
+/** Render current connections per class.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_classes(struct MetricsConn* mc)
+{
+  return metrics_class_family(mc, "ircd_class_connections",
+                              "Connections and Connect blocks using each "
+                              "connection class.", 0);
+}
+
+/** Render the connection limit of each class.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_class_limits(struct MetricsConn* mc)
+{
+  return metrics_class_family(mc, "ircd_class_max_connections",
+                              "Maximum connections for each connection "
+                              "class.", 1);
+}
+
+/** Total the sendQs of local connections, #METRICS_FD_CHUNK descriptors
+ * per call, and report the totals after the last chunk.
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_sendq(struct MetricsConn* mc)
+{
+  struct Client* cptr;
+  unsigned int length;
+  int fd, end;
+
+  if (mc->item == 0) {
+    mc->sendq_bytes = 0;
+    mc->sendq_max = 0;
+    mc->sendq_count = 0;
+  }
+  fd = mc->item * METRICS_FD_CHUNK;
+  for (end = fd + METRICS_FD_CHUNK; fd < end && fd <= HighestFd; fd++) {
+    if (!(cptr = LocalClientArray[fd]) || !(length = MsgQLength(&cli_sendQ(cptr))))
+      continue;
+    mc->sendq_bytes += length;
+    mc->sendq_count++;
+    if (length > mc->sendq_max)
+      mc->sendq_max = length;
+  }
+  if (fd <= HighestFd)
+    return 0;
+
+  metrics_value(mc, "ircd_sendq_bytes", "gauge",
+                "Bytes queued for all local connections.", mc->sendq_bytes);
+  metrics_value(mc, "ircd_sendq_max_bytes", "gauge",
+                "Largest sendQ of a local connection.", mc->sendq_max);
+  metrics_value(mc, "ircd_sendq_connections", "gauge",
+                "Local connections with queued output.", mc->sendq_count);
+  return 1;
+}
+
+/** Render event loop timing (see /STATS e).
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_loop(struct MetricsConn* mc)
+{
+  static const char hist[] = "ircd_loop_iteration_seconds";
+  const struct LoopTimes* lt = event_loop_times();
+  unsigned long long count = 0;
+  char buf[32];
+  unsigned int ii;
+
+  metrics_family(mc, "ircd_loop_seconds_total", "counter",
+                 "Event loop time, by phase.");
+  metrics_printf(mc, "ircd_loop_seconds_total{phase=\"wait\"} %s\n",
+                 metrics_seconds(buf, sizeof(buf), lt->wait));
+  metrics_printf(mc, "ircd_loop_seconds_total{phase=\"events\"} %s\n",
+                 metrics_seconds(buf, sizeof(buf), lt->events));
+  metrics_printf(mc, "ircd_loop_seconds_total{phase=\"timers\"} %s\n",
+                 metrics_seconds(buf, sizeof(buf), lt->timers));
+  metrics_family(mc, "ircd_loop_iteration_max_seconds", "gauge",
+                 "Longest event loop iteration, excluding the wait.");
+  metrics_printf(mc, "ircd_loop_iteration_max_seconds %s\n",
+                 metrics_seconds(buf, sizeof(buf), lt->max));
+
+  metrics_family(mc, hist, "histogram",
+                 "Event loop iteration time, excluding the wait.");
+  for (ii = 0; ii < LOOP_BUCKETS - 1; ii++) {
+    count += lt->buckets[ii];
+    /* bucket ii holds iterations shorter than 2^ii microseconds */
+    metrics_printf(mc, "%s_bucket{le=\"%s\"} %qu\n", hist,
+                   metrics_seconds(buf, sizeof(buf), 1000ULL << ii), count);
+  }
+  metrics_printf(mc, "%s_bucket{le=\"+Inf\"} %u\n", hist, lt->iterations);
+  metrics_printf(mc, "%s_sum %s\n%s_count %u\n", hist,
+                 metrics_seconds(buf, sizeof(buf), lt->events + lt->timers),
+                 hist, lt->iterations);
+
+  metrics_value(mc, "ircd_slow_callbacks_total", "counter",
+                "Event callbacks slower than SLOW_CALLBACK_MSEC.", lt->slow);
+  return 1;
+}
+
+/** Render one metric family per command and handler type, one command
+ * per call.
+ * @param[in] mc Scrape connection.
+ * @param[in] name Metric family name.
+ * @param[in] help Description of the metric.
+ * @param[in] seconds Non-zero to report handler time rather than calls.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_command_family(struct MetricsConn* mc, const char* name,
+                       const char* help, int seconds)
+{
+  const struct Message* mptr = &msgtab[mc->item];
+  char buf[32];
+  int type;
+
+  if (mc->item == 0)
+    metrics_family(mc, name, "counter", help);
+  if (!mptr->cmd)
+    return 1;
+  for (type = 0; type < LAST_HANDLER_TYPE; type++) {
+    if (!mptr->times[type].calls)
+      continue;
+    if (seconds)
+      metrics_printf(mc, "%s{command=\"%s\",handler=\"%s\"} %s\n", name,
+                     mptr->cmd, msg_handler_names[type],
+                     metrics_seconds(buf, sizeof(buf), mptr->times[type].total));
+    else
+      metrics_printf(mc, "%s{command=\"%s\",handler=\"%s\"} %u\n", name,
+                     mptr->cmd, msg_handler_names[type],
+                     mptr->times[type].calls);
+  }
+  return 0;
+}
+
+/** Render command handler call counts (see /STATS M).
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_command_calls(struct MetricsConn* mc)
+{
+  return metrics_command_family(mc, "ircd_command_calls_total",
+                                "Command handler calls.", 0);
+}
+
+/** Render time spent in command handlers (see /STATS M).
+ * @param[in] mc Scrape connection.
+ * @return Non-zero when the section is complete.
+ */
+static int
+metrics_command_seconds(struct MetricsConn* mc)
+{
+  return metrics_command_family(mc, "ircd_command_seconds_total",
+                                "Time spent in command handlers.", 1);
+}
+
+/** Section renderers, in output order.  Each call renders one item and
+ * returns non-zero after the last one; MetricsConn::item counts the
+ * calls made so far for the current section.
+ */
+static int (*const metrics_sections[])(struct MetricsConn*) = {
+  metrics_users,
+  metrics_traffic,
+  metrics_rejected,
+  metrics_memory,
+  metrics_classes,
+  metrics_class_limits,
+  metrics_sendq,
+  metrics_loop,
+  metrics_command_calls,
+  metrics_command_seconds
+};
+
+/** Number of entries in #metrics_sections. */
+#define METRICS_SECTIONS (sizeof(metrics_sections) / sizeof(metrics_sections[0]))
+
+/** Close a scrape connection.  The structure is freed when its socket
+ * is destroyed.
+ * @param[in] mc Scrape connection to close.
+ */
+static void
+metrics_close(struct MetricsConn* mc)
+{
+  struct MetricsConn** pp;
+
+  if (mc->state == MS_CLOSED)
+    return;
+  for (pp = &metrics_list; *pp; pp = &(*pp)->next)
+    if (*pp == mc) {
+      *pp = mc->next;
+      break;
+    }
+  metrics_count--;
+  mc->state = MS_CLOSED;
+  close(s_fd(&mc->socket));
+  socket_del(&mc->socket);
+}
+
+/** Finish a scrape whose response has been sent.  Closing a socket
+ * with unread input makes the kernel reset the connection, which can
+ * destroy the response before the scraper reads it, so the write side
+ * is shut down and input is discarded until the peer closes.
+ * @param[in] mc Scrape connection.
+ */
+static void
+metrics_finish(struct MetricsConn* mc)
+{
+  if (shutdown(s_fd(&mc->socket), SHUT_WR)) {
+    metrics_close(mc);
+    return;
+  }
+  mc->state = MS_DRAIN;
+  socket_events(&mc->socket, SOCK_ACTION_SET | SOCK_EVENT_READABLE);
+}
+
+/** Discard input on a finished scrape.
+ * @param[in] mc Scrape connection.
+ */
+static void
+metrics_drain(struct MetricsConn* mc)
+{
+  unsigned int len;
+
+  if (os_recv_nonb(s_fd(&mc->socket), mc->req, sizeof(mc->req), &len)
+      == IO_FAILURE)
+    metrics_close(mc);
+}
+
+/** Start an HTTP response.
+ * @param[in] mc Scrape connection.
+ * @param[in] status Status line, without the protocol version.
+ * @param[in] body Response body, or NULL to render the metrics.
+ */
+static void
+metrics_respond(struct MetricsConn* mc, const char* status, const char* body)
+{
+  metrics_printf(mc, "HTTP/1.0 %s\r\nConnection: close\r\n"
+                 "Content-Type: %s\r\n\r\n", status,
+                 body ? "text/plain; charset=utf-8"
+                 : "text/plain; version=0.0.4; charset=utf-8");
+  if (body)
+    metrics_printf(mc, "%s\n", body);
+  mc->section = body ? METRICS_SECTIONS : 0;
+  mc->item = 0;
+  mc->state = MS_RESPONSE;
+  socket_events(&mc->socket, SOCK_ACTION_SET | SOCK_EVENT_WRITABLE);
+}
+
+/** Check a complete request and start the matching response.
+ * @param[in] mc Scrape connection whose headers have all arrived.
+ */
+static void
+metrics_request(struct MetricsConn* mc)
+{
+  char* path;
+  char* end;
+
+  if (strncmp(mc->req, "GET ", 4)) {
+    metrics_respond(mc, "405 Method Not Allowed", "Only GET is supported.");
+    return;
+  }
+  path = mc->req + 4;
+  end = path + strcspn(path, " ?\r\n");
+  if (end - path != 8 || strncmp(path, "/metrics", 8))
+    metrics_respond(mc, "404 Not Found", "Try /metrics.");
+  else
+    metrics_respond(mc, "200 OK", 0);
+}
+
+/** Read more of a scrape's request.
+ * @param[in] mc Scrape connection.
+ */
+static void
+metrics_read(struct MetricsConn* mc)
+{
+  unsigned int len;
+
+  switch (os_recv_nonb(s_fd(&mc->socket), mc->req + mc->reqlen,
+                       sizeof(mc->req) - 1 - mc->reqlen, &len)) {
+  case IO_SUCCESS:
+    mc->reqlen += len;
+    mc->req[mc->reqlen] = '\0';
+    if (strstr(mc->req, "\r\n\r\n") || strstr(mc->req, "\n\n"))
+      metrics_request(mc);
+    else if (mc->reqlen >= sizeof(mc->req) - 1)
+      metrics_respond(mc, "431 Request Header Fields Too Large",
+                      "Request too large.");
+    break;
+  case IO_BLOCKED:
+    break;
+  case IO_FAILURE:
+    metrics_close(mc);
+    break;
+  }
+}
+
+/** Send more of a scrape's response, rendering it as space allows.
+ * @param[in] mc Scrape connection.
+ */
+static void
+metrics_write(struct MetricsConn* mc)
+{
+  unsigned int len;
+
+  if (mc->outpos > 0) {
+    memmove(mc->out, mc->out + mc->outpos, mc->outlen - mc->outpos);
+    mc->outlen -= mc->outpos;
+    mc->outpos = 0;
+  }
+  while (mc->outlen < METRICS_LOWATER && mc->section < METRICS_SECTIONS) {
+    if ((*metrics_sections[mc->section])(mc)) {
+      mc->section++;
+      mc->item = 0;
+    } else
+      mc->item++;
+  }
+
+  if (mc->outlen == 0) { /* everything has been sent */
+    metrics_finish(mc);
+    return;
+  }
+  switch (os_send_nonb(s_fd(&mc->socket), mc->out, mc->outlen, &len)) {
+  case IO_SUCCESS:
+    mc->outpos = len;
+    if (mc->outpos == mc->outlen && mc->section == METRICS_SECTIONS)
+      metrics_finish(mc);
+    break;
+  case IO_BLOCKED:
+    break;
+  case IO_FAILURE:
+    metrics_close(mc);
+    break;
+  }
+}
+
+/** Handle socket activity on a scrape connection.
+ * @param[in] ev Socket event; its data is the struct MetricsConn.
+ */
+static void
+metrics_callback(struct Event* ev)
+{
+  struct MetricsConn* mc;
+
+  assert(0 != ev_socket(ev));
+  assert(0 != s_data(ev_socket(ev)));
+
+  mc = (struct MetricsConn*) s_data(ev_socket(ev));
+
+  switch (ev_type(ev)) {
+  case ET_DESTROY: /* socket is gone; release the connection */
+    MyFree(mc);
+    break;
+
+  case ET_READ:
+    if (mc->state == MS_REQUEST)
+      metrics_read(mc);
+    else if (mc->state == MS_DRAIN)
+      metrics_drain(mc);
+    break;
+
+  case ET_WRITE:
+    if (mc->state == MS_RESPONSE)
+      metrics_write(mc);
+    break;
+
+  case ET_EOF:
+  case ET_ERROR:
+    metrics_close(mc);
+    break;
+
+  default:
+    assert(0 && "Unrecognized event in metrics_callback().");
+    break;
+  }
+}
+
+/** Drop scrapes that have taken too long.
+ * @param[in] ev Timer event (ignored).
+ */
+static void
+metrics_expire(struct Event* ev)
+{
+  struct MetricsConn* mc;
+  struct MetricsConn* next;
+
+  if (ev_type(ev) != ET_EXPIRE)
+    return;
+  for (mc = metrics_list; mc; mc = next) {
+    next = mc->next;
+    if (CurrentTime - mc->started > METRICS_TIMEOUT) {
+      Debug((DEBUG_INFO, "Metrics scrape on fd %d timed out",
+             s_fd(&mc->socket)));
+      metrics_close(mc);
+    }
+  }
+}
+
+/** Start serving a connection accepted on a metrics port.
+ * Without a mask in its Port block, a metrics port only accepts
+ * connections from loopback addresses.
+ * @param[in] listener Listener that accepted the connection.
+ * @param[in] fd File descriptor of the new connection.
+ * @param[in] peer Address of the scraper.
+ */
+void
+metrics_accept(struct Listener* listener, int fd,
+               const struct irc_sockaddr* peer)
+{
+  struct MetricsConn* mc;
+
+  if ((!listener->mask_bits && !irc_in_addr_is_loopback(&peer->addr))
+      || metrics_count >= METRICS_MAXCONN || !os_set_nonblocking(fd)) {
+    close(fd);
+    return;
+  }
+
+  mc = (struct MetricsConn*) MyCalloc(1, sizeof(*mc));
+  mc->state = MS_REQUEST;
+  mc->started = CurrentTime;
+  if (!socket_add(&mc->socket, metrics_callback, mc, SS_CONNECTED,
+                  SOCK_EVENT_READABLE, fd)) {
+    close(fd);
+    MyFree(mc);
+    return;
+  }
+  mc->next = metrics_list;
+  metrics_list = mc;
+  metrics_count++;
+
+  if (!t_active(&metrics_timer))
+    timer_add(timer_init(&metrics_timer), metrics_expire, 0, TT_PERIODIC,
+              METRICS_TIMEOUT / 3);
+}
@@ -77,6 +77,7 @@
   int yylex(void);
   /* Now all the globals we need :/... */
   int tping, tconn, maxflood, maxlinks, sendq, port, invert, stringno, flags;
+  int writebudget, workers;
   char *name, *pass, *host, *ip, *username, *origin, *hub_limit;
   char *tls_certfile, *tls_ciphers, *tls_fingerprint, *tls_keyfile;
   char *tls_cacertfile, *tls_cacertdir;
@@ -164,6 +165,7 @@ static void free_slist(struct SLink **link) {
 %token PINGFREQ
 %token CONNECTFREQ
 %token MAXFLOOD
+%token WRITEBUDGET
 %token MAXLINKS
 %token MAXHOPS
 %token SENDQ
@@ -219,11 +221,14 @@ static void free_slist(struct SLink **link) {
 %token FAST
 %token AUTOCONNECT
 %token PROGRAM
+%token WORKERS
 %token TOK_IPV4 TOK_IPV6
 %token DNS
 %token WEBIRC
 %token WEBSOCKET
 %token CLOUDFLARE
+%token METRICS
+%token COMPRESS
 %token IPCHECK
 %token EXCEPT
 %token INCLUDE
@@ -519,6 +524,7 @@ classblock: CLASS {
     c_class = find_class(name);
     MyFree(c_class->default_umode);
     c_class->default_umode = pass;
+    c_class->write_budget = writebudget;
     memcpy(&c_class->privs, &privs, sizeof(c_class->privs));
     memcpy(&c_class->privs_dirty, &privs_dirty, sizeof(c_class->privs_dirty));
   }
@@ -532,12 +538,14 @@ classblock: CLASS {
   maxflood = 0;
   maxlinks = 0;
   sendq = 0;
+  writebudget = 0;
   memset(&privs, 0, sizeof(privs));
   memset(&privs_dirty, 0, sizeof(privs_dirty));
 };
 classitems: classitem classitems | classitem;
 classitem: classname | classpingfreq | classconnfreq | classmaxflood |
-           classmaxlinks | classsendq | classusermode | priv;
+           classmaxlinks | classsendq | classwritebudget | classusermode |
+           priv;
 classname: NAME '=' QSTRING ';'
 {
   MyFree(name);
@@ -563,6 +571,10 @@ classsendq: SENDQ '=' sizespec ';'
 {
   sendq = $3;
 };
+classwritebudget: WRITEBUDGET '=' sizespec ';'
+{
+  writebudget = $3;
+};
 classusermode: USERMODE '=' QSTRING ';'
 {
   MyFree(pass);
@@ -640,7 +652,7 @@ connectitems: connectitem connectitems | connectitem;
 connectitem: connectname | connectpass | connectclass | connecthost
               | connectport | connectvhost | connectleaf | connecthub
               | connecthublimit | connectmaxhops | connectauto
-              | connecttls | tlsfingerprint | tlsciphers
+              | connecttls | connectcompress | tlsfingerprint | tlsciphers
               | tlsverifypeer | tlssystemca | tlscertfile | tlscertdir;
 connectname: NAME '=' QSTRING ';'
 {
@@ -701,6 +713,14 @@ connecttls: TLS '=' YES ';'
 {
   flags &= ~CONF_CONNECT_TLS;
 };
+connectcompress: COMPRESS '=' YES ';'
+{
+  flags |= CONF_CONNECT_COMPRESS;
+}
+| COMPRESS '=' NO ';'
+{
+  flags &= ~CONF_CONNECT_COMPRESS;
+};
 
 uworldblock: UWORLD {
   if (!permitted(BLOCK_UWORLD)) YYERROR;
@@ -901,6 +921,14 @@ portblock: PORT {
       parse_error("Port %d has cloudflare = yes but is not a websocket port", port);
       break;
     }
+    if (FlagHas(&flags_here, LISTEN_METRICS)
+        && (FlagHas(&flags_here, LISTEN_SERVER)
+            || FlagHas(&flags_here, LISTEN_WEBIRC)
+            || FlagHas(&flags_here, LISTEN_WEBSOCKET)
+            || FlagHas(&flags_here, LISTEN_TLS))) {
+      parse_error("Port %d has metrics = yes and another port type", port);
+      break;
+    }
     switch (link->flags & (USE_IPV4 | USE_IPV6)) {
     case USE_IPV4:
       FlagSet(&flags_here, LISTEN_IPV4);
@@ -934,7 +962,8 @@ portblock: PORT {
 };
 portitems: portitem portitems | portitem;
 portitem: portnumber | portvhost | portvhostnumber | portmask | portserver
-  | portwebirc | portwebsocket | portcloudflare | porthidden | porttls | tlsciphers
+  | portwebirc | portwebsocket | portcloudflare | portmetrics | porthidden
+  | porttls | tlsciphers
   | tlsverifypeer | tlssystemca | tlscertfile | tlscertdir;
 portnumber: PORT '=' address_family NUMBER ';'
 {
@@ -1028,6 +1057,14 @@ portcloudflare: CLOUDFLARE '=' YES ';'
   FlagClr(&listen_flags, LISTEN_CLOUDFLARE);
 };
 
+portmetrics: METRICS '=' YES ';'
+{
+  FlagSet(&listen_flags, LISTEN_METRICS);
+} | METRICS '=' NO ';'
+{
+  FlagClr(&listen_flags, LISTEN_METRICS);
+};
+
 clientblock: CLIENT
 {
   if (!permitted(BLOCK_CLIENT)) YYERROR;
@@ -1139,6 +1176,12 @@ killblock: KILL
 } '{' killitems '}' ';'
 {
   if (dconf->usermask || dconf->hostmask ||dconf->realmask) {
+    if (dconf->usermask)
+      dconf->usercomp = matchmask_make(dconf->usermask);
+    if (dconf->hostmask)
+      dconf->hostcomp = matchmask_make(dconf->hostmask);
+    if (dconf->realmask)
+      dconf->realcomp = matchmask_make(dconf->realmask);
     dconf->next = denyConfList;
     denyConfList = dconf;
   }
@@ -1390,8 +1433,9 @@ pseudoflags: FAST ';'
 
 iauthblock: IAUTH {
   if (!permitted(BLOCK_IAUTH)) YYERROR;
+  workers = 1;
 } '{' iauthitems '}' ';' {
-  auth_spawn(stringno, stringlist);
+  auth_spawn(stringno, stringlist, workers);
   while (stringno > 0)
   {
     --stringno;
@@ -1400,7 +1444,7 @@ iauthblock: IAUTH {
 };
 
 iauthitems: iauthitem iauthitems | iauthitem;
-iauthitem: iauthprogram;
+iauthitem: iauthprogram | iauthworkers;
 iauthprogram: PROGRAM '='
 {
   while (stringno > 0)
@@ -1410,6 +1454,14 @@ iauthprogram: PROGRAM '='
   }
 } stringlist ';';
 
+iauthworkers: WORKERS '=' NUMBER ';'
+{
+  if ($3 < 1 || $3 > IAUTH_MAX_WORKERS)
+    parse_error("IAuth workers must be between 1 and %d", IAUTH_MAX_WORKERS);
+  else
+    workers = $3;
+};
+
 webircblock: WEBIRC
 {
   if (!permitted(BLOCK_WEBIRC)) YYERROR;
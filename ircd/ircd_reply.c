@@ -29,6 +29,7 @@
 #include "ircd_reply.h"
 #include "client.h"
 #include "ircd.h"
+#include "ircd_alloc.h"
 #include "ircd_log.h"
 #include "ircd_snprintf.h"
 #include "msg.h"
@@ -41,6 +42,16 @@
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <string.h>
 
+/** Prefix and target of every numeric sent by send_reply(). */
+static const char reply_format[] = "%:#C %s %C %v";
+
+/** Compile the formats used to send numerics. */
+void reply_init(void)
+{
+  ircd_format_compile(reply_format);
+  init_numerics();
+}
+
 /** Report a protocol violation warning to anyone listening.  This can
  * be easily used to clean up the last couple of parts of the code.
  * @param[in] cptr Client that violated the protocol.
@@ -102,7 +113,7 @@ int send_reply(struct Client *to, int reply, ...)
   assert(0 != vd.vd_format);
 
   /* build buffer */
-  mb = msgq_make(cli_from(to), "%:#C %s %C %v", &me, num->str, to, &vd);
+  mb = msgq_make(cli_from(to), reply_format, &me, num->str, to, &vd);
 
   va_end(vd.vd_args);
 
@@ -114,5 +125,110 @@ int send_reply(struct Client *to, int reply, ...)
   return 0; /* convenience return */
 }
 
+/** Render a reply for later use with send_reply_template().
+ * The pattern is formatted without a recipient, so it must not use
+ * conversions such as %C that depend on one.
+ * @param[in,out] rt Template to (re)fill.
+ * @param[in] reply Numeric of message, optionally with #SND_EXPLICIT.
+ */
+void reply_template_set(struct ReplyTemplate* rt, int reply, ...)
+{
+  struct VarData vd;
+  const struct Numeric *num;
+  char text[BUFSIZE];
+
+  assert(0 != rt);
+  assert(0 != reply);
+
+  num = get_error_numeric(reply & ~SND_EXPLICIT);
+
+  va_start(vd.vd_args, reply);
+  if (reply & SND_EXPLICIT)
+    vd.vd_format = (const char *) va_arg(vd.vd_args, char *);
+  else
+    vd.vd_format = num->format;
+  assert(0 != vd.vd_format);
+  rt->len = ircd_snprintf(0, text, sizeof(text), " %v", &vd);
+  va_end(vd.vd_args);
+
+  if (rt->len > sizeof(text) - 1) /* truncated */
+    rt->len = sizeof(text) - 1;
+
+  MyFree(rt->text);
+  rt->reply = reply & ~SND_EXPLICIT;
+  DupString(rt->text, text);
+}
+
+/** Release the text of a reply template.
+ * @param[in,out] rt Template to clear.
+ */
+void reply_template_clear(struct ReplyTemplate* rt)
+{
+  assert(0 != rt);
+
+  MyFree(rt->text);
+  rt->text = 0;
+  rt->len = 0;
+}
+
+/** Copy at most the room left in a message buffer.
+ * @param[in] dst Where to copy to.
+ * @param[in] end End of the usable space.
+ * @param[in] src Text to copy.
+ * @param[in] len Length of \a src.
+ * @return Position after the copied text.
+ */
+static char *reply_copy(char *dst, const char *end, const char *src,
+                        size_t len)
+{
+  if (len > (size_t)(end - dst))
+    len = end - dst;
+  memcpy(dst, src, len);
+  return dst + len;
+}
+
+/** Send a pre-rendered reply to a user.
+ * This produces the same line as send_reply() with the template's
+ * pattern, but for local users builds it by copying rather than by
+ * formatting.
+ * @param[in] to Client that wants a reply.
+ * @param[in] rt Reply rendered by reply_template_set().
+ * @return Zero.
+ */
+int send_reply_template(struct Client* to, const struct ReplyTemplate* rt)
+{
+  const struct Numeric *num;
+  struct MsgBuf *mb;
+  const char *end;
+  char *pos;
+
+  assert(0 != to);
+  assert(0 != rt);
+  assert(0 != rt->text);
+
+  num = get_error_numeric(rt->reply);
+
+  if (!MyUser(to)) /* remote targets get a numeric nick; format it */
+    return send_reply(to, SND_EXPLICIT | rt->reply, "%s", rt->text + 1);
+
+  mb = msgq_raw_alloc(to, BUFSIZE);
+  pos = mb->msg;
+  end = mb->msg + BUFSIZE - 2; /* leave room for \r\n */
 
+  pos = reply_copy(pos, end, ":", 1);
+  pos = reply_copy(pos, end, cli_name(&me), strlen(cli_name(&me)));
+  pos = reply_copy(pos, end, " ", 1);
+  pos = reply_copy(pos, end, num->str, strlen(num->str));
+  pos = reply_copy(pos, end, " ", 1);
+  pos = reply_copy(pos, end, cli_name(to), strlen(cli_name(to)));
+  pos = reply_copy(pos, end, rt->text, rt->len);
+  *pos++ = '\r';
+  *pos++ = '\n';
+  mb->length = pos - mb->msg;
 
+  send_buffer(to, NULL, mb, 0, NULL, NULL);
+
+  msgq_clean(mb);
+
+  return 0;
+}
@@ -59,6 +59,8 @@ static struct Socket res_socket_v4;
 static struct Socket res_socket_v6;
 /** Next DNS lookup timeout. */
 static struct Timer res_timeout;
+/** Timer that completes requests answered from the cache. */
+static struct Timer res_cache_timer;
 /** Local address for IPv4 DNS lookups. */
 struct irc_sockaddr VirtualHost_dns_v4;
 /** Local address for IPv6 DNS lookups. */
@@ -155,6 +157,10 @@ struct reslist
   unsigned char *tcp_recv; /**< Response body buffer. */
   unsigned short tcp_recv_len; /**< Expected response body length. */
   unsigned short tcp_recv_pos; /**< Bytes of body received so far. */
+  /* Answer cache */
+  unsigned long ttl;       /**< Smallest TTL among the answer records. */
+  char cached;             /**< Non-zero if answered from the cache. */
+  int cached_rcode;        /**< Response code of a cached failure, or -1. */
 };
 
 /** Heap-allocated DNS-over-TCP transport session.
@@ -216,6 +222,9 @@ static void process_dns_reply(struct reslist *request, HEADER *header,
 static void dns_tcp_callback(struct Event *ev);
 static int dns_tcp_send(struct reslist *request);
 static void dns_tcp_read(struct reslist *request);
+static void finish_negative(struct reslist *request, int rcode, int final);
+static void finish_answer(struct reslist *request);
+static void dns_cache_flush(void);
 
 /** Add an IP address to the reslist's address array.
  * @param[in] request The reslist to add the address to.
@@ -292,6 +301,9 @@ restart_resolver(void)
   if (!request_list.next)
     request_list.next = request_list.prev = &request_list;
 
+  /* The nameservers may have changed; forget what the old ones said. */
+  dns_cache_flush();
+
   /* Check which address family (or families) our nameservers use. */
   for (need_v4 = need_v6 = ns = 0; ns < irc_nscount; ns++)
   {
@@ -411,6 +423,279 @@ make_request(dns_callback_f callback, void *ctx)
   return(request);
 }
 
+/** Number of buckets in the resolver cache hash table. */
+#define DNS_CACHE_BUCKETS 1024
+
+/** A cached answer to one query.
+ * An entry with no name and no addresses is a negative answer.
+ */
+struct dns_cache
+{
+  struct dlink lru;           /**< LRU list node; most recently used first. */
+  struct dns_cache *hnext;    /**< Next entry in the same hash bucket. */
+  time_t expires;             /**< When the entry goes stale. */
+  size_t size;                /**< Memory charged to the entry. */
+  char type;                  /**< Query type (T_PTR, T_A or T_AAAA). */
+  char rcode;                 /**< Response code of a negative answer. */
+  char *name;                 /**< Hostname from a PTR answer. */
+  struct irc_in_addr *addrs;  /**< Addresses from an A or AAAA answer. */
+  int addr_count;             /**< Number of entries in \a addrs. */
+  char key[1];                /**< Queried name, or address for PTR. */
+};
+
+/** Hash table of cached answers. */
+static struct dns_cache *dns_cache_table[DNS_CACHE_BUCKETS];
+/** Cached answers in least recently used order. */
+static struct dlink dns_cache_lru = { &dns_cache_lru, &dns_cache_lru };
+/** Number of cached answers. */
+static unsigned int dns_cache_count;
+/** Memory used by cached answers. */
+static size_t dns_cache_mem;
+/** Lookups answered with cached addresses or names. */
+static unsigned int dns_cache_hits;
+/** Lookups answered with a cached failure. */
+static unsigned int dns_cache_neghits;
+/** Lookups that had to ask a nameserver. */
+static unsigned int dns_cache_misses;
+/** Entries dropped to stay within DNS_CACHE_SIZE. */
+static unsigned int dns_cache_evictions;
+
+/** Get the cache key for a request.
+ * PTR lookups are keyed by address, since request->name is
+ * overwritten by the answer; forward lookups by hostname.
+ * @param[in] request Request to look at.
+ * @return Cache key for \a request.
+ */
+static const char *
+dns_cache_key(const struct reslist *request)
+{
+  return request->type == T_PTR ? ircd_ntoa(&request->addr) : request->name;
+}
+
+/** Hash a cache key.
+ * @param[in] key Queried name or address.
+ * @param[in] type Query type.
+ * @return Bucket index into #dns_cache_table.
+ */
+static unsigned int
+dns_cache_hash(const char *key, int type)
+{
+  unsigned int hash = 2166136261u ^ type;
+
+  while (*key)
+    hash = (hash ^ ToLower(*key++)) * 16777619u;
+  return hash % DNS_CACHE_BUCKETS;
+}
+
+/** Remove an entry from the cache and free it.
+ * @param[in] entry Entry to drop.
+ */
+static void
+dns_cache_free(struct dns_cache *entry)
+{
+  struct dns_cache **pp;
+
+  for (pp = &dns_cache_table[dns_cache_hash(entry->key, entry->type)];
+       *pp != entry; pp = &(*pp)->hnext)
+    assert(*pp != NULL);
+  *pp = entry->hnext;
+  entry->lru.prev->next = entry->lru.next;
+  entry->lru.next->prev = entry->lru.prev;
+  dns_cache_mem -= entry->size;
+  --dns_cache_count;
+  MyFree(entry->name);
+  MyFree(entry->addrs);
+  MyFree(entry);
+}
+
+/** Evict least recently used entries until the cache fits in \a limit.
+ * @param[in] limit Memory the cache may use, in bytes.
+ */
+static void
+dns_cache_trim(size_t limit)
+{
+  while (dns_cache_mem > limit && dns_cache_lru.prev != &dns_cache_lru)
+  {
+    dns_cache_free((struct dns_cache *)dns_cache_lru.prev);
+    ++dns_cache_evictions;
+  }
+}
+
+/** Find a live cache entry, dropping it if it has expired.
+ * @param[in] key Queried name or address.
+ * @param[in] type Query type.
+ * @return Matching entry, or NULL.
+ */
+static struct dns_cache *
+dns_cache_find(const char *key, int type)
+{
+  struct dns_cache *entry;
+
+  for (entry = dns_cache_table[dns_cache_hash(key, type)]; entry;
+       entry = entry->hnext)
+  {
+    if (entry->type != type || ircd_strcmp(entry->key, key))
+      continue;
+    if (entry->expires <= CurrentTime)
+    {
+      dns_cache_free(entry);
+      return NULL;
+    }
+    /* Move to the head of the LRU list. */
+    entry->lru.prev->next = entry->lru.next;
+    entry->lru.next->prev = entry->lru.prev;
+    add_dlink(&entry->lru, dns_cache_lru.next);
+    return entry;
+  }
+  return NULL;
+}
+
+/** Remember the outcome of a request.
+ * Positive answers are kept for the smallest TTL in the reply, negative
+ * ones for DNS_CACHE_NEGTTL; both are capped at DNS_CACHE_MAXTTL.
+ * @param[in] request Request that got a reply.
+ * @param[in] rcode Response code of a negative answer, or -1 for a
+ *   positive answer.
+ */
+static void
+dns_cache_store(struct reslist *request, int rcode)
+{
+  struct dns_cache *entry;
+  const char *key = dns_cache_key(request);
+  size_t limit = feature_int(FEAT_DNS_CACHE_SIZE);
+  unsigned long ttl = rcode < 0 ? request->ttl
+    : (unsigned long) feature_int(FEAT_DNS_CACHE_NEGTTL);
+  unsigned int hash;
+  size_t len;
+
+  if (!limit || !key || !*key)
+    return;
+  if (ttl > (unsigned long) feature_int(FEAT_DNS_CACHE_MAXTTL))
+    ttl = feature_int(FEAT_DNS_CACHE_MAXTTL);
+  if (ttl == 0)
+    return;
+
+  if ((entry = dns_cache_find(key, request->type)))
+    dns_cache_free(entry);
+
+  len = strlen(key);
+  entry = (struct dns_cache *)MyCalloc(1, sizeof(*entry) + len);
+  memcpy(entry->key, key, len + 1);
+  entry->size = sizeof(*entry) + len;
+  entry->type = request->type;
+  entry->rcode = rcode;
+  entry->expires = CurrentTime + ttl;
+  if (rcode < 0 && request->type == T_PTR)
+  {
+    DupString(entry->name, request->name);
+    entry->size += strlen(entry->name) + 1;
+  }
+  else if (rcode < 0)
+  {
+    entry->addr_count = request->addr_count;
+    entry->addrs = (struct irc_in_addr *)
+      MyMalloc(entry->addr_count * sizeof(*entry->addrs));
+    memcpy(entry->addrs, request->addrs,
+           entry->addr_count * sizeof(*entry->addrs));
+    entry->size += entry->addr_count * sizeof(*entry->addrs);
+  }
+
+  hash = dns_cache_hash(key, request->type);
+  entry->hnext = dns_cache_table[hash];
+  dns_cache_table[hash] = entry;
+  add_dlink(&entry->lru, dns_cache_lru.next);
+  dns_cache_mem += entry->size;
+  ++dns_cache_count;
+  dns_cache_trim(limit);
+}
+
+/** Complete requests that were answered from the cache.
+ * Cache hits are delivered from a timer rather than from inside
+ * gethost_byname() or gethost_byaddr(), so callers never see their
+ * callback run before the lookup call returns.
+ * @param[in] ev Timer event data (ignored).
+ */
+static void
+dns_cache_deliver(struct Event *ev)
+{
+  struct dlink *ptr, *next_ptr;
+  struct reslist *request;
+
+  if (ev_type(ev) != ET_EXPIRE)
+    return;
+
+  for (ptr = request_list.next; ptr != &request_list; ptr = next_ptr)
+  {
+    next_ptr = ptr->next;
+    request = (struct reslist *)ptr;
+    if (!request->cached)
+      continue;
+    request->cached = 0;
+    if (request->cached_rcode < 0)
+      finish_answer(request);
+    else
+      finish_negative(request, request->cached_rcode, 1);
+  }
+}
+
+/** Answer a request from the cache, if possible.
+ * @param[in] request Request about to be sent to a nameserver.
+ * @return Non-zero if \a request will be completed from the cache.
+ */
+static int
+dns_cache_lookup(struct reslist *request)
+{
+  struct dns_cache *entry;
+  const char *key;
+  int ii;
+
+  if (!feature_int(FEAT_DNS_CACHE_SIZE) || !(key = dns_cache_key(request))
+      || !(entry = dns_cache_find(key, request->type)))
+  {
+    ++dns_cache_misses;
+    return 0;
+  }
+
+  request->cached_rcode = -1;
+  if (entry->name)
+  {
+    ircd_strncpy(request->name, entry->name, HOSTLEN);
+    ++dns_cache_hits;
+  }
+  else if (entry->addr_count > 0)
+  {
+    request->addr_count = 0;
+    for (ii = 0; ii < entry->addr_count; ++ii)
+      add_addr_to_request(request, &entry->addrs[ii]);
+    ++dns_cache_hits;
+  }
+  else
+  {
+    request->cached_rcode = entry->rcode;
+    ++dns_cache_neghits;
+  }
+  request->cached = 1;
+
+  if (!t_onqueue(&res_cache_timer))
+    timer_add(&res_cache_timer, dns_cache_deliver, NULL, TT_RELATIVE, 0);
+  return 1;
+}
+
+/** Apply a new DNS_CACHE_SIZE, evicting answers that no longer fit. */
+void
+dns_cache_resize(void)
+{
+  dns_cache_trim(feature_int(FEAT_DNS_CACHE_SIZE));
+}
+
+/** Drop every cached answer. */
+static void
+dns_cache_flush(void)
+{
+  while (dns_cache_lru.next != &dns_cache_lru)
+    dns_cache_free((struct dns_cache *)dns_cache_lru.next);
+}
+
 /** Make sure that a timeout event will happen by the given time.
  * @param[in] when Latest time for timeout to run.
  */
@@ -544,7 +829,7 @@ find_id(int id)
   {
     request = (struct reslist*)ptr;
 
-    if (request->id == id) {
+    if (request->id == id && !request->cached) {
       Debug((DEBUG_DNS, "find_id(%d) -> %p", id, request));
       return(request);
     }
@@ -661,7 +946,7 @@ do_query_number(dns_callback_f callback, void *ctx, const struct irc_in_addr *ad
     request->state= REQ_PTR;
     request->type = T_PTR;
     memcpy(&request->addr, addr, sizeof(request->addr));
-    request->name = (char *)MyMalloc(HOSTLEN + 1);
+    request->name = (char *)MyCalloc(1, HOSTLEN + 1);
   }
   Debug((DEBUG_DNS, "Requesting DNS PTR %s as %p", ipbuf, request));
   query_name(ipbuf, C_IN, T_PTR, request);
@@ -680,6 +965,12 @@ query_name(const char *name, int query_class, int type,
   char buf[MAXPACKET];
   int request_len = 0;
 
+  if (dns_cache_lookup(request))
+  {
+    Debug((DEBUG_DNS, "Request %p answered from cache", request));
+    return;
+  }
+
   memset(buf, 0, sizeof(buf));
 
   if ((request_len = irc_res_mkquery(name, query_class, type,
@@ -766,6 +1057,7 @@ proc_answer(struct reslist *request, HEADER* header, char* buf, char* eob)
   int type;                    /* answer type */
   int n;                       /* temp count */
   int rd_length;
+  unsigned long ttl;
 
   current = (unsigned char *)buf + sizeof(HEADER);
 
@@ -816,8 +1108,12 @@ proc_answer(struct reslist *request, HEADER* header, char* buf, char* eob)
     type = irc_ns_get16(current);
     current += TYPE_SIZE;
 
-    /* We do not use the class or TTL values. */
+    /* We do not use the class value; the TTL bounds how long the
+     * answer may be cached. */
     current += CLASS_SIZE;
+    ttl = irc_ns_get32(current);
+    if (ttl < request->ttl)
+      request->ttl = ttl;
     current += TTL_SIZE;
 
     rd_length = irc_ns_get16(current);
@@ -1336,111 +1632,147 @@ start_dns_tcp(struct reslist *request, const struct irc_sockaddr *ns)
   return 1;
 }
 
-/** Finish handling a decoded DNS response for \a request.
- * Truncated UDP replies (TC=1) are handled by the caller before invoking
- * this; truncation over TCP is not meaningful and is ignored here.
+/** Finish a request whose reply carried no usable answer.
+ * @param[in] request Request that failed.
+ * @param[in] rcode Response code of the reply.
+ * @param[in] final Non-zero if the reply settles the query, so the
+ *   request must not be left to time out and be sent again.
  */
 static void
-process_dns_reply(struct reslist *request, HEADER *header, char *buf,
-                  unsigned int rc)
+finish_negative(struct reslist *request, int rcode, int final)
 {
-  int answer_count;
-
-  if ((header->rcode != NO_ERRORS) || (header->ancount == 0))
+  if (SERVFAIL == rcode || NXDOMAIN == rcode)
+  {
+      /*
+       * If a bad error was returned, we stop here and don't send
+       * send any more (no retries granted).
+       */
+      Debug((DEBUG_DNS, "Request %p has bad response (state %d type %d rcode %d)", request, request->state, request->type, rcode));
+      (*request->callback)(request->callback_ctx, NULL, 0, NULL);
+      rem_request(request);
+  }
+  else
   {
-    if (SERVFAIL == header->rcode || NXDOMAIN == header->rcode)
+    /*
+     * If we haven't already tried this, and we're looking up AAAA, try A
+     * now.  This is reached only for complete replies -- a truncated UDP
+     * reply is diverted to a TCP retry before we get here -- so an empty
+     * answer section is an authoritative "no AAAA" even in TCP mode, and
+     * the A fallback goes back to plain UDP.
+     */
+
+    if (request->state == REQ_AAAA && request->type == T_AAAA)
     {
-        /*
-         * If a bad error was returned, we stop here and don't send
-         * send any more (no retries granted).
-         */
-        Debug((DEBUG_DNS, "Request %p has bad response (state %d type %d rcode %d)", request, request->state, request->type, header->rcode));
-        (*request->callback)(request->callback_ctx, NULL, 0, NULL);
-	rem_request(request);
+      request->tcp_mode = 0;
+      request->timeout += feature_int(FEAT_IRCD_RES_TIMEOUT);
+      resend_query(request);
     }
-    else
+    else if (request->type == T_PTR && request->state != REQ_INT &&
+             !irc_in_addr_is_ipv4(&request->addr))
+    {
+      request->tcp_mode = 0;
+      request->state = REQ_INT;
+      request->timeout += feature_int(FEAT_IRCD_RES_TIMEOUT);
+      resend_query(request);
+    }
+    else if (final)
+    {
+      (*request->callback)(request->callback_ctx, NULL, 0, NULL);
+      rem_request(request);
+    }
+  }
+}
+
+/** Finish a request that has its answer.
+ * @param[in] request Request with a PTR name or forward addresses.
+ */
+static void
+finish_answer(struct reslist *request)
+{
+  if (request->type == T_PTR)
+  {
+    if (request->name == NULL)
     {
       /*
-       * If we haven't already tried this, and we're looking up AAAA, try A
-       * now.  This is reached only for complete replies -- a truncated UDP
-       * reply is diverted to a TCP retry before we get here -- so an empty
-       * answer section is an authoritative "no AAAA" even in TCP mode, and
-       * the A fallback goes back to plain UDP.
+       * got a PTR response with no name, something bogus is happening
+       * don't bother trying again, the client address doesn't resolve
        */
+      Debug((DEBUG_DNS, "Request %p PTR had empty name", request));
+      (*request->callback)(request->callback_ctx, NULL, 0, NULL);
+      rem_request(request);
+      return;
+    }
 
-      if (request->state == REQ_AAAA && request->type == T_AAAA)
-      {
-        request->tcp_mode = 0;
-        request->timeout += feature_int(FEAT_IRCD_RES_TIMEOUT);
-        resend_query(request);
-      }
-      else if (request->type == T_PTR && request->state != REQ_INT &&
-               !irc_in_addr_is_ipv4(&request->addr))
-      {
-        request->tcp_mode = 0;
-        request->state = REQ_INT;
-        request->timeout += feature_int(FEAT_IRCD_RES_TIMEOUT);
-        resend_query(request);
-      }
-      else if (request->tcp_mode)
-      {
-        (*request->callback)(request->callback_ctx, NULL, 0, NULL);
-        rem_request(request);
-      }
+    /*
+     * Lookup the 'authoritative' name that we were given for the
+     * ip#.
+     */
+#ifdef IPV6
+    if (!irc_in_addr_is_ipv4(&request->addr))
+      do_query_name(request->callback, request->callback_ctx, request->name, NULL, T_AAAA);
+    else
+#endif
+    do_query_name(request->callback, request->callback_ctx, request->name, NULL, T_A);
+    Debug((DEBUG_DNS, "Request %p switching to forward resolution", request));
+    rem_request(request);
+  }
+  else
+  {
+    /*
+     * got a name and address response, client resolved
+     * Pass all IPs to the callback with count
+     */
+    if (request->addr_count > 0) {
+      (*request->callback)(request->callback_ctx, request->addrs, request->addr_count, request->name);
+      Debug((DEBUG_DNS, "Request %p got forward resolution with %d IPs", request, request->addr_count));
+    } else {
+      (*request->callback)(request->callback_ctx, &request->addr, 1, request->name);
+      Debug((DEBUG_DNS, "Request %p got forward resolution", request));
     }
+    rem_request(request);
+  }
+}
+
+/** Finish handling a decoded DNS response for \a request.
+ * Truncated UDP replies (TC=1) are handled by the caller before invoking
+ * this; truncation over TCP is not meaningful and is ignored here.
+ */
+static void
+process_dns_reply(struct reslist *request, HEADER *header, char *buf,
+                  unsigned int rc)
+{
+  int answer_count;
 
+  if ((header->rcode != NO_ERRORS) || (header->ancount == 0))
+  {
+    /* SERVFAIL is usually transient, so only NXDOMAIN and empty
+     * answers are cached.  An empty ip6.arpa answer is not final
+     * until ip6.int has been tried, and both share a cache key. */
+    if (header->rcode == NXDOMAIN
+        || (header->rcode == NO_ERRORS
+            && !(request->type == T_PTR && request->state != REQ_INT
+                 && !irc_in_addr_is_ipv4(&request->addr))))
+      dns_cache_store(request, header->rcode);
+    /* An empty answer is as final as the cached copy of it: complete
+     * it now, as dns_cache_deliver() would.  Other errors over UDP are
+     * left to time out and be retried. */
+    finish_negative(request, header->rcode,
+                    request->tcp_mode || header->rcode == NO_ERRORS);
     return;
   }
   /*
    * If this fails there was an error decoding the received packet,
    * try it again and hope it works the next time.
    */
+  request->ttl = ~0UL;
   answer_count = proc_answer(request, header, buf, buf + rc);
 
   if (answer_count)
   {
-    if (request->type == T_PTR)
-    {
-      if (request->name == NULL)
-      {
-        /*
-         * got a PTR response with no name, something bogus is happening
-         * don't bother trying again, the client address doesn't resolve
-         */
-        Debug((DEBUG_DNS, "Request %p PTR had empty name", request));
-        (*request->callback)(request->callback_ctx, NULL, 0, NULL);
-        rem_request(request);
-        return;
-      }
-
-      /*
-       * Lookup the 'authoritative' name that we were given for the
-       * ip#.
-       */
-#ifdef IPV6
-      if (!irc_in_addr_is_ipv4(&request->addr))
-        do_query_name(request->callback, request->callback_ctx, request->name, NULL, T_AAAA);
-      else
-#endif
-      do_query_name(request->callback, request->callback_ctx, request->name, NULL, T_A);
-      Debug((DEBUG_DNS, "Request %p switching to forward resolution", request));
-      rem_request(request);
-    }
-    else
-    {
-      /*
-       * got a name and address response, client resolved
-       * Pass all IPs to the callback with count
-       */
-      if (request->addr_count > 0) {
-        (*request->callback)(request->callback_ctx, request->addrs, request->addr_count, request->name);
-        Debug((DEBUG_DNS, "Request %p got forward resolution with %d IPs", request, request->addr_count));
-      } else {
-        (*request->callback)(request->callback_ctx, &request->addr, 1, request->name);
-        Debug((DEBUG_DNS, "Request %p got forward resolution", request));
-      }
-      rem_request(request);
-    }
+    if (request->type == T_PTR ? request->name && *request->name
+        : request->addr_count > 0)
+      dns_cache_store(request, -1);
+    finish_answer(request);
   }
   else if (!request->sent)
   {
@@ -1477,11 +1809,15 @@ report_dns_servers(struct Client *source_p, const struct StatDesc *sd, char *par
     ircd_ntoa_r(ipaddr, &irc_nsaddr_list[i].addr);
     send_reply(source_p, RPL_STATSALINE, ipaddr);
   }
+  send_reply(source_p, SND_EXPLICIT | RPL_STATSALINE, "cache :%u entries, "
+             "%zu bytes, %u hits, %u negative hits, %u misses, %u evicted",
+             dns_cache_count, dns_cache_mem, dns_cache_hits,
+             dns_cache_neghits, dns_cache_misses, dns_cache_evictions);
 }
 
 /** Report memory usage to a client.
  * @param[in] sptr Client requesting information.
- * @return Total memory used by pending requests.
+ * @return Total memory used by pending requests and cached answers.
  */
 size_t
 cres_mem(struct Client* sptr)
@@ -1503,5 +1839,9 @@ cres_mem(struct Client* sptr)
 
   send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
 	     ":Resolver: requests %d(%d)", request_count, request_mem);
-  return request_mem;
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+	     ":Resolver cache: entries %u(%zu) hits %u negative %u misses %u "
+	     "evicted %u", dns_cache_count, dns_cache_mem, dns_cache_hits,
+	     dns_cache_neghits, dns_cache_misses, dns_cache_evictions);
+  return request_mem + dns_cache_mem;
 }
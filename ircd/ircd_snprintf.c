@@ -24,6 +24,7 @@
 
 #include "client.h"
 #include "channel.h"
+#include "ircd_alloc.h"
 #include "ircd_log.h"
 #include "ircd_snprintf.h"
 #include "struct.h"
@@ -1447,38 +1448,68 @@ addc(struct BufData *buf_p, int c)
     buf_p->buf[buf_p->buf_loc++] = c;
 }
 
-/** Append a string to an output buffer.
+/** Return length of string, up to a maximum.
+ * @param[in] str String to find length for.
+ * @param[in] maxlen Maximum value to return.
+ * @return Minimum of \a maxlen and length of \a str.
+ */
+static int
+my_strnlen(const char *str, int maxlen)
+{
+  int len = 0;
+
+  while (*str++ && maxlen--)
+    len++;
+
+  return len;
+}
+
+/** Append a counted string to an output buffer.
  * @param[in,out] buf_p Buffer to append to.
- * @param[in] s_len Length of string to append.
- * @param[in] s String to append.
+ * @param[in] len Number of characters to append.
+ * @param[in] s String to append; need not be NUL-terminated.
  */
 static void
-adds(struct BufData *buf_p, int s_len, const char *s)
+addn(struct BufData *buf_p, size_t len, const char *s)
 {
-  int overflow = 0;
+  size_t count = len, past = 0, room;
 
-  /* while the string exists and has non-zero length */
-  while (s_len && *s)
-  {
-    /* poor man's inlining; see addc(), above */
-    if (buf_p->limit == 0) { /* We've gone past the limit... */
-      buf_p->overflow++;
-      overflow++;
-    } else if (buf_p->limit > 0) /* update the limit */
-      buf_p->limit--;
-
-    if (buf_p->buf_loc >= buf_p->buf_size) { /* We've gone past buffer */
-      buf_p->buf_overflow++;
-      overflow++;
-    }
-
-    if (!overflow) /* add the character to the buffer */
-      buf_p->buf[buf_p->buf_loc++] = *s;
+  if (buf_p->limit >= 0 && count > (size_t)buf_p->limit) {
+    past = count - buf_p->limit; /* We've gone past the limit... */
+    count = buf_p->limit;
+    buf_p->overflow += past;
+  }
+  if (buf_p->limit > 0) /* update the limit */
+    buf_p->limit -= count;
 
-    s++; /* advance to next character */
-    if (s_len > 0) /* update string length left to copy */
-      s_len--;
+  room = buf_p->buf_size - buf_p->buf_loc;
+  if (count > room) { /* We've gone past buffer */
+    buf_p->buf_overflow += count - room;
+    count = room;
   }
+  if (buf_p->buf_loc + count >= buf_p->buf_size)
+    buf_p->buf_overflow += past; /* past both */
+
+  memcpy(buf_p->buf + buf_p->buf_loc, s, count);
+  buf_p->buf_loc += count;
+}
+
+/** Append a string to an output buffer.
+ * @param[in,out] buf_p Buffer to append to.
+ * @param[in] s_len Length of string to append, or -1 for all of it.
+ * @param[in] s String to append.
+ */
+static void
+adds(struct BufData *buf_p, int s_len, const char *s)
+{
+  size_t len = 0;
+
+  if (s_len < 0)
+    len = strlen(s);
+  else /* \a s need not be terminated within \a s_len */
+    while (len < (size_t)s_len && s[len])
+      len++;
+  addn(buf_p, len, s);
 }
 
 /** Add certain padding to an output buffer.
@@ -1497,31 +1528,20 @@ do_pad(struct BufData *buf_p, int padlen, char *pad)
   adds(buf_p, padlen, pad);
 }
 
-/** Return length of string, up to a maximum.
- * @param[in] str String to find length for.
- * @param[in] maxlen Maximum value to return.
- * @return Minimum of \a maxlen and length of \a str.
+/** Parse the flags, width, precision and type of one field.
+ * When compiling a format, \a buf_p and \a vp are NULL, and fields
+ * that need anything but their own argument at output time are
+ * refused.
+ * @param[out] fld_s Description of the field.
+ * @param[in] fmt Format string, just past the '%'.
+ * @param[in,out] buf_p Output buffer (for %n), or NULL.
+ * @param[in,out] vp Argument list (for '*' and %n), or NULL.
+ * @return Pointer to the conversion character, to the end of \a fmt
+ * if it ended first, or NULL if the field cannot be compiled.
  */
-static int
-my_strnlen(const char *str, int maxlen)
-{
-  int len = 0;
-
-  while (*str++ && maxlen--)
-    len++;
-
-  return len;
-}
-
-/** Workhorse printing function.
- * @param[in] dest Client to format the message.
- * @param[in,out] buf_p Description of output buffer.
- * @param[in] fmt Message format string.
- * @param[in] vp Variable-length argument list for format string.
- */
-static void
-doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
-	 va_list vp)
+static const char *
+parse_field(struct FieldData *fld_s, const char *fmt, struct BufData *buf_p,
+	    va_list *vp)
 {
   enum {
     FLAG,	/* Gathering flags */
@@ -1531,589 +1551,791 @@ doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
     OPT,	/* Gathering field options (l, h, q, etc.) */
     SPEC	/* Looking for field specifier */
   } state = FLAG;
-  struct FieldData fld_s = FIELDDATA_INIT;
-  const char *fstart = 0;
+  const char *fstart = fmt;
+
+  fld_s->flags = 0; /* initialize our field data */
+  fld_s->base = BASE_DECIMAL;
+  fld_s->width = 0;
+  fld_s->prec = -1;
 
   for (; *fmt; fmt++) {
-    /* If it's not %, or if it's %%, append it to the string */
-    if (*fmt != '%' || (*fmt == '%' && *++fmt == '%')) {
-      addc(buf_p, *fmt); /* add the character to the string */
+    switch (*fmt) {
+    case '-': /* Deal with a minus flag */
+      if (state == FLAG)
+	fld_s->flags |= FLAG_MINUS;
+      else if (state == PREC) { /* precisions may not be negative */
+	fld_s->prec = -1;
+	state = OPT; /* prohibit further precision wrangling */
+      }
+      continue;
 
-      continue; /* go to the next character */
-    }
+    case '+': /* Deal with a plus flag */
+      if (state == FLAG)
+	fld_s->flags |= FLAG_PLUS;
+      continue;
 
-    state = FLAG; /* initialize our field data */
-    fld_s.flags = 0;
-    fld_s.base = BASE_DECIMAL;
-    fld_s.width = 0;
-    fld_s.prec = -1;
-    fstart = fmt;
-
-    for (; *fmt; fmt++) {
-      switch (*fmt) {
-      case '-': /* Deal with a minus flag */
-	if (state == FLAG)
-	  fld_s.flags |= FLAG_MINUS;
-	else if (state == PREC) { /* precisions may not be negative */
-	  fld_s.prec = -1;
-	  state = OPT; /* prohibit further precision wrangling */
-	}
-	continue;
+    case ' ': /* Deal with a space flag */
+      if (state == FLAG)
+	fld_s->flags |= FLAG_SPACE;
+      continue;
 
-      case '+': /* Deal with a plus flag */
-	if (state == FLAG)
-	  fld_s.flags |= FLAG_PLUS;
-	continue;
+    case '#': /* Deal with the so-called "alternate" flag */
+      if (state == FLAG)
+	fld_s->flags |= FLAG_ALT;
+      continue;
 
-      case ' ': /* Deal with a space flag */
-	if (state == FLAG)
-	  fld_s.flags |= FLAG_SPACE;
-	continue;
+    case ':': /* Deal with the colon flag */
+      if (state == FLAG)
+	fld_s->flags |= FLAG_COLON;
+      continue;
 
-      case '#': /* Deal with the so-called "alternate" flag */
-	if (state == FLAG)
-	  fld_s.flags |= FLAG_ALT;
+    case '0': /* Deal with a zero flag */
+      if (state == FLAG) {
+	fld_s->flags |= FLAG_ZERO;
 	continue;
+      }
+      /*FALLTHROUGH*/
+    case '1':  case '2':  case '3':  case '4':  case '5':
+    case '6':  case '7':  case '8':  case '9':
+      if (state == FLAG) /* switch to the WIDTH state if needed? */
+	state = WIDTH;
+      else if (state != WIDTH && state != PREC)
+	continue; /* don't process it any more */
+
+      /* convert number */
+      if (state == WIDTH) {
+	if (fld_s->width < WIDTH_MAX) /* prevent overflow */
+	  fld_s->width = fld_s->width * 10 + (*fmt - '0');
+      } else {
+	if (fld_s->prec < WIDTH_MAX) /* prevent overflow */
+	  fld_s->prec = fld_s->prec * 10 + (*fmt - '0');
+      }
+      continue;
 
-      case ':': /* Deal with the colon flag */
-	if (state == FLAG)
-	  fld_s.flags |= FLAG_COLON;
-	continue;
+    case '.': /* We found a '.'; go to precision state */
+      if (state <= DOT) {
+	state = PREC;
+	fld_s->prec = 0;
+      }
+      continue;
 
-      case '0': /* Deal with a zero flag */
-	if (state == FLAG) {
-	  fld_s.flags |= FLAG_ZERO;
-	  continue;
-	}
-	/*FALLTHROUGH*/
-      case '1':  case '2':  case '3':  case '4':  case '5':
-      case '6':  case '7':  case '8':  case '9':
-	if (state == FLAG) /* switch to the WIDTH state if needed? */
-	  state = WIDTH;
-	else if (state != WIDTH && state != PREC)
-	  continue; /* don't process it any more */
-
-	/* convert number */
-	if (state == WIDTH) {
-	  if (fld_s.width < WIDTH_MAX) /* prevent overflow */
-	    fld_s.width = fld_s.width * 10 + (*fmt - '0');
-	} else {
-	  if (fld_s.prec < WIDTH_MAX) /* prevent overflow */
-	    fld_s.prec = fld_s.prec * 10 + (*fmt - '0');
-	}
-	continue;
+    case '*': /* Grab an argument containing a width or precision */
+      if (!vp) /* not known until output time */
+	return 0;
+      if (state <= WIDTH && fld_s->width <= 0) {
+	fld_s->width = (short)va_arg(*vp, int); /* Get argument */
+
+	state = DOT; /* '.' better be next */
 
-      case '.': /* We found a '.'; go to precision state */
-	if (state <= DOT) {
-	  state = PREC;
-	  fld_s.prec = 0;
+	if (fld_s->width < 0) { /* deal with negative width */
+	  fld_s->flags |= FLAG_MINUS;
+	  fld_s->width = -fld_s->width;
 	}
-	continue;
+      } else if (state == PREC && fld_s->prec <= 0) {
+	fld_s->prec = (short)va_arg(*vp, int); /* Get argument */
 
-      case '*': /* Grab an argument containing a width or precision */
-	if (state <= WIDTH && fld_s.width <= 0) {
-	  fld_s.width = (short)va_arg(vp, int); /* Get argument */
+	state = OPT; /* No more precision stuff */
 
-	  state = DOT; /* '.' better be next */
+	if (fld_s->prec < 0) /* deal with negative precision */
+	  fld_s->prec = -1;
+      }
+      continue;
 
-	  if (fld_s.width < 0) { /* deal with negative width */
-	    fld_s.flags |= FLAG_MINUS;
-	    fld_s.width = -fld_s.width;
-	  }
-	} else if (state == PREC && fld_s.prec <= 0) {
-	  fld_s.prec = (short)va_arg(vp, int); /* Get argument */
+    case 'h': /* it's a short */
+      if (state <= OPT) {
+	state = OPT;
+	if (fld_s->flags & TYPE_SHORT) /* We support 'hh' */
+	  fld_s->flags |= TYPE_CHAR;
+	else if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_SHORT;
+      }
+      continue;
 
-	  state = OPT; /* No more precision stuff */
+    case 'l': /* it's a long */
+      if (state <= OPT) {
+	state = OPT;
+	if (fld_s->flags & TYPE_LONG) /* We support 'll' */
+	  fld_s->flags |= TYPE_QUAD | TYPE_LONGDOUBLE;
+	else if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_LONG;
+      }
+      continue;
 
-	  if (fld_s.prec < 0) /* deal with negative precision */
-	    fld_s.prec = -1;
-	}
-	continue;
+    case 'q':  case 'L': /* it's a quad or long double */
+      if (state <= OPT) {
+	state = OPT;
+	if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_QUAD | TYPE_LONGDOUBLE;
+      }
+      continue;
 
-      case 'h': /* it's a short */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (fld_s.flags & TYPE_SHORT) /* We support 'hh' */
-	    fld_s.flags |= TYPE_CHAR;
-	  else if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_SHORT;
-	}
-	continue;
+    case 'j': /* it's an intmax_t */
+      if (state <= OPT) {
+	state = OPT;
+	if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_INTMAX;
+      }
+      continue;
 
-      case 'l': /* it's a long */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (fld_s.flags & TYPE_LONG) /* We support 'll' */
-	    fld_s.flags |= TYPE_QUAD | TYPE_LONGDOUBLE;
-	  else if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_LONG;
-	}
-	continue;
+    case 't': /* it's a ptrdiff_t */
+      if (state <= OPT) {
+	state = OPT;
+	if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_PTRDIFF;
+      }
+      continue;
 
-      case 'q':  case 'L': /* it's a quad or long double */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_QUAD | TYPE_LONGDOUBLE;
-	}
-	continue;
+    case 'z':  case 'Z': /* it's a size_t */
+      if (state <= OPT) {
+	state = OPT;
+	if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_SIZE;
+      }
+      continue;
 
-      case 'j': /* it's an intmax_t */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_INTMAX;
-	}
-	continue;
+    case 'T': /* it's a time_t */
+      if (state <= OPT) {
+	state = OPT;
+	if (!(fld_s->flags & TYPE_MASK))
+	  fld_s->flags |= TYPE_TIME;
+      }
+      continue;
 
-      case 't': /* it's a ptrdiff_t */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_PTRDIFF;
-	}
-	continue;
+    case 's': /* convert a string */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
+			FLAG_COLON | TYPE_MASK);
+      fld_s->flags |= ARG_PTR | CONV_STRING;
+      break;
 
-      case 'z':  case 'Z': /* it's a size_t */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_SIZE;
-	}
-	continue;
+    case 'd':  case 'i':
+      fld_s->flags &= ~(FLAG_COLON);
+      fld_s->flags |= ARG_INT | CONV_INT;
+      break;
 
-      case 'T': /* it's a time_t */
-	if (state <= OPT) {
-	  state = OPT;
-	  if (!(fld_s.flags & TYPE_MASK))
-	    fld_s.flags |= TYPE_TIME;
-	}
-	continue;
+    case 'X': /* uppercase hexadecimal */
+      fld_s->flags |= INFO_UPPERCASE;
+      /*FALLTHROUGH*/
+    case 'o':  case 'x': /* octal or hexadecimal */
+      if (*fmt == 'o')
+	fld_s->base = BASE_OCTAL;
+      else
+	fld_s->base = BASE_HEX;
+      /*FALLTHROUGH*/
+    case 'u': /* Unsigned int */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_COLON);
+      fld_s->flags |= INFO_UNSIGNED | ARG_INT | CONV_INT;
+      break;
 
-      case 's': /* convert a string */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
-			 FLAG_COLON | TYPE_MASK);
-	fld_s.flags |= ARG_PTR | CONV_STRING;
-	break;
-
-      case 'd':  case 'i':
-	fld_s.flags &= ~(FLAG_COLON);
-	fld_s.flags |= ARG_INT | CONV_INT;
-	break;
-
-      case 'X': /* uppercase hexadecimal */
-	fld_s.flags |= INFO_UPPERCASE;
-	/*FALLTHROUGH*/
-      case 'o':  case 'x': /* octal or hexadecimal */
-	if (*fmt == 'o')
-	  fld_s.base = BASE_OCTAL;
-	else
-	  fld_s.base = BASE_HEX;
-	/*FALLTHROUGH*/
-      case 'u': /* Unsigned int */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_COLON);
-	fld_s.flags |= INFO_UNSIGNED | ARG_INT | CONV_INT;
-	break;
-
-	/* Don't support floating point at this time; it's too complicated */
+      /* Don't support floating point at this time; it's too complicated */
 /*        case 'E':  case 'G':  case 'A': */
-/*  	fld_s.flags |= INFO_UPPERCASE; */
-	/*FALLTHROUGH*/
+/*  	fld_s->flags |= INFO_UPPERCASE; */
+      /*FALLTHROUGH*/
 /*        case 'e':  case 'f':  case 'g':  case 'a': */
-/*  	fld_s.flags |= ARG_FLOAT | CONV_FLOAT; */
+/*  	fld_s->flags |= ARG_FLOAT | CONV_FLOAT; */
 /*  	break; */
 
-      case 'c': /* character */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
-			 FLAG_COLON | TYPE_MASK);
-	fld_s.flags |= INFO_UNSIGNED | ARG_INT | TYPE_CHAR | CONV_CHAR;
-	fld_s.prec = -1;
-	break;
-
-      case 'p': /* display a pointer */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_COLON | TYPE_MASK);
-	fld_s.flags |= (FLAG_ALT | FLAG_ZERO | TYPE_POINTER | ARG_PTR |
-			CONV_INT | INFO_UNSIGNED);
-	fld_s.prec = (SIZEOF_VOID_P * 2); /* number of characters */
-	fld_s.base = BASE_HEX;
-	break;
-
-      case 'n': /* write back a character count */
-	if (fld_s.flags & TYPE_CHAR) /* eg, %hhn */
-	  *((char *)va_arg(vp, int *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_SHORT) /* eg, %hn */
-	  *((short *)va_arg(vp, int *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_QUAD) /* eg, %qn */
-	  *((int64_t *)va_arg(vp, int64_t *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_LONG) /* eg, %ln */
-	  *((long *)va_arg(vp, long *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_INTMAX) /* eg, %jn */
-	  *((_large_t *)va_arg(vp, _large_t *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_PTRDIFF) /* eg, %tn */
-	  *((ptrdiff_t *)va_arg(vp, ptrdiff_t *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_SIZE) /* eg, %zn */
-	  *((size_t *)va_arg(vp, size_t *)) = TOTAL(buf_p);
-	else if (fld_s.flags & TYPE_TIME) /* eg, %Tn */
-	  *((time_t *)va_arg(vp, time_t *)) = TOTAL(buf_p);
-	else /* eg, %n */
-	  *((int *)va_arg(vp, int *)) = TOTAL(buf_p);
-	fld_s.flags = 0; /* no further processing required */
-	break;
-
-      case 'm': /* write out a string describing an errno error */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
-			 FLAG_COLON | TYPE_MASK);
-	fld_s.flags |= CONV_STRING;
-	fld_s.value.v_ptr = (void *)strerror(errno);
-	break;
-
-      case 'v': /* here's the infamous %v... */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
-			 FLAG_COLON | TYPE_MASK);
-	fld_s.flags |= ARG_PTR | CONV_VARARGS;
-	break;
-
-      case 'C': /* convert a client name... */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ZERO | TYPE_MASK);
-	fld_s.flags |= ARG_PTR | CONV_CLIENT;
-	break;
-
-      case 'H': /* convert a channel name... */
-	fld_s.flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
-			 FLAG_COLON | TYPE_MASK);
-	fld_s.flags |= ARG_PTR | CONV_CHANNEL;
-	break;
-
-      default: /* Unsupported, display a message and the entire format */
-	adds(buf_p, -1, "(Unsupported: %");
-	adds(buf_p, fmt - fstart + 1, fstart);
-	addc(buf_p, ')');
-	fld_s.flags = 0; /* no further processing required */
-	break;
-      } /* switch (*fmt) { */
+    case 'c': /* character */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
+			FLAG_COLON | TYPE_MASK);
+      fld_s->flags |= INFO_UNSIGNED | ARG_INT | TYPE_CHAR | CONV_CHAR;
+      fld_s->prec = -1;
+      break;
 
+    case 'p': /* display a pointer */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_COLON | TYPE_MASK);
+      fld_s->flags |= (FLAG_ALT | FLAG_ZERO | TYPE_POINTER | ARG_PTR |
+		       CONV_INT | INFO_UNSIGNED);
+      fld_s->prec = (SIZEOF_VOID_P * 2); /* number of characters */
+      fld_s->base = BASE_HEX;
       break;
-    } /* for (; *fmt; fmt++) { */
 
-    if (!*fmt) /* hit the end */
+    case 'n': /* write back a character count */
+      if (!buf_p) /* not known until output time */
+	return 0;
+      if (fld_s->flags & TYPE_CHAR) /* eg, %hhn */
+	*((char *)va_arg(*vp, int *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_SHORT) /* eg, %hn */
+	*((short *)va_arg(*vp, int *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_QUAD) /* eg, %qn */
+	*((int64_t *)va_arg(*vp, int64_t *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_LONG) /* eg, %ln */
+	*((long *)va_arg(*vp, long *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_INTMAX) /* eg, %jn */
+	*((_large_t *)va_arg(*vp, _large_t *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_PTRDIFF) /* eg, %tn */
+	*((ptrdiff_t *)va_arg(*vp, ptrdiff_t *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_SIZE) /* eg, %zn */
+	*((size_t *)va_arg(*vp, size_t *)) = TOTAL(buf_p);
+      else if (fld_s->flags & TYPE_TIME) /* eg, %Tn */
+	*((time_t *)va_arg(*vp, time_t *)) = TOTAL(buf_p);
+      else /* eg, %n */
+	*((int *)va_arg(*vp, int *)) = TOTAL(buf_p);
+      fld_s->flags = 0; /* no further processing required */
       break;
-    else if (!(fld_s.flags & (ARG_MASK | CONV_MASK))) /* is it done? */
-      continue;
 
-    if ((fld_s.flags & ARG_MASK) == ARG_INT) { /* grab an integer argument */
-      if (fld_s.flags & INFO_UNSIGNED) { /* go direct if unsigned */
-	if (fld_s.flags & TYPE_CHAR) /* eg, %hhu */
-	  fld_s.value.v_int = (unsigned char)va_arg(vp, unsigned int);
-	else if (fld_s.flags & TYPE_SHORT) /* eg, %hu */
-	  fld_s.value.v_int = (unsigned short)va_arg(vp, unsigned int);
-	else if (fld_s.flags & TYPE_QUAD) /* eg, %qu */
-	  fld_s.value.v_int = va_arg(vp, uint64_t);
-	else if (fld_s.flags & TYPE_LONG) /* eg, %lu */
-	  fld_s.value.v_int = va_arg(vp, unsigned long);
-	else if (fld_s.flags & TYPE_INTMAX) /* eg, %ju */
-	  fld_s.value.v_int = va_arg(vp, _large_t);
-	else if (fld_s.flags & TYPE_PTRDIFF) /* eg, %tu */
-	  fld_s.value.v_int = va_arg(vp, ptrdiff_t);
-	else if (fld_s.flags & TYPE_SIZE) /* eg, %zu */
-	  fld_s.value.v_int = va_arg(vp, size_t);
-	else if (fld_s.flags & TYPE_TIME) /* eg, %Tu */
-	  fld_s.value.v_int = va_arg(vp, time_t);
-	else if (fld_s.flags & TYPE_POINTER) /* eg, %p */
-	  fld_s.value.v_int = va_arg(vp, _pointer_t);
-	else /* eg, %u */
-	  fld_s.value.v_int = va_arg(vp, unsigned int);
-      } else {
-	_large_t signed_int; /* temp. store the signed integer */
-
-	if (fld_s.flags & TYPE_CHAR) /* eg, %hhd */
-	  signed_int = (char)va_arg(vp, unsigned int);
-	else if (fld_s.flags & TYPE_SHORT) /* eg, %hd */
-	  signed_int = (short)va_arg(vp, unsigned int);
-	else if (fld_s.flags & TYPE_QUAD) /* eg, %qd */
-	  signed_int = va_arg(vp, int64_t);
-	else if (fld_s.flags & TYPE_LONG) /* eg, %ld */
-	  signed_int = va_arg(vp, long);
-	else if (fld_s.flags & TYPE_INTMAX) /* eg, %jd */
-	  signed_int = va_arg(vp, _large_t);
-	else if (fld_s.flags & TYPE_PTRDIFF) /* eg, %td */
-	  signed_int = va_arg(vp, ptrdiff_t);
-	else if (fld_s.flags & TYPE_SIZE) /* eg, %zd */
-	  signed_int = va_arg(vp, size_t);
-	else if (fld_s.flags & TYPE_TIME) /* eg, %Td */
-	  signed_int = va_arg(vp, time_t);
-	else /* eg, %d */
-	  signed_int = va_arg(vp, int);
-
-	if (signed_int < 0) { /* Now figure out if it's negative... */
-	  fld_s.flags |= INFO_NEGATIVE;
-	  fld_s.value.v_int = -signed_int; /* negate safely (I hope) */
-	} else
-	  fld_s.value.v_int = signed_int;
-      }
-    } else if ((fld_s.flags & ARG_MASK) == ARG_FLOAT) { /* extract a float */
-      if (fld_s.flags & TYPE_LONGDOUBLE) /* eg, %Lf */
-	fld_s.value.v_float = va_arg(vp, long double);
-      else /* eg, %f */
-	fld_s.value.v_float = va_arg(vp, double);
-    } else if ((fld_s.flags & ARG_MASK) == ARG_PTR) { /* pointer argument */
-      fld_s.value.v_ptr = va_arg(vp, void *);
+    case 'm': /* write out a string describing an errno error */
+      if (!buf_p) /* not known until output time */
+	return 0;
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
+			FLAG_COLON | TYPE_MASK);
+      fld_s->flags |= CONV_STRING;
+      fld_s->value.v_ptr = (void *)strerror(errno);
+      break;
+
+    case 'v': /* here's the infamous %v... */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
+			FLAG_COLON | TYPE_MASK);
+      fld_s->flags |= ARG_PTR | CONV_VARARGS;
+      break;
+
+    case 'C': /* convert a client name... */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ZERO | TYPE_MASK);
+      fld_s->flags |= ARG_PTR | CONV_CLIENT;
+      break;
+
+    case 'H': /* convert a channel name... */
+      fld_s->flags &= ~(FLAG_PLUS | FLAG_SPACE | FLAG_ALT | FLAG_ZERO |
+			FLAG_COLON | TYPE_MASK);
+      fld_s->flags |= ARG_PTR | CONV_CHANNEL;
+      break;
+
+    default: /* Unsupported, display a message and the entire format */
+      if (!buf_p) /* leave it to be reported */
+	return 0;
+      adds(buf_p, -1, "(Unsupported: %");
+      adds(buf_p, fmt - fstart + 1, fstart);
+      addc(buf_p, ')');
+      fld_s->flags = 0; /* no further processing required */
+      break;
+    } /* switch (*fmt) { */
+
+    break;
+  } /* for (; *fmt; fmt++) { */
+
+  return fmt;
+}
+
+/** Fetch the argument for a field.
+ * @param[in,out] fld_s Description of the field; its value is set.
+ * @param[in,out] vp Argument list.
+ */
+static void
+get_arg(struct FieldData *fld_s, va_list *vp)
+{
+  if ((fld_s->flags & ARG_MASK) == ARG_INT) { /* grab an integer argument */
+    if (fld_s->flags & INFO_UNSIGNED) { /* go direct if unsigned */
+      if (fld_s->flags & TYPE_CHAR) /* eg, %hhu */
+	fld_s->value.v_int = (unsigned char)va_arg(*vp, unsigned int);
+      else if (fld_s->flags & TYPE_SHORT) /* eg, %hu */
+	fld_s->value.v_int = (unsigned short)va_arg(*vp, unsigned int);
+      else if (fld_s->flags & TYPE_QUAD) /* eg, %qu */
+	fld_s->value.v_int = va_arg(*vp, uint64_t);
+      else if (fld_s->flags & TYPE_LONG) /* eg, %lu */
+	fld_s->value.v_int = va_arg(*vp, unsigned long);
+      else if (fld_s->flags & TYPE_INTMAX) /* eg, %ju */
+	fld_s->value.v_int = va_arg(*vp, _large_t);
+      else if (fld_s->flags & TYPE_PTRDIFF) /* eg, %tu */
+	fld_s->value.v_int = va_arg(*vp, ptrdiff_t);
+      else if (fld_s->flags & TYPE_SIZE) /* eg, %zu */
+	fld_s->value.v_int = va_arg(*vp, size_t);
+      else if (fld_s->flags & TYPE_TIME) /* eg, %Tu */
+	fld_s->value.v_int = va_arg(*vp, time_t);
+      else if (fld_s->flags & TYPE_POINTER) /* eg, %p */
+	fld_s->value.v_int = va_arg(*vp, _pointer_t);
+      else /* eg, %u */
+	fld_s->value.v_int = va_arg(*vp, unsigned int);
+    } else {
+      _large_t signed_int; /* temp. store the signed integer */
+
+      if (fld_s->flags & TYPE_CHAR) /* eg, %hhd */
+	signed_int = (char)va_arg(*vp, unsigned int);
+      else if (fld_s->flags & TYPE_SHORT) /* eg, %hd */
+	signed_int = (short)va_arg(*vp, unsigned int);
+      else if (fld_s->flags & TYPE_QUAD) /* eg, %qd */
+	signed_int = va_arg(*vp, int64_t);
+      else if (fld_s->flags & TYPE_LONG) /* eg, %ld */
+	signed_int = va_arg(*vp, long);
+      else if (fld_s->flags & TYPE_INTMAX) /* eg, %jd */
+	signed_int = va_arg(*vp, _large_t);
+      else if (fld_s->flags & TYPE_PTRDIFF) /* eg, %td */
+	signed_int = va_arg(*vp, ptrdiff_t);
+      else if (fld_s->flags & TYPE_SIZE) /* eg, %zd */
+	signed_int = va_arg(*vp, size_t);
+      else if (fld_s->flags & TYPE_TIME) /* eg, %Td */
+	signed_int = va_arg(*vp, time_t);
+      else /* eg, %d */
+	signed_int = va_arg(*vp, int);
+
+      if (signed_int < 0) { /* Now figure out if it's negative... */
+	fld_s->flags |= INFO_NEGATIVE;
+	fld_s->value.v_int = -signed_int; /* negate safely (I hope) */
+      } else
+	fld_s->value.v_int = signed_int;
     }
+  } else if ((fld_s->flags & ARG_MASK) == ARG_FLOAT) { /* extract a float */
+    if (fld_s->flags & TYPE_LONGDOUBLE) /* eg, %Lf */
+      fld_s->value.v_float = va_arg(*vp, long double);
+    else /* eg, %f */
+      fld_s->value.v_float = va_arg(*vp, double);
+  } else if ((fld_s->flags & ARG_MASK) == ARG_PTR) { /* pointer argument */
+    fld_s->value.v_ptr = va_arg(*vp, void *);
+  }
+}
 
-    /* We've eaten the arguments, we have all the information we need for
-     * the conversion.  Time to actually *do* the conversion
-     */
-    if ((fld_s.flags & CONV_MASK) == CONV_INT) {
-      /* convert an integer */
-      char intbuf[INTBUF_LEN], **table = 0, *tstr;
-      int ibuf_loc = INTBUF_LEN, ilen, zlen = 0, plen = 0, elen = 0;
-
-      if (fld_s.base == BASE_OCTAL) /* select string table to use */
-	table = octal;
-      else if (fld_s.base == BASE_DECIMAL)
-	table = decimal;
-      else if (fld_s.base == BASE_HEX) { /* have to deal with upper case */
-	table = (fld_s.flags & INFO_UPPERCASE) ? HEX : hex;
-	if (fld_s.flags & FLAG_ALT)
-	  elen = 2; /* account for the length of 0x */
-      }
+static void doprintf(struct Client *dest, struct BufData *buf_p,
+		     const char *fmt, va_list vp);
 
-      if (fld_s.prec < 0) { /* default precision is 1 */
-	if ((fld_s.flags & (FLAG_MINUS | FLAG_ZERO)) == FLAG_ZERO &&
-	    fld_s.width) {
-	  fld_s.prec = fld_s.width - elen;
-	  fld_s.width = 0;
-	} else
-	  fld_s.prec = 1;
-      }
+/** Convert a field whose argument has been fetched.
+ * @param[in] dest Client to format the message.
+ * @param[in,out] buf_p Description of output buffer.
+ * @param[in,out] fld_s Description of the field.
+ */
+static void
+do_field(struct Client *dest, struct BufData *buf_p, struct FieldData *fld_s)
+{
+  if ((fld_s->flags & CONV_MASK) == CONV_INT) {
+    /* convert an integer */
+    char intbuf[INTBUF_LEN], **table = 0, *tstr;
+    int ibuf_loc = INTBUF_LEN, ilen, zlen = 0, plen = 0, elen = 0;
+
+    if (fld_s->base == BASE_OCTAL) /* select string table to use */
+      table = octal;
+    else if (fld_s->base == BASE_DECIMAL)
+      table = decimal;
+    else if (fld_s->base == BASE_HEX) { /* have to deal with upper case */
+      table = (fld_s->flags & INFO_UPPERCASE) ? HEX : hex;
+      if (fld_s->flags & FLAG_ALT)
+	elen = 2; /* account for the length of 0x */
+    }
 
-      /* If there's a sign flag, account for it */
-      if (fld_s.flags & (FLAG_PLUS | FLAG_SPACE | INFO_NEGATIVE))
-	elen++;
+    if (fld_s->prec < 0) { /* default precision is 1 */
+      if ((fld_s->flags & (FLAG_MINUS | FLAG_ZERO)) == FLAG_ZERO &&
+	  fld_s->width) {
+	fld_s->prec = fld_s->width - elen;
+	fld_s->width = 0;
+      } else
+	fld_s->prec = 1;
+    }
 
-      if (fld_s.base < 0) { /* non-binary base flagged by negative */
-	fld_s.base = -fld_s.base; /* negate it... */
+    /* If there's a sign flag, account for it */
+    if (fld_s->flags & (FLAG_PLUS | FLAG_SPACE | INFO_NEGATIVE))
+      elen++;
 
-	while (fld_s.value.v_int) { /* and convert it */
-	  tstr = table[fld_s.value.v_int % fld_s.base]; /* which string? */
-	  fld_s.value.v_int /= fld_s.base; /* next value */
+    if (fld_s->base < 0) { /* non-binary base flagged by negative */
+      fld_s->base = -fld_s->base; /* negate it... */
 
-	  ilen = 3; /* if we have to fill in zeros, here's how many */
+      while (fld_s->value.v_int) { /* and convert it */
+	tstr = table[fld_s->value.v_int % fld_s->base]; /* which string? */
+	fld_s->value.v_int /= fld_s->base; /* next value */
 
-	  while (*tstr) { /* add string to intbuf; note growing backwards */
-	    intbuf[--ibuf_loc] = *(tstr++);
-	    ilen--;
-	  }
+	ilen = 3; /* if we have to fill in zeros, here's how many */
 
-	  if (fld_s.value.v_int > 0 && ilen) /* add zeros if needed */
-	    while (ilen--)
-	      intbuf[--ibuf_loc] = '0';
+	while (*tstr) { /* add string to intbuf; note growing backwards */
+	  intbuf[--ibuf_loc] = *(tstr++);
+	  ilen--;
 	}
-      } else { /* optimize for powers of 2 */
-	while (fld_s.value.v_int) { /* which string? */
-	  tstr = table[(fld_s.value.v_int & ((1 << fld_s.base) - 1))];
-	  fld_s.value.v_int >>= fld_s.base; /* next value */
 
-	  ilen = 3; /* if we have to fill in zeros, here's how many */
+	if (fld_s->value.v_int > 0 && ilen) /* add zeros if needed */
+	  while (ilen--)
+	    intbuf[--ibuf_loc] = '0';
+      }
+    } else { /* optimize for powers of 2 */
+      while (fld_s->value.v_int) { /* which string? */
+	tstr = table[(fld_s->value.v_int & ((1 << fld_s->base) - 1))];
+	fld_s->value.v_int >>= fld_s->base; /* next value */
 
-	  while (*tstr) { /* add string to intbuf; note growing backwards */
-	    intbuf[--ibuf_loc] = *(tstr++);
-	    ilen--;
-	  }
+	ilen = 3; /* if we have to fill in zeros, here's how many */
 
-	  if (fld_s.value.v_int > 0 && ilen) /* add zeros if needed */
-	    while (ilen--)
-	      intbuf[--ibuf_loc] = '0';
+	while (*tstr) { /* add string to intbuf; note growing backwards */
+	  intbuf[--ibuf_loc] = *(tstr++);
+	  ilen--;
 	}
+
+	if (fld_s->value.v_int > 0 && ilen) /* add zeros if needed */
+	  while (ilen--)
+	    intbuf[--ibuf_loc] = '0';
       }
+    }
 
-      ilen = INTBUF_LEN - ibuf_loc; /* how many chars did we add? */
+    ilen = INTBUF_LEN - ibuf_loc; /* how many chars did we add? */
 
-      if (fld_s.prec > ilen) /* do we need any leading zeros? */
-	zlen = fld_s.prec - ilen;
+    if (fld_s->prec > ilen) /* do we need any leading zeros? */
+      zlen = fld_s->prec - ilen;
 
-      if (fld_s.base == BASE_OCTAL && zlen == 0 && fld_s.flags & FLAG_ALT)
-	zlen++; /* factor in a leading zero for %#o */
+    if (fld_s->base == BASE_OCTAL && zlen == 0 && fld_s->flags & FLAG_ALT)
+      zlen++; /* factor in a leading zero for %#o */
 
-      if (fld_s.width > ilen + zlen + elen) /* calculate space padding */
-	plen = fld_s.width - (ilen + zlen + elen);
+    if (fld_s->width > ilen + zlen + elen) /* calculate space padding */
+      plen = fld_s->width - (ilen + zlen + elen);
 
-      if (plen > 0 && !(fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* pre-padding */
+    if (plen > 0 && !(fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* pre-padding */
 
-      if (fld_s.flags & INFO_NEGATIVE) /* leading signs */
-	addc(buf_p, '-');
-      else if (fld_s.flags & FLAG_PLUS)
-	addc(buf_p, '+');
-      else if (fld_s.flags & FLAG_SPACE)
-	addc(buf_p, ' ');
+    if (fld_s->flags & INFO_NEGATIVE) /* leading signs */
+      addc(buf_p, '-');
+    else if (fld_s->flags & FLAG_PLUS)
+      addc(buf_p, '+');
+    else if (fld_s->flags & FLAG_SPACE)
+      addc(buf_p, ' ');
 
-      if ((fld_s.flags & FLAG_ALT) && fld_s.base == BASE_HEX) { /* hex 0x */
-	addc(buf_p, '0');
-	addc(buf_p, fld_s.flags & INFO_UPPERCASE ? 'X' : 'x');
-      }
+    if ((fld_s->flags & FLAG_ALT) && fld_s->base == BASE_HEX) { /* hex 0x */
+      addc(buf_p, '0');
+      addc(buf_p, fld_s->flags & INFO_UPPERCASE ? 'X' : 'x');
+    }
 
-      if (zlen > 0) /* leading zeros */
-	do_pad(buf_p, zlen, zeros);
+    if (zlen > 0) /* leading zeros */
+      do_pad(buf_p, zlen, zeros);
 
-      adds(buf_p, ilen, intbuf + ibuf_loc); /* add the integer string */
+    addn(buf_p, ilen, intbuf + ibuf_loc); /* add the integer string */
 
-      if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* post-padding */
+    if (plen > 0 &&  (fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* post-padding */
 
-      /* Don't support floating point at this time; it's too complicated */
-/*      } else if ((fld_s.flags & CONV_MASK) == CONV_FLOAT) { */
-      /* convert a float */
-    } else if ((fld_s.flags & CONV_MASK) == CONV_CHAR) {
-      if (fld_s.width > 0 && !(fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, fld_s.width - 1, spaces); /* pre-padding */
+    /* Don't support floating point at this time; it's too complicated */
+/*      } else if ((fld_s->flags & CONV_MASK) == CONV_FLOAT) { */
+    /* convert a float */
+  } else if ((fld_s->flags & CONV_MASK) == CONV_CHAR) {
+    if (fld_s->width > 0 && !(fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, fld_s->width - 1, spaces); /* pre-padding */
+
+    addc(buf_p, fld_s->value.v_int); /* add the character */
 
-      addc(buf_p, fld_s.value.v_int); /* add the character */
+    if (fld_s->width > 0 &&  (fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, fld_s->width - 1, spaces); /* post-padding */
+  } else if ((fld_s->flags & CONV_MASK) == CONV_STRING ||
+	     fld_s->value.v_ptr == 0) { /* spaces or null pointers */
+    int slen, plen;
+    char *str = (char*) fld_s->value.v_ptr;
 
-      if (fld_s.width > 0 &&  (fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, fld_s.width - 1, spaces); /* post-padding */
-    } else if ((fld_s.flags & CONV_MASK) == CONV_STRING ||
-	       fld_s.value.v_ptr == 0) { /* spaces or null pointers */
-      int slen, plen;
-      char *str = (char*) fld_s.value.v_ptr;
+    if (!str) /* NULL pointers print "(null)" */
+      str = "(null)";
 
-      if (!str) /* NULL pointers print "(null)" */
-	str = "(null)";
+    slen = my_strnlen(str, fld_s->prec); /* str lengths and pad lengths */
+    plen = (fld_s->width - slen <= 0 ? 0 : fld_s->width - slen);
 
-      slen = my_strnlen(str, fld_s.prec); /* str lengths and pad lengths */
-      plen = (fld_s.width - slen <= 0 ? 0 : fld_s.width - slen);
+    if (plen > 0 && !(fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* pre-padding */
 
-      if (plen > 0 && !(fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* pre-padding */
+    addn(buf_p, slen, str); /* add the string */
 
-      adds(buf_p, slen, str); /* add the string */
+    if (plen > 0 &&  (fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* post-padding */
+  } else if ((fld_s->flags & CONV_MASK) == CONV_VARARGS) {
+    struct BufData buf_s = BUFDATA_INIT;
+    struct VarData *vdata = (struct VarData*) fld_s->value.v_ptr;
+    int plen, tlen;
 
-      if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* post-padding */
-    } else if ((fld_s.flags & CONV_MASK) == CONV_VARARGS) {
-      struct BufData buf_s = BUFDATA_INIT;
-      struct VarData *vdata = (struct VarData*) fld_s.value.v_ptr;
-      int plen, tlen;
+    buf_s.buf = buf_p->buf + buf_p->buf_loc;
+    buf_s.buf_size = buf_p->buf_size - buf_p->buf_loc;
+    buf_s.limit = fld_s->prec;
 
-      buf_s.buf = buf_p->buf + buf_p->buf_loc;
-      buf_s.buf_size = buf_p->buf_size - buf_p->buf_loc;
-      buf_s.limit = fld_s.prec;
+    doprintf(dest, &buf_s, vdata->vd_format, vdata->vd_args);
 
-      doprintf(dest, &buf_s, vdata->vd_format, vdata->vd_args);
+    plen = (fld_s->width <= buf_s.buf_loc ? 0 :
+	    fld_s->width - buf_s.buf_loc);
 
-      plen = (fld_s.width <= buf_s.buf_loc ? 0 :
-	      fld_s.width - buf_s.buf_loc);
+    if (plen > 0) {
+      if (fld_s->flags & FLAG_MINUS) { /* left aligned... */
+	buf_p->buf_loc += buf_s.buf_loc; /* remember the modifications */
+	buf_p->buf_overflow += buf_s.buf_overflow;
+
+	do_pad(buf_p, plen, spaces); /* and do the post-padding */
+      } else { /* right aligned... */
+	/* Ok, first, see if we'll have *anything* left after padding */
+	if (plen > buf_s.buf_size) {
+	  /* nope, good, this is easy: everything overflowed buffer */
+	  do_pad(buf_p, plen, spaces);
 
-      if (plen > 0) {
-	if (fld_s.flags & FLAG_MINUS) { /* left aligned... */
-	  buf_p->buf_loc += buf_s.buf_loc; /* remember the modifications */
+	  buf_s.buf_overflow += buf_s.buf_loc; /* update buf counts */
+	  buf_s.buf_loc = 0;
 	  buf_p->buf_overflow += buf_s.buf_overflow;
+	} else {
+	  /* first figure out how much we're going to save */
+	  tlen = SNP_MIN(buf_s.buf_loc, buf_s.buf_size - plen);
+
+	  memmove(buf_s.buf + plen, buf_s.buf, tlen); /* save it... */
+	  do_pad(buf_p, plen, spaces); /* add spaces... */
 
-	  do_pad(buf_p, plen, spaces); /* and do the post-padding */
-	} else { /* right aligned... */
-	  /* Ok, first, see if we'll have *anything* left after padding */
-	  if (plen > buf_s.buf_size) {
-	    /* nope, good, this is easy: everything overflowed buffer */
-	    do_pad(buf_p, plen, spaces);
-
-	    buf_s.buf_overflow += buf_s.buf_loc; /* update buf counts */
-	    buf_s.buf_loc = 0;
-	    buf_p->buf_overflow += buf_s.buf_overflow;
-	  } else {
-	    /* first figure out how much we're going to save */
-	    tlen = SNP_MIN(buf_s.buf_loc, buf_s.buf_size - plen);
-
-	    memmove(buf_s.buf + plen, buf_s.buf, tlen); /* save it... */
-	    do_pad(buf_p, plen, spaces); /* add spaces... */
-
-	    buf_s.buf_overflow += buf_s.buf_loc - tlen; /* update buf counts */
-	    buf_s.buf_loc = tlen;
-	    buf_p->buf_overflow += buf_s.buf_overflow;
-	    buf_p->buf_loc += buf_s.buf_loc;
-	  }
+	  buf_s.buf_overflow += buf_s.buf_loc - tlen; /* update buf counts */
+	  buf_s.buf_loc = tlen;
+	  buf_p->buf_overflow += buf_s.buf_overflow;
+	  buf_p->buf_loc += buf_s.buf_loc;
 	}
-      } else {
-	buf_p->buf_loc += buf_s.buf_loc; /* no padding, but remember mods */
-	buf_p->buf_overflow += buf_s.buf_overflow;
       }
+    } else {
+      buf_p->buf_loc += buf_s.buf_loc; /* no padding, but remember mods */
+      buf_p->buf_overflow += buf_s.buf_overflow;
+    }
 
-      vdata->vd_chars = buf_s.buf_loc; /* return relevant data */
-      vdata->vd_overflow = SNP_MAX(buf_s.buf_overflow, buf_s.overflow);
-    } else if ((fld_s.flags & CONV_MASK) == CONV_CLIENT) {
-      struct Client *cptr = (struct Client*) fld_s.value.v_ptr;
-      const char *str1 = 0, *str2 = 0, *str3 = 0;
-      int slen1 = 0, slen2 = 0, slen3 = 0, elen = 0, plen = 0;
-
-      /* &me is used if it's not a definite server */
-      if (dest && (IsServer(dest) || IsMe(dest))) {
-	if (IsServer(cptr) || IsMe(cptr))
-	  str1 = cli_yxx(cptr);
-	else {
-	  str1 = cli_yxx(cli_user(cptr)->server);
-	  str2 = cli_yxx(cptr);
-	}
-	fld_s.flags &= ~(FLAG_ALT | FLAG_COLON);
-      } else {
-	str1 = *cli_name(cptr) ? cli_name(cptr) : "*";
-	if (!IsServer(cptr) && !IsMe(cptr) && fld_s.flags & FLAG_ALT) {
-	  assert(0 != cli_user(cptr));
-	  assert(0 != *(cli_name(cptr)));
-	  str2 = cli_user(cptr)->username;
-	  str3 = cli_user(cptr)->host;
-	} else
-	  fld_s.flags &= ~FLAG_ALT;
+    vdata->vd_chars = buf_s.buf_loc; /* return relevant data */
+    vdata->vd_overflow = SNP_MAX(buf_s.buf_overflow, buf_s.overflow);
+  } else if ((fld_s->flags & CONV_MASK) == CONV_CLIENT) {
+    struct Client *cptr = (struct Client*) fld_s->value.v_ptr;
+    const char *str1 = 0, *str2 = 0, *str3 = 0;
+    int slen1 = 0, slen2 = 0, slen3 = 0, elen = 0, plen = 0;
+
+    /* &me is used if it's not a definite server */
+    if (dest && (IsServer(dest) || IsMe(dest))) {
+      if (IsServer(cptr) || IsMe(cptr))
+	str1 = cli_yxx(cptr);
+      else {
+	str1 = cli_yxx(cli_user(cptr)->server);
+	str2 = cli_yxx(cptr);
       }
+      fld_s->flags &= ~(FLAG_ALT | FLAG_COLON);
+    } else {
+      str1 = *cli_name(cptr) ? cli_name(cptr) : "*";
+      if (!IsServer(cptr) && !IsMe(cptr) && fld_s->flags & FLAG_ALT) {
+	assert(0 != cli_user(cptr));
+	assert(0 != *(cli_name(cptr)));
+	str2 = cli_user(cptr)->username;
+	str3 = cli_user(cptr)->host;
+      } else
+	fld_s->flags &= ~FLAG_ALT;
+    }
+
+    if (fld_s->flags & FLAG_COLON)
+      elen++; /* account for : */
+
+    slen1 = my_strnlen(str1, fld_s->prec < 0 ? -1 : fld_s->prec - elen);
+    if (fld_s->flags & FLAG_ALT)
+      elen++; /* account for ! */
+    if (str2 && (fld_s->prec < 0 || fld_s->prec - (slen1 + elen) > 0))
+      slen2 = my_strnlen(str2, fld_s->prec < 0 ? -1 : fld_s->prec -
+			 (slen1 + elen));
+    if (fld_s->flags & FLAG_ALT)
+      elen++; /* account for @ */
+    if (str3 && (fld_s->prec < 0 || fld_s->prec - (slen1 + slen2 + elen) > 0))
+      slen3 = my_strnlen(str3, fld_s->prec < 0 ? -1 : fld_s->prec -
+			 (slen1 + slen2 + elen));
+    plen = (fld_s->width - (slen1 + slen2 + slen3 + elen) <= 0 ? 0 :
+	    fld_s->width - (slen1 + slen2 + slen3 + elen));
+
+    if (plen > 0 && !(fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* pre-padding */
+
+    if (fld_s->flags & FLAG_COLON)
+      addc(buf_p, ':');
+    addn(buf_p, slen1, str1);
+    if (fld_s->flags & FLAG_ALT)
+      addc(buf_p, '!');
+    if (str2)
+      addn(buf_p, slen2, str2);
+    if (fld_s->flags & FLAG_ALT)
+      addc(buf_p, '@');
+    if (str3)
+      addn(buf_p, slen3, str3);
+
+    if (plen > 0 &&  (fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* post-padding */
+  } else if ((fld_s->flags & CONV_MASK) == CONV_CHANNEL) {
+    struct Channel *chan = (struct Channel *)fld_s->value.v_ptr;
+    char *str = chan->chname;
+    int slen, plen;
+
+    slen = my_strnlen(str, fld_s->prec); /* str lengths and pad lengths */
+    plen = (fld_s->width - slen <= 0 ? 0 : fld_s->width - slen);
+
+    if (plen > 0 && !(fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* pre-padding */
+
+    addn(buf_p, slen, str); /* add the string */
+
+    if (plen > 0 &&  (fld_s->flags & FLAG_MINUS))
+      do_pad(buf_p, plen, spaces); /* post-padding */
+  }
+}
+
+/** Largest number of steps in a compiled format. */
+#define FORMAT_MAXOPS	64
+/** Log2 of the number of slots in the compiled format cache. */
+#define FORMAT_CACHE_BITS 11
+/** Number of slots in the compiled format cache. */
+#define FORMAT_CACHE_SIZE (1 << FORMAT_CACHE_BITS)
+
+/** One step of a compiled format: a literal run or a conversion. */
+struct FormatOp {
+  const char   *text;		/**< literal text, or NULL for a field */
+  unsigned int	len;		/**< length of literal text */
+  unsigned int	flags;		/**< flags describing argument */
+  short		base;		/**< base for integer conversions */
+  short		width;		/**< width of field */
+  short		prec;		/**< precision of field */
+};
+
+/** A format string parsed once by ircd_format_compile(). */
+struct Format {
+  const char	       *format;	/**< format string this came from */
+  unsigned int		count;	/**< number of steps */
+  struct FormatOp	ops[1];	/**< steps, in order */
+};
+
+/** Compiled formats, hashed by the address of the format string. */
+static const struct Format *format_cache[FORMAT_CACHE_SIZE];
+/** Number of entries in #format_cache. */
+static unsigned int format_count;
+
+/** Find the first cache slot to probe for a format.
+ * @param[in] fmt Format string.
+ * @return Slot index.
+ */
+static unsigned int
+format_slot(const char *fmt)
+{
+  return ((_pointer_t)fmt * 0x9e3779b97f4a7c15ull) >> (64 - FORMAT_CACHE_BITS);
+}
 
-      if (fld_s.flags & FLAG_COLON)
-	elen++; /* account for : */
-
-      slen1 = my_strnlen(str1, fld_s.prec < 0 ? -1 : fld_s.prec - elen);
-      if (fld_s.flags & FLAG_ALT)
-	elen++; /* account for ! */
-      if (str2 && (fld_s.prec < 0 || fld_s.prec - (slen1 + elen) > 0))
-	slen2 = my_strnlen(str2, fld_s.prec < 0 ? -1 : fld_s.prec -
-			   (slen1 + elen));
-      if (fld_s.flags & FLAG_ALT)
-	elen++; /* account for @ */
-      if (str3 && (fld_s.prec < 0 || fld_s.prec - (slen1 + slen2 + elen) > 0))
-	slen3 = my_strnlen(str3, fld_s.prec < 0 ? -1 : fld_s.prec -
-			   (slen1 + slen2 + elen));
-      plen = (fld_s.width - (slen1 + slen2 + slen3 + elen) <= 0 ? 0 :
-	      fld_s.width - (slen1 + slen2 + slen3 + elen));
-
-      if (plen > 0 && !(fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* pre-padding */
-
-      if (fld_s.flags & FLAG_COLON)
-	addc(buf_p, ':');
-      adds(buf_p, slen1, str1);
-      if (fld_s.flags & FLAG_ALT)
-	addc(buf_p, '!');
-      if (str2)
-	adds(buf_p, slen2, str2);
-      if (fld_s.flags & FLAG_ALT)
-	addc(buf_p, '@');
-      if (str3)
-	adds(buf_p, slen3, str3);
-
-      if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* post-padding */
-    } else if ((fld_s.flags & CONV_MASK) == CONV_CHANNEL) {
-      struct Channel *chan = (struct Channel *)fld_s.value.v_ptr;
-      char *str = chan->chname;
-      int slen, plen;
-
-      slen = my_strnlen(str, fld_s.prec); /* str lengths and pad lengths */
-      plen = (fld_s.width - slen <= 0 ? 0 : fld_s.width - slen);
-
-      if (plen > 0 && !(fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* pre-padding */
-
-      adds(buf_p, slen, str); /* add the string */
-
-      if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
-	do_pad(buf_p, plen, spaces); /* post-padding */
+/** Look up the compiled form of a format string.
+ * @param[in] fmt Format string.
+ * @return Compiled format, or NULL if \a fmt was never compiled.
+ */
+static const struct Format *
+format_find(const char *fmt)
+{
+  unsigned int slot;
+
+  if (!format_count)
+    return 0;
+  for (slot = format_slot(fmt); format_cache[slot];
+       slot = (slot + 1) & (FORMAT_CACHE_SIZE - 1))
+    if (format_cache[slot]->format == fmt)
+      return format_cache[slot];
+  return 0;
+}
+
+/** Compile a format string so later calls using it skip parsing.
+ * Formats are found again by address, not by contents, so \a format
+ * must be a string literal or a constant table entry that never
+ * changes.  Calls with other format strings are unaffected.
+ * @param[in] format Format string.
+ * @return Non-zero if \a format is compiled, or zero if it uses
+ * conversions that must be parsed on every call ('*', %n, %m) or the
+ * cache is full.
+ */
+int
+ircd_format_compile(const char *format)
+{
+  struct FormatOp ops[FORMAT_MAXOPS];
+  struct FieldData fld_s = FIELDDATA_INIT;
+  struct Format *cfmt;
+  const char *fmt, *start;
+  unsigned int count = 0, slot;
+
+  assert(0 != format);
+
+  if (format_find(format))
+    return 1;
+  if (format_count >= FORMAT_CACHE_SIZE / 2) /* keep probe chains short */
+    return 0;
+
+  for (fmt = format; *fmt; fmt++) {
+    if (count >= FORMAT_MAXOPS)
+      return 0;
+    if (*fmt != '%' || fmt[1] == '%') { /* collect a literal run */
+      start = (*fmt == '%') ? ++fmt : fmt;
+      while (fmt[1] && fmt[1] != '%')
+	fmt++;
+      ops[count].text = start;
+      ops[count++].len = fmt - start + 1;
+      continue;
     }
-  } /* for (; *fmt; fmt++) { */
+    if (!(fmt = parse_field(&fld_s, fmt + 1, 0, 0)) || !*fmt)
+      return 0;
+    ops[count].text = 0;
+    ops[count].len = 0;
+    ops[count].flags = fld_s.flags;
+    ops[count].base = fld_s.base;
+    ops[count].width = fld_s.width;
+    ops[count++].prec = fld_s.prec;
+  }
+
+  cfmt = (struct Format *)MyMalloc(sizeof(*cfmt) +
+				   sizeof(cfmt->ops[0]) * count);
+  cfmt->format = format;
+  cfmt->count = count;
+  memcpy(cfmt->ops, ops, sizeof(ops[0]) * count);
+
+  for (slot = format_slot(format); format_cache[slot];
+       slot = (slot + 1) & (FORMAT_CACHE_SIZE - 1))
+    ;
+  format_cache[slot] = cfmt;
+  format_count++;
+  return 1;
+}
+
+/** Output a compiled format.
+ * @param[in] dest Client to format the message.
+ * @param[in,out] buf_p Description of output buffer.
+ * @param[in] cfmt Compiled format.
+ * @param[in,out] vp Argument list for the format.
+ */
+static void
+do_format(struct Client *dest, struct BufData *buf_p,
+	  const struct Format *cfmt, va_list *vp)
+{
+  const struct FormatOp *op, *end = cfmt->ops + cfmt->count;
+  struct FieldData fld_s = FIELDDATA_INIT;
+
+  for (op = cfmt->ops; op < end; op++) {
+    if (op->text) { /* literal text */
+      addn(buf_p, op->len, op->text);
+      continue;
+    }
+
+    fld_s.flags = op->flags;
+    fld_s.base = op->base;
+    fld_s.width = op->width;
+    fld_s.prec = op->prec;
+    get_arg(&fld_s, vp);
+    do_field(dest, buf_p, &fld_s);
+  }
+}
+
+/** Workhorse printing function.
+ * @param[in] dest Client to format the message.
+ * @param[in,out] buf_p Description of output buffer.
+ * @param[in] fmt Message format string.
+ * @param[in] vp Variable-length argument list for format string.
+ */
+static void
+doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
+	 va_list vp)
+{
+  struct FieldData fld_s = FIELDDATA_INIT;
+  const struct Format *cfmt;
+  const char *start;
+  va_list args;
+
+  va_copy(args, vp); /* so the helpers can share our place in it */
+
+  if ((cfmt = format_find(fmt))) { /* already parsed */
+    do_format(dest, buf_p, cfmt, &args);
+    va_end(args);
+    return;
+  }
+
+  for (; *fmt; fmt++) {
+    if (*fmt != '%') { /* append a run of plain text */
+      for (start = fmt; fmt[1] && fmt[1] != '%'; fmt++)
+	;
+      addn(buf_p, fmt - start + 1, start);
+      continue;
+    }
+    if (*++fmt == '%') { /* %% is a literal % */
+      addc(buf_p, '%');
+      continue;
+    }
+
+    if (!*(fmt = parse_field(&fld_s, fmt, buf_p, &args))) /* hit the end */
+      break;
+    else if (!(fld_s.flags & (ARG_MASK | CONV_MASK))) /* is it done? */
+      continue;
+
+    get_arg(&fld_s, &args); /* grab the argument and convert it */
+    do_field(dest, buf_p, &fld_s);
+  }
+
+  va_end(args);
 }
 
 /* ircd_snprintf() has a big Doxygen comment in the header file. */
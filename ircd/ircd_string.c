@@ -178,15 +178,14 @@ NTL_HDR_strCasediff { NTL_SRC_strCasediff }
  */
 int ircd_strcmp(const char *a, const char *b)
 {
-  const char* ra = a;
-  const char* rb = b;
-  while (ToLower(*ra) == ToLower(*rb)) {
-    if (!*ra++)
+  /* Names usually match exactly, so only fold case on a mismatch. */
+  for (;; ++a, ++b) {
+    if (*a != *b) {
+      if (ToLower(*a) != ToLower(*b))
+        return (ToLower(*a) - ToLower(*b));
+    } else if (!*a)
       return 0;
-    else
-      ++rb;
   }
-  return (ToLower(*ra) - ToLower(*rb));
 }
 
 /** Case insensitive comparison of the starts of two strings.
@@ -198,18 +197,14 @@ int ircd_strcmp(const char *a, const char *b)
  */
 int ircd_strncmp(const char *a, const char *b, size_t n)
 {
-  const char* ra = a;
-  const char* rb = b;
-  int left = n;
-  if (!left--)
-    return 0;
-  while (ToLower(*ra) == ToLower(*rb)) {
-    if (!*ra++ || !left--)
-      return 0;
-    else
-      ++rb;
+  for (; n; --n, ++a, ++b) {
+    if (*a != *b) {
+      if (ToLower(*a) != ToLower(*b))
+        return (ToLower(*a) - ToLower(*b));
+    } else if (!*a)
+      break;
   }
-  return (ToLower(*ra) - ToLower(*rb));
+  return 0;
 }
 
 /** Fill a vector of distinct names from a delimited input list.
@@ -0,0 +1,754 @@
+/*
+ * IRC - Internet Relay Chat, ircd/ircd_upgrade.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Hot upgrade: restart the server without dropping its users.
+ *
+ * The upgrade file is line oriented.  Each line starts with a record
+ * type, and the last field may be prefixed by ':' to hold spaces, just
+ * like an IRC message.  Fields that may be empty are written with a
+ * leading '+'.  Channels are written before the users, and every line
+ * describing a user names it by its file descriptor.
+ *
+ * Only plaintext, registered users survive.  Servers are split off
+ * once the state is saved (they get a fresh burst when they
+ * reconnect), and TLS and WebSocket sessions carry state that cannot
+ * be handed to another process, so those users are disconnected.
+ */
+#include "config.h"
+
+#include "ircd_upgrade.h"
+#include "IPcheck.h"
+#include "channel.h"
+#include "client.h"
+#include "dbuf.h"
+#include "fileio.h"
+#include "hash.h"
+#include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_log.h"
+#include "ircd_snprintf.h"
+#include "ircd_string.h"
+#include "list.h"
+#include "listener.h"
+#include "match.h"
+#include "msg.h"
+#include "msgq.h"
+#include "numnicks.h"
+#include "querycmds.h"
+#include "s_bsd.h"
+#include "s_conf.h"
+#include "s_debug.h"
+#include "s_misc.h"
+#include "s_serv.h"
+#include "s_user.h"
+#include "send.h"
+#include "struct.h"
+#include "userload.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/** Version of the upgrade file format.  Bump this whenever a record
+ * changes meaning, or whenever the channel mode or membership bits
+ * that are saved verbatim are renumbered.
+ */
+#define UPGRADE_VERSION 1
+
+/** Longest line in the upgrade file. */
+#define UPGRADE_LINELEN 2048
+
+/** Bytes of sendQ or recvQ data per line. */
+#define UPGRADE_CHUNK 512
+
+/** Most fields in one line. */
+#define UPGRADE_MAXPARA 64
+
+/** Channel mode bits that describe the channel rather than the
+ * state of some operation on it. */
+#define UPGRADE_MODES (~(MODE_SAVE | MODE_FREE | MODE_BURSTADDED))
+
+/** Membership bits that are kept across an upgrade. */
+#define UPGRADE_CHFL (CHFL_CHANOP | CHFL_VOICE | CHFL_DEOPPED | \
+                      CHFL_SERVOPOK | CHFL_CHANNEL_MANAGER | \
+                      CHFL_DELAYED | CHFL_DELAYED_TARGET)
+
+/** Client flags kept across an upgrade, by name, so that renumbering
+ * enum Flag does not break an upgrade between versions. */
+static const struct {
+  enum Flag flag;     /**< Flag value. */
+  const char *name;   /**< Name used in the upgrade file. */
+} upgrade_flags[] = {
+  { FLAG_GOTID,              "gotid" },
+  { FLAG_EXEMPT_THROTTLE,    "exempt_throttle" },
+  { FLAG_LOCOP,              "locop" },
+  { FLAG_SERVNOTICE,         "servnotice" },
+  { FLAG_OPER,               "oper" },
+  { FLAG_SASL,               "sasl" },
+  { FLAG_INVISIBLE,          "invisible" },
+  { FLAG_WALLOP,             "wallop" },
+  { FLAG_DEAF,               "deaf" },
+  { FLAG_BLOCK_UNAUTH_USERS, "block_unauth" },
+  { FLAG_CHSERV,             "chserv" },
+  { FLAG_DEBUG,              "debug" },
+  { FLAG_ACCOUNT,            "account" },
+  { FLAG_HIDDENHOST,         "hiddenhost" },
+  { FLAG_CAP302,             "cap302" },
+  { FLAG_HIDEIDLE,           "hideidle" },
+  { FLAG_COMMONCHANS,        "commonchans" },
+  { FLAG_LAST_FLAG,          0 }
+};
+
+/** Client capabilities, by name. */
+static const struct {
+  unsigned int cap;   /**< Capability bit. */
+  const char *name;   /**< Capability name. */
+} upgrade_caps[] = {
+#define _CAP(cap, config, flags, name) { CAP_ ## cap, name }
+  CAPLIST,
+#undef _CAP
+  { 0, 0 }
+};
+
+/** One line read back from the upgrade file. */
+struct UpgradeLine {
+  struct UpgradeLine *next;   /**< Next line in the file. */
+  char text[1];               /**< Line contents, without CR or LF. */
+};
+
+/** Lines loaded by upgrade_load(), waiting for upgrade_restore(). */
+static struct UpgradeLine *upgrade_lines;
+/** Non-zero for each file descriptor that belongs to a kept user. */
+static unsigned char upgrade_fds[MAXCONNECTIONS];
+/** Non-zero if writing the upgrade file failed. */
+static int upgrade_failed;
+
+/** Decide whether a local client can survive an upgrade.
+ * @param[in] cptr Locally connected client.
+ * @return Non-zero if \a cptr will be kept.
+ */
+static int upgrade_keep(struct Client *cptr)
+{
+  return IsUser(cptr) && !IsTLS(cptr) && !IsWebsocket(cptr)
+    && cli_fd(cptr) >= 0 && cli_listener(cptr)
+    && !HasFlag(cptr, FLAG_DEADSOCKET) && !HasFlag(cptr, FLAG_KILLED);
+}
+
+/** Write one formatted line to the upgrade file.
+ * @param[in] fb Upgrade file.
+ * @param[in] pattern Format string for the line, without line ending.
+ */
+static void upgrade_printf(FBFILE *fb, const char *pattern, ...)
+{
+  char buf[UPGRADE_LINELEN];
+  struct VarData vd;
+
+  vd.vd_format = pattern;
+  va_start(vd.vd_args, pattern);
+  ircd_snprintf(0, buf, sizeof(buf) - 1, "%v", &vd);
+  va_end(vd.vd_args);
+  strcat(buf, "\n");
+  if (fbputs(buf, fb) != (int) strlen(buf))
+    upgrade_failed = 1;
+}
+
+/** Write a block of buffered data as hex, #UPGRADE_CHUNK bytes per line.
+ * @param[in] fb Upgrade file.
+ * @param[in] what Record type.
+ * @param[in] fd File descriptor of the owning client.
+ * @param[in] data Bytes to write.
+ * @param[in] length Number of bytes in \a data.
+ */
+static void upgrade_hex(FBFILE *fb, const char *what, int fd,
+                        const char *data, unsigned int length)
+{
+  static const char hexdigits[] = "0123456789abcdef";
+  char hex[UPGRADE_CHUNK * 2 + 1];
+  unsigned int count, i;
+
+  while (length > 0) {
+    count = (length > UPGRADE_CHUNK) ? UPGRADE_CHUNK : length;
+    for (i = 0; i < count; i++) {
+      hex[i * 2] = hexdigits[(unsigned char)data[i] >> 4];
+      hex[i * 2 + 1] = hexdigits[(unsigned char)data[i] & 15];
+    }
+    hex[count * 2] = '\0';
+    upgrade_printf(fb, "%s %d %s", what, fd, hex);
+    data += count;
+    length -= count;
+  }
+}
+
+/** Write a channel, its topic and its bans.
+ * @param[in] fb Upgrade file.
+ * @param[in] chptr Channel to save.
+ */
+static void upgrade_save_channel(FBFILE *fb, struct Channel *chptr)
+{
+  struct Ban *ban;
+
+  upgrade_printf(fb, "CHANNEL %s %Tu %x %u +%s +%s +%s", chptr->chname,
+                 chptr->creationtime, chptr->mode.mode & UPGRADE_MODES,
+                 chptr->mode.limit, chptr->mode.key, chptr->mode.apass,
+                 chptr->mode.upass);
+  if (*chptr->topic)
+    upgrade_printf(fb, "TOPIC %s %Tu +%s :%s", chptr->chname,
+                   chptr->topic_time, chptr->topic_nick, chptr->topic);
+  for (ban = chptr->banlist; ban; ban = ban->next)
+    upgrade_printf(fb, "BAN %s %x %Tu +%s %s", chptr->chname,
+                   ban->flags & BAN_EXCEPTION, ban->when, ban->who,
+                   ban->banstr);
+}
+
+/** Write a local user, its memberships, silences and invites.
+ * @param[in] fb Upgrade file.
+ * @param[in] cptr User to save.
+ */
+static void upgrade_save_client(FBFILE *fb, struct Client *cptr)
+{
+  struct User *user = cli_user(cptr);
+  struct Listener *listener = cli_listener(cptr);
+  struct Membership *member;
+  struct SLink *lp;
+  struct Ban *sile;
+  char buf[UPGRADE_LINELEN];
+  char ipbuf[SOCKIPLEN + 1];
+  char lipbuf[SOCKIPLEN + 1];
+  const char *name;
+  unsigned int i;
+  int fd = cli_fd(cptr);
+  int pos;
+
+  upgrade_printf(fb, "CLIENT %d %d %s %Tu %Tu %Tu %s %s %s +%s %s %s %s %s :%s",
+                 fd, listener->addr.port,
+                 ircd_ntoa_r(lipbuf, &listener->addr.addr),
+                 cli_firsttime(cptr), cli_lastnick(cptr), user->last,
+                 ircd_ntoa_r(ipbuf, &cli_ip(cptr)), cli_sock_ip(cptr),
+                 cli_name(cptr), cli_username(cptr), user->username,
+                 user->host, user->realhost, cli_sockhost(cptr),
+                 cli_info(cptr));
+
+  for (i = pos = 0; upgrade_flags[i].name; i++)
+    if (HasFlag(cptr, upgrade_flags[i].flag))
+      pos += ircd_snprintf(0, buf + pos, sizeof(buf) - pos, " %s",
+                           upgrade_flags[i].name);
+  if (pos)
+    upgrade_printf(fb, "FLAGS %d%s", fd, buf);
+
+  for (i = pos = 0; i < PRIV_LAST_PRIV; i++)
+    if (HasPriv(cptr, i) && (name = client_priv_name(i)))
+      pos += ircd_snprintf(0, buf + pos, sizeof(buf) - pos, " %s", name);
+  if (pos)
+    upgrade_printf(fb, "PRIVS %d%s", fd, buf);
+
+  for (i = pos = 0; upgrade_caps[i].name; i++) {
+    if (CapHas(cli_capab(cptr), upgrade_caps[i].cap))
+      pos += ircd_snprintf(0, buf + pos, sizeof(buf) - pos, " %s",
+                           upgrade_caps[i].name);
+    if (CapHas(cli_active(cptr), upgrade_caps[i].cap))
+      pos += ircd_snprintf(0, buf + pos, sizeof(buf) - pos, " !%s",
+                           upgrade_caps[i].name);
+  }
+  if (pos)
+    upgrade_printf(fb, "CAPS %d%s", fd, buf);
+
+  if (cli_snomask(cptr))
+    upgrade_printf(fb, "SNOMASK %d %u", fd, cli_snomask(cptr));
+  if (*user->account)
+    upgrade_printf(fb, "ACCOUNT %d %s %qu %qu", fd, user->account,
+                   user->acc_id, user->acc_flags);
+  if (user->away)
+    upgrade_printf(fb, "AWAY %d :%s", fd, user->away);
+  for (lp = cli_confs(cptr); lp; lp = lp->next)
+    if (lp->value.aconf->status & CONF_OPERATOR)
+      upgrade_printf(fb, "OPER %d %s", fd, lp->value.aconf->name);
+
+  for (member = user->channel; member; member = member->next_channel)
+    if (!IsZombie(member))
+      upgrade_printf(fb, "MEMBER %d %s %x %u", fd, member->channel->chname,
+                     member->status & UPGRADE_CHFL, OpLevel(member));
+  for (sile = user->silence; sile; sile = sile->next)
+    upgrade_printf(fb, "SILENCE %d %x %s", fd,
+                   sile->flags & BAN_EXCEPTION, sile->banstr);
+  for (lp = user->invited; lp; lp = lp->next)
+    upgrade_printf(fb, "INVITE %d %s", fd, lp->value.chptr->chname);
+}
+
+/** Write the data queued for and from a local user.
+ * Empties the user's sendQ and recvQ.
+ * @param[in] fb Upgrade file.
+ * @param[in] cptr User to save.
+ */
+static void upgrade_save_queues(FBFILE *fb, struct Client *cptr)
+{
+  struct iovec iov[64];
+  char buf[UPGRADE_CHUNK];
+  unsigned int length, count, i;
+  int fd = cli_fd(cptr);
+
+  while (MsgQLength(&cli_sendQ(cptr))) {
+    count = msgq_mapiov(&cli_sendQ(cptr), iov, 64, &length);
+    for (i = 0; i < count; i++)
+      upgrade_hex(fb, "SENDQ", fd, iov[i].iov_base, iov[i].iov_len);
+    msgq_delete(&cli_sendQ(cptr), length);
+  }
+  client_drop_sendq(cli_connect(cptr));
+  while ((length = dbuf_get(&cli_recvQ(cptr), buf, UPGRADE_CHUNK)))
+    upgrade_hex(fb, "RECVQ", fd, buf, length);
+}
+
+/** Save the state of local users for a hot upgrade.
+ * Once that state is safely on disk, every local client that cannot
+ * be kept is disconnected and every server link is closed.  The data
+ * still queued for the kept users, including the quits this causes,
+ * is appended last.  The sockets of the kept users are kept out of
+ * close_connections() from here on.
+ *
+ * The file holds channel keys, so it is only readable by its owner.
+ * @param[in] path Name of the upgrade file.
+ * @return Zero on success, -1 if the file could not be written; in
+ *   that case no client has been disconnected.
+ */
+int upgrade_save(const char *path)
+{
+  struct Client *acptr;
+  struct Channel *chptr;
+  char tmppath[PATH_MAX];
+  FBFILE *fb;
+  int i;
+
+  upgrade_failed = 0;
+  ircd_snprintf(0, tmppath, sizeof(tmppath), "%s.tmp", path);
+  /* fbopen() creates files with mode 0600, but keeps the mode of one
+   * that already exists. */
+  unlink(tmppath);
+  if (!(fb = fbopen(tmppath, "w"))) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to write upgrade file %s: %m",
+              tmppath);
+    return -1;
+  }
+
+  upgrade_printf(fb, "UPGRADE %d %s %Tu", UPGRADE_VERSION, cli_name(&me),
+                 TStime());
+  for (chptr = GlobalChannelList; chptr; chptr = chptr->next)
+    if (chptr->members)
+      upgrade_save_channel(fb, chptr);
+  for (i = 0; i <= HighestFd; ++i) {
+    if (!(acptr = LocalClientArray[i]) || !upgrade_keep(acptr))
+      continue;
+    upgrade_save_client(fb, acptr);
+    upgrade_fds[i] = 1;
+  }
+
+  fbclose(fb);
+  if (upgrade_failed || rename(tmppath, path)) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to write upgrade file %s: %m",
+              path);
+    unlink(tmppath);
+    memset(upgrade_fds, 0, sizeof(upgrade_fds));
+    return -1;
+  }
+
+  for (i = HighestFd; i >= 0; --i) {
+    if (!(acptr = LocalClientArray[i]) || upgrade_fds[i])
+      continue;
+    if (IsUser(acptr))
+      sendcmdto_one(&me, CMD_NOTICE, acptr, "%C :*** Server upgrading; "
+                    "your connection cannot be kept", acptr);
+    exit_client(acptr, acptr, &me, "Server upgrading");
+  }
+
+  for (i = 0; i <= HighestFd; ++i)
+    if ((acptr = LocalClientArray[i]))
+      sendcmdto_one(&me, CMD_NOTICE, acptr, "%C :*** Server upgrading; "
+                    "please stand by", acptr);
+  flush_connections(0);
+
+  /* The kept users are committed to by now, so a failure here only
+   * loses what was still queued for them. */
+  if (!(fb = fbopen(path, "a"))) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to save queued data to %s: %m",
+              path);
+    return 0;
+  }
+  for (i = 0; i <= HighestFd; ++i)
+    if (upgrade_fds[i] && (acptr = LocalClientArray[i]))
+      upgrade_save_queues(fb, acptr);
+  upgrade_printf(fb, "END");
+  fbclose(fb);
+  if (upgrade_failed)
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to save queued data to %s: %m",
+              path);
+  return 0;
+}
+
+/** Split an upgrade file line into fields.
+ * @param[in,out] line Line to split; modified in place.
+ * @param[out] parv Receives the fields.
+ * @return Number of fields.
+ */
+static int upgrade_split(char *line, char *parv[])
+{
+  int parc = 0;
+
+  while (*line && parc < UPGRADE_MAXPARA) {
+    while (*line == ' ')
+      *line++ = '\0';
+    if (!*line)
+      break;
+    if (*line == ':') {
+      parv[parc++] = line + 1;
+      break;
+    }
+    parv[parc++] = line;
+    while (*line && *line != ' ')
+      line++;
+  }
+  return parc;
+}
+
+/** Read the upgrade file written by the process that exec()ed us.
+ * The file is removed once it has been read, so that a later restart
+ * does not find stale state.
+ * @param[in] path Name of the upgrade file.
+ * @return Number of user connections inherited.
+ */
+int upgrade_load(const char *path)
+{
+  struct UpgradeLine **tail = &upgrade_lines;
+  struct UpgradeLine *line;
+  char buf[UPGRADE_LINELEN];
+  char *parv[UPGRADE_MAXPARA];
+  char *end;
+  FBFILE *fb;
+  int count = 0;
+  int fd;
+
+  if (!(fb = fbopen(path, "r")))
+    return 0;
+  unlink(path);
+
+  while (fbgets(buf, sizeof(buf), fb)) {
+    if ((end = strchr(buf, '\n')))
+      *end = '\0';
+    line = (struct UpgradeLine*) MyMalloc(sizeof(*line) + strlen(buf));
+    strcpy(line->text, buf);
+    line->next = 0;
+    *tail = line;
+    tail = &line->next;
+
+    if (!strncmp(buf, "CLIENT ", 7) && upgrade_split(buf, parv) > 1) {
+      fd = atoi(parv[1]);
+      if (fd >= 0 && fd < MAXCONNECTIONS) {
+        upgrade_fds[fd] = 1;
+        count++;
+      }
+    }
+  }
+  fbclose(fb);
+  return count;
+}
+
+/** Report whether a file descriptor belongs to a user kept across a
+ * hot upgrade.
+ * @param[in] fd File descriptor.
+ * @return Non-zero if \a fd must stay open.
+ */
+int upgrade_inherited(int fd)
+{
+  return fd >= 0 && fd < MAXCONNECTIONS && upgrade_fds[fd];
+}
+
+/** Rebuild a user from a CLIENT line.
+ * @param[in] parc Number of fields.
+ * @param[in] parv Fields of the line.
+ * @return The restored user, or NULL if it could not be kept.
+ */
+static struct Client *upgrade_client(int parc, char *parv[])
+{
+  struct Listener *listener;
+  struct irc_in_addr addr;
+  struct Client *cptr;
+  struct User *user;
+  time_t next_target = 0;
+  int fd;
+
+  if (parc < 16)
+    return 0;
+  fd = atoi(parv[1]);
+  if (!upgrade_inherited(fd))
+    return 0;
+  if (!ircd_aton(&addr, parv[3])
+      || !(listener = find_listener(atoi(parv[2]), &addr))
+      || !listener_active(listener) || listener_tls(listener)
+      || listener_websocket(listener)) {
+    close(fd);
+    return 0;
+  }
+  if (!(cptr = adopt_connection(listener, fd)))
+    return 0;
+
+  cli_firsttime(cptr) = atoi(parv[4]);
+  cli_lastnick(cptr) = atoi(parv[5]);
+  ircd_aton(&cli_ip(cptr), parv[7]);
+  ircd_strncpy(cli_sock_ip(cptr), parv[8], SOCKIPLEN);
+  ircd_strncpy(cli_name(cptr), parv[9], NICKLEN);
+  ircd_strncpy(cli_username(cptr), parv[10] + 1, USERLEN);
+  ircd_strncpy(cli_sockhost(cptr), parv[14], HOSTLEN);
+  ircd_strncpy(cli_info(cptr), parv[15], REALLEN);
+
+  user = cli_user(cptr) = make_user(cptr);
+  user->server = &me;
+  user->last = atoi(parv[6]);
+  ircd_strncpy(user->username, parv[11], USERLEN);
+  ircd_strncpy(user->host, parv[12], HOSTLEN);
+  ircd_strncpy(user->realhost, parv[13], HOSTLEN);
+
+  if (IPcheck_local_connect(&cli_ip(cptr), &next_target))
+    SetIPChecked(cptr);
+  if (next_target)
+    cli_nexttarget(cptr) = next_target;
+
+  add_client_to_list(cptr);
+  hAddClient(cptr);
+  Count_unknownbecomesclient(cptr, UserStats);
+  SetUser(cptr);
+  cli_handler(cptr) = CLIENT_HANDLER;
+  SetLocalNumNick(cptr);
+  cli_announced(cptr) = client_serial_next();
+
+  if (conf_check_client(cptr) != ACR_OK) {
+    exit_client(cptr, cptr, &me, "No longer authorized");
+    return 0;
+  }
+  return cptr;
+}
+
+/** Apply one line describing a kept user.
+ * @param[in] cptr User the line describes.
+ * @param[in] parc Number of fields.
+ * @param[in] parv Fields of the line.
+ */
+static void upgrade_client_data(struct Client *cptr, int parc, char *parv[])
+{
+  struct User *user = cli_user(cptr);
+  struct ConfItem *aconf;
+  struct Channel *chptr;
+  struct Ban *sile, **tail;
+  struct MsgBuf *mb;
+  char buf[UPGRADE_CHUNK];
+  unsigned int length;
+  int i, j;
+
+  if (!strcmp(parv[0], "FLAGS")) {
+    for (i = 2; i < parc; i++)
+      for (j = 0; upgrade_flags[j].name; j++)
+        if (!strcmp(parv[i], upgrade_flags[j].name))
+          SetFlag(cptr, upgrade_flags[j].flag);
+    if (IsInvisible(cptr))
+      ++UserStats.inv_clients;
+    if (IsOper(cptr))
+      ++UserStats.opers;
+    if (IsAnOper(cptr))
+      cli_handler(cptr) = OPER_HANDLER;
+  } else if (!strcmp(parv[0], "PRIVS")) {
+    for (i = 2; i < parc; i++)
+      if ((j = client_priv_find(parv[i])) >= 0)
+        SetPriv(cptr, j);
+  } else if (!strcmp(parv[0], "CAPS")) {
+    for (i = 2; i < parc; i++)
+      for (j = 0; upgrade_caps[j].name; j++) {
+        if (!strcmp(parv[i], upgrade_caps[j].name))
+          CapSet(cli_capab(cptr), upgrade_caps[j].cap);
+        else if (parv[i][0] == '!'
+                 && !strcmp(parv[i] + 1, upgrade_caps[j].name))
+          CapSet(cli_active(cptr), upgrade_caps[j].cap);
+      }
+  } else if (!strcmp(parv[0], "SNOMASK") && parc > 2) {
+    set_snomask(cptr, strtoul(parv[2], 0, 10), SNO_SET);
+  } else if (!strcmp(parv[0], "ACCOUNT") && parc > 4) {
+    ircd_strncpy(user->account, parv[2], ACCOUNTLEN);
+    user->acc_id = strtoull(parv[3], 0, 10);
+    user->acc_flags = strtoull(parv[4], 0, 10);
+  } else if (!strcmp(parv[0], "AWAY") && parc > 2) {
+    if (user->away)
+      MyFree(user->away);
+    DupString(user->away, parv[2]);
+  } else if (!strcmp(parv[0], "OPER") && parc > 2) {
+    aconf = find_conf_exact(parv[2], cptr, CONF_OPERATOR);
+    if (aconf && attach_conf(cptr, aconf) == ACR_OK) {
+      /* Pick the sendq and flood limit up from the oper's class. */
+      cli_max_sendq(cptr) = 0;
+      cli_max_flood(cptr) = 0;
+    }
+  } else if (!strcmp(parv[0], "SILENCE") && parc > 3) {
+    /* Keep the silences in the order they were set. */
+    for (tail = &user->silence; *tail; tail = &(*tail)->next)
+      ;
+    sile = make_ban(parv[3]);
+    sile->flags |= strtoul(parv[2], 0, 16) & BAN_EXCEPTION;
+    sile->next = 0;
+    *tail = sile;
+  } else if (!strcmp(parv[0], "INVITE") && parc > 2) {
+    if ((chptr = FindChannel(parv[2])))
+      add_invite(cptr, chptr);
+  } else if (!strcmp(parv[0], "MEMBER") && parc > 4) {
+    if ((chptr = FindChannel(parv[2])) && !find_member_link(chptr, cptr))
+      add_user_to_channel(chptr, cptr, strtoul(parv[3], 0, 16),
+                          atoi(parv[4]));
+  } else if ((!strcmp(parv[0], "SENDQ") || !strcmp(parv[0], "RECVQ"))
+             && parc > 2) {
+    for (length = 0; length < sizeof(buf) && parv[2][length * 2]
+           && parv[2][length * 2 + 1]; length++) {
+      char hex[3] = { parv[2][length * 2], parv[2][length * 2 + 1], '\0' };
+      buf[length] = (char) strtoul(hex, 0, 16);
+    }
+    if (parv[0][0] == 'R')
+      dbuf_put(&cli_recvQ(cptr), buf, length);
+    else {
+      mb = msgq_raw_alloc(cptr, length);
+      memcpy(mb->msg, buf, length);
+      mb->length = length;
+      msgq_add(&cli_sendQ(cptr), mb, 0);
+      msgq_clean(mb);
+    }
+  }
+}
+
+/** Rebuild a channel from a CHANNEL line.
+ * @param[in] parc Number of fields.
+ * @param[in] parv Fields of the line.
+ */
+static void upgrade_channel(int parc, char *parv[])
+{
+  struct Channel *chptr;
+
+  if (parc < 8 || !(chptr = get_channel(&me, parv[1], CGT_CREATE)))
+    return;
+  chptr->creationtime = atoi(parv[2]);
+  chptr->mode.mode = strtoul(parv[3], 0, 16) & UPGRADE_MODES;
+  chptr->mode.limit = strtoul(parv[4], 0, 10);
+  ircd_strncpy(chptr->mode.key, parv[5] + 1, KEYLEN);
+  ircd_strncpy(chptr->mode.apass, parv[6] + 1, KEYLEN);
+  ircd_strncpy(chptr->mode.upass, parv[7] + 1, KEYLEN);
+}
+
+/** Apply a TOPIC or BAN line to a restored channel.
+ * @param[in] parc Number of fields.
+ * @param[in] parv Fields of the line.
+ */
+static void upgrade_channel_data(int parc, char *parv[])
+{
+  struct Channel *chptr;
+  struct Ban *ban, **tail;
+
+  if (parc < 5 || !(chptr = FindChannel(parv[1])))
+    return;
+  if (!strcmp(parv[0], "TOPIC")) {
+    chptr->topic_time = atoi(parv[2]);
+    ircd_strncpy(chptr->topic_nick, parv[3] + 1, NICKLEN);
+    ircd_strncpy(chptr->topic, parv[4], TOPICLEN);
+  } else if (parc > 5) {
+    /* Keep the bans in the order they were set. */
+    for (tail = &chptr->banlist; *tail; tail = &(*tail)->next)
+      ;
+    ban = make_ban(parv[5]);
+    ban->flags |= strtoul(parv[2], 0, 16) & BAN_EXCEPTION;
+    ban->when = atoi(parv[3]);
+    ircd_strncpy(ban->who, parv[4] + 1, NICKLEN);
+    ban->next = 0;
+    *tail = ban;
+  }
+}
+
+/** Rebuild the users and channels loaded by upgrade_load().
+ * Must be called once our own server structure is set up, and before
+ * the event loop starts.
+ */
+void upgrade_restore(void)
+{
+  struct UpgradeLine *line;
+  struct Client *cptr;
+  struct Channel *chptr, *next;
+  char *parv[UPGRADE_MAXPARA];
+  int parc;
+  int count = 0;
+  int fd;
+
+  if (!upgrade_lines)
+    return;
+
+  line = upgrade_lines;
+  parc = upgrade_split(line->text, parv);
+  if (parc < 2 || strcmp(parv[0], "UPGRADE")
+      || atoi(parv[1]) != UPGRADE_VERSION) {
+    log_write(LS_SYSTEM, L_CRIT, 0, "Upgrade file has an unknown format; "
+              "dropping inherited connections");
+    line = 0;
+  }
+
+  for (; line; line = line->next) {
+    parc = upgrade_split(line->text, parv);
+    if (parc < 2)
+      continue;
+    if (!strcmp(parv[0], "CHANNEL"))
+      upgrade_channel(parc, parv);
+    else if (!strcmp(parv[0], "TOPIC") || !strcmp(parv[0], "BAN"))
+      upgrade_channel_data(parc, parv);
+    else if (!strcmp(parv[0], "CLIENT")) {
+      if (upgrade_client(parc, parv))
+        count++;
+    } else if ((fd = atoi(parv[1])) >= 0 && fd < MAXCONNECTIONS
+               && (cptr = LocalClientArray[fd]) && IsUser(cptr))
+      upgrade_client_data(cptr, parc, parv);
+  }
+
+  for (line = upgrade_lines; line; line = upgrade_lines) {
+    upgrade_lines = line->next;
+    MyFree(line);
+  }
+
+  /* Close whatever was inherited but not adopted. */
+  for (fd = 0; fd < MAXCONNECTIONS; fd++) {
+    if (upgrade_fds[fd] && !LocalClientArray[fd])
+      close(fd);
+    upgrade_fds[fd] = 0;
+  }
+
+  for (chptr = GlobalChannelList; chptr; chptr = next) {
+    next = chptr->next;
+    if (!chptr->members)
+      destruct_channel(chptr);
+  }
+
+  for (fd = 0; fd <= HighestFd; fd++) {
+    if (!(cptr = LocalClientArray[fd]))
+      continue;
+    update_write(cptr);
+    schedule_recvq(cptr);
+    sendcmdto_one(&me, CMD_NOTICE, cptr, "%C :*** Server upgrade complete",
+                  cptr);
+  }
+
+  log_write(LS_SYSTEM, L_NOTICE, 0, "Upgrade kept %d client connections",
+            count);
+}
@@ -0,0 +1,305 @@
+/*
+ * IRC - Internet Relay Chat, ircd/ircd_zip.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Stream compression for server links.
+ */
+#include "config.h"
+
+#include "ircd_zip.h"
+#include "client.h"
+#include "ircd_alloc.h"
+#include "ircd_log.h"
+#include "msgq.h"
+#include "s_debug.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <string.h>
+#include <time.h>
+
+#ifdef USE_ZLIB
+
+#include <zlib.h>
+
+/** Size of the message buffers compressed output is written into. */
+#define ZIP_CHUNK 4096
+
+/** Compression state for one server link. */
+struct ZipState {
+  z_stream out;            /**< Deflate stream towards the peer. */
+  z_stream in;             /**< Inflate stream from the peer. */
+  int pending;             /**< Non-zero if deflate holds unflushed input. */
+  struct ZipStats stats;   /**< Byte and time counters. */
+};
+
+/** Read a monotonic clock for the zlib time counter.
+ * @return Current time in nanoseconds.
+ */
+static uint64_t zip_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Report whether this server was built with link compression.
+ * @return Non-zero if compressed links can be negotiated.
+ */
+int zip_supported(void)
+{
+  return 1;
+}
+
+/** Start compressing a server link in both directions.
+ * Everything queued for \a cptr after this call is compressed, and
+ * everything received from it is expected to be compressed.
+ * @param[in] cptr Locally connected server.
+ * @return Zero on success, -1 if zlib could not be initialized.
+ */
+int zip_start(struct Client *cptr)
+{
+  struct ZipState *zs;
+
+  assert(0 != cli_connect(cptr));
+  assert(0 == cli_zip(cptr));
+
+  zs = (struct ZipState*) MyCalloc(1, sizeof(struct ZipState));
+  if (deflateInit(&zs->out, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    MyFree(zs);
+    return -1;
+  }
+  if (inflateInit(&zs->in) != Z_OK) {
+    deflateEnd(&zs->out);
+    MyFree(zs);
+    return -1;
+  }
+  cli_zip(cptr) = zs;
+  Debug((DEBUG_INFO, "Compressing link to %s", cli_name(cptr)));
+  return 0;
+}
+
+/** Release the compression state of a link.
+ * @param[in] cptr Locally connected server.
+ */
+void zip_free(struct Client *cptr)
+{
+  struct ZipState *zs = cli_zip(cptr);
+
+  if (!zs)
+    return;
+  deflateEnd(&zs->out);
+  inflateEnd(&zs->in);
+  MyFree(zs);
+  cli_zip(cptr) = NULL;
+}
+
+/** Run the deflate stream and queue whatever it produces.
+ * The output is appended to the link's sendQ at normal priority;
+ * compressed data must never be reordered.
+ * @param[in] cptr Locally connected server.
+ * @param[in] zs Compression state of \a cptr.
+ * @param[in] flush zlib flush mode.
+ * @return Zero on success, -1 on a zlib error.
+ */
+static int zip_deflate(struct Client *cptr, struct ZipState *zs, int flush)
+{
+  struct MsgBuf *mb;
+  int res;
+
+  do {
+    mb = msgq_raw_alloc(cptr, ZIP_CHUNK);
+    zs->out.next_out = (Bytef*) mb->msg;
+    zs->out.avail_out = ZIP_CHUNK;
+    res = deflate(&zs->out, flush);
+    mb->length = ZIP_CHUNK - zs->out.avail_out;
+    if (mb->length) {
+      msgq_add(&(cli_sendQ(cptr)), mb, 0);
+      zs->stats.zip_out += mb->length;
+    }
+    msgq_clean(mb);
+    if (res != Z_OK && res != Z_BUF_ERROR)
+      return -1;
+  } while (zs->out.avail_out == 0);
+
+  return 0;
+}
+
+/** Compress a message onto a link's sendQ.
+ * The compressor may keep the data until the next zip_flush().
+ * @param[in] cptr Locally connected server.
+ * @param[in] mb Message to send.
+ * @return Zero on success, -1 on a zlib error.
+ */
+int zip_send(struct Client *cptr, struct MsgBuf *mb)
+{
+  struct ZipState *zs = cli_zip(cptr);
+  uint64_t start;
+  int res;
+
+  assert(0 != zs);
+
+  start = zip_clock();
+  zs->out.next_in = (Bytef*) mb->msg;
+  zs->out.avail_in = mb->length;
+  zs->stats.raw_out += mb->length;
+  res = zip_deflate(cptr, zs, Z_NO_FLUSH);
+  zs->pending = 1;
+  zs->stats.nsec += zip_clock() - start;
+  return res;
+}
+
+/** Push everything held by the compressor onto the link's sendQ.
+ * Uses a sync flush, so the peer can decode every complete line it
+ * has received.
+ * @param[in] cptr Locally connected server.
+ * @return Zero on success, -1 on a zlib error.
+ */
+int zip_flush(struct Client *cptr)
+{
+  struct ZipState *zs = cli_zip(cptr);
+  uint64_t start;
+  int res;
+
+  if (!zs || !zs->pending)
+    return 0;
+  start = zip_clock();
+  res = zip_deflate(cptr, zs, Z_SYNC_FLUSH);
+  zs->pending = 0;
+  zs->stats.nsec += zip_clock() - start;
+  return res;
+}
+
+/** Check whether the compressor holds data that is not yet queued.
+ * @param[in] cptr Locally connected client.
+ * @return Non-zero if zip_flush() would queue more data.
+ */
+int zip_pending(struct Client *cptr)
+{
+  return cli_zip(cptr) && cli_zip(cptr)->pending;
+}
+
+/** Hand data received from a compressed link to the decompressor.
+ * The caller then collects the output with zip_inflate().
+ * @param[in] cptr Locally connected server.
+ * @param[in] buf Compressed data; must stay valid until drained.
+ * @param[in] length Number of bytes in \a buf.
+ */
+void zip_input(struct Client *cptr, const char *buf, unsigned int length)
+{
+  struct ZipState *zs = cli_zip(cptr);
+
+  assert(0 != zs);
+
+  /* The line that started compression ended in CR LF, but it was
+   * parsed at the CR; drop whatever is left of the line ending.
+   */
+  if (zs->in.total_in == 0)
+    while (length > 0 && (*buf == '\r' || *buf == '\n')) {
+      buf++;
+      length--;
+    }
+  zs->in.next_in = (Bytef*) buf;
+  zs->in.avail_in = length;
+  zs->stats.zip_in += length;
+}
+
+/** Decompress data passed to zip_input().
+ * Call repeatedly until it returns zero.
+ * @param[in] cptr Locally connected server.
+ * @param[out] buf Buffer for decompressed data.
+ * @param[in] size Length of \a buf.
+ * @return Number of bytes stored in \a buf, or -1 if the peer sent
+ *   a corrupt stream.
+ */
+int zip_inflate(struct Client *cptr, char *buf, unsigned int size)
+{
+  struct ZipState *zs = cli_zip(cptr);
+  uint64_t start;
+  unsigned int count;
+  int res;
+
+  assert(0 != zs);
+
+  start = zip_clock();
+  zs->in.next_out = (Bytef*) buf;
+  zs->in.avail_out = size;
+  res = inflate(&zs->in, Z_SYNC_FLUSH);
+  zs->stats.nsec += zip_clock() - start;
+  /* Neither end ever finishes its stream, so Z_STREAM_END is an error. */
+  if (res != Z_OK && res != Z_BUF_ERROR)
+    return -1;
+  count = size - zs->in.avail_out;
+  zs->stats.raw_in += count;
+  return count;
+}
+
+/** Get the counters for a compressed link.
+ * @param[in] cptr Locally connected client.
+ * @return Counters for \a cptr, or NULL if its link is not compressed.
+ */
+const struct ZipStats *zip_stats(struct Client *cptr)
+{
+  return cli_zip(cptr) ? &cli_zip(cptr)->stats : NULL;
+}
+
+#else /* !USE_ZLIB */
+
+int zip_supported(void)
+{
+  return 0;
+}
+
+int zip_start(struct Client *cptr)
+{
+  return -1;
+}
+
+void zip_free(struct Client *cptr)
+{
+}
+
+int zip_send(struct Client *cptr, struct MsgBuf *mb)
+{
+  return -1;
+}
+
+int zip_flush(struct Client *cptr)
+{
+  return 0;
+}
+
+int zip_pending(struct Client *cptr)
+{
+  return 0;
+}
+
+void zip_input(struct Client *cptr, const char *buf, unsigned int length)
+{
+}
+
+int zip_inflate(struct Client *cptr, char *buf, unsigned int size)
+{
+  return -1;
+}
+
+const struct ZipStats *zip_stats(struct Client *cptr)
+{
+  return NULL;
+}
+
+#endif /* USE_ZLIB */
@@ -40,6 +40,7 @@
 #include "s_conf.h"
 #include "s_debug.h"
 #include "s_misc.h"
+#include "s_serv.h"
 #include "s_user.h"
 #include "send.h"
 #include "struct.h"
@@ -66,6 +67,9 @@ static struct Connection* connectionFreeList;
 /** Linked list of currently unused SLink structures. */
 static struct SLink* slinkFreeList;
 
+/** Most recently assigned client serial number. */
+static uint64_t clientSerial;
+
 /** Initialize the list manipulation support system.
  * Pre-allocate MAXCONNECTIONS Client and Connection structures.
  */
@@ -336,6 +340,9 @@ void remove_client_from_list(struct Client *cptr)
   assert(!cli_next(cptr) || cli_verify(cli_next(cptr)));
   assert(!IsMe(cptr));
 
+  /* Move any outgoing burst positioned on this client past it. */
+  burst_client_removed(cptr);
+
   /* Only try remove cptr from the list if it IS in the list.
    * cli_next(cptr) cannot be NULL here, as &me is always the end
    * the list, and we never remove &me.    -GW 
@@ -395,6 +402,17 @@ void add_client_to_list(struct Client *cptr)
   GlobalClientList = cptr;
   if (cli_next(cptr))
     cli_prev(cli_next(cptr)) = cptr;
+  cli_maskserial(cptr) = cli_serial(cptr) = client_serial_next();
+}
+
+/** Allocate a new client serial number.
+ * Serial numbers increase monotonically, so comparing them tells
+ * which of two events happened first.
+ * @return A serial number larger than any previously returned.
+ */
+uint64_t client_serial_next(void)
+{
+  return ++clientSerial;
 }
 
 #if 0
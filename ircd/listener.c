@@ -29,6 +29,7 @@
 #include "ircd_events.h"
 #include "ircd_features.h"
 #include "ircd_log.h"
+#include "ircd_metrics.h"
 #include "ircd_osdep.h"
 #include "ircd_reply.h"
 #include "ircd_snprintf.h"
@@ -156,7 +157,7 @@ void show_ports(struct Client* sptr, const struct StatDesc* sd,
                 char* param)
 {
   struct Listener *listener = 0;
-  char flags[8];
+  char flags[16];
   int show_hidden = IsOper(sptr);
   int count = (IsOper(sptr) || MyUser(sptr)) ? 100 : 8;
   int port = 0;
@@ -174,6 +175,7 @@ void show_ports(struct Client* sptr, const struct StatDesc* sd,
     flags[len++] = listener_server(listener) ? 'S'
         : listener_webirc(listener) ? 'W'
         : listener_websocket(listener) ? 'B'
+        : listener_metrics(listener) ? 'M'
         : 'C';
     if (FlagHas(&listener->flags, LISTEN_HIDDEN))
     {
@@ -299,7 +301,7 @@ static int inetport(struct Listener* listener, int family)
  * @param[in] addr Local address to search for.
  * @return Listener that matches (or NULL if none match).
  */
-static struct Listener* find_listener(int port, const struct irc_in_addr *addr)
+struct Listener* find_listener(int port, const struct irc_in_addr *addr)
 {
   struct Listener* listener;
   for (listener = ListenerPollList; listener; listener = listener->next) {
@@ -604,6 +606,12 @@ static void accept_connection(struct Event* ev)
       goto reject;
     }
 
+    if (listener_metrics(listener))
+    {
+      metrics_accept(listener, fd, &addr);
+      continue;
+    }
+
     ++ServerStats->is_ac;
     add_connection(listener, fd);
   }
@@ -106,6 +106,84 @@
 #include <string.h>
 #include <ctype.h>
 
+/** Bans already on a channel, hashed by mask without regard to case,
+ * so that ms_burst() can spot exact duplicates without a list walk. */
+struct BurstBans {
+  unsigned int mask;    /**< Number of slots, minus one. */
+  struct Ban **slots;   /**< Bans; NULL if the slot is empty. */
+};
+
+/** Hash a ban mask the way ircd_strcmp() compares it.
+ * @param[in] bb Ban hash.
+ * @param[in] banstr Ban mask.
+ * @return Home slot for \a banstr.
+ */
+static unsigned int
+burst_bans_slot(const struct BurstBans *bb, const char *banstr)
+{
+  unsigned int hash = 2166136261u;
+
+  while (*banstr)
+    hash = (hash ^ ToLower(*banstr++)) * 16777619u;
+  return hash & bb->mask;
+}
+
+/** Add a ban to a ban hash that has room for it.
+ * @param[in,out] bb Ban hash.
+ * @param[in] ban Ban to add.
+ */
+static void
+burst_bans_add(struct BurstBans *bb, struct Ban *ban)
+{
+  unsigned int ii;
+
+  for (ii = burst_bans_slot(bb, ban->banstr); bb->slots[ii];
+       ii = (ii + 1) & bb->mask)
+    ;
+  bb->slots[ii] = ban;
+}
+
+/** Look up a ban mask in a ban hash.
+ * @param[in] bb Ban hash.
+ * @param[in] banstr Ban mask.
+ * @return Ban with the same mask, or NULL.
+ */
+static struct Ban *
+burst_bans_find(const struct BurstBans *bb, const char *banstr)
+{
+  unsigned int ii;
+
+  for (ii = burst_bans_slot(bb, banstr); bb->slots[ii];
+       ii = (ii + 1) & bb->mask)
+    if (!ircd_strcmp(bb->slots[ii]->banstr, banstr))
+      return bb->slots[ii];
+  return NULL;
+}
+
+/** Hash a channel's bans, leaving room for the ones in a BURST.
+ * @param[out] bb Ban hash to fill; free its slots with MyFree().
+ * @param[in] chptr Channel whose bans to hash.
+ * @param[in] banlist Space-separated bans from the BURST.
+ */
+static void
+burst_bans_init(struct BurstBans *bb, struct Channel *chptr,
+                const char *banlist)
+{
+  struct Ban *lp;
+  unsigned int count = 1, size;
+
+  for (lp = chptr->banlist; lp; lp = lp->next)
+    count++;
+  for (; (banlist = strchr(banlist, ' ')); banlist++)
+    count++;
+  for (size = 16; size < 2 * count; size <<= 1)
+    ;
+  bb->mask = size - 1;
+  bb->slots = MyCalloc(size, sizeof(*bb->slots));
+  for (lp = chptr->banlist; lp; lp = lp->next)
+    burst_bans_add(bb, lp);
+}
+
 static int
 netride_modes(int parc, char **parv, const char *curr_key)
 {
@@ -377,11 +455,23 @@ int ms_burst(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
       if (parse_flags & MODE_PARSE_SET) {
 	char *banlist = parv[param] + 1, *p = 0, *ban, *ptr;
 	struct Ban *newban;
+	struct BurstBans seen;
 
+	burst_bans_init(&seen, chptr, banlist);
 	for (ban = ircd_strtok(&p, banlist, " "); ban;
 	     ban = ircd_strtok(&p, 0, " ")) {
 	  ban = collapse(pretty_mask(ban));
 
+	  /*
+	   * After a short split most bans are already here.  No ban in
+	   * the list is more specific than another one, so an exact
+	   * match settles the ban without the walk below.
+	   */
+	  if ((lp = burst_bans_find(&seen, ban))) {
+	    lp->flags &= ~BAN_BURST_WIPEOUT; /* not wiping out */
+	    continue; /* new ban already existed; don't even repropagate */
+	  }
+
 	    /*
 	     * Yeah, we should probably do this elsewhere, and make it better
 	     * and more general; this will hold until we get there, though.
@@ -426,8 +516,10 @@ int ms_burst(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
 	      lp->next = newban; /* link it in */
 	    else
 	      chptr->banlist = newban;
+	    burst_bans_add(&seen, newban);
 	  }
 	}
+	MyFree(seen.slots);
       } 
       param++; /* look at next param */
       break;
@@ -439,8 +531,14 @@ int ms_burst(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
 	int current_mode, last_mode, base_mode;
 	int oplevel = -1;	/* Mark first field with digits: means the same as 'o' (but with level). */
 	int last_oplevel = 0;
+	unsigned int nmembers = 1;
 	struct Membership* member;
 
+        /* size the member hash once for the whole list */
+        for (ptr = nicklist; (ptr = strchr(ptr, ',')); ptr++)
+          nmembers++;
+        reserve_channel_members(chptr, nmembers);
+
         base_mode = CHFL_DEOPPED | CHFL_BURST_JOINED;
         if (chptr->mode.mode & MODE_DELJOINS)
             base_mode |= CHFL_DELAYED;
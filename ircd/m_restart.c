@@ -94,12 +94,21 @@
 
 /*
  * mo_restart - oper message handler
+ *
+ * parv[0] = sender prefix
+ * parv[1] = "UPGRADE" to keep local users connected (optional)
  */
 int mo_restart(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
 {
   if (!HasPriv(sptr, PRIV_RESTART))
     return send_reply(sptr, ERR_NOPRIVILEGES);
 
+  if (parc > 1 && !ircd_strcmp(parv[1], "UPGRADE")) {
+    log_write(LS_SYSTEM, L_NOTICE, 0, "Server RESTART UPGRADE by %#C", sptr);
+    server_upgrade("received RESTART UPGRADE");
+    return 0;
+  }
+
   log_write(LS_SYSTEM, L_NOTICE, 0, "Server RESTART by %#C", sptr);
   server_restart("received RESTART");
 
@@ -494,6 +494,7 @@ void set_server_flags(struct Client *cptr, const char *flags)
     case 's': SetService(cptr); break;
     case '6': SetIPv6(cptr); break;
     case 'z': SetTLS(cptr); break;
+    case 'c': SetCompress(cptr); break;
     }
 }
 
@@ -660,6 +661,8 @@ int mr_server(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
   recv_time = TStime();
   check_start_timestamp(cptr, timestamp, start_timestamp, recv_time);
   ret = server_estab(cptr, aconf);
+  if (ret == CPTR_KILLED)
+    return ret;
 
   if (feature_bool(FEAT_RELIABLE_CLOCK) &&
       labs(cli_serv(cptr)->timestamp - recv_time) > 30) {
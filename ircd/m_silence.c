@@ -263,6 +263,9 @@ forward_silences(struct Client *sptr, char *silences, struct Client *dest)
       free_ban(accepted[ii]);
     }
   }
+
+  /* Cached verdicts may point at silences freed above. */
+  silence_changed(sptr);
 }
 
 /** Handle a SILENCE command from a local user.
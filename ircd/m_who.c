@@ -369,7 +369,12 @@ int m_who(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
 
     if (mask)
     {
-      matchcomp(mymask, &minlen, &cset, mask);
+      if (matchcomp(mymask, &minlen, &cset, mask) < 0) {
+        /* Keep the plain mask; matchexec() checks it with match(). */
+        strcpy(mymask, mask);
+        minlen = -1;
+        cset = ~0;
+      }
       if (!ipmask_parse(mask, &imask, &ibits))
         matchsel &= ~WHO_FIELD_NIP;
       if ((minlen > NICKLEN) || !(cset & NTL_IRCNK))
@@ -23,10 +23,14 @@
 #include "config.h"
 
 #include "match.h"
+#include "ircd_alloc.h"
 #include "ircd_chattr.h"
 #include "ircd_string.h"
 #include "ircd_snprintf.h"
 
+#include <stdint.h>
+#include <string.h>
+
 /*
  * mmatch()
  *
@@ -72,6 +76,18 @@ int mmatch(const char *old_mask, const char *new_mask)
   const char *na = n;
   int wild = 0;
   int mq = 0, nq = 0;
+  size_t ml, nl;
+
+  /* Whatever old_mask ends with after its last wildcard must also end
+   * new_mask.  Checking that first turns most mismatches away without
+   * any backtracking. */
+  for (ml = strlen(m), nl = strlen(n); ml && nl; ml--, nl--)
+  {
+    if (m[ml - 1] == '*' || m[ml - 1] == '?' || m[ml - 1] == '\\')
+      break;
+    if (ToLower(m[ml - 1]) != ToLower(n[nl - 1]))
+      return 1;
+  }
 
   while (1)
   {
@@ -223,7 +239,7 @@ int match(const char *mask, const char *name)
       if (!*m)
         return 0;
       else if (*m == '\\') {
-        m_tmp = ++m;
+        m_tmp = m++;
         if (!*m)
           return 1;
         for (n_tmp = n; *n && *n != *m; n++) ;
@@ -362,9 +378,14 @@ char *collapse(char *mask)
  *   specifically the symbols 'A' and 'Z' are reserved for special use)
  * - All non-escaped stars '*' are replaced by the letter 'Z'
  * - All non-escaped question marks '?' are replaced by the letter 'A' 
- * - All escape characters are removed, the wilds escaped by them are
- *   then passed by without the escape since they don't collide anymore
- *   with the real wilds (encoded as A/Z) 
+ * - All escape characters are removed, the characters escaped by them
+ *   (usually wilds) are then passed by without the escape since they
+ *   don't collide anymore with the real wilds (encoded as A/Z).  match()
+ *   compares an escaped character exactly, which a compiled mask cannot
+ *   express for characters that have case, so a mask that escapes one
+ *   of those is not compiled at all.  matchcomp() then returns -1 and
+ *   leaves \a cmask and \a minlen alone; callers keep the plain text
+ *   with a minlen of -1, which tells matchexec() to use match().
  * - Finally the part of the mask that follows the last asterisk is
  *   reversed (byte order mirroring) and moved right after the first
  *   asterisk.
@@ -380,6 +401,11 @@ char *collapse(char *mask)
  * The balance point of using compiled masks in terms of CPU is when you expect
  * to use matchexec() instead of match() at least 20 times on the same mask
  * or when you expect to use mmexec() instead of mmatch() 3 times.
+ * Unlike match(), matchexec() never backtracks: masks with many stars
+ * take time linear in the length of the string, so masks that are
+ * stored and checked against every client (bans, silences, G-lines and
+ * Kill blocks) are compiled once with matchmask_make() and checked with
+ * matchmask().
  */
 
 /** Compile a mask for faster matching.
@@ -388,7 +414,8 @@ char *collapse(char *mask)
  * @param[out] minlen Minimum length of matching strings.
  * @param[out] charset Character attributes used in compiled mask.
  * @param[out] mask Input mask.
- * @return Length of compiled mask, not including NUL terminator.
+ * @return Length of compiled mask, not including NUL terminator, or -1
+ *   if \a mask escapes a character that has case.
  */
 int matchcomp(char *cmask, int *minlen, int *charset, const char *mask)
 {
@@ -404,6 +431,16 @@ int matchcomp(char *cmask, int *minlen, int *charset, const char *mask)
   int chset = ~0;
   int chset2 = (NTL_LOWER | NTL_UPPER);
 
+  /* Compiled masks ignore case, so they cannot hold an escaped
+   * character that match() compares exactly. */
+  for (; m && *m; m++)
+    if (*m == '\\' && m[1]) {
+      ch = *++m;
+      if (ToLower(ch) != ch || ToUpper(ch) != ch)
+        return -1;
+    }
+  m = mask;
+
   if (m)
     while ((ch = *m++))
       switch (ch)
@@ -417,7 +454,7 @@ int matchcomp(char *cmask, int *minlen, int *charset, const char *mask)
           chset2 &= ~NTL_LOWER;
           break;
         case '\\':
-          if ((*m == '?') || (*m == '*'))
+          if (*m)
             ch = *m++;
           /* fall through */
         default:
@@ -478,9 +515,93 @@ int matchcomp(char *cmask, int *minlen, int *charset, const char *mask)
 
 }
 
+/** Longest chunk that match_chunk() searches for in linear time. */
+#define MATCH_CHUNK_MAX 64
+
+/** Find the first place a chunk of a compiled mask occurs in a string.
+ * The chunk is first compared directly where its first character
+ * occurs.  If that fails, chunks of up to #MATCH_CHUNK_MAX characters
+ * are found with a bit-parallel (Shift-And) scan, so each character of
+ * the string is looked at once.  Longer chunks fall back to trying
+ * each start in turn; no stored mask is that long.
+ * @param[in] s Start of the string to search.
+ * @param[in] end End of the string to search.
+ * @param[in] chunk Text of the chunk, with 'A' for any character.
+ * @param[in] len Length of \a chunk (non-zero).
+ * @return Pointer just past the first occurrence, or NULL if none.
+ */
+static const char *match_chunk(const char *s, const char *end,
+                               const char *chunk, unsigned int len)
+{
+  unsigned char seen[256 / 8];
+  uint64_t tab[256], any = 0, state = 0, last;
+  unsigned int ii, ch;
+  const char *t;
+
+  /* Usually the chunk occurs where its first character first does. */
+  if (*chunk != 'A')
+    while (s < end && ToLower(*s) != *chunk)
+      ++s;
+  if ((unsigned int)(end - s) < len)
+    return NULL;
+  for (ii = 1, t = s + 1; ii < len; ++ii, ++t)
+    if (chunk[ii] != 'A' && ToLower(*t) != chunk[ii])
+      break;
+  if (ii == len)
+    return t;
+
+  if (len > MATCH_CHUNK_MAX) {
+    for (; (unsigned int)(end - s) >= len; ++s) {
+      for (ii = 0, t = s; ii < len; ++ii, ++t)
+        if (chunk[ii] != 'A' && ToLower(*t) != chunk[ii])
+          break;
+      if (ii == len)
+        return t;
+    }
+    return NULL;
+  }
+
+  /* Bit i of tab[ch] is set if position i of the chunk accepts ch. */
+  memset(seen, 0, sizeof(seen));
+  for (ii = 0; ii < len; ++ii) {
+    ch = (unsigned char)chunk[ii];
+    if (ch == 'A') {
+      any |= (uint64_t)1 << ii;
+      continue;
+    }
+    if (!(seen[ch >> 3] & (1 << (ch & 7)))) {
+      seen[ch >> 3] |= 1 << (ch & 7);
+      tab[ch] = 0;
+    }
+    tab[ch] |= (uint64_t)1 << ii;
+  }
+  last = (uint64_t)1 << (len - 1);
+
+  for (; s < end; ++s) {
+    /* With no partial match, skip ahead to the chunk's first character. */
+    if (!state && *chunk != 'A') {
+      while (ToLower(*s) != *chunk)
+        if (++s == end)
+          return NULL;
+    }
+    ch = (unsigned char)ToLower(*s);
+    state = ((state << 1) | 1)
+      & (any | ((seen[ch >> 3] & (1 << (ch & 7))) ? tab[ch] : 0));
+    if (state & last)
+      return s + 1;
+  }
+  return NULL;
+}
+
 /** Compare a string to a compiled mask.
+ * The head and tail of the mask are compared in place, then each
+ * chunk between stars is found at its earliest position after the
+ * previous one.  This never backtracks, so the time taken is linear
+ * in the lengths of the string and the mask.
  * If \a cmask is not from matchcomp(), or if \a minlen is not the value
- * passed out of matchcomp(), this may core.
+ * passed out of matchcomp(), this may core.  A negative \a minlen
+ * means matchcomp() refused the mask, and \a cmask is the plain mask,
+ * which is checked with match().
  * See also @ref compiledmasks.
  * @param[in] string String to test.
  * @param[in] cmask Compiled mask string.
@@ -489,69 +610,69 @@ int matchcomp(char *cmask, int *minlen, int *charset, const char *mask)
  */
 int matchexec(const char *string, const char *cmask, int minlen)
 {
-  const char *s = string - 1;
-  const char *b = cmask - 1;
-  int trash;
-  const char *bb, *bs;
-  char ch;
+  const char *s = string;
+  const char *b = cmask;
+  const char *end, *chunk;
 
-tryhead:
-  while ((ToLower(*++s) == *++b) && *s);
-  if (!*s)
-    return ((*b != '\0') && ((*b++ != 'Z') || (*b != '\0')));
-  if (*b != 'Z')
-  {
-    if (*b == 'A')
-      goto tryhead;
-    return 1;
-  };
+  if (minlen < 0)
+    return match(cmask, string);
 
-  bs = s;
-  while (*++s);
+  /* Everything before the first star must match exactly. */
+  for (; *b != 'Z'; ++b, ++s) {
+    if (!*b)
+      return (*s != '\0');
+    if (!*s || (*b != 'A' && ToLower(*s) != *b))
+      return 1;
+  }
 
-  if ((trash = (s - string - minlen)) < 0)
+  end = s + strlen(s);
+  if (end - string < minlen)
     return 2;
 
-trytail:
-  while ((ToLower(*--s) == *++b) && *b && (ToLower(*--s) == *++b) && *b
-      && (ToLower(*--s) == *++b) && *b && (ToLower(*--s) == *++b) && *b);
-  if (*b != 'Z')
-  {
-    if (*b == 'A')
-      goto trytail;
-    return (*b != '\0');
-  };
+  /* So must everything after the last star, which is stored reversed. */
+  for (++b; *b && *b != 'Z'; ++b) {
+    --end;
+    if (*b != 'A' && ToLower(*end) != *b)
+      return 3;
+  }
 
-  s = --bs;
-  bb = b;
+  /* The chunks between stars must appear in order in what is left. */
+  while (*b) {
+    for (chunk = ++b; *b && *b != 'Z'; ++b)
+      ;
+    if (!(s = match_chunk(s, end, chunk, b - chunk)))
+      return 4;
+  }
 
-  while ((ch = *++b))
-  {
-    while ((ToLower(*++s) != ch))
-      if (--trash < 0)
-        return 4;
-    bs = s;
+  return 0;
+}
 
-trychunk:
-    while ((ToLower(*++s) == *++b) && *b);
-    if (!*b)
-      return 0;
-    if (*b == 'Z')
-    {
-      --s;
-      bb = b;
-      continue;
-    };
-    if (*b == 'A')
-      goto trychunk;
+/** Compile a mask to be stored and checked many times.
+ * A mask that matchcomp() cannot compile is kept as it is.
+ * See also @ref compiledmasks.
+ * @param[in] mask Mask to compile.
+ * @return Newly allocated compiled mask; free it with MyFree().
+ */
+struct MatchMask *matchmask_make(const char *mask)
+{
+  struct MatchMask *mm;
 
-    b = bb;
-    s = bs;
-    if (--trash < 0)
-      return 5;
-  };
+  mm = MyMalloc(sizeof(*mm) + strlen(mask));
+  if (matchcomp(mm->cmask, &mm->minlen, NULL, mask) < 0) {
+    mm->minlen = -1;
+    strcpy(mm->cmask, mask);
+  }
+  return mm;
+}
 
-  return 0;
+/** Compare a string to a mask from matchmask_make().
+ * @param[in] mm Compiled mask.
+ * @param[in] string String to test.
+ * @return Zero if the string matches, non-zero otherwise.
+ */
+int matchmask(const struct MatchMask *mm, const char *string)
+{
+  return matchexec(string, mm->cmask, mm->minlen);
 }
 
 /*
@@ -179,6 +179,17 @@ motd_cache(struct Motd *motd)
   memcpy(motd->cache, cache, sizeof(struct MotdCache) +
          (MOTD_LINESIZE * (cache->count - 1)));
   MyFree(cache);
+  cache = motd->cache;
+
+  /* render the replies once, so each greeting only has to copy them */
+  cache->replies = (struct ReplyTemplate*)MyCalloc(cache->count + 1,
+                                                   sizeof(struct ReplyTemplate));
+  reply_template_set(&cache->replies[0], SND_EXPLICIT | RPL_MOTD,
+		     ":- %d-%d-%d %d:%02d", cache->modtime.tm_year + 1900,
+		     cache->modtime.tm_mon + 1, cache->modtime.tm_mday,
+		     cache->modtime.tm_hour, cache->modtime.tm_min);
+  for (i = 0; i < cache->count; i++)
+    reply_template_set(&cache->replies[i + 1], RPL_MOTD, cache->motd[i]);
 
   /* now link it in... */
   motd->cache->next = MotdList.cachelist;
@@ -198,6 +209,7 @@ static void
 motd_decache(struct Motd *motd)
 {
   struct MotdCache* cache;
+  int i;
 
   assert(0 != motd);
 
@@ -213,6 +225,10 @@ motd_decache(struct Motd *motd)
 
     MyFree(cache->path); /* free path info... */
 
+    for (i = 0; i <= cache->count; i++) /* and the rendered replies */
+      reply_template_clear(&cache->replies[i]);
+    MyFree(cache->replies);
+
     MyFree(cache); /* very simple for a reason... */
   }
 }
@@ -289,15 +305,10 @@ motd_forward(struct Client *cptr, struct MotdCache *cache)
   if (!cache) /* no motd to send */
     return send_reply(cptr, ERR_NOMOTD);
 
-  /* send the motd */
+  /* send the motd: the date line, then the body */
   send_reply(cptr, RPL_MOTDSTART, cli_name(&me));
-  send_reply(cptr, SND_EXPLICIT | RPL_MOTD, ":- %d-%d-%d %d:%02d",
-	     cache->modtime.tm_year + 1900, cache->modtime.tm_mon + 1,
-	     cache->modtime.tm_mday, cache->modtime.tm_hour,
-	     cache->modtime.tm_min);
-
-  for (i = 0; i < cache->count; i++)
-    send_reply(cptr, RPL_MOTD, cache->motd[i]);
+  for (i = 0; i <= cache->count; i++)
+    send_reply_template(cptr, &cache->replies[i]);
 
   return send_reply(cptr, RPL_ENDOFMOTD); /* end */
 }
@@ -446,6 +457,7 @@ motd_memory_count(struct Client *cptr)
 {
   struct Motd *ptr;
   struct MotdCache *cache;
+  int i;
   unsigned int mt = 0,   /* motd count */
                mtc = 0,  /* motd cache count */
                mtf = 0;  /* motd free list count */
@@ -478,6 +490,9 @@ motd_memory_count(struct Client *cptr)
     mtc++;
     mtcm += sizeof(struct MotdCache) + (MOTD_LINESIZE * (cache->count - 1));
     mtcm += cache->path ? (strlen(cache->path) + 1) : 0;
+    mtcm += sizeof(struct ReplyTemplate) * (cache->count + 1);
+    for (i = 0; i <= cache->count; i++)
+      mtcm += cache->replies[i].len + 1;
   }
 
   if (MotdList.freelist)
@@ -685,6 +685,22 @@ msgq_count_memory(struct Client *cptr, size_t *msg_alloc, size_t *msgbuf_alloc)
   *msgbuf_alloc = total;
 }
 
+/** Count memory allocated for messages without reporting it.
+ * @param[out] msg_alloc Receives bytes allocated for Msg structures.
+ * @param[out] msgbuf_alloc Receives bytes allocated for MsgBufs.
+ */
+void
+msgq_memory(size_t *msg_alloc, size_t *msgbuf_alloc)
+{
+  int i;
+
+  *msg_alloc = MQData.msgs.alloc * sizeof(struct Msg);
+  *msgbuf_alloc = 0;
+  for (i = MB_BASE_SHIFT; i < MB_MAX_SHIFT + 1; i++)
+    *msgbuf_alloc += MQData.msgBufs[i - MB_BASE_SHIFT].alloc
+      * (sizeof(struct MsgBuf) + (1 << i));
+}
+
 /** Report remaining space in a MsgBuf.
  * @param[in] mb Message buffer to check.
  * @return Number of additional bytes that can be appended to the message.
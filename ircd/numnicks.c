@@ -385,7 +385,7 @@ int SetLocalNumNick(struct Client *cptr)
 /** Mark servers whose name matches the given (compiled) mask by
  * setting their FLAG_MAP flag.
  * @param[in] cmask Compiled mask for server names.
- * @param[in] minlen Minimum match length for \a cmask.
+ * @param[in] minlen Minimum match length for \a cmask (see matchexec()).
  * @return Number of servers marked.
  */
 int markMatchexServer(const char *cmask, int minlen)
@@ -29,6 +29,7 @@
 #include "ircd_chattr.h"
 #include "ircd_defs.h"
 #include "ircd_log.h"
+#include "ircd_zip.h"
 #include "parse.h"
 #include "s_bsd.h"
 #include "s_misc.h"
@@ -55,7 +56,7 @@ static void update_messages_received(struct Client* cptr)
   ++(cli_receiveM(cptr));
 }
 
-/** Handle received data from a directly connected server.
+/** Split uncompressed data from a server into lines and parse them.
  * @param[in] cptr Peer server that sent us data.
  * @param[in] buffer Input buffer.
  * @param[in] length Number of bytes in input buffer.
@@ -64,7 +65,8 @@ static void update_messages_received(struct Client* cptr)
  * Message-tags (a leading '@' ... ' ' section) are accepted in addition
  * to the normal BUFSIZE message body.
  */
-int server_dopacket(struct Client* cptr, const char* buffer, int length)
+static int server_parse_packet(struct Client* cptr, const char* buffer,
+                               int length)
 {
   const char* src;
   char*       endp;
@@ -72,10 +74,6 @@ int server_dopacket(struct Client* cptr, const char* buffer, int length)
   char*       body;                 /* Start of body after tags, or NULL
                                        while still reading the tag section. */
 
-  assert(0 != cptr);
-
-  update_bytes_received(cptr, length);
-
   client_buffer = cli_buffer(cptr);
   endp = client_buffer + cli_count(cptr);
   src = buffer;
@@ -164,6 +162,35 @@ int server_dopacket(struct Client* cptr, const char* buffer, int length)
   return 1;
 }
 
+/** Handle received data from a directly connected server.
+ * Data from a compressed link is inflated before it is parsed.
+ * @param[in] cptr Peer server that sent us data.
+ * @param[in] buffer Input buffer.
+ * @param[in] length Number of bytes in input buffer.
+ * @return 1 on success or CPTR_KILLED if the client is squit.
+ */
+int server_dopacket(struct Client* cptr, const char* buffer, int length)
+{
+  static char inflated[8192];
+  int         count;
+  int         res;
+
+  assert(0 != cptr);
+
+  update_bytes_received(cptr, length);
+
+  if (!cli_zip(cptr))
+    return server_parse_packet(cptr, buffer, length);
+
+  zip_input(cptr, buffer, length);
+  while ((count = zip_inflate(cptr, inflated, sizeof(inflated))) > 0)
+    if ((res = server_parse_packet(cptr, inflated, count)) != 1)
+      return res;
+  if (count < 0)
+    return exit_client(cptr, cptr, &me, "Decompression error");
+  return 1;
+}
+
 /** Handle received data from a new (unregistered) connection.
  * @param[in] cptr Unregistered connection that sent us data.
  * @param[in] buffer Input buffer.
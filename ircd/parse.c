@@ -59,6 +59,7 @@
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 /*
  * Message Tree stuff mostly written by orabidoo, with changes by Dianora.
@@ -845,6 +846,7 @@ int register_mapping(struct s_map *map)
     msg->flags |= MFLG_SLOW;
   msg->bytes = 0;
   msg->extra = map;
+  memset(msg->times, 0, sizeof(msg->times));
 
   msg->handlers[UNREGISTERED_HANDLER] = m_ignore;
   msg->handlers[CLIENT_HANDLER] = m_pseudo;
@@ -880,6 +882,59 @@ int unregister_mapping(struct s_map *map)
   return 1;
 }
 
+/** Names of message handler types, indexed by HandlerType. */
+const char *msg_handler_names[LAST_HANDLER_TYPE] = {
+  "unregistered", "client", "server", "oper", "service"
+};
+
+/** Read the monotonic clock used to time message handlers.
+ * @return Current time in nanoseconds.
+ */
+static unsigned long long parse_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Record one handler invocation in a message's latency statistics.
+ * @param[in] mptr Message that was handled.
+ * @param[in] type Handler type that was invoked.
+ * @param[in] start parse_clock() value from before the handler ran.
+ */
+static void msg_time(struct Message *mptr, HandlerType type,
+                     unsigned long long start)
+{
+  struct MessageTimes *mt = &mptr->times[type];
+  unsigned long long elapsed = parse_clock() - start;
+  unsigned long long usec;
+  unsigned int bucket;
+
+  for (usec = elapsed / 1000, bucket = 0;
+       usec && bucket < MSG_TIME_BUCKETS - 1;
+       usec >>= 1)
+    bucket++;
+  mt->calls++;
+  mt->total += elapsed;
+  if (elapsed > mt->max)
+    mt->max = elapsed;
+  mt->buckets[bucket]++;
+}
+
+/** Clear the handler latency statistics of every message. */
+void msg_times_reset(void)
+{
+  struct Message *mptr;
+  struct s_map *map;
+
+  for (mptr = msgtab; mptr->cmd; mptr++)
+    memset(mptr->times, 0, sizeof(mptr->times));
+  for (map = GlobalServiceMapList; map; map = map->next)
+    if (map->msg)
+      memset(map->msg->times, 0, sizeof(map->msg->times));
+}
+
 /** Parse a line of data from a user.
  * NOTE: parse_*() should not be called recursively by any other
  * functions!
@@ -899,6 +954,9 @@ parse_client(struct Client *cptr, char *buffer, char *bufend)
   int             paramcount;
   struct Message* mptr;
   MessageHandler  handler = 0;
+  HandlerType     type;
+  unsigned long long start;
+  int             ret;
 
   Debug((DEBUG_DEBUG, "Client Parsing: %s", buffer));
 
@@ -1038,14 +1096,18 @@ parse_client(struct Client *cptr, char *buffer, char *bufend)
   para[++i] = NULL;
   ++mptr->count;
 
-  handler = mptr->handlers[cli_handler(cptr)];
+  type = cli_handler(cptr);
+  handler = mptr->handlers[type];
   assert(0 != handler);
 
   if (!feature_bool(FEAT_IDLE_FROM_MSG) && IsUser(cptr) &&
       handler != m_ping && handler != m_ignore)
     cli_user(from)->last = CurrentTime;
 
-  return (*handler) (cptr, from, i, para);
+  start = parse_clock();
+  ret = (*handler) (cptr, from, i, para);
+  msg_time(mptr, type, start);
+  return ret;
 }
 
 /** Parse a line of data from a server.
@@ -1065,6 +1127,9 @@ int parse_server(struct Client *cptr, char *buffer, char *bufend)
   int             numeric = 0;
   int             paramcount;
   struct Message* mptr;
+  HandlerType     type;
+  unsigned long long start;
+  int             ret;
 
   Debug((DEBUG_DEBUG, "Server Parsing: %s", buffer));
 
@@ -1353,5 +1418,9 @@ int parse_server(struct Client *cptr, char *buffer, char *bufend)
     return (do_numeric(numeric, (*buffer != ':'), cptr, from, i, para));
   mptr->count++;
 
-  return (*mptr->handlers[cli_handler(cptr)]) (cptr, from, i, para);
+  type = cli_handler(cptr);
+  start = parse_clock();
+  ret = (*mptr->handlers[type]) (cptr, from, i, para);
+  msg_time(mptr, type, start);
+  return ret;
 }
@@ -16,44 +16,201 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 /** @file
- * @brief 32-bit pseudo-random number generator implementation.
+ * @brief ChaCha20-based pseudo-random number generator implementation.
  * @version $Id$
+ *
+ * The generator keeps a 256-bit ChaCha20 key and fills a pool of
+ * output from it several blocks at a time.  Each refill first replaces
+ * the key with fresh keystream, so output that has already been handed
+ * out cannot be recomputed from the state left in memory.  The key is
+ * seeded from the kernel the first time random output is needed.
  */
 #include "config.h"
 
 #include "random.h"
 #include "client.h"
 #include "ircd_log.h"
-#include "ircd_md5.h"
 #include "ircd_reply.h"
 #include "send.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_RANDOM_H
+#include <sys/random.h>
+#endif
+
+/** Number of ChaCha20 blocks generated per refill. */
+#define RANDOM_BLOCKS 16
+/** Size of the output pool, in bytes. */
+#define RANDOM_POOL (RANDOM_BLOCKS * CHACHA20_BLOCK)
+/** Size of the generator key, in bytes. */
+#define RANDOM_KEY 32
+
+/** Current generator key. */
+static unsigned char random_key[RANDOM_KEY];
+/** Output not yet handed out; the unused part starts at #random_pos. */
+static unsigned char random_pool[RANDOM_POOL];
+/** Offset of the next unused byte in #random_pool. */
+static unsigned int random_pos = RANDOM_POOL;
+/** Non-zero once #random_key has been seeded. */
+static int random_seeded;
+
+/** Rotate a 32-bit word left. */
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+/** ChaCha quarter round on four words of the working state. */
+#define QUARTERROUND(x, a, b, c, d) do { \
+  x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL(x[d], 16); \
+  x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL(x[b], 12); \
+  x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL(x[d], 8); \
+  x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL(x[b], 7); \
+} while (0)
+
+/** Read a little-endian 32-bit word. */
+static uint32_t load32(const unsigned char *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+    | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/** Store a little-endian 32-bit word. */
+static void store32(unsigned char *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
 
-/** Pseudo-random number generator state. */
-static struct MD5Context localkey;
-/** Next byte position in #localkey to insert at. */
-static unsigned int localkey_pos;
-
-/** Add bytes to #localkey.
- * This should be fairly resistant to adding non-random bytes, but the
- * more random the bytes are, the harder it is for an attacker to
- * guess the internal state.
- * @param[in] buf Buffer of bytes to add.
- * @param[in] count Number of bytes to add.
+/** Compute one ChaCha20 block (RFC 7539, section 2.3).
+ * @param[out] out Receives #CHACHA20_BLOCK bytes of keystream.
+ * @param[in] key 256-bit key.
+ * @param[in] counter Block counter.
+ * @param[in] nonce 96-bit nonce.
  */
-static void
-random_add_entropy(const char *buf, unsigned int count)
+void chacha20_block(unsigned char *out, const unsigned char *key,
+                    uint32_t counter, const unsigned char *nonce)
 {
-  while (count--) {
-    localkey.in[localkey_pos++] ^= *buf++;
-    if (localkey_pos >= sizeof(localkey.in))
-      localkey_pos = 0;
+  uint32_t in[16], x[16];
+  int i;
+
+  in[0] = 0x61707865;
+  in[1] = 0x3320646e;
+  in[2] = 0x79622d32;
+  in[3] = 0x6b206574;
+  for (i = 0; i < 8; i++)
+    in[4 + i] = load32(key + 4 * i);
+  in[12] = counter;
+  for (i = 0; i < 3; i++)
+    in[13 + i] = load32(nonce + 4 * i);
+
+  memcpy(x, in, sizeof(x));
+  for (i = 0; i < 10; i++) {
+    QUARTERROUND(x, 0, 4, 8, 12);
+    QUARTERROUND(x, 1, 5, 9, 13);
+    QUARTERROUND(x, 2, 6, 10, 14);
+    QUARTERROUND(x, 3, 7, 11, 15);
+    QUARTERROUND(x, 0, 5, 10, 15);
+    QUARTERROUND(x, 1, 6, 11, 12);
+    QUARTERROUND(x, 2, 7, 8, 13);
+    QUARTERROUND(x, 3, 4, 9, 14);
+  }
+  for (i = 0; i < 16; i++)
+    store32(out + 4 * i, x[i] + in[i]);
+}
+
+/** Fill a buffer from the kernel's random number generator.
+ * @param[out] buf Buffer to fill.
+ * @param[in] len Number of bytes wanted.
+ * @return Non-zero if all of \a buf was filled.
+ */
+static int random_kernel(unsigned char *buf, size_t len)
+{
+  size_t pos = 0;
+  ssize_t res;
+  int fd;
+
+#ifdef HAVE_GETRANDOM
+  while (pos < len) {
+    res = getrandom(buf + pos, len - pos, 0);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    pos += res;
+  }
+  if (pos == len)
+    return 1;
+#endif
+
+  if ((fd = open("/dev/urandom", O_RDONLY)) < 0)
+    return 0;
+  while (pos < len) {
+    res = read(fd, buf + pos, len - pos);
+    if (res <= 0) {
+      if (res < 0 && errno == EINTR)
+        continue;
+      break;
+    }
+    pos += res;
   }
+  close(fd);
+  return pos == len;
+}
+
+/** Seed #random_key from the kernel.
+ * If neither getrandom() nor /dev/urandom works, the key is mixed with
+ * the time and process ID instead, and the RANDOM_SEED feature is the
+ * only real source of entropy.
+ */
+static void random_init(void)
+{
+  unsigned char seed[RANDOM_KEY];
+  struct timeval tv;
+  unsigned int i;
+
+  if (!random_kernel(seed, sizeof(seed))) {
+    log_write(LS_SYSTEM, L_WARNING, 0, "Unable to read random seed from "
+              "the kernel; set RANDOM_SEED");
+    gettimeofday(&tv, 0);
+    memset(seed, 0, sizeof(seed));
+    memcpy(seed, &tv, sizeof(tv) < sizeof(seed) ? sizeof(tv) : sizeof(seed));
+    store32(seed + RANDOM_KEY - 4, getpid());
+  }
+  for (i = 0; i < RANDOM_KEY; i++)
+    random_key[i] ^= seed[i];
+  memset(seed, 0, sizeof(seed));
+  random_seeded = 1;
+}
+
+/** Rekey the generator and refill #random_pool.
+ * The first block of new keystream becomes the next key and is never
+ * handed out.
+ */
+static void random_refill(void)
+{
+  static const unsigned char nonce[12];
+  unsigned char block[CHACHA20_BLOCK];
+  uint32_t ii;
+
+  if (!random_seeded)
+    random_init();
+
+  chacha20_block(block, random_key, 0, nonce);
+  memcpy(random_key, block, RANDOM_KEY);
+  for (ii = 0; ii < RANDOM_BLOCKS; ii++)
+    chacha20_block(random_pool + ii * CHACHA20_BLOCK, block, ii + 1, nonce);
+  memset(block, 0, sizeof(block));
+  random_pos = 0;
 }
 
 /** Seed the PRNG with a string.
+ * The string is mixed into the generator key, and any output that was
+ * generated with the old key is discarded.
  * @param[in] from Client setting the seed (may be NULL).
  * @param[in] fields Input arguments (fields[0] is used).
  * @param[in] count Number of input arguments.
@@ -62,6 +219,9 @@ random_add_entropy(const char *buf, unsigned int count)
 int
 random_seed_set(struct Client* from, const char* const* fields, int count)
 {
+  const char *seed;
+  unsigned int ii;
+
   if (count < 1) {
     if (from) /* send an error */
       return need_more_params(from, "SET");
@@ -71,39 +231,43 @@ random_seed_set(struct Client* from, const char* const* fields, int count)
     }
   }
 
-  random_add_entropy(fields[0], strlen(fields[0]));
+  for (seed = fields[0], ii = 0; *seed; seed++, ii++)
+    random_key[ii % RANDOM_KEY] ^= *seed;
+  random_refill();
   return 1;
 }
 
+/** Fill a buffer with pseudo-random bytes.
+ * @param[out] buf Buffer to fill.
+ * @param[in] len Number of bytes to generate.
+ */
+void random_bytes(void *buf, size_t len)
+{
+  unsigned char *out = buf;
+  size_t count;
+
+  while (len > 0) {
+    if (random_pos >= RANDOM_POOL)
+      random_refill();
+    count = RANDOM_POOL - random_pos;
+    if (count > len)
+      count = len;
+    memcpy(out, random_pool + random_pos, count);
+    /* Do not leave handed-out bytes behind in the pool. */
+    memset(random_pool + random_pos, 0, count);
+    random_pos += count;
+    out += count;
+    len -= count;
+  }
+}
+
 /** Generate a pseudo-random number.
- * This uses the #localkey structure plus current time as input to
- * MD5, feeding most of the MD5 output back to #localkey and using one
- * output words as the pseudo-random output.
  * @return A 32-bit pseudo-random number.
  */
 unsigned int ircrandom(void)
 {
-  struct timeval tv;
-  char usec[3];
-
-  /* Add some randomness to the pool. */
-  gettimeofday(&tv, 0);
-  usec[0] = tv.tv_usec;
-  usec[1] = tv.tv_usec >> 8;
-  usec[2] = tv.tv_usec >> 16;
-  random_add_entropy(usec, 3);
-
-  /* Perform MD5 step. */
-  localkey.buf[0] = 0x67452301;
-  localkey.buf[1] = 0xefcdab89;
-  localkey.buf[2] = 0x98badcfe;
-  localkey.buf[3] = 0x10325476;
-  MD5Transform(localkey.buf, (uint32*)localkey.in);
-
-  /* Feed back 12 bytes of hash value into randomness pool. */
-  random_add_entropy((char*)localkey.buf, 12);
-
-  /* Return the final word of hash, which should not provide any
-   * useful insight into current pool contents. */
-  return localkey.buf[3];
+  unsigned char buf[4];
+
+  random_bytes(buf, sizeof(buf));
+  return load32(buf);
 }
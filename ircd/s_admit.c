@@ -0,0 +1,374 @@
+/*
+ * IRC - Internet Relay Chat, ircd/s_admit.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Registration admission queue.
+ * @version $Id$
+ *
+ * Every client connection that reaches start_auth() starts a DNS
+ * lookup, an ident query and an iauth exchange.  After a netsplit or
+ * a restart, thousands of clients reconnect within seconds and all of
+ * that work starts at once.  ADMIT_MAX_PENDING and ADMIT_PORT_PENDING
+ * cap the number of connections doing those checks at a time,
+ * server-wide and per Port block; connections over the cap wait here,
+ * without being read from, until another connection's checks finish.
+ * A connection gives its slot back as soon as its own checks are
+ * done, so one that then sits idle instead of sending NICK and USER
+ * does not keep anybody out.
+ *
+ * Each listener has two FIFO queues: one for connections that are the
+ * only one from their address (per IPcheck), one for the rest.  Free
+ * slots go to listeners in turn, and within a listener to the first
+ * queue, unless the head of the second has waited ADMIT_REPEAT_LAG
+ * seconds longer, so a host opening many connections cannot crowd out
+ * everybody else.  Connections still waiting after ADMIT_QUEUE_TIMEOUT
+ * seconds are told to try again later.
+ */
+#include "config.h"
+
+#include "s_admit.h"
+#include "IPcheck.h"
+#include "client.h"
+#include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_events.h"
+#include "ircd_features.h"
+#include "ircd_log.h"
+#include "ircd_reply.h"
+#include "listener.h"
+#include "numeric.h"
+#include "s_auth.h"
+#include "s_debug.h"
+#include "s_misc.h"
+#include "send.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <time.h>
+
+/** How many seconds longer a repeat connection must have waited to be
+ * admitted ahead of a listener's first-connection queue. */
+#define ADMIT_REPEAT_LAG 2
+
+/** A connection waiting for admission. */
+struct AdmitWait {
+  struct AdmitWait *next;      /**< Next (younger) entry in the queue. */
+  struct AdmitWait *prev;      /**< Previous (older) entry in the queue. */
+  struct Client *client;       /**< Waiting client. */
+  unsigned long long since;    /**< admit_clock() when queued. */
+  unsigned int repeat;         /**< Queue index: 1 if not the only
+                                  connection from its address. */
+};
+
+/** Unused AdmitWait structures. */
+static struct AdmitWait *admit_freelist;
+/** Connections doing their checks, server-wide. */
+static unsigned int admit_pending;
+/** Connections waiting for admission, server-wide. */
+static unsigned int admit_queued;
+/** Position in ListenerPollList of the next listener to serve. */
+static unsigned int admit_turn;
+/** Connections admitted without waiting. */
+static unsigned long admit_direct;
+/** Connections admitted from a queue. */
+static unsigned long admit_waited;
+/** Connections rejected after waiting too long. */
+static unsigned long admit_expired;
+/** Total and longest wait of admitted connections, in nanoseconds. */
+static unsigned long long admit_wait_total, admit_wait_max;
+/** Periodic timer that expires waiting connections. */
+static struct Timer admit_tick;
+/** One-shot timer to admit connections after a slot is given back. */
+static struct Timer admit_kick;
+
+/** Read the monotonic clock.
+ * @return Nanoseconds since an arbitrary fixed point.
+ */
+static unsigned long long admit_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Check whether the server-wide limit allows another connection in.
+ * @return Non-zero if a connection may start its checks.
+ */
+static int admit_global_room(void)
+{
+  int max = feature_int(FEAT_ADMIT_MAX_PENDING);
+
+  return max <= 0 || admit_pending < (unsigned int)max;
+}
+
+/** Check whether both limits allow another connection in on \a l.
+ * @param[in] l Listener that accepted the connection.
+ * @return Non-zero if a connection may start its checks.
+ */
+static int admit_room(const struct Listener *l)
+{
+  int max = feature_int(FEAT_ADMIT_PORT_PENDING);
+
+  return admit_global_room()
+    && (max <= 0 || l->admit_pending < (unsigned int)max);
+}
+
+/** Give \a cptr a slot and start its lookups.
+ * @param[in] cptr Client to admit.
+ */
+static void admit_start(struct Client *cptr)
+{
+  SetFlag(cptr, FLAG_ADMITTED);
+  ++admit_pending;
+  ++cli_listener(cptr)->admit_pending;
+  start_auth(cptr);
+}
+
+/** Unlink \a wait from its listener's queue and free it.
+ * @param[in] wait Queue entry to remove.
+ */
+static void admit_unlink(struct AdmitWait *wait)
+{
+  struct Listener *l = cli_listener(wait->client);
+
+  if (wait->prev)
+    wait->prev->next = wait->next;
+  else
+    l->admit_head[wait->repeat] = wait->next;
+  if (wait->next)
+    wait->next->prev = wait->prev;
+  else
+    l->admit_tail[wait->repeat] = wait->prev;
+  --l->admit_queued[wait->repeat];
+  --admit_queued;
+  cli_admit(wait->client) = NULL;
+
+  wait->next = admit_freelist;
+  admit_freelist = wait;
+}
+
+/** Admit the connection that has waited longest on \a l, preferring
+ * the only connections from their addresses.
+ * @param[in] l Listener with at least one waiting connection.
+ */
+static void admit_next(struct Listener *l)
+{
+  struct AdmitWait *wait = l->admit_head[0];
+  struct AdmitWait *repeat = l->admit_head[1];
+  struct Client *cptr;
+  unsigned long long waited;
+
+  if (!wait || (repeat && repeat->since + ADMIT_REPEAT_LAG * 1000000000ULL
+                < wait->since))
+    wait = repeat;
+  assert(0 != wait);
+
+  cptr = wait->client;
+  waited = admit_clock() - wait->since;
+  admit_unlink(wait);
+  ++admit_waited;
+  admit_wait_total += waited;
+  if (waited > admit_wait_max)
+    admit_wait_max = waited;
+  Debug((DEBUG_INFO, "Admitting %p after %qu ns", cptr, waited));
+  admit_start(cptr);
+}
+
+/** Reject the connections on \a l that have been waiting since before
+ * \a limit.
+ * @param[in] l Listener to check.
+ * @param[in] limit admit_clock() value before which waits expire.
+ */
+static void admit_expire(struct Listener *l, unsigned long long limit)
+{
+  struct AdmitWait *wait;
+  struct Client *cptr;
+  unsigned int ii;
+  int last;
+
+  for (ii = 0; ii < 2; ++ii) {
+    while ((wait = l->admit_head[ii]) && wait->since < limit) {
+      cptr = wait->client;
+      admit_unlink(wait);
+      ++admit_expired;
+      if (IsIPChecked(cptr))
+        IPcheck_connect_fail(cptr, 0);
+      /* Exiting the last client of a closed listener frees it. */
+      last = l->ref_count == 1 && !listener_active(l);
+      exit_client(cptr, cptr, &me, "Server busy -- try again later");
+      if (last)
+        return;
+    }
+  }
+}
+
+/** Reject connections that have waited longer than ADMIT_QUEUE_TIMEOUT
+ * seconds (unless it is 0), then hand out free slots to the listeners
+ * in turn until the limits or the queues run out.
+ */
+static void admit_run(void)
+{
+  struct Listener *l, *next;
+  unsigned long long now, limit;
+  unsigned int pos, first, pass, admitted;
+
+  if (!admit_queued)
+    return;
+
+  now = admit_clock();
+  limit = (unsigned long long)feature_int(FEAT_ADMIT_QUEUE_TIMEOUT)
+    * 1000000000;
+  for (l = ListenerPollList; l && limit && now > limit; l = next) {
+    next = l->next;
+    admit_expire(l, now - limit);
+  }
+
+  do {
+    admitted = 0;
+    first = admit_turn;
+    for (pass = 0; pass < 2; ++pass) {
+      for (pos = 0, l = ListenerPollList; l; l = next, ++pos) {
+        next = l->next;
+        if ((pos >= first) == pass || !admit_room(l)
+            || !(l->admit_queued[0] + l->admit_queued[1]))
+          continue;
+        admit_turn = pos + 1;
+        admit_next(l);
+        ++admitted;
+        if (!admit_global_room())
+          return;
+      }
+    }
+  } while (admitted && admit_queued);
+}
+
+/** Handle an admission timer.
+ * @param[in] ev Timer event.
+ */
+static void admit_callback(struct Event *ev)
+{
+  if (ev_type(ev) == ET_EXPIRE)
+    admit_run();
+}
+
+/** Start the timer that expires waiting connections. */
+void admit_init(void)
+{
+  timer_add(timer_init(&admit_tick), admit_callback, 0, TT_PERIODIC, 1);
+}
+
+/** Start the checks for a newly connected client, or queue it if too
+ * many connections are already doing theirs.
+ * @param[in] cptr Client whose connection (and TLS handshake, if any)
+ *   is complete.
+ */
+void admit_client(struct Client *cptr)
+{
+  struct Listener *l = cli_listener(cptr);
+  struct AdmitWait *wait;
+
+  /* Server links are never held back. */
+  if (!l || IsServerPort(cptr)) {
+    start_auth(cptr);
+    return;
+  }
+
+  if (!admit_queued && admit_room(l)) {
+    ++admit_direct;
+    admit_start(cptr);
+    return;
+  }
+
+  /* A TLS client may still be polled from its handshake. */
+  socket_events(&(cli_socket(cptr)), SOCK_ACTION_SET);
+
+  wait = admit_freelist;
+  if (wait)
+    admit_freelist = wait->next;
+  else
+    wait = MyMalloc(sizeof(*wait));
+  wait->client = cptr;
+  wait->since = admit_clock();
+  wait->repeat = IsIPChecked(cptr) && IPcheck_nr(cptr) > 1;
+  wait->next = NULL;
+  wait->prev = l->admit_tail[wait->repeat];
+  if (wait->prev)
+    wait->prev->next = wait;
+  else
+    l->admit_head[wait->repeat] = wait;
+  l->admit_tail[wait->repeat] = wait;
+  ++l->admit_queued[wait->repeat];
+  ++admit_queued;
+  cli_admit(cptr) = wait;
+  Debug((DEBUG_INFO, "Queued %p for admission (%u waiting)", cptr,
+         admit_queued));
+
+  /* Another listener's queue may be what is blocking; check soon. */
+  if (!t_active(&admit_kick))
+    timer_add(timer_init(&admit_kick), admit_callback, 0, TT_RELATIVE, 0);
+}
+
+/** Forget about \a cptr: remove it from its admission queue, or give
+ * back its slot and let the next connection in.
+ * @param[in] cptr Client whose checks are done, or that is closing.
+ */
+void admit_done(struct Client *cptr)
+{
+  struct Listener *l = cli_listener(cptr);
+
+  if (cli_admit(cptr))
+    admit_unlink(cli_admit(cptr));
+  if (!HasFlag(cptr, FLAG_ADMITTED))
+    return;
+  ClrFlag(cptr, FLAG_ADMITTED);
+  assert(admit_pending > 0 && l->admit_pending > 0);
+  --admit_pending;
+  --l->admit_pending;
+  /* Admit from the timer: we may be deep inside exit_client(). */
+  if (admit_queued && !t_active(&admit_kick))
+    timer_add(timer_init(&admit_kick), admit_callback, 0, TT_RELATIVE, 0);
+}
+
+/** Report admission queue statistics.
+ * @param[in] sptr Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void admit_report(struct Client *sptr, const struct StatDesc *sd,
+                  char *param)
+{
+  struct Listener *l;
+
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Admission: %u checking (limit %d, %d per port), "
+             "%u waiting, %lu at once, %lu after waiting, %lu expired",
+             admit_pending, feature_int(FEAT_ADMIT_MAX_PENDING),
+             feature_int(FEAT_ADMIT_PORT_PENDING), admit_queued,
+             admit_direct, admit_waited, admit_expired);
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Admission wait: %qu avg, %qu max (usec)",
+             admit_waited ? admit_wait_total / admit_waited / 1000 : 0,
+             admit_wait_max / 1000);
+  for (l = ListenerPollList; l; l = l->next) {
+    if (listener_server(l) || listener_metrics(l))
+      continue;
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Port %u: %u checking, %u waiting first, %u waiting "
+               "repeat", l->addr.port, l->admit_pending,
+               l->admit_queued[0], l->admit_queued[1]);
+  }
+}
@@ -58,6 +58,7 @@
 #include "querycmds.h"
 #include "random.h"
 #include "res.h"
+#include "s_admit.h"
 #include "s_bsd.h"
 #include "s_conf.h"
 #include "s_debug.h"
@@ -70,6 +71,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/socket.h>
@@ -183,6 +185,12 @@ struct IAuth {
   struct SLink *i_config;               /**< configuration string list */
   struct SLink *i_stats;                /**< statistics string list */
   char **i_argv;                        /**< argument list */
+  unsigned int i_index;                 /**< position in #iauth_pool */
+  unsigned int i_pending;               /**< clients waiting for a verdict */
+  unsigned int i_done;                  /**< clients given a verdict */
+  unsigned int i_restarts;              /**< automatic respawns */
+  unsigned long long i_latency;         /**< total verdict delay (nsec) */
+  unsigned long long i_maxlatency;      /**< longest verdict delay (nsec) */
 };
 
 /** Return whether flag \a flag is set on \a iauth. */
@@ -203,8 +211,24 @@ struct IAuth {
 /** Return debug level for \a iauth. */
 #define i_debug(iauth) ((iauth)->i_debug)
 
-/** Active instance of IAuth. */
-static struct IAuth *iauth;
+/** IAuth state of one client connection, indexed by file descriptor.
+ * This outlives the AuthRequest so that the exit notice reaches the
+ * worker that saw the client.
+ */
+struct IAuthQuery {
+  struct IAuth *worker;                 /**< worker told about the client */
+  unsigned long long sent;              /**< when the worker was told */
+  int pending;                          /**< counted in IAuth::i_pending */
+};
+
+/** Running IAuth workers; the first also answers /stats queries. */
+static struct IAuth *iauth_pool[IAUTH_MAX_WORKERS];
+/** Number of entries used in #iauth_pool. */
+static unsigned int iauth_count;
+/** Worker to try first for the next client. */
+static unsigned int iauth_next;
+/** IAuth state of each local connection. */
+static struct IAuthQuery iauth_queries[MAXCONNECTIONS];
 /** Freelist of AuthRequest structures. */
 static struct AuthRequest *auth_freelist;
 /** Clients currently receiving IAuth statistics. */
@@ -215,10 +239,68 @@ static struct SLink *iauth_stats_queued;
 static void iauth_sock_callback(struct Event *ev);
 static void iauth_stderr_callback(struct Event *ev);
 static int sendto_iauth(struct Client *cptr, const char *format, ...);
+static int sendto_iauth_worker(struct IAuth *iauth, struct Client *cptr,
+                               const char *format, ...);
+static void iauth_requeue(void);
 static int preregister_user(struct Client *cptr);
 typedef int (*iauth_cmd_handler)(struct IAuth *iauth, struct Client *cli,
 				 int parc, char **params);
 
+/** Read the monotonic clock used for IAuth latency statistics.
+ * @return Current time in nanoseconds.
+ */
+static unsigned long long iauth_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Find the IAuth worker responsible for a client.
+ * @param[in] cptr Local client.
+ * @return Worker that was told about \a cptr, NULL if that worker was
+ *   removed before answering, or the first worker if none was told.
+ */
+static struct IAuth *auth_iauth(struct Client *cptr)
+{
+  struct IAuthQuery *query;
+
+  if (cli_fd(cptr) < 0)
+    return iauth_pool[0];
+  query = &iauth_queries[cli_fd(cptr)];
+  if (query->worker || query->pending)
+    return query->worker;
+  return iauth_pool[0];
+}
+
+/** Stop counting a client as waiting on its IAuth worker.
+ * @param[in] cptr Local client.
+ * @param[in] answered Non-zero if the worker gave a verdict.
+ */
+static void iauth_finish(struct Client *cptr, int answered)
+{
+  struct IAuthQuery *query;
+  unsigned long long elapsed;
+
+  if (cli_fd(cptr) < 0)
+    return;
+  query = &iauth_queries[cli_fd(cptr)];
+  if (!query->pending)
+    return;
+  query->pending = 0;
+  if (!query->worker)
+    return;
+  query->worker->i_pending--;
+  if (answered) {
+    elapsed = iauth_clock() - query->sent;
+    query->worker->i_done++;
+    query->worker->i_latency += elapsed;
+    if (elapsed > query->worker->i_maxlatency)
+      query->worker->i_maxlatency = elapsed;
+  }
+}
+
 /** Sends response \a r (from #ReportType) to client \a cptr. */
 static void sendheader(struct Client *cptr, ReportType r)
 {
@@ -438,6 +520,7 @@ int auth_set_account(struct AuthRequest *auth, const char *account_info)
 static void iauth_notify(struct AuthRequest *auth, enum AuthRequestFlag flag)
 {
   struct Client *sptr = auth->client;
+  struct IAuth *iauth = auth_iauth(sptr);
 
   switch (flag)
   {
@@ -497,9 +580,18 @@ static int check_auth_finished(struct AuthRequest *auth, int bitclr)
   from_iauth = (bitclr < 0);
   if (from_iauth)
     bitclr = -bitclr;
+  if (bitclr == AR_IAUTH_PENDING)
+    iauth_finish(auth->client, from_iauth);
   if (bitclr != AR_IAUTH_SOFT_DONE)
     FlagClr(&auth->flags, bitclr);
 
+  /* Once our own lookups are over, waiting for NICK, USER and PONG
+   * costs nothing, so let the next connection have the slot. */
+  if (!FlagHas(&auth->flags, AR_DNS_PENDING)
+      && !FlagHas(&auth->flags, AR_AUTH_PENDING)
+      && !FlagHas(&auth->flags, AR_IAUTH_PENDING))
+    admit_done(auth->client);
+
   if ((IsUserPort(auth->client) || IsWebsocketPort(auth->client))
       && !FlagHas(&auth->flags, AR_GLINE_CHECKED))
   {
@@ -579,7 +671,7 @@ static int check_auth_finished(struct AuthRequest *auth, int bitclr)
       hurry_up = 1;
 
       /* If iauth wants it, give client more time. */
-      if (IAuthHas(iauth, IAUTH_EXTRAWAIT))
+      if (IAuthHas(auth_iauth(auth->client), IAUTH_EXTRAWAIT))
         cli_firsttime(auth->client) = CurrentTime;
     }
 
@@ -588,7 +680,7 @@ static int check_auth_finished(struct AuthRequest *auth, int bitclr)
       iauth_notify(auth, (enum AuthRequestFlag)bitclr);
 
     /* Do we need to tell IAuth to hurry up? */
-    if (hurry_up && IAuthHas(iauth, IAUTH_UNDERNET))
+    if (hurry_up && IAuthHas(auth_iauth(auth->client), IAUTH_UNDERNET))
       sendto_iauth(auth->client, "H");
 
     Debug((DEBUG_INFO, "Auth %p [%d] still has flag %d", auth,
@@ -958,6 +1050,7 @@ void destroy_auth_request(struct AuthRequest* auth)
   if (t_active(&auth->timeout))
     timer_del(&auth->timeout);
 
+  admit_done(auth->client);
   cli_auth(auth->client) = NULL;
   auth->next = auth_freelist;
   auth_freelist = auth;
@@ -998,7 +1091,7 @@ int auth_ping_timeout(struct Client *cptr)
 
   /* Check for iauth timeout. */
   if (FlagHas(&auth->flags, AR_IAUTH_PENDING)) {
-    if (IAuthHas(iauth, IAUTH_REQUIRED)) {
+    if (IAuthHas(auth_iauth(cptr), IAUTH_REQUIRED)) {
       sendheader(cptr, REPORT_FAIL_IAUTH);
       return exit_client_msg(cptr, cptr, &me, "Authorization Timeout");
     }
@@ -1214,16 +1307,119 @@ static void start_dns_query(struct AuthRequest *auth)
   gethost_byaddr(&cli_ip(auth->client), auth_dns_callback, auth);
 }
 
+/** Choose the IAuth worker with the fewest clients waiting on it.
+ * Ties go to the worker after the one chosen last.
+ * @return A running worker, or NULL if there is none.
+ */
+static struct IAuth *iauth_pick(void)
+{
+  struct IAuth *best = NULL;
+  struct IAuth *iauth;
+  unsigned int ii;
+
+  for (ii = 0; ii < iauth_count; ++ii) {
+    iauth = iauth_pool[(iauth_next + ii) % iauth_count];
+    if (!i_GetConnected(iauth) || IAuthHas(iauth, IAUTH_CLOSING))
+      continue;
+    if (!best || iauth->i_pending < best->i_pending)
+      best = iauth;
+  }
+  if (best)
+    iauth_next = best->i_index + 1;
+  return best;
+}
+
+/** Hand a client to an IAuth worker.
+ * A client taken over from a worker that went away is replayed to
+ * the new worker: it gets what the old one was told, as far as the
+ * auth request still shows it.
+ * @param[in] auth Authorization request with #AR_IAUTH_PENDING set.
+ * @param[in] iauth Running worker to take the client.
+ * @return Non-zero if the client was introduced to \a iauth.
+ */
+static int iauth_assign(struct AuthRequest *auth, struct IAuth *iauth)
+{
+  struct Client *cptr = auth->client;
+  struct IAuthQuery *query = &iauth_queries[cli_fd(cptr)];
+  enum AuthRequestFlag flag;
+  int replay;
+
+  replay = query->pending;
+  if (!replay)
+    query->sent = iauth_clock();
+  else if (query->worker)
+    query->worker->i_pending--;
+  query->worker = iauth;
+  query->pending = 1;
+  iauth->i_pending++;
+
+  if (!sendto_iauth(cptr, "C %s %hu %s %hu", cli_sock_ip(cptr), auth->port,
+                    ircd_ntoa(&auth->local.addr), auth->local.port))
+    return 0;
+  if (!replay)
+    return 1;
+
+  if (IsTLS(cptr) && *cli_tls_fingerprint(cptr))
+    sendto_iauth(cptr, "Z %s", cli_tls_fingerprint(cptr));
+  if (IsAccount(cptr))
+    sendto_iauth(cptr, "A %s", cli_user(cptr)->account);
+  if (FlagHas(&auth->flags, AR_CAP_PENDING))
+    sendto_iauth(cptr, "c");
+  if (*cli_passwd(cptr) && IAuthHas(iauth, IAUTH_ADDLINFO))
+    sendto_iauth(cptr, "P :%s", cli_passwd(cptr));
+  if (FlagHas(&auth->flags, AR_GLINE_CHECKED))
+    for (flag = 1; flag <= AR_LAST_SCAN; ++flag)
+      if (!FlagHas(&auth->flags, flag))
+        iauth_notify(auth, flag);
+  if (FlagHas(&auth->flags, AR_IAUTH_HURRY)
+      && IAuthHas(iauth, IAUTH_UNDERNET))
+    sendto_iauth(cptr, "H");
+  return 1;
+}
+
+/** Move clients whose IAuth worker went away to running workers. */
+static void iauth_requeue(void)
+{
+  struct IAuthQuery *query;
+  struct IAuth *iauth;
+  struct Client *cptr;
+  int fd;
+
+  for (fd = 0; fd <= HighestFd; ++fd) {
+    query = &iauth_queries[fd];
+    if (!query->pending || i_GetConnected(query->worker))
+      continue;
+    cptr = LocalClientArray[fd];
+    if (!cptr || !cli_auth(cptr)
+        || !FlagHas(&cli_auth(cptr)->flags, AR_IAUTH_PENDING)) {
+      /* Should not happen, but do not keep counting it. */
+      if (query->worker)
+        query->worker->i_pending--;
+      query->pending = 0;
+      continue;
+    }
+    if (!(iauth = iauth_pick()))
+      return;
+    iauth_assign(cli_auth(cptr), iauth);
+  }
+}
+
 /** Initiate IAuth check for a client.
  * @param[in] auth The auth request for which to star the IAuth check.
  */
 static void start_iauth_query(struct AuthRequest *auth)
 {
+  struct IAuth *iauth;
+
+  /* Forget what an earlier client on this descriptor left behind. */
+  iauth_finish(auth->client, 0);
+  iauth_queries[cli_fd(auth->client)].worker = NULL;
+
   FlagSet(&auth->flags, AR_IAUTH_PENDING);
-  if (!sendto_iauth(auth->client, "C %s %hu %s %hu",
-                    cli_sock_ip(auth->client), auth->port,
-                    ircd_ntoa(&auth->local.addr), auth->local.port))
+  if (!(iauth = iauth_pick()) || !iauth_assign(auth, iauth)) {
+    iauth_finish(auth->client, 0);
     FlagClr(&auth->flags, AR_IAUTH_PENDING);
+  }
 }
 
 /** Starts auth (identd) and dns queries for a client.
@@ -1402,7 +1598,7 @@ int auth_set_nick(struct AuthRequest *auth, const char *nickname)
 int auth_set_password(struct AuthRequest *auth, const char *password)
 {
   assert(auth != NULL);
-  if (IAuthHas(iauth, IAUTH_ADDLINFO))
+  if (IAuthHas(auth_iauth(auth->client), IAUTH_ADDLINFO))
     sendto_iauth(auth->client, "P :%s", password);
   return 0;
 }
@@ -1412,18 +1608,32 @@ int auth_set_password(struct AuthRequest *auth, const char *password)
  */
 void auth_send_exit(struct Client *cptr)
 {
+  iauth_finish(cptr, 0);
   sendto_iauth(cptr, "D");
+  if (cli_fd(cptr) >= 0)
+    iauth_queries[cli_fd(cptr)].worker = NULL;
 }
 
 /** Forward an XREPLY on to iauth.
  * @param[in] sptr Source of the XREPLY.
- * @param[in] routing Routing information for the original XQUERY.
+ * @param[in] routing Routing information for the original XQUERY,
+ *   starting with the number of the worker that sent it.
  * @param[in] reply Contents of the reply.
  */
 void auth_send_xreply(struct Client *sptr, const char *routing,
 		      const char *reply)
 {
-  sendto_iauth(NULL, "X %#C %s :%s", sptr, routing, reply);
+  struct IAuth *iauth = iauth_pool[0];
+  unsigned long index;
+  char *end;
+
+  index = strtoul(routing, &end, 10);
+  if (end != routing && *end == ':') {
+    if (index < iauth_count)
+      iauth = iauth_pool[index];
+    routing = end + 1;
+  }
+  sendto_iauth_worker(iauth, NULL, "X %#C %s :%s", sptr, routing, reply);
 }
 
 /** Mark that a user has started capabilities negotiation.
@@ -1488,7 +1698,7 @@ int auth_spoof_user(struct AuthRequest *auth, const char *username, const char *
   }
 
   start_iauth_query(auth);
-  if (username && IAuthHas(iauth, IAUTH_UNDERNET))
+  if (username && IAuthHas(auth_iauth(sptr), IAUTH_UNDERNET))
     sendto_iauth(sptr, "u %s", cli_username(sptr));
 
   return check_auth_finished(auth, 0);
@@ -1515,6 +1725,8 @@ int iauth_do_spawn(struct IAuth *iauth, int automatic)
 
   /* Record time we tried to spawn the iauth process. */
   iauth->started = CurrentTime;
+  iauth->i_count = 0;
+  iauth->i_errcount = 0;
 
   /* Attempt to allocate a pair of sockets. */
   res = os_socketpair(s_io);
@@ -1595,7 +1807,8 @@ int iauth_do_spawn(struct IAuth *iauth, int automatic)
      * Need to use conf_get_local() since &me may not be fully
      * initialized the first time we run.
      */
-    sendto_iauth(NULL, "M %s %d", conf_get_local()->name, MAXCONNECTIONS);
+    sendto_iauth_worker(iauth, NULL, "M %s %d", conf_get_local()->name,
+                        MAXCONNECTIONS);
     /* Indicate success (until the child dies). */
     return 0;
   }
@@ -1616,58 +1829,92 @@ int iauth_do_spawn(struct IAuth *iauth, int automatic)
   exit(EXIT_FAILURE);
 }
 
-/** See if an %IAuth program must be spawned.
- * If a process is already running with the specified options, keep it.
- * Otherwise spawn a new child process to perform the %IAuth function.
- * @param[in] argc Number of parameters to use when starting process.
+/** Check whether an %IAuth worker runs a given command line.
+ * @param[in] iauth Worker to check.
+ * @param[in] argc Number of parameters in \a argv.
  * @param[in] argv Array of parameters to start process.
- * @return 0 on failure, 1 on new process, 2 on reuse of existing process.
+ * @return Non-zero if \a iauth was started with exactly \a argv.
  */
-int auth_spawn(int argc, char *argv[])
+static int iauth_same_argv(const struct IAuth *iauth, int argc, char *argv[])
 {
   int ii;
 
-  if (iauth) {
-    int same = 1;
+  for (ii = 0; ii < argc; ++ii) {
+    if (NULL == iauth->i_argv[ii]
+        || 0 != strcmp(iauth->i_argv[ii], argv[ii]))
+      return 0;
+  }
+  return NULL == iauth->i_argv[ii];
+}
 
-    /* Check that incoming arguments all match pre-existing arguments. */
-    for (ii = 0; same && (ii < argc); ++ii) {
-      if (NULL == iauth->i_argv[ii]
-          || 0 != strcmp(iauth->i_argv[ii], argv[ii]))
-        same = 0;
-    }
-    /* Check that we have no more pre-existing arguments. */
-    if (same && iauth->i_argv[ii])
-      same = 0;
-    /* If they are the same and still connected, clear the "closing" flag and exit. */
-    if (same && i_GetConnected(iauth)) {
-      Debug((DEBUG_INFO, "Reusing existing IAuth process"));
-      IAuthClr(iauth, IAUTH_CLOSING);
-      return 2;
-    }
+/** See if %IAuth programs must be spawned.
+ * Running workers with the specified options are kept.  Workers that
+ * died are restarted, and more are spawned until \a workers run.
+ * Workers past that number are left marked as closing.
+ * @param[in] argc Number of parameters to use when starting process.
+ * @param[in] argv Array of parameters to start process.
+ * @param[in] workers Number of worker processes to run.
+ * @return 0 on failure, 1 on new process, 2 on reuse of existing processes.
+ */
+int auth_spawn(int argc, char *argv[], int workers)
+{
+  struct IAuth *iauth;
+  unsigned int ii;
+  int jj;
+  int res = 2;
+
+  if (workers < 1)
+    workers = 1;
+  else if (workers > IAUTH_MAX_WORKERS)
+    workers = IAUTH_MAX_WORKERS;
+
+  /* A different program replaces every worker. */
+  if (iauth_count && !iauth_same_argv(iauth_pool[0], argc, argv)) {
+    auth_mark_closing();
     auth_close_unused();
   }
 
-  /* Need to initialize a new connection. */
-  iauth = MyCalloc(1, sizeof(*iauth));
-  msgq_init(i_sendQ(iauth));
-  /* Populate iauth's argv array. */
-  iauth->i_argv = MyCalloc(argc + 1, sizeof(iauth->i_argv[0]));
-  for (ii = 0; ii < argc; ++ii)
-    DupString(iauth->i_argv[ii], argv[ii]);
-  iauth->i_argv[ii] = NULL;
-  /* Try to spawn it, and handle the results. */
-  if (iauth_do_spawn(iauth, 0))
-    return 0;
-  IAuthClr(iauth, IAUTH_CLOSING);
-  return 1;
+  for (ii = 0; ii < (unsigned int)workers; ++ii) {
+    if (ii < iauth_count) {
+      iauth = iauth_pool[ii];
+      if (i_GetConnected(iauth)) {
+        Debug((DEBUG_INFO, "Reusing existing IAuth process %u", ii));
+        IAuthClr(iauth, IAUTH_CLOSING);
+        continue;
+      }
+    } else {
+      /* Need to initialize a new connection. */
+      iauth = MyCalloc(1, sizeof(*iauth));
+      msgq_init(i_sendQ(iauth));
+      s_fd(i_socket(iauth)) = -1;
+      s_fd(i_stderr(iauth)) = -1;
+      /* Populate iauth's argv array. */
+      iauth->i_argv = MyCalloc(argc + 1, sizeof(iauth->i_argv[0]));
+      for (jj = 0; jj < argc; ++jj)
+        DupString(iauth->i_argv[jj], argv[jj]);
+      iauth->i_argv[jj] = NULL;
+      iauth->i_index = ii;
+      iauth_pool[iauth_count++] = iauth;
+    }
+    /* Try to spawn it, and handle the results. */
+    if (iauth_do_spawn(iauth, 0))
+      res = 0;
+    else if (res)
+      res = 1;
+    IAuthClr(iauth, IAUTH_CLOSING);
+  }
+
+  iauth_requeue();
+  return res;
 }
 
 /** Mark all %IAuth connections as closing. */
 void auth_mark_closing(void)
 {
-  if (iauth)
-    IAuthSet(iauth, IAUTH_CLOSING);
+  unsigned int ii;
+
+  for (ii = 0; ii < iauth_count; ++ii)
+    IAuthSet(iauth_pool[ii], IAUTH_CLOSING);
 }
 
 /** Complete disconnection of an %IAuth connection.
@@ -1678,6 +1925,10 @@ static void iauth_disconnect(struct IAuth *iauth)
   if (iauth == NULL)
     return;
 
+  /* Drop output meant for this process. */
+  msgq_delete(i_sendQ(iauth), MsgQLength(i_sendQ(iauth)));
+  IAuthClr(iauth, IAUTH_BLOCKED);
+
   /* Close error socket. */
   if (s_fd(i_stderr(iauth)) != -1) {
     close(s_fd(i_stderr(iauth)));
@@ -1693,19 +1944,36 @@ static void iauth_disconnect(struct IAuth *iauth)
   }
 }
 
-/** Close all %IAuth connections marked as closing. */
+/** Close all %IAuth connections marked as closing.
+ * Clients still waiting on them move to the remaining workers.
+ */
 void auth_close_unused(void)
 {
-  if (IAuthHas(iauth, IAUTH_CLOSING)) {
-    int ii;
+  struct IAuth *iauth;
+  unsigned int ii, jj, count;
+  int fd;
+
+  for (ii = count = 0; ii < iauth_count; ++ii) {
+    iauth = iauth_pool[ii];
+    iauth_pool[ii] = NULL;
+    if (!IAuthHas(iauth, IAUTH_CLOSING)) {
+      iauth->i_index = count;
+      iauth_pool[count++] = iauth;
+      continue;
+    }
+    for (fd = 0; fd <= HighestFd; ++fd)
+      if (iauth_queries[fd].worker == iauth)
+        iauth_queries[fd].worker = NULL;
     iauth_disconnect(iauth);
     if (iauth->i_argv) {
-      for (ii = 0; iauth->i_argv[ii]; ++ii)
-        MyFree(iauth->i_argv[ii]);
+      for (jj = 0; iauth->i_argv[jj]; ++jj)
+        MyFree(iauth->i_argv[jj]);
       MyFree(iauth->i_argv);
     }
     MyFree(iauth);
   }
+  iauth_count = count;
+  iauth_requeue();
 }
 
 /** Send queued output to \a iauth.
@@ -1740,14 +2008,15 @@ static void iauth_write(struct IAuth *iauth)
   socket_events(i_socket(iauth), SOCK_ACTION_DEL | SOCK_EVENT_WRITABLE);
 }
 
-/** Send a message to iauth.
+/** Send a message to an iauth worker.
+ * @param[in] iauth Worker to send to.
  * @param[in] cptr Optional client context for message.
- * @param[in] format Format string for message.
+ * @param[in] vd Format string and arguments for message.
  * @return Non-zero on successful send or buffering, zero on failure.
  */
-static int sendto_iauth(struct Client *cptr, const char *format, ...)
+static int iauth_send(struct IAuth *iauth, struct Client *cptr,
+                      struct VarData *vd)
 {
-  struct VarData vd;
   struct MsgBuf *mb;
 
   /* Do not send requests when we have no iauth. */
@@ -1755,15 +2024,12 @@ static int sendto_iauth(struct Client *cptr, const char *format, ...)
     return 0;
   /* Do not send for clients in the NORMAL state. */
   if (cptr
-      && (format[0] != 'D')
+      && (vd->vd_format[0] != 'D')
       && (!cli_auth(cptr) || !FlagHas(&cli_auth(cptr)->flags, AR_IAUTH_PENDING)))
     return 0;
 
   /* Build the message buffer. */
-  vd.vd_format = format;
-  va_start(vd.vd_args, format);
-  mb = msgq_make(NULL, "%d %v", cptr ? cli_fd(cptr) : -1, &vd);
-  va_end(vd.vd_args);
+  mb = msgq_make(NULL, "%d %v", cptr ? cli_fd(cptr) : -1, vd);
 
   /* Tack it onto the iauth sendq and try to write it. */
   ++iauth->i_sendM;
@@ -1773,6 +2039,44 @@ static int sendto_iauth(struct Client *cptr, const char *format, ...)
   return 1;
 }
 
+/** Send a message to iauth.
+ * Messages about a client go to the worker that was told about it;
+ * others go to the first worker.
+ * @param[in] cptr Optional client context for message.
+ * @param[in] format Format string for message.
+ * @return Non-zero on successful send or buffering, zero on failure.
+ */
+static int sendto_iauth(struct Client *cptr, const char *format, ...)
+{
+  struct VarData vd;
+  int res;
+
+  vd.vd_format = format;
+  va_start(vd.vd_args, format);
+  res = iauth_send(cptr ? auth_iauth(cptr) : iauth_pool[0], cptr, &vd);
+  va_end(vd.vd_args);
+  return res;
+}
+
+/** Send a message to a particular iauth worker.
+ * @param[in] iauth Worker to send to.
+ * @param[in] cptr Optional client context for message.
+ * @param[in] format Format string for message.
+ * @return Non-zero on successful send or buffering, zero on failure.
+ */
+static int sendto_iauth_worker(struct IAuth *iauth, struct Client *cptr,
+                               const char *format, ...)
+{
+  struct VarData vd;
+  int res;
+
+  vd.vd_format = format;
+  va_start(vd.vd_args, format);
+  res = iauth_send(iauth, cptr, &vd);
+  va_end(vd.vd_args);
+  return res;
+}
+
 /** Send text to interested operators (SNO_AUTH server notice).
  * @param[in] iauth Active IAuth session.
  * @param[in] cli Client referenced by command.
@@ -1953,7 +2257,7 @@ static int iauth_cmd_newstats(struct IAuth *iauth, struct Client *cli,
   struct SLink *head;
   struct SLink *next;
 
-  if (iauth_stats_clients)
+  if (iauth_stats_clients && iauth == iauth_pool[0])
   {
     for (head = iauth_stats_clients; head; head = next)
     {
@@ -1998,7 +2302,7 @@ static int iauth_cmd_stats(struct IAuth *iauth, struct Client *cli,
   char *line;
 
   line = paste_params(parc, params);
-  if (iauth_stats_clients)
+  if (iauth_stats_clients && iauth == iauth_pool[0])
   {
     for (node = iauth_stats_clients; node; node = node->next)
     {
@@ -2315,8 +2619,10 @@ static int iauth_cmd_done_account(struct IAuth *iauth, struct Client *cli,
 static int iauth_cmd_kill(struct IAuth *iauth, struct Client *cli,
 			  int parc, char **params)
 {
-  if (cli_auth(cli))
+  if (cli_auth(cli) && FlagHas(&cli_auth(cli)->flags, AR_IAUTH_PENDING)) {
+    iauth_finish(cli, 1);
     FlagClr(&cli_auth(cli)->flags, AR_IAUTH_PENDING);
+  }
   if (EmptyString(params[0]))
     params[0] = "Access denied";
   exit_client(cli, cli, &me, params[0]);
@@ -2374,34 +2680,36 @@ static int iauth_cmd_xquery(struct IAuth *iauth, struct Client *cli,
 
   /* Process parameters */
   if (EmptyString(params[0])) {
-    sendto_iauth(cli, "E Missing :Missing server parameter");
+    sendto_iauth_worker(iauth, cli, "E Missing :Missing server parameter");
     return 0;
   } else
     serv = params[0];
 
   if (EmptyString(params[1])) {
-    sendto_iauth(cli, "E Missing :Missing routing parameter");
+    sendto_iauth_worker(iauth, cli, "E Missing :Missing routing parameter");
     return 0;
   } else
     routing = params[1];
 
   if (EmptyString(params[2])) {
-    sendto_iauth(cli, "E Missing :Missing query parameter");
+    sendto_iauth_worker(iauth, cli, "E Missing :Missing query parameter");
     return 0;
   } else
     query = params[2];
 
   /* Try to find the specified server */
   if (!(acptr = find_match_server(serv))) {
-    sendto_iauth(cli, "x %s %s :Server not online", serv, routing);
+    sendto_iauth_worker(iauth, cli, "x %s %s :Server not online", serv,
+                        routing);
     return 0;
   }
 
   /* If it's to us, do nothing; otherwise, forward the query */
   if (!IsMe(acptr))
-    /* The "iauth:" prefix helps ircu route the reply to iauth */
-    sendcmdto_one(&me, CMD_XQUERY, acptr, "%C iauth:%s :%s", acptr, routing,
-		  query);
+    /* The "iauth:" prefix helps ircu route the reply to iauth, and
+     * the worker number to the worker that asked. */
+    sendcmdto_one(&me, CMD_XQUERY, acptr, "%C iauth:%u:%s :%s", acptr,
+                  iauth->i_index, routing, query);
 
   return 0;
 }
@@ -2448,7 +2756,7 @@ static void iauth_parse(struct IAuth *iauth, char *message)
 	     */
   case 'K': handler = iauth_cmd_kill; has_cli = 2; break;
   case 'r': /* we handle termination directly */ return;
-  default:  sendto_iauth(NULL, "E Garbage :[%s]", message); return;
+  default:  sendto_iauth_worker(iauth, NULL, "E Garbage :[%s]", message); return;
   }
 
   while (parc < MAXPARA) {
@@ -2481,11 +2789,13 @@ static void iauth_parse(struct IAuth *iauth, char *message)
     /* Try to find the client associated with the request. */
     id = strtol(params[0], NULL, 10);
     if (parc < 3)
-      sendto_iauth(NULL, "E Missing :Need <id> <ip> <port>");
-    else if (id < 0 || id > HighestFd || !(cli = LocalClientArray[id]))
-      /* Client no longer exists (or never existed). */
-      sendto_iauth(NULL, "E Gone :[%s %s %s]", params[0], params[1],
-		   params[2]);
+      sendto_iauth_worker(iauth, NULL, "E Missing :Need <id> <ip> <port>");
+    else if (id < 0 || id > HighestFd || !(cli = LocalClientArray[id])
+             || auth_iauth(cli) != iauth)
+      /* Client no longer exists (or never existed, or belongs to
+       * another worker). */
+      sendto_iauth_worker(iauth, NULL, "E Gone :[%s %s %s]", params[0],
+                          params[1], params[2]);
     else if ((!(auth = cli_auth(cli)) ||
 	      !FlagHas(&auth->flags, AR_IAUTH_PENDING)) &&
 	     has_cli == 1)
@@ -2569,6 +2879,17 @@ static void iauth_read(struct IAuth *iauth)
   memcpy(iauth->i_buffer, sol, iauth->i_count);
 }
 
+/** Restart an %IAuth worker whose process went away, and move the
+ * clients it left waiting to running workers.
+ * @param[in] iauth Worker that lost its process.
+ */
+static void iauth_lost(struct IAuth *iauth)
+{
+  if (!IAuthHas(iauth, IAUTH_CLOSING) && !iauth_do_spawn(iauth, 1))
+    ++iauth->i_restarts;
+  iauth_requeue();
+}
+
 /** Handle socket activity for an %IAuth connection.
  * @param[in] ev &Socket event; the IAuth connection is the user data
  *   pointer for the socket.
@@ -2583,8 +2904,8 @@ static void iauth_sock_callback(struct Event *ev)
 
   switch (ev_type(ev)) {
   case ET_DESTROY:
-    if (!IAuthHas(iauth, IAUTH_CLOSING) && !s_active(i_stderr(iauth)))
-      iauth_do_spawn(iauth, 1);
+    if (!s_active(i_stderr(iauth)))
+      iauth_lost(iauth);
     break;
   case ET_READ:
     iauth_read(iauth);
@@ -2657,8 +2978,8 @@ static void iauth_stderr_callback(struct Event *ev)
 
   switch (ev_type(ev)) {
   case ET_DESTROY:
-    if (!IAuthHas(iauth, IAUTH_CLOSING) && !s_active(i_socket(iauth)))
-      iauth_do_spawn(iauth, 1);
+    if (!s_active(i_socket(iauth)))
+      iauth_lost(iauth);
     break;
   case ET_READ:
     iauth_read_stderr(iauth);
@@ -2682,6 +3003,7 @@ static void iauth_stderr_callback(struct Event *ev)
  */
 void report_iauth_conf(struct Client *cptr, const struct StatDesc *sd, char *param)
 {
+  struct IAuth *iauth = iauth_pool[0];
   struct SLink *link;
 
   if (!iauth)
@@ -2701,17 +3023,33 @@ void report_iauth_conf(struct Client *cptr, const struct StatDesc *sd, char *par
 }
 
 /** Report active iauth's statistics to \a cptr.
+ * The server's own per-worker counters come first, with times in
+ * microseconds; the rest is what the first worker reports.
  * @param[in] cptr Client requesting statistics.
  * @param[in] sd Stats descriptor for request.
  * @param[in] param Extra parameter from user (may be NULL).
  */
 void report_iauth_stats(struct Client *cptr, const struct StatDesc *sd, char *param)
 {
+  struct IAuth *iauth = iauth_pool[0];
+  struct IAuth *worker;
   struct SLink *link;
+  unsigned int ii;
 
   if (!iauth)
     return;
 
+  for (ii = 0; ii < iauth_count; ++ii)
+  {
+    worker = iauth_pool[ii];
+    send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG, ":Worker %u: %s, "
+               "%u pending, %u queued, %u answered, %qu avg, %qu max, "
+               "%u restarts", ii, i_GetConnected(worker) ? "running" : "dead",
+               worker->i_pending, MsgQLength(i_sendQ(worker)), worker->i_done,
+               worker->i_done ? worker->i_latency / worker->i_done / 1000 : 0,
+               worker->i_maxlatency / 1000, worker->i_restarts);
+  }
+
   if (IAuthHas(iauth, IAUTH_STATS2))
   {
     struct SLink *link;
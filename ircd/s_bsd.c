@@ -38,6 +38,8 @@
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
 #include "ircd_tls.h"
+#include "ircd_upgrade.h"
+#include "ircd_zip.h"
 #include "ircd.h"
 #include "list.h"
 #include "listener.h"
@@ -50,10 +52,12 @@
 #include "querycmds.h"
 #include "res.h"
 #include "sasl.h"
+#include "s_admit.h"
 #include "s_auth.h"
 #include "s_conf.h"
 #include "s_debug.h"
 #include "s_misc.h"
+#include "s_serv.h"
 #include "s_user.h"
 #include "send.h"
 #include "struct.h"
@@ -170,12 +174,13 @@ void close_connections(int close_stderr)
   int i;
   if (close_stderr)
   {
-    close(0);
-    close(1);
-    close(2);
+    for (i = 0; i < 3; ++i)
+      if (!upgrade_inherited(i))
+        close(i);
   }
   for (i = 3; i < MAXCONNECTIONS; ++i)
-    close(i);
+    if (!upgrade_inherited(i))
+      close(i);
 }
 
 /** Initialize process fd limit to MAXCONNECTIONS.
@@ -394,10 +399,12 @@ static int completed_connection(struct Client* cptr)
   cli_lasttime(cptr) = CurrentTime;
   ClearPingSent(cptr);
 
-  sendrawto_one(cptr, MSG_SERVER " %s 1 %Tu %Tu J%s %s%s +%s6 :%s",
+  sendrawto_one(cptr, MSG_SERVER " %s 1 %Tu %Tu J%s %s%s +%s%s6 :%s",
                 cli_name(&me), cli_serv(&me)->timestamp, newts,
 		MAJOR_PROTOCOL, NumServCap(&me),
-		feature_bool(FEAT_HUB) ? "h" : "", cli_info(&me));
+		feature_bool(FEAT_HUB) ? "h" : "",
+		(aconf->flags & CONF_CONNECT_COMPRESS) && zip_supported() ? "c" : "",
+		cli_info(&me));
 
   if (IsTLS(cptr) && !IsNegotiatingTLS(cptr)) {
     Debug((DEBUG_DEBUG, "TLS connection completed for %s", cli_name(cptr)));
@@ -460,6 +467,7 @@ void close_connection(struct Client *cptr)
     socket_del(&(cli_socket(cptr))); /* queue a socket delete */
     cli_fd(cptr) = -1;
   }
+  zip_free(cptr);
   SetFlag(cptr, FLAG_DEADSOCKET);
 
   MsgQClear(&(cli_sendQ(cptr)));
@@ -473,6 +481,9 @@ void close_connection(struct Client *cptr)
   /* Clean up SASL timer if it exists */
   sasl_stop_timeout(cptr);
 
+  /* Leave the admission queue, or free up a registration slot. */
+  admit_done(cptr);
+
   if (cli_listener(cptr)) {
     release_listener(cli_listener(cptr));
     cli_listener(cptr) = 0;
@@ -625,7 +636,65 @@ void add_connection(struct Listener* listener, int fd) {
   Count_newunknown(UserStats);
   /* if we've made it this far we can put the client on the auth query pile */
   if (!IsTLS(new_client))
-    start_auth(new_client);
+    admit_client(new_client);
+}
+
+/** Adopt a user connection inherited from the process that exec()ed us
+ * for a hot upgrade.  The socket is registered with the event engine
+ * and entered in LocalClientArray, but the caller fills in everything
+ * else about the client.
+ * @param[in] listener Listener that originally accepted \a fd.
+ * @param[in] fd Connected socket.
+ * @return The new client, or NULL if \a fd could not be registered.
+ */
+struct Client* adopt_connection(struct Listener* listener, int fd)
+{
+  struct Client* new_client;
+
+  assert(0 != listener);
+
+  if (!os_set_nonblocking(fd)) {
+    close(fd);
+    return 0;
+  }
+
+  new_client = make_client(0, STAT_UNKNOWN_USER);
+  cli_fd(new_client) = fd;
+  if (!socket_add(&(cli_socket(new_client)), client_sock_callback,
+		  (void*) cli_connect(new_client), SS_CONNECTED, 0, fd)) {
+    close(fd);
+    cli_fd(new_client) = -1;
+    free_client(new_client);
+    return 0;
+  }
+  cli_freeflag(new_client) |= FREEFLAG_SOCKET;
+  cli_listener(new_client) = listener;
+  ++listener->ref_count;
+
+  cli_lasttime(new_client) = CurrentTime;
+  cli_since(new_client) = CurrentTime;
+  if (fd > HighestFd)
+    HighestFd = fd;
+  LocalClientArray[fd] = new_client;
+  socket_events(&(cli_socket(new_client)),
+                SOCK_ACTION_SET | SOCK_EVENT_READABLE);
+
+  Count_newunknown(UserStats);
+  return new_client;
+}
+
+/** Parse whatever is already in a client's recvQ without waiting for
+ * the client to send more.
+ * @param[in] cptr Client whose recvQ was filled without a read.
+ */
+void schedule_recvq(struct Client* cptr)
+{
+  if (DBufLength(&(cli_recvQ(cptr))) && !t_onqueue(&(cli_proc(cptr))))
+  {
+    cli_freeflag(cptr) |= FREEFLAG_TIMER;
+    timer_add(&(cli_proc(cptr)), client_timer_callback, cli_connect(cptr),
+              TT_RELATIVE, 1);
+  }
 }
 
 /** Determines whether to tell the events engine we're interested in
@@ -634,13 +703,15 @@ void add_connection(struct Listener* listener, int fd) {
  */
 void update_write(struct Client* cptr)
 {
-  /* If there are messages that need to be sent along, or if the client
-   * is in the middle of a /list, then we need to tell the engine that
-   * we're interested in writable events--otherwise, we need to drop
-   * that interest.
+  /* If there are messages that need to be sent along (possibly still
+   * inside the link compressor), or if the client is in the middle of
+   * a /list or a burst, then we need to tell the engine that we're
+   * interested in writable events--otherwise, we need to drop that
+   * interest.
    */
   socket_events(&(cli_socket(cptr)),
-		((MsgQLength(&cli_sendQ(cptr)) || cli_listing(cptr)) ?
+		((MsgQLength(&cli_sendQ(cptr)) || cli_listing(cptr)
+		  || cli_burst(cptr) || zip_pending(cptr)) ?
 		 SOCK_ACTION_ADD : SOCK_ACTION_DEL) | SOCK_EVENT_WRITABLE);
 }
 
@@ -1090,7 +1161,7 @@ static void tls_handshake_succeeded(struct Client *cptr)
   if (IsConnecting(cptr))
     completed_connection(cptr);
   else if (!cli_auth(cptr))
-    start_auth(cptr);
+    admit_client(cptr);
 }
 
 /** Process events on a client socket.
@@ -1180,8 +1251,13 @@ static void client_sock_callback(struct Event* ev)
     ClrFlag(cptr, FLAG_BLOCKED);
     if (cli_listing(cptr) && MsgQLength(&(cli_sendQ(cptr))) < 2048)
       list_next_channels(cptr);
-    Debug((DEBUG_SEND, "Sending queued data to %C", cptr));
-    send_queued(cptr);
+    if (cli_burst(cptr))
+      server_burst_next(cptr);
+    /* Clients wait for the write scheduler; server links go now. */
+    if (WritePriority(cptr)) {
+      Debug((DEBUG_SEND, "Sending queued data to %C", cptr));
+      send_queued(cptr);
+    }
     break;
 
   case ET_READ: /* socket is readable */
@@ -1197,6 +1273,8 @@ static void client_sock_callback(struct Event* ev)
         }
         /* TLS negotiation succeeded */
         tls_handshake_succeeded(cptr);
+        if (cli_admit(cptr))
+          break; /* not reading until admitted */
       }
       if (read_packet(cptr, 1) == 0) /* error while reading packet */
         fallback = "EOF from client";
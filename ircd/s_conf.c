@@ -619,14 +619,14 @@ struct ConfItem *conf_debug_iline(const char *client)
 
   /* Look for a Kill block with the user's name on it. */
   for (deny = denyConfList; deny; deny = deny->next) {
-    if (deny->usermask && match(deny->usermask, username))
+    if (deny->usercomp && matchmask(deny->usercomp, username))
       continue;
-    if (deny->realmask && match(deny->realmask, realname))
+    if (deny->realcomp && matchmask(deny->realcomp, realname))
       continue;
     if (deny->bits > 0) {
       if (!ipmask_check(&address, &deny->address, deny->bits))
         continue;
-    } else if (deny->hostmask && match(deny->hostmask, hostname))
+    } else if (deny->hostcomp && matchmask(deny->hostcomp, hostname))
       continue;
 
     /* Looks like a match; report it. */
@@ -904,6 +904,9 @@ void conf_erase_deny_list(void)
     MyFree(p->usermask);
     MyFree(p->message);
     MyFree(p->realmask);
+    MyFree(p->hostcomp);
+    MyFree(p->usercomp);
+    MyFree(p->realcomp);
     MyFree(p);
   }
   denyConfList = 0;
@@ -1261,14 +1264,14 @@ int find_kill(struct Client *cptr)
    *             -- Isomer
    */
   for (deny = denyConfList; deny; deny = deny->next) {
-    if (deny->usermask && match(deny->usermask, name))
+    if (deny->usercomp && matchmask(deny->usercomp, name))
       continue;
-    if (deny->realmask && match(deny->realmask, realname))
+    if (deny->realcomp && matchmask(deny->realcomp, realname))
       continue;
     if (deny->bits > 0) {
       if (!ipmask_check(&cli_ip(cptr), &deny->address, deny->bits))
         continue;
-    } else if (deny->hostmask && match(deny->hostmask, host))
+    } else if (deny->hostcomp && matchmask(deny->hostcomp, host))
       continue;
 
     if (EmptyString(deny->message))
@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include "s_debug.h"
+#include "IPcheck.h"
 #include "channel.h"
 #include "class.h"
 #include "client.h"
@@ -215,6 +216,7 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
   struct ConfItem *aconf;
   const struct ConnectionClass* cltmp;
   struct Membership* member;
+  struct IPcheckStats ipc;
 
   int acc = 0,                  /* accounts */
       c = 0,                    /* clients */
@@ -353,6 +355,14 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
 	     ":Glines %d(%zu) Jupes %d(%zu)", gl, glm, ju, jum);
 
+  IPcheck_stats(&ipc);
+  send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
+	     ":IPcheck %u(%zu) idle %u buckets %u/%u chain %u "
+	     "/48 %u buckets %u/%u chain %u expired %u",
+	     ipc.entries, ipc.bytes, ipc.idle, ipc.used, ipc.buckets,
+	     ipc.max_chain, ipc.entries48, ipc.used48, ipc.buckets48,
+	     ipc.max_chain48, ipc.expired);
+
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
 	     ":Hash: client %d(%zu), chan is the same", HASHSIZE,
 	     sizeof(void *) * HASHSIZE);
@@ -382,7 +392,7 @@ void count_memory(struct Client *cptr, const struct StatDesc *sd,
 
   tot =
       totww + totch + totcl + com + cl * sizeof(struct ConnectionClass) +
-      dbufs_allocated + msg_allocated + msgbuf_allocated + rm;
+      dbufs_allocated + msg_allocated + msgbuf_allocated + rm + ipc.bytes;
   tot += sizeof(void *) * HASHSIZE * 3;
 
 #if defined(MDEBUG)
@@ -24,6 +24,7 @@
 
 #include "numeric.h"
 #include "ircd_log.h"
+#include "ircd_snprintf.h"
 #include "s_debug.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
@@ -2046,6 +2047,18 @@ const struct Numeric* get_error_numeric(int n)
   return &replyTable[n];
 }
 
+/** Compile the format of every numeric so send_reply() need not parse
+ * it each time.
+ */
+void init_numerics(void)
+{
+  int n;
+
+  for (n = 1; n < ERR_LASTERROR; n++)
+    if (replyTable[n].value && replyTable[n].format)
+      ircd_format_compile(replyTable[n].format);
+}
+
 /** Return a format string for a numeric response.
  * @param n %Numeric to look up.
  * @return Pointer to a static buffer containing the format string.
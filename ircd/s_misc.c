@@ -262,6 +262,10 @@ static void exit_one_client(struct Client* bcptr, const char* comment)
     remove_dlink(&(cli_serv(cli_serv(bcptr)->up))->down, cli_serv(bcptr)->updown);
     cli_serv(bcptr)->updown = 0;
 
+    /* Stop an unfinished outgoing burst */
+    if (MyConnect(bcptr) && cli_burst(bcptr))
+      server_burst_free(bcptr);
+
     if (MyConnect(bcptr))
       Count_serverdisconnects(UserStats);
     else
@@ -653,6 +657,8 @@ void tstats(struct Client *cptr, const struct StatDesc *sd, char *param)
 	     ":auth successes %u fails %u", sp->is_asuc, sp->is_abad);
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG, ":local connections %u",
 	     sp->is_loc);
+  send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG,
+	     ":silence cache hits %u misses %u", sp->is_sil_hit, sp->is_sil_miss);
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG, ":Client server");
   send_reply(cptr, SND_EXPLICIT | RPL_STATSDEBUG, ":connected %u %u maxconn %u",
 	     sp->is_cl, sp->is_sv, maxconn);
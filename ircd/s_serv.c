@@ -41,6 +41,7 @@
 #include "ircd_string.h"
 #include "ircd_snprintf.h"
 #include "ircd_crypt.h"
+#include "ircd_zip.h"
 #include "jupe.h"
 #include "list.h"
 #include "match.h"
@@ -74,6 +75,8 @@ static int next_secure_group_id = 1;
 unsigned int max_connection_count = 0;
 /** Maximum (local) client count since last restart. */
 unsigned int max_client_count = 0;
+/** Outgoing bursts that are still in progress. */
+static struct BurstState* BurstList;
 
 /** Squit a new (pre-burst) server.
  * @param cptr Local client that tried to introduce the server.
@@ -117,11 +120,12 @@ int a_kills_b_too(struct Client *a, struct Client *b)
 /** Handle a connection that has sent a valid PASS and SERVER.
  * @param cptr New peer server.
  * @param aconf Connect block for \a cptr.
- * @return Zero.
+ * @return Zero, or CPTR_KILLED if the link could not be set up.
  */
 int server_estab(struct Client *cptr, struct ConfItem *aconf)
 {
   struct Client* acptr = 0;
+  struct BurstState* burst;
   const char*    inpath;
   int            i;
 
@@ -136,13 +140,21 @@ int server_estab(struct Client *cptr, struct ConfItem *aconf)
     /*
      *  Pass my info to the new server
      */
-    sendrawto_one(cptr, MSG_SERVER " %s 1 %Tu %Tu J%s %s%s +%s6 :%s",
+    sendrawto_one(cptr, MSG_SERVER " %s 1 %Tu %Tu J%s %s%s +%s%s6 :%s",
 		  cli_name(&me), cli_serv(&me)->timestamp,
 		  cli_serv(cptr)->timestamp, MAJOR_PROTOCOL, NumServCap(&me),
 		  feature_bool(FEAT_HUB) ? "h" : "",
+		  (aconf->flags & CONF_CONNECT_COMPRESS) && zip_supported() ? "c" : "",
 		  *(cli_info(&me)) ? cli_info(&me) : "IRCers United");
   }
 
+  /* Both ends offered compression: everything after the SERVER lines
+   * is compressed in both directions.
+   */
+  if ((aconf->flags & CONF_CONNECT_COMPRESS) && IsCompress(cptr)
+      && zip_start(cptr) < 0)
+    return exit_client(cptr, cptr, &me, "Unable to start link compression");
+
   det_confs_butmask(cptr, CONF_SERVER | CONF_UWORLD);
 
   if (!IsHandshake(cptr))
@@ -247,38 +259,220 @@ int server_estab(struct Client *cptr, struct ConfItem *aconf)
     }
   }
 
-  for (acptr = &me; acptr; acptr = cli_prev(acptr))
-  {
-    /* acptr->from == acptr for acptr == cptr */
-    if (cli_from(acptr) == cptr)
-      continue;
-    if (IsUser(acptr))
-    {
-      char xxx_buf[25];
-      char *s = umode_str(acptr);
-      sendcmdto_one(cli_user(acptr)->server, CMD_NICK, cptr,
-		    "%s %d %Tu %s %s %s%s%s%s %s%s :%s",
-		    cli_name(acptr), cli_hopcount(acptr) + 1, cli_lastnick(acptr),
-		    cli_user(acptr)->username, cli_user(acptr)->realhost,
-		    *s ? "+" : "", s, *s ? " " : "",
-		    iptobase64(xxx_buf, &cli_ip(acptr), sizeof(xxx_buf), IsIPv6(cptr)),
-		    NumNick(acptr), cli_info(acptr));
-      if (feature_bool(FEAT_AWAY_BURST) && cli_user(acptr)->away)
-        sendcmdto_one(acptr, CMD_AWAY, cptr, ":%s", cli_user(acptr)->away);
+  /*
+   * Then pass on users and channels.  On a large network this is
+   * far too much to queue at once, so it is generated a slice at a
+   * time as the sendQ of the new link drains.
+   */
+  burst = (struct BurstState*) MyCalloc(1, sizeof(struct BurstState));
+  burst->link = cptr;
+  burst->phase = BURST_USERS;
+  burst->serial = client_serial_next();
+  burst->user = &me;
+  if ((burst->next = BurstList))
+    BurstList->prev = burst;
+  BurstList = burst;
+  cli_burst(cptr) = burst;
+
+  server_burst_next(cptr);
+  update_write(cptr);
+
+  return 0;
+}
+
+/** Send a user to a server that is receiving our burst.
+ * @param cptr Server link receiving the burst.
+ * @param acptr User to introduce.
+ */
+static void burst_user(struct Client *cptr, struct Client *acptr)
+{
+  char xxx_buf[25];
+  char *s = umode_str(acptr);
+
+  sendcmdto_one(cli_user(acptr)->server, CMD_NICK, cptr,
+                "%s %d %Tu %s %s %s%s%s%s %s%s :%s",
+                cli_name(acptr), cli_hopcount(acptr) + 1, cli_lastnick(acptr),
+                cli_user(acptr)->username, cli_user(acptr)->realhost,
+                *s ? "+" : "", s, *s ? " " : "",
+                iptobase64(xxx_buf, &cli_ip(acptr), sizeof(xxx_buf), IsIPv6(cptr)),
+                NumNick(acptr), cli_info(acptr));
+  if (feature_bool(FEAT_AWAY_BURST) && cli_user(acptr)->away)
+    sendcmdto_one(acptr, CMD_AWAY, cptr, ":%s", cli_user(acptr)->away);
+}
+
+/** Continue sending our burst to a server.
+ * Users are sent oldest first, followed by all channels and
+ * END_OF_BURST.  Generation stops whenever the link's sendQ grows
+ * past FEAT_BURST_SENDQ, and resumes when the socket is writable.
+ *
+ * Clients and channels created after the burst started are announced
+ * to the link as they appear, so they are skipped here.  A user who
+ * sends something to the link, or is named by a message to it, before
+ * the burst reaches them is introduced early (see
+ * burst_user_introduce() and burst_introduce_targets()); otherwise the NICK
+ * we eventually send reflects any changes made in the meantime.
+ * @param cptr Server link receiving the burst.
+ */
+void server_burst_next(struct Client *cptr)
+{
+  struct BurstState *burst = cli_burst(cptr);
+  unsigned int limit = feature_int(FEAT_BURST_SENDQ);
+  struct Client *acptr;
+  struct Channel *chptr;
+
+  assert(0 != burst);
+
+  if (burst->phase == BURST_USERS) {
+    while ((acptr = burst->user)) {
+      if (IsDead(cptr) || (limit && MsgQLength(&cli_sendQ(cptr)) >= limit))
+        return;
+      burst->user = cli_prev(acptr);
+      /* acptr->from == acptr for acptr == cptr */
+      if (IsUser(acptr) && cli_from(acptr) != cptr
+          && cli_announced(acptr) < burst->serial)
+        burst_user(cptr, acptr);
     }
+    burst->phase = BURST_CHANNELS;
+    burst->channel = GlobalChannelList;
   }
+
   /*
    * Last, send the BURST.
    * (Or for 2.9 servers: pass all channels plus statuses)
    */
-  {
-    struct Channel *chptr;
-    for (chptr = GlobalChannelList; chptr; chptr = chptr->next)
-      send_channel_modes(cptr, chptr);
+  while ((chptr = burst->channel)) {
+    if (IsDead(cptr) || (limit && MsgQLength(&cli_sendQ(cptr)) >= limit))
+      return;
+    burst->channel = chptr->next;
+    send_channel_modes(cptr, chptr);
   }
+
   sendcmdto_one(&me, CMD_END_OF_BURST, cptr, "");
-  
-  return 0;
+  server_burst_free(cptr);
+}
+
+/** Forget about an outgoing burst.
+ * @param cptr Server link that was receiving the burst.
+ */
+void server_burst_free(struct Client *cptr)
+{
+  struct BurstState *burst = cli_burst(cptr);
+
+  assert(0 != burst);
+
+  if (burst->next)
+    burst->next->prev = burst->prev;
+  if (burst->prev)
+    burst->prev->next = burst->next;
+  else
+    BurstList = burst->next;
+  MyFree(burst);
+  cli_burst(cptr) = 0;
+}
+
+/** Check whether a user has yet to be sent to a bursting server.
+ * @param link Local server link.
+ * @param acptr Client that may not be known to \a link yet.
+ * @return Non-zero if messages from \a acptr must not go to \a link.
+ */
+int burst_user_pending(struct Client *link, struct Client *acptr)
+{
+  struct BurstState *burst = cli_burst(link);
+
+  if (!burst || burst->phase != BURST_USERS || !burst->user
+      || !IsUser(acptr))
+    return 0;
+  return cli_announced(acptr) < burst->serial
+    && cli_serial(acptr) >= cli_serial(burst->user)
+    && cli_from(acptr) != link;
+}
+
+/** Introduce a user to every bursting link that has yet to see it.
+ * Used when \a acptr has something to send to such a link before
+ * the burst gets to it.  The user is then marked as announced, so
+ * the burst walk skips it.
+ * @param acptr User about to be the source of a message.
+ */
+void burst_user_introduce(struct Client *acptr)
+{
+  struct BurstState *burst;
+
+  for (burst = BurstList; burst; burst = burst->next)
+    burst->introduce = burst_user_pending(burst->link, acptr);
+  /* Mark it first: the AWAY sent by burst_user() comes from acptr. */
+  cli_announced(acptr) = client_serial_next();
+  for (burst = BurstList; burst; burst = burst->next)
+    if (burst->introduce) {
+      burst->introduce = 0;
+      burst_user(burst->link, acptr);
+    }
+}
+
+/** Introduce any not-yet-burst users named in a message to \a link.
+ * The source of a message is handled by send_buffer(), but a MODE
+ * +o, KILL, INVITE or KICK also names its target by numnick, and
+ * \a link must know that user before the message arrives.  Every
+ * five-character word (or comma-separated item) before the trailing
+ * parameter is looked up; introducing a user early is always safe.
+ * @param link Local server link receiving an outgoing burst.
+ * @param msg Message text (not NUL terminated).
+ * @param len Length of \a msg.
+ */
+void burst_introduce_targets(struct Client *link, const char *msg,
+                             unsigned int len)
+{
+  struct BurstState *burst = cli_burst(link);
+  struct Client *acptr;
+  char yxx[6];
+  unsigned int ii, start;
+
+  if (!burst || burst->phase != BURST_USERS || !burst->user)
+    return;
+  for (ii = start = 0; ii <= len; ++ii) {
+    if (ii < len && msg[ii] != ' ' && msg[ii] != ',' && msg[ii] != '\r'
+        && msg[ii] != '\n') {
+      if (ii == start && msg[ii] == ':' && ii > 0)
+        break; /* trailing parameter */
+      if (!IsAlnum(msg[ii]) && msg[ii] != '[' && msg[ii] != ']')
+        start = len + 1; /* not a numnick; skip the rest of the word */
+      continue;
+    }
+    if (start <= len && ii - start == 5) {
+      memcpy(yxx, msg + start, 5);
+      yxx[5] = '\0';
+      if ((acptr = findNUser(yxx)) && burst_user_pending(link, acptr))
+        burst_user_introduce(acptr);
+    }
+    start = ii + 1;
+  }
+}
+
+/** Advance any outgoing burst positioned on a client leaving
+ * GlobalClientList.
+ * @param cptr Client being removed.
+ */
+void burst_client_removed(struct Client *cptr)
+{
+  struct BurstState *burst;
+
+  for (burst = BurstList; burst; burst = burst->next)
+    if (burst->user == cptr && !(burst->user = cli_prev(cptr))) {
+      /* That was the newest client, so every user has been sent. */
+      burst->phase = BURST_CHANNELS;
+      burst->channel = GlobalChannelList;
+    }
+}
+
+/** Advance any outgoing burst positioned on a channel being destroyed.
+ * @param chptr Channel being destroyed.
+ */
+void burst_channel_removed(struct Channel *chptr)
+{
+  struct BurstState *burst;
+
+  for (burst = BurstList; burst; burst = burst->next)
+    if (burst->channel == chptr)
+      burst->channel = chptr->next;
 }
 
 /** Compute secure path groups for all servers in the network.
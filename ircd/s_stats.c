@@ -36,6 +36,8 @@
 #include "ircd_reply.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
+#include "ircd_tls.h"
+#include "ircd_zip.h"
 #include "listener.h"
 #include "list.h"
 #include "match.h"
@@ -44,8 +46,10 @@
 #include "msgq.h"
 #include "numeric.h"
 #include "numnicks.h"
+#include "parse.h"
 #include "querycmds.h"
 #include "res.h"
+#include "s_admit.h"
 #include "s_auth.h"
 #include "s_bsd.h"
 #include "s_conf.h"
@@ -151,15 +155,27 @@ stats_crule_list(struct Client* to, const struct StatDesc *sd,
   }
 }
 
-/** Report active event engine name.
+/** Report active event engine name and event loop timing, or reset
+ * the timing.
  * @param[in] to Client requesting statistics.
  * @param[in] sd Stats descriptor for request (ignored).
- * @param[in] param Extra parameter from user (ignored).
+ * @param[in] param "reset" to clear the timing statistics.
  */
 static void
 stats_engine(struct Client *to, const struct StatDesc *sd, char *param)
 {
+  if (param && !ircd_strcmp(param, "reset")) {
+    if (!IsAnOper(to)) {
+      send_reply(to, ERR_NOPRIVILEGES);
+      return;
+    }
+    event_stats_reset();
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Event loop statistics reset");
+    return;
+  }
   send_reply(to, RPL_STATSENGINE, engine_name());
+  event_stats_report(to);
 }
 
 /** Report client access lists.
@@ -288,6 +304,16 @@ stats_klines(struct Client *sptr, const struct StatDesc *sd, char *mask)
   }
 }
 
+/** Compute how much of a byte stream link compression saved.
+ * @param[in] zipped Compressed size of the stream.
+ * @param[in] raw Uncompressed size of the stream.
+ * @return Percentage of \a raw saved by compression.
+ */
+static unsigned int zip_saved(uint64_t zipped, uint64_t raw)
+{
+  return (raw && zipped < raw) ? (unsigned int)(100 - zipped * 100 / raw) : 0;
+}
+
 /** Report on servers and/or clients connected to the network.
  * @param[in] sptr Client requesting statistics.
  * @param[in] sd Stats descriptor for request (ignored).
@@ -296,6 +322,7 @@ stats_klines(struct Client *sptr, const struct StatDesc *sd, char *mask)
 static void
 stats_links(struct Client* sptr, const struct StatDesc* sd, char* name)
 {
+  const struct ZipStats *zs;
   struct Client *acptr;
   int i;
   int wilds = 0;
@@ -334,6 +361,14 @@ stats_links(struct Client* sptr, const struct StatDesc* sd, char* name)
                  (int)MsgQLength(&(cli_sendQ(acptr))), (int)cli_sendM(acptr),
                  (cli_sendB(acptr) >> 10), (int)cli_receiveM(acptr),
                  (cli_receiveB(acptr) >> 10), CurrentTime - cli_firsttime(acptr));
+      if ((zs = zip_stats(acptr)))
+        send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+                   ":%s compression: sent %Lu/%Lu KB (%u%% saved), "
+                   "received %Lu/%Lu KB (%u%% saved), %Lu.%03Lu s in zlib",
+                   cli_name(acptr), zs->zip_out >> 10, zs->raw_out >> 10,
+                   zip_saved(zs->zip_out, zs->raw_out), zs->zip_in >> 10,
+                   zs->raw_in >> 10, zip_saved(zs->zip_in, zs->raw_in),
+                   zs->nsec / 1000000000, (zs->nsec / 1000000) % 1000);
     }
 }
 
@@ -389,6 +424,100 @@ stats_commands(struct Client* to, const struct StatDesc* sd, char* param)
       send_reply(to, RPL_STATSCOMMANDS, mptr->cmd, mptr->count, mptr->bytes);
 }
 
+/** Report one handler's latency statistics.
+ * @param[in] to Client requesting statistics.
+ * @param[in] name Command name.
+ * @param[in] type Handler type.
+ * @param[in] mt Latency statistics to report.
+ */
+static void
+report_cmdtimes(struct Client *to, const char *name, int type,
+                const struct MessageTimes *mt)
+{
+  char hist[MSG_TIME_BUCKETS * 11 + 1];
+  size_t len = 0;
+  int ii;
+
+  for (ii = 0; ii < MSG_TIME_BUCKETS; ii++)
+    len += ircd_snprintf(0, hist + len, sizeof(hist) - len, "%s%u",
+                         ii ? " " : "", mt->buckets[ii]);
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG, ":%s %s %u %qu %qu %s",
+             name, msg_handler_names[type], mt->calls, mt->total / 1000,
+             mt->max / 1000, hist);
+}
+
+/** Add one handler's latency statistics to a running total.
+ * @param[in,out] sum Total to update.
+ * @param[in] mt Statistics to add.
+ */
+static void
+add_cmdtimes(struct MessageTimes *sum, const struct MessageTimes *mt)
+{
+  int ii;
+
+  sum->calls += mt->calls;
+  sum->total += mt->total;
+  if (mt->max > sum->max)
+    sum->max = mt->max;
+  for (ii = 0; ii < MSG_TIME_BUCKETS; ii++)
+    sum->buckets[ii] += mt->buckets[ii];
+}
+
+/** Report message handler latency, or reset it.
+ * Each line gives the command, handler type, number of calls, total and
+ * maximum time in microseconds, and the latency histogram (see
+ * #MSG_TIME_BUCKETS).  Lines for command "*" total each handler type.
+ * @param[in] to Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param "reset" to clear the statistics, or a mask to
+ * filter command names.
+ */
+static void
+stats_cmdtimes(struct Client* to, const struct StatDesc* sd, char* param)
+{
+  struct MessageTimes sum[LAST_HANDLER_TYPE];
+  struct Message *mptr;
+  struct s_map *map;
+  int type;
+
+  if (param && !ircd_strcmp(param, "reset")) {
+    if (!IsAnOper(to)) {
+      send_reply(to, ERR_NOPRIVILEGES);
+      return;
+    }
+    msg_times_reset();
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Command timing statistics reset");
+    return;
+  }
+
+  memset(sum, 0, sizeof(sum));
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG, ":Command Handler Calls "
+             "TotalUsec MaxUsec Histogram(<1us <2us <4us ... >=16ms)");
+  for (mptr = msgtab; mptr->cmd; mptr++)
+    for (type = 0; type < LAST_HANDLER_TYPE; type++) {
+      if (!mptr->times[type].calls)
+        continue;
+      add_cmdtimes(&sum[type], &mptr->times[type]);
+      if (!param || !match(param, mptr->cmd))
+        report_cmdtimes(to, mptr->cmd, type, &mptr->times[type]);
+    }
+  for (map = GlobalServiceMapList; map; map = map->next) {
+    if (!map->msg)
+      continue;
+    for (type = 0; type < LAST_HANDLER_TYPE; type++) {
+      if (!map->msg->times[type].calls)
+        continue;
+      add_cmdtimes(&sum[type], &map->msg->times[type]);
+      if (!param || !match(param, map->msg->cmd))
+        report_cmdtimes(to, map->msg->cmd, type, &map->msg->times[type]);
+    }
+  }
+  for (type = 0; type < LAST_HANDLER_TYPE; type++)
+    if (sum[type].calls)
+      report_cmdtimes(to, "*", type, &sum[type]);
+}
+
 /** List channel quarantines.
  * @param[in] to Client requesting statistics.
  * @param[in] sd Stats descriptor for request (ignored).
@@ -604,9 +733,9 @@ struct StatDesc statsinfo[] = {
   { 'D', "crules", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_d,
     stats_crule_list, CRULE_ALL,
     "Dynamic routing configuration." },
-  { 'e', "engine", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_e,
+  { 'e', "engine", (STAT_FLAG_OPERFEAT | STAT_FLAG_VARPARAM), FEAT_HIS_STATS_e,
     stats_engine, 0,
-    "Report server event loop engine." },
+    "Report server event loop engine and its timing." },
   { 'f', "features", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_f,
     feature_report, 0,
     "Feature settings." },
@@ -639,6 +768,10 @@ struct StatDesc statsinfo[] = {
   { 'm', "commands", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_m,
     stats_commands, 0,
     "Message usage information." },
+  { 'M', "cmdtimes", (STAT_FLAG_OPERFEAT | STAT_FLAG_VARPARAM | STAT_FLAG_CASESENS),
+    FEAT_HIS_STATS_M,
+    stats_cmdtimes, 0,
+    "Message handler latency histograms." },
   { 'o', "operators", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_o,
     stats_configured_links, CONF_OPERATOR,
     "Operator information." },
@@ -704,6 +837,15 @@ struct StatDesc statsinfo[] = {
   { ' ', "netconf", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_C,
     config_stats, 0,
     "Network configuration entries." },
+  { ' ', "admission", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_ADMISSION,
+    admit_report, 0,
+    "Registration admission queues." },
+  { ' ', "writes", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_WRITES,
+    report_class_writes, 0,
+    "Write scheduler statistics per connection class." },
+  { ' ', "tls", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_TLS,
+    ircd_tls_report_stats, 0,
+    "TLS session resumption statistics." },
   { '*', "help", STAT_FLAG_CASESENS, FEAT_LAST_F,
     stats_help, 0,
     "Send help for stats." },
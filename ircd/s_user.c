@@ -116,6 +116,7 @@ void free_user(struct User* user)
     assert(0 == user->joined);
     assert(0 == user->invited);
     assert(0 == user->channel);
+    assert(0 == user->channel_hash);
 
     MyFree(user);
     assert(userCount>0);
@@ -444,6 +445,11 @@ int register_user(struct Client *cptr, struct Client *sptr)
   if (IsOper(sptr))
     ++UserStats.opers;
 
+  /* Remember when the user was announced, so an outgoing burst that
+   * started earlier knows the NICK below already reached its link.
+   */
+  cli_announced(sptr) = client_serial_next();
+
   tmpstr = umode_str(sptr);
   /* Send full IP address to IPv6-grokking servers. */
   sendcmdto_flag_serv_butone(user->server, CMD_NICK, cptr,
@@ -637,6 +643,8 @@ int set_nick_name(struct Client* cptr, struct Client* sptr,
       hRemClient(sptr);
     strcpy(cli_name(sptr), nick);
     hAddClient(sptr);
+    /* Silence verdicts about the old nick no longer apply. */
+    cli_maskserial(sptr) = client_serial_next();
   }
   else {
     /* Local client setting NICK the first time */
@@ -936,6 +944,7 @@ hide_hostmask(struct Client *cptr, unsigned int flag)
   }
 
   SetFlag(cptr, flag);
+  cli_maskserial(cptr) = client_serial_next();
   if (!HasFlag(cptr, FLAG_HIDDENHOST) || !HasFlag(cptr, FLAG_ACCOUNT))
     return 0;
 
@@ -1243,6 +1252,7 @@ int set_user_mode(struct Client *cptr, struct Client *sptr, int parc,
         }
       }
       ircd_strncpy(cli_user(sptr)->account, account, len);
+      cli_maskserial(sptr) = client_serial_next();
   }
   if (!FlagHas(&setflags, FLAG_HIDDENHOST) && do_host_hiding && allow_modes != ALLOWMODES_DEFAULT)
     hide_hostmask(sptr, FLAG_HIDDENHOST);
@@ -1564,13 +1574,31 @@ void set_snomask(struct Client *cptr, unsigned int newmask, int what)
  */
 int is_silenced(struct Client *sptr, struct Client *acptr)
 {
+  struct SilenceVerdict *verdict;
   struct Ban *found;
   struct User *user;
   size_t buf_used, slen;
+  unsigned int ii;
   char buf[BUFSIZE];
 
-  if (IsServer(sptr) || !(user = cli_user(acptr))
-      || !(found = find_ban(sptr, user->silence)))
+  if (IsServer(sptr) || !(user = cli_user(acptr)) || !user->silence)
+    return 0;
+
+  /* Reuse an earlier verdict if the sender has not changed since. */
+  for (ii = 0; ii < SILENCE_CACHE; ++ii)
+    if (user->silence_cache[ii].sender == cli_maskserial(sptr))
+      break;
+  if (ii < SILENCE_CACHE) {
+    ServerStats->is_sil_hit++;
+    found = user->silence_cache[ii].found;
+  } else {
+    ServerStats->is_sil_miss++;
+    found = find_ban(sptr, user->silence);
+    verdict = &user->silence_cache[user->silence_next++ % SILENCE_CACHE];
+    verdict->sender = cli_maskserial(sptr);
+    verdict->found = found;
+  }
+  if (!found)
     return 0;
   assert(!(found->flags & BAN_EXCEPTION));
   if (!MyConnect(sptr)) {
@@ -1604,6 +1632,30 @@ int is_silenced(struct Client *sptr, struct Client *acptr)
   return 1;
 }
 
+/** Forget the silence verdicts cached for \a cptr.
+ * Called whenever its silence list changes.
+ * @param[in] cptr User whose silence list changed.
+ */
+void silence_changed(struct Client *cptr)
+{
+  struct User *user = cli_user(cptr);
+
+  memset(user->silence_cache, 0, sizeof(user->silence_cache));
+}
+
+/** RPL_ISUPPORT lines, rendered on first use after a change. */
+static struct ReplyTemplate supported[2];
+
+/** Forget the rendered RPL_ISUPPORT lines.
+ * Called when a feature they report changes.
+ */
+void
+supported_changed(void)
+{
+  reply_template_clear(&supported[0]);
+  reply_template_clear(&supported[1]);
+}
+
 /** Send RPL_ISUPPORT lines to \a cptr.
  * @param[in] cptr Client to send ISUPPORT to.
  * @return Zero.
@@ -1613,10 +1665,17 @@ send_supported(struct Client *cptr)
 {
   char featurebuf[512];
 
-  ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES1, FEATURESVALUES1);
-  send_reply(cptr, RPL_ISUPPORT, featurebuf);
-  ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES2, FEATURESVALUES2);
-  send_reply(cptr, RPL_ISUPPORT, featurebuf);
+  if (!supported[0].text) {
+    ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES1,
+                  FEATURESVALUES1);
+    reply_template_set(&supported[0], RPL_ISUPPORT, featurebuf);
+    ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES2,
+                  FEATURESVALUES2);
+    reply_template_set(&supported[1], RPL_ISUPPORT, featurebuf);
+  }
+
+  send_reply_template(cptr, &supported[0]);
+  send_reply_template(cptr, &supported[1]);
 
   return 0; /* convenience return, if it's ever needed */
 }
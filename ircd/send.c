@@ -32,6 +32,7 @@
 #include "ircd_log.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
+#include "ircd_zip.h"
 #include "list.h"
 #include "match.h"
 #include "msg.h"
@@ -43,11 +44,13 @@
 #include "s_bsd.h"
 #include "s_debug.h"
 #include "s_misc.h"
+#include "s_serv.h"
 #include "s_user.h"
 #include "struct.h"
 #include "sys.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -59,6 +62,25 @@ struct SLink *opsarray[32];     /* don't use highest bit unless you change
 /** Linked list of all connections with data queued to send. */
 static struct Connection *send_queues;
 
+/** Prefix for a command sent to users. */
+static const char user_cmd_format[] = "%:#C %s %v";
+/** Prefix for a command sent to users, addressed to channel ops. */
+static const char user_ops_format[] = "%:#C %s @%v";
+/** Prefix for a command sent to servers. */
+static const char serv_cmd_format[] = "%C %s %v";
+/** Prefix for a command sent to servers whose text is all one
+ * trailing parameter. */
+static const char serv_text_format[] = "%C %s :%v";
+
+/** Compile the command prefixes that nearly every message uses. */
+void send_init(void)
+{
+  ircd_format_compile(user_cmd_format);
+  ircd_format_compile(user_ops_format);
+  ircd_format_compile(serv_cmd_format);
+  ircd_format_compile(serv_text_format);
+}
+
 /*
  * dead_link
  *
@@ -140,6 +162,71 @@ kill_highest_sendq(int servers_too)
     dead_link(highest_client, "Buffer allocation error");
 }
 
+/** Smallest write scheduler quantum, in bytes. */
+#define WRITE_QUANTUM_MIN 512
+
+/** Number of write scheduler passes so far. */
+static unsigned int write_round;
+
+/** Attempt to send up to some number of bytes queued for a client.
+ * At least \a limit bytes are sent if that much is queued and the
+ * socket takes it; the last write may go past \a limit.
+ * @param[in] to Client to send data to.
+ * @param[in] limit Number of bytes to stop after.
+ * @return Number of bytes sent.
+ */
+static unsigned int send_queued_limit(struct Client *to, unsigned int limit)
+{
+  unsigned int sent = 0;
+
+  assert(0 != to);
+  assert(0 != cli_local(to));
+
+  if (IsBlocked(to) || !can_send(to))
+    return 0;                   /* Don't bother */
+
+  /* If we're still negotiating TLS, don't try to send data yet */
+  if (IsTLS(to) && IsNegotiatingTLS(to))
+    return 0;
+
+  /* Move anything still held by the link compressor to the sendQ. */
+  if (zip_flush(to) < 0) {
+    dead_link(to, "Compression error");
+    return 0;
+  }
+
+  while (MsgQLength(&(cli_sendQ(to))) > 0) {
+    unsigned int len;
+
+    if (sent >= limit) {
+      update_write(to);
+      return sent;
+    }
+    if ((len = deliver_it(to, &(cli_sendQ(to))))) {
+      msgq_delete(&(cli_sendQ(to)), len);
+      cli_lastsq(to) = MsgQLength(&(cli_sendQ(to))) / 1024;
+      sent += len;
+      if (IsBlocked(to)) {
+        update_write(to);
+        return sent;
+      }
+    }
+    else {
+      if (IsDead(to)) {
+        char tmp[512];
+        sprintf(tmp,"Write error: %s",(strerror(cli_error(to))) ? (strerror(cli_error(to))) : "Unknown error" );
+        dead_link(to, tmp);
+      }
+      return sent;
+    }
+  }
+
+  /* Ok, sendq is now empty... */
+  client_drop_sendq(cli_connect(to));
+  update_write(to);
+  return sent;
+}
+
 /*
  * flush_connections
  *
@@ -151,6 +238,7 @@ kill_highest_sendq(int servers_too)
  * -avalon
  */
 /** Flush data queued for one or all connections.
+ * When flushing all connections, server links go first.
  * @param[in] cptr Client to flush (if NULL, do all).
  */
 void flush_connections(struct Client* cptr)
@@ -160,59 +248,162 @@ void flush_connections(struct Client* cptr)
   }
   else {
     struct Connection* con;
-    for (con = send_queues; con; con = con_next(con)) {
-      assert(0 < MsgQLength(&(con_sendQ(con))));
-      send_queued(con_client(con));
+    struct Connection* next;
+    int servers;
+
+    for (servers = 1; servers >= 0; servers--) {
+      for (con = send_queues; con; con = next) {
+        next = con_next(con);
+        assert(0 < MsgQLength(&(con_sendQ(con))));
+        if (!WritePriority(con_client(con)) == !servers)
+          send_queued(con_client(con));
+      }
     }
   }
 }
 
-/*
- * send_queued
- *
- * This function is called from the main select-loop (or whatever)
- * when there is a chance that some output would be possible. This
- * attempts to empty the send queue as far as possible...
+/** Find a client's connection class for the write scheduler, starting
+ * the class's budget for this pass if it has not been yet.
+ * @param[in] to Client being written to.
+ * @return Connection class of \a to, or NULL.
  */
-/** Attempt to send data queued for a client.
- * @param[in] to Client to send data to.
+static struct ConnectionClass *write_class(struct Client *to)
+{
+  struct ConnectionClass *cl = class_resolve(to);
+
+  if (cl && cl->write_round != write_round) {
+    cl->write_round = write_round;
+    cl->write_left = WriteBudget(cl);
+  }
+  return cl;
+}
+
+/** Charge bytes sent to a client against its class's write budget.
+ * @param[in] cl Connection class of the client, or NULL.
+ * @param[in] sent Number of bytes sent.
  */
-void send_queued(struct Client *to)
+static void write_charge(struct ConnectionClass *cl, unsigned int sent)
 {
-  assert(0 != to);
-  assert(0 != cli_local(to));
+  if (!cl || !sent)
+    return;
+  cl->write_bytes += sent;
+  cl->write_sends++;
+  if (WriteBudget(cl))
+    cl->write_left -= sent < cl->write_left ? sent : cl->write_left;
+}
 
-  if (IsBlocked(to) || !can_send(to))
-    return;                     /* Don't bother */
+/** Move a connection to the head of the list of connections with
+ * queued data, keeping the order of the others.
+ * @param[in] con Connection on the list.
+ */
+static void send_queues_rotate(struct Connection *con)
+{
+  struct Connection *tail;
 
-  /* If we're still negotiating TLS, don't try to send data yet */
-  if (IsTLS(to) && IsNegotiatingTLS(to))
+  if (con == send_queues)
     return;
+  for (tail = con; con_next(tail); tail = con_next(tail))
+    ;
+  *con_prev_p(con) = 0;
+  con_next(tail) = send_queues;
+  con_prev_p(send_queues) = &con_next(tail);
+  send_queues = con;
+  con_prev_p(con) = &send_queues;
+}
 
-  while (MsgQLength(&(cli_sendQ(to))) > 0) {
-    unsigned int len;
+/** Run the write scheduler.  The event engines call this once per loop
+ * iteration, before waiting for events.
+ *
+ * Server links are flushed first, and clients with data on their
+ * priority queue get one quantum sent.  The other clients are then
+ * served by deficit round-robin: each round, every writable client
+ * whose class has budget left may send #FEAT_WRITE_QUANTUM bytes plus
+ * whatever it was still owed (at most one more quantum), until no
+ * client makes progress.  Clients whose class ran out of budget wait
+ * for the next pass, and the first of them heads the list then.
+ */
+void flush_scheduled_connections(void)
+{
+  struct Connection *con;
+  struct Connection *next;
+  struct Connection *first_deferred = 0;
+  struct ConnectionClass *cl;
+  struct Client *to;
+  unsigned int quantum, want, limit, sent;
+  int progress;
+
+  if (!send_queues)
+    return;
 
-    if ((len = deliver_it(to, &(cli_sendQ(to))))) {
-      msgq_delete(&(cli_sendQ(to)), len);
-      cli_lastsq(to) = MsgQLength(&(cli_sendQ(to))) / 1024;
-      if (IsBlocked(to)) {
-        update_write(to);
-        return;
+  write_round++;
+  if ((quantum = feature_int(FEAT_WRITE_QUANTUM)) < WRITE_QUANTUM_MIN)
+    quantum = WRITE_QUANTUM_MIN;
+
+  for (con = send_queues; con; con = next) {
+    next = con_next(con);
+    to = con_client(con);
+    if (WritePriority(to))
+      write_charge(write_class(to), send_queued_limit(to, UINT_MAX));
+    else if (cli_sendQ(to).prio.head)
+      write_charge(write_class(to), send_queued_limit(to, quantum));
+  }
+
+  do {
+    progress = 0;
+    for (con = send_queues; con; con = next) {
+      next = con_next(con);
+      to = con_client(con);
+      if (WritePriority(to) || IsBlocked(to))
+        continue;
+      cl = write_class(to);
+      want = limit = con_deficit(con) + quantum;
+      if (cl && WriteBudget(cl)) {
+        if (!cl->write_left)
+          continue;
+        if (limit > cl->write_left)
+          limit = cl->write_left;
       }
+      sent = send_queued_limit(to, limit);
+      write_charge(cl, sent);
+      if (sent)
+        progress = 1;
+      /* Only what the class budget held back is owed later, and never
+       * more than one quantum, so a starved connection cannot save up
+       * a burst for when the budget returns. */
+      if (sent >= limit && !IsBlocked(to) && MsgQLength(&(cli_sendQ(to))))
+        con_deficit(con) = (want - limit > quantum) ? quantum : want - limit;
+      else
+        con_deficit(con) = 0;
     }
-    else {
-      if (IsDead(to)) {
-        char tmp[512];
-        sprintf(tmp,"Write error: %s",(strerror(cli_error(to))) ? (strerror(cli_error(to))) : "Unknown error" );
-        dead_link(to, tmp);
-      }
-      return;
+  } while (progress);
+
+  for (con = send_queues; con; con = con_next(con)) {
+    to = con_client(con);
+    if (WritePriority(to) || IsBlocked(to))
+      continue;
+    if ((cl = write_class(to)) && WriteBudget(cl) && !cl->write_left) {
+      cl->write_deferred++;
+      if (!first_deferred)
+        first_deferred = con;
     }
   }
+  if (first_deferred)
+    send_queues_rotate(first_deferred);
+}
 
-  /* Ok, sendq is now empty... */
-  client_drop_sendq(cli_connect(to));
-  update_write(to);
+/*
+ * send_queued
+ *
+ * This function is called from the main select-loop (or whatever)
+ * when there is a chance that some output would be possible. This
+ * attempts to empty the send queue as far as possible...
+ */
+/** Attempt to send data queued for a client.
+ * @param[in] to Client to send data to.
+ */
+void send_queued(struct Client *to)
+{
+  send_queued_limit(to, UINT_MAX);
 }
 
 /** Queue raw octets on a client's sendq without IRC or WebSocket framing.
@@ -325,7 +516,8 @@ make_wire_msgbuf(struct Client *to, struct MsgBuf *body,
 
 /** Try to send a buffer to a client, queueing it if needed.
  * @param[in,out] to Client to send message to.
- * @param[in] from Message source (for account-tag; may be NULL).
+ * @param[in] from Message source (for account-tag and burst holds;
+ *   may be NULL).
  * @param[in] buf Message body (without tags).
  * @param[in] prio If non-zero, send as high priority.
  * @param[in] ctx Optional per-message tag context (may be NULL).  Ignored
@@ -357,6 +549,16 @@ void send_buffer(struct Client* to, struct Client* from, struct MsgBuf* buf, int
      */
     return;
 
+  /* A server still waiting for our burst to introduce the source
+   * or a target of this message would not know who it is, so
+   * introduce them now.
+   */
+  if (cli_burst(to)) {
+    if (from && burst_user_pending(to, from))
+      burst_user_introduce(from);
+    burst_introduce_targets(to, buf->msg, buf->length);
+  }
+
   if (MsgQLength(&(cli_sendQ(to))) > get_sendq(to)) {
     if (IsServer(to))
       sendto_opmask_butone(0, SNO_OLDSNO, "Max SendQ limit exceeded for %C: "
@@ -421,7 +623,18 @@ void send_buffer(struct Client* to, struct Client* from, struct MsgBuf* buf, int
     wire = ws_framed;
   }
 
-  msgq_add(&(cli_sendQ(to)), wire, prio);
+  /* A compressed link queues deflate output instead of the message;
+   * that stream cannot be reordered, so priority is ignored.
+   */
+  if (cli_zip(to)) {
+    if (zip_send(to, wire) < 0) {
+      if (owned)
+        msgq_clean(owned);
+      dead_link(to, "Compression error");
+      return;
+    }
+  } else
+    msgq_add(&(cli_sendQ(to)), wire, prio);
   /* msgq_add() took its own reference on the queued buffer, so release the
    * reference websocket_frame_msgbuf() handed us. Without this, one MsgBuf
    * leaks per outbound WebSocket message and exhausts the buffer pool. */
@@ -429,7 +642,8 @@ void send_buffer(struct Client* to, struct Client* from, struct MsgBuf* buf, int
     msgq_clean(ws_framed);
   if (owned)
     msgq_clean(owned);
-  client_add_sendq(cli_connect(to), &send_queues);
+  if (MsgQLength(&(cli_sendQ(to))))
+    client_add_sendq(cli_connect(to), &send_queues);
   update_write(to);
 
   /*
@@ -446,8 +660,12 @@ void send_buffer(struct Client* to, struct Client* from, struct MsgBuf* buf, int
    * Also stops us from deliberately building a large sendQ and then
    * trying to flood that link with data (possible during the net
    * relinking done by servers with a large load).
+   * Clients are otherwise left to the write scheduler until their sendQ
+   * is half full.
    */
-  if (MsgQLength(&(cli_sendQ(to))) / 1024 > cli_lastsq(to))
+  if (MsgQLength(&(cli_sendQ(to))) / 1024 > cli_lastsq(to)
+      && (WritePriority(to)
+          || MsgQLength(&(cli_sendQ(to))) > get_sendq(to) / 2))
     send_queued(to);
 }
 
@@ -515,7 +733,7 @@ void sendcmdto_one(struct Client *from, const char *cmd, const char *tok,
   vd.vd_format = pattern; /* set up the struct VarData for %v */
   va_start(vd.vd_args, pattern);
 
-  mb = msgq_make(to, "%:#C %s %v", from, IsServer(to) || IsMe(to) ? tok : cmd,
+  mb = msgq_make(to, user_cmd_format, from, IsServer(to) || IsMe(to) ? tok : cmd,
 		 &vd);
 
   va_end(vd.vd_args);
@@ -546,7 +764,7 @@ void sendcmdto_prio_one(struct Client *from, const char *cmd, const char *tok,
   vd.vd_format = pattern; /* set up the struct VarData for %v */
   va_start(vd.vd_args, pattern);
 
-  mb = msgq_make(to, "%:#C %s %v", from, IsServer(to) || IsMe(to) ? tok : cmd,
+  mb = msgq_make(to, user_cmd_format, from, IsServer(to) || IsMe(to) ? tok : cmd,
 		 &vd);
 
   va_end(vd.vd_args);
@@ -582,7 +800,7 @@ void sendcmdto_flag_serv_butone(struct Client *from, const char *cmd,
   va_start(vd.vd_args, pattern);
 
   /* use token */
-  mb = msgq_make(&me, "%C %s %v", from, tok, &vd);
+  mb = msgq_make(&me, serv_cmd_format, from, tok, &vd);
   va_end(vd.vd_args);
 
   msgtagctx_init(&mctx, tok);
@@ -594,7 +812,7 @@ void sendcmdto_flag_serv_butone(struct Client *from, const char *cmd,
       continue;
     if ((forbid < FLAG_LAST_FLAG) && HasFlag(lp->value.cptr, forbid))
       continue;
-    send_buffer(lp->value.cptr, NULL, mb, 0, &mctx, NULL);
+    send_buffer(lp->value.cptr, from, mb, 0, &mctx, NULL);
   }
 
   msgq_clean(mb);
@@ -621,7 +839,7 @@ void sendcmdto_serv_butone(struct Client *from, const char *cmd,
   va_start(vd.vd_args, pattern);
 
   /* use token */
-  mb = msgq_make(&me, "%C %s %v", from, tok, &vd);
+  mb = msgq_make(&me, serv_cmd_format, from, tok, &vd);
   va_end(vd.vd_args);
 
   msgtagctx_init(&mctx, tok);
@@ -629,7 +847,7 @@ void sendcmdto_serv_butone(struct Client *from, const char *cmd,
   for (lp = cli_serv(&me)->down; lp; lp = lp->next) {
     if (one && lp->value.cptr == cli_from(one))
       continue;
-    send_buffer(lp->value.cptr, NULL, mb, 0, &mctx, NULL);
+    send_buffer(lp->value.cptr, from, mb, 0, &mctx, NULL);
   }
 
   msgq_clean(mb);
@@ -684,7 +902,7 @@ void sendcmdto_common_channels_butone(struct Client *from, const char *cmd,
   va_start(vd.vd_args, pattern);
 
   /* build the buffer */
-  mb = msgq_make(0, "%:#C %s %v", from, cmd, &vd);
+  mb = msgq_make(0, user_cmd_format, from, cmd, &vd);
   va_end(vd.vd_args);
 
   tagsendcache_init(&tcache);
@@ -742,7 +960,7 @@ void sendcmdto_capflag_common_channels_butone(struct Client *from, const char *c
   va_start(vd.vd_args, pattern);
 
   /* build the buffer */
-  mb = msgq_make(0, "%:#C %s %v", from, cmd, &vd);
+  mb = msgq_make(0, user_cmd_format, from, cmd, &vd);
   va_end(vd.vd_args);
 
   tagsendcache_init(&tcache);
@@ -805,7 +1023,7 @@ void sendcmdto_capflag_channel_butserv_butone(struct Client *from, const char *c
   va_start(vd.vd_args, pattern);
 
   /* build the buffer */
-  mb = msgq_make(0, "%:#C %s %v", from, cmd, &vd);
+  mb = msgq_make(0, user_cmd_format, from, cmd, &vd);
   va_end(vd.vd_args);
 
   tagsendcache_init(&tcache);
@@ -884,7 +1102,7 @@ void sendcmdto_channel_butserv_butone(struct Client *from, const char *cmd,
   va_start(vd.vd_args, pattern);
 
   /* build the buffer */
-  mb = msgq_make(0, "%:#C %s %v", from, cmd, &vd);
+  mb = msgq_make(0, user_cmd_format, from, cmd, &vd);
   va_end(vd.vd_args);
 
   tagsendcache_init(&tcache);
@@ -926,7 +1144,7 @@ void sendcmdto_channel_servers_butone(struct Client *from, const char *cmd,
   /* build the buffer */
   vd.vd_format = pattern;
   va_start(vd.vd_args, pattern);
-  serv_mb = msgq_make(&me, "%:#C %s %v", from, tok, &vd);
+  serv_mb = msgq_make(&me, user_cmd_format, from, tok, &vd);
   va_end(vd.vd_args);
 
   msgtagctx_init(&mctx, tok);
@@ -942,7 +1160,7 @@ void sendcmdto_channel_servers_butone(struct Client *from, const char *cmd,
         || (skip & SKIP_NONVOICES && !IsChanOp(member) && !HasVoice(member)))
       continue;
     cli_sentalong(member->user) = sentalong_marker;
-    send_buffer(member->user, NULL, serv_mb, 0, &mctx, NULL);
+    send_buffer(member->user, from, serv_mb, 0, &mctx, NULL);
   }
   msgq_clean(serv_mb);
 }
@@ -974,13 +1192,13 @@ void sendcmdto_channel_butone(struct Client *from, const char *cmd,
 
   /* Build buffer to send to users */
   va_start(vd.vd_args, pattern);
-  user_mb = msgq_make(0, skip & (SKIP_NONOPS | SKIP_NONVOICES) ? "%:#C %s @%v" : "%:#C %s %v",
+  user_mb = msgq_make(0, skip & (SKIP_NONOPS | SKIP_NONVOICES) ? user_ops_format : user_cmd_format,
                       from, skip & (SKIP_NONOPS | SKIP_NONVOICES) ? MSG_NOTICE : cmd, &vd);
   va_end(vd.vd_args);
 
   /* Build buffer to send to servers */
   va_start(vd.vd_args, pattern);
-  serv_mb = msgq_make(&me, "%C %s %v", from, tok, &vd);
+  serv_mb = msgq_make(&me, serv_cmd_format, from, tok, &vd);
   va_end(vd.vd_args);
 
   tagsendcache_init_cmd(&tcache, tok);
@@ -1001,7 +1219,7 @@ void sendcmdto_channel_butone(struct Client *from, const char *cmd,
     if (MyConnect(member->user)) /* pick right buffer to send */
       send_buffer(member->user, from, user_mb, 0, NULL, &tcache);
     else
-      send_buffer(member->user, NULL, serv_mb, 0, NULL, &tcache);
+      send_buffer(member->user, from, serv_mb, 0, NULL, &tcache);
   }
 
   msgq_clean(user_mb);
@@ -1069,7 +1287,7 @@ void sendwallto_group_butone(struct Client *from, int type, struct Client *one,
 
   /* Build buffer to send to servers */
   va_start(vd.vd_args, pattern);
-  mb = msgq_make(&me, "%C %s :%v", from, tok, &vd);
+  mb = msgq_make(&me, serv_text_format, from, tok, &vd);
   va_end(vd.vd_args);
 
   msgtagctx_init(&mctx, tok);
@@ -1077,7 +1295,7 @@ void sendwallto_group_butone(struct Client *from, int type, struct Client *one,
   for (lp = cli_serv(&me)->down; lp; lp = lp->next) {
     if (one && lp->value.cptr == cli_from(one))
       continue;
-    send_buffer(lp->value.cptr, NULL, mb, 1, &mctx, NULL);
+    send_buffer(lp->value.cptr, from, mb, 1, &mctx, NULL);
   }
 
   msgq_clean(mb);
@@ -1108,12 +1326,12 @@ void sendcmdto_match_butone(struct Client *from, const char *cmd,
 
   /* Build buffer to send to users */
   va_start(vd.vd_args, pattern);
-  user_mb = msgq_make(0, "%:#C %s %v", from, cmd, &vd);
+  user_mb = msgq_make(0, user_cmd_format, from, cmd, &vd);
   va_end(vd.vd_args);
 
   /* Build buffer to send to servers */
   va_start(vd.vd_args, pattern);
-  serv_mb = msgq_make(&me, "%C %s %v", from, tok, &vd);
+  serv_mb = msgq_make(&me, serv_cmd_format, from, tok, &vd);
   va_end(vd.vd_args);
 
   tagsendcache_init_cmd(&tcache, tok);
@@ -1129,7 +1347,7 @@ void sendcmdto_match_butone(struct Client *from, const char *cmd,
     if (MyConnect(cptr)) /* send right buffer */
       send_buffer(cptr, from, user_mb, 0, NULL, &tcache);
     else
-      send_buffer(cptr, NULL, serv_mb, 0, NULL, &tcache);
+      send_buffer(cptr, from, serv_mb, 0, NULL, &tcache);
   }
 
   msgq_clean(user_mb);
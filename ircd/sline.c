@@ -88,15 +88,7 @@ static unsigned int sline_token_hash(uint64_t token) {
 static uint64_t next_hold_token = 1;
 
 /** Statistics counters for S-line operations */
-static struct {
-  unsigned int sline_hits;          /**< Number of times S-lines matched messages */
-  unsigned int messages_held;       /**< Total number of messages held */
-  unsigned int messages_released;   /**< Number of messages released (XREPLY YES) */
-  unsigned int messages_blocked;    /**< Number of messages blocked (XREPLY NO + timeout) */
-  unsigned int xreply_accepted;     /**< Number of XREPLY YES responses */
-  unsigned int xreply_rejected;     /**< Number of XREPLY NO responses */
-  unsigned int timeout_expired;     /**< Number of messages expired due to timeout */
-} sline_stats_counters = { 0, 0, 0, 0, 0, 0, 0 };
+struct SlineCounters sline_stats_counters = { 0, 0, 0, 0, 0, 0, 0 };
 
 /** Timer for checking expired hold queue entries */
 static struct Timer hold_timeout_timer;
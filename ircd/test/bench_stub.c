@@ -0,0 +1,138 @@
+/* bench_stub.c - stand-ins for ircd_bench
+ *
+ * The benchmarked modules reference much of the server.  The stand-ins
+ * below are either never reached by the benchmarks or only need to
+ * return a harmless value.
+ */
+
+#include "config.h"
+#include "IPcheck.h"
+#include "class.h"
+#include "client.h"
+#include "destruct_event.h"
+#include "ircd.h"
+#include "ircd_features.h"
+#include "ircd_osdep.h"
+#include "ircd_reply.h"
+#include "ircd_tls.h"
+#include "list.h"
+#include "msgq.h"
+#include "querycmds.h"
+#include "random.h"
+#include "s_misc.h"
+#include "s_serv.h"
+#include "send.h"
+#include "sline.h"
+#include "whowas.h"
+#include <stdlib.h>
+#include <string.h>
+
+time_t CurrentTime;
+time_t TSoffset;
+struct Client his;
+struct UserStatistics UserStats;
+static struct ServerStatistics bench_stats;
+struct ServerStatistics *ServerStats = &bench_stats;
+
+int feature_int(enum Feature feat)
+{
+  /* Let the buffer pools grow as far as the benchmarks need. */
+  return feat == FEAT_BUFFERPOOL ? 1 << 30 : 0;
+}
+
+int feature_bool(enum Feature feat)
+{
+  return 0;
+}
+
+const char *feature_str(enum Feature feat)
+{
+  return feat == FEAT_HIDDEN_HOST ? "users.example.net" : "";
+}
+
+unsigned int ircrandom(void)
+{
+  return (unsigned int)random();
+}
+
+unsigned int get_sendq(struct Client *cptr)
+{
+  return 40000000;
+}
+
+struct SLink *make_link(void)
+{
+  return calloc(1, sizeof(struct SLink));
+}
+
+void free_link(struct SLink *lp)
+{
+  free(lp);
+}
+
+void server_panic(const char *message)
+{
+  abort();
+}
+
+void kill_highest_sendq(int servers_too) { }
+void flush_connections(struct Client *cptr) { }
+int IPcheck_local_connect(const struct irc_in_addr *ip, time_t *next_target_out)
+{
+  return 1;
+}
+void IPcheck_connect_fail(const struct Client *cptr, int disconnect) { }
+void burst_channel_removed(struct Channel *chptr) { }
+int get_secure_group_id(struct Client *cli) { return 0; }
+struct Client *get_history(const char *nick) { return 0; }
+int ircd_tls_sha1_base64(const void *data, size_t len, char *out, size_t outlen)
+{
+  return -1;
+}
+IOResult os_send_nonb(int fd, const char *buf, unsigned int length,
+                      unsigned int *length_out)
+{
+  *length_out = length;
+  return IO_SUCCESS;
+}
+void remove_destruct_event(struct Channel *chptr) { }
+void schedule_destruct_event_1m(struct Channel *chptr) { }
+void schedule_destruct_event_48h(struct Channel *chptr) { }
+void sline_cleanup_channel(struct Channel *chptr) { }
+void send_buffer(struct Client *to, struct Client *from, struct MsgBuf *buf,
+                 int prio, const struct MsgTagCtx *ctx,
+                 struct TagSendCache *cache) { }
+void send_raw_buffer(struct Client *to, struct MsgBuf *mb, int prio) { }
+void sendcmdto_one(struct Client *from, const char *cmd, const char *tok,
+                   struct Client *to, const char *pattern, ...) { }
+void sendcmdto_serv_butone(struct Client *from, const char *cmd,
+                           const char *tok, struct Client *one,
+                           const char *pattern, ...) { }
+void sendcmdto_capflag_common_channels_butone(struct Client *from,
+                                              const char *cmd,
+                                              const char *tok,
+                                              struct Client *one,
+                                              capset_t require,
+                                              capset_t forbid,
+                                              const char *pattern, ...) { }
+void sendcmdto_capflag_channel_butserv_butone(struct Client *from,
+                                              const char *cmd,
+                                              const char *tok,
+                                              struct Channel *to,
+                                              struct Client *one,
+                                              unsigned int skip,
+                                              capset_t require,
+                                              capset_t forbid,
+                                              const char *pattern, ...) { }
+void sendcmdto_channel_butserv_butone(struct Client *from, const char *cmd,
+                                      const char *tok, struct Channel *to,
+                                      struct Client *one, unsigned int skip,
+                                      const char *pattern, ...) { }
+void sendjointo_channel_butserv(struct Client *from, struct Channel *chptr,
+                                capset_t require, capset_t forbid) { }
+void sendjointo_one(struct Client *from, struct Channel *chptr,
+                    struct Client *one) { }
+void sendto_opmask_butone(struct Client *one, unsigned int mask,
+                          const char *pattern, ...) { }
+void sendwallto_group_butone(struct Client *from, int type,
+                             struct Client *one, const char *pattern, ...) { }
@@ -0,0 +1,630 @@
+/*
+ * ircd_bench.c - microbenchmarks for core primitives
+ *
+ * Results are printed one per line in the Go benchmark format
+ * ("Benchmark<Name> <iterations> <ns> ns/op"), so the output of two
+ * builds can be compared with benchstat.  Options:
+ *   -t seconds  minimum time per measurement (default 0.5)
+ *   -c count    measurements per benchmark (default 1)
+ * Any other arguments select benchmarks whose names contain them.
+ */
+#include "config.h"
+#include "capab.h"
+#include "channel.h"
+#include "client.h"
+#include "dbuf.h"
+#include "handlers.h"
+#include "hash.h"
+#include "ircd.h"
+#include "ircd_reply.h"
+#include "ircd_snprintf.h"
+#include "ircd_string.h"
+#include "match.h"
+#include "msg.h"
+#include "msg_tag.h"
+#include "msgq.h"
+#include "numeric.h"
+#include "numnicks.h"
+#include "struct.h"
+#include "websocket.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Keeps the compiler from discarding benchmarked results. */
+static volatile unsigned long sink;
+
+static struct Connection bench_con;
+static struct User bench_user;
+static struct Client bench_client;
+
+/** Set up a registered local client to format and match against. */
+static void setup_client(void)
+{
+  if (cli_connect(&bench_client))
+    return;
+  cli_connect(&bench_client) = &bench_con;
+  cli_user(&bench_client) = &bench_user;
+  cli_status(&bench_client) = STAT_USER;
+  ircd_strncpy(cli_name(&bench_client), "Benchmarker", NICKLEN);
+  ircd_strncpy(bench_user.username, "~bench", USERLEN);
+  ircd_strncpy(bench_user.host, "dsl-203-0-113-7.example.net", HOSTLEN);
+  ircd_strncpy(bench_user.realhost, bench_user.host, HOSTLEN);
+  ircd_aton(&cli_ip(&bench_client), "203.0.113.7");
+  CapSet(cli_active(&bench_client), CAP_SERVER_TIME);
+  CapSet(cli_active(&bench_client), CAP_MESSAGE_TAGS);
+}
+
+/* Adversarial masks: every start position almost matches. */
+#define ADV_MASK "*a*a*a*a*a*b"
+#define ADV_CHUNK "*aaaaaaaaaaaaaaaaaaaaaaaaaaaaab*"
+#define ADV_TEXT "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+
+static void bench_match_literal(unsigned long n)
+{
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++)
+    sink += match("irc.example.net", "irc.example.net");
+}
+
+static void bench_match_wild(unsigned long n)
+{
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++)
+    sink += match("*!*@*.dsl.*.example.net",
+                  "nick!~user@host-203-0-113-7.dsl.pool.example.net");
+}
+
+static void bench_match_miss(unsigned long n)
+{
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++)
+    sink += match(ADV_MASK, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+}
+
+static void bench_match_chunk(unsigned long n)
+{
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++)
+    sink += match(ADV_CHUNK, ADV_TEXT);
+}
+
+static void bench_matchexec_miss(unsigned long n)
+{
+  static char cmask[sizeof(ADV_MASK)];
+  static int minlen;
+  unsigned long ii;
+
+  if (!cmask[0])
+    matchcomp(cmask, &minlen, NULL, ADV_MASK);
+  for (ii = 0; ii < n; ii++)
+    sink += matchexec("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", cmask, minlen);
+}
+
+static void bench_matchexec_chunk(unsigned long n)
+{
+  static char cmask[sizeof(ADV_CHUNK)];
+  static int minlen;
+  unsigned long ii;
+
+  if (!cmask[0])
+    matchcomp(cmask, &minlen, NULL, ADV_CHUNK);
+  for (ii = 0; ii < n; ii++)
+    sink += matchexec(ADV_TEXT, cmask, minlen);
+}
+
+static void bench_matchexec(unsigned long n)
+{
+  static char cmask[64];
+  static int minlen;
+  unsigned long ii;
+  int charset;
+
+  if (!cmask[0])
+    matchcomp(cmask, &minlen, &charset, "*!*@*.dsl.*.example.net");
+  for (ii = 0; ii < n; ii++)
+    sink += matchexec("nick!~user@host-203-0-113-7.dsl.pool.example.net",
+                      cmask, minlen);
+}
+
+#define HASH_CLIENTS 10000
+
+static struct Client *hash_clients;
+
+/** Fill the client hash table with #HASH_CLIENTS users. */
+static void setup_hash(void)
+{
+  unsigned int ii;
+
+  if (hash_clients)
+    return;
+  init_hash();
+  hash_clients = calloc(HASH_CLIENTS, sizeof(*hash_clients));
+  for (ii = 0; ii < HASH_CLIENTS; ii++) {
+    ircd_snprintf(0, cli_name(&hash_clients[ii]), NICKLEN, "user%u", ii * 7919);
+    cli_status(&hash_clients[ii]) = STAT_USER;
+    hAddClient(&hash_clients[ii]);
+  }
+}
+
+static void bench_hash_seek(unsigned long n)
+{
+  unsigned long ii;
+
+  setup_hash();
+  for (ii = 0; ii < n; ii++)
+    sink += (unsigned long)hSeekClient(
+      cli_name(&hash_clients[ii % HASH_CLIENTS]), STAT_USER);
+}
+
+static void bench_hash_miss(unsigned long n)
+{
+  static const char *names[] = { "Nobody", "NotHere", "Missing", "absent" };
+  unsigned long ii;
+
+  setup_hash();
+  for (ii = 0; ii < n; ii++)
+    sink += (unsigned long)hSeekClient(names[ii & 3], STAT_USER);
+}
+
+/** Nicknames of typical lengths, compared as typed and with their
+ * case changed. */
+static const char *case_names[][2] = {
+  { "Benchmarker", "Benchmarker" },
+  { "user70000", "USER70000" },
+  { "[Guest]12345", "[Guest]12345" },
+  { "x", "X" },
+};
+
+static void bench_strcasecmp(unsigned long n)
+{
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++)
+    sink += ircd_strcmp(case_names[ii & 3][0], case_names[ii & 3][1]);
+}
+
+static struct Ban *ban_list;
+
+/** Build a 20-entry ban list that the benchmark client only matches at
+ * its very end. */
+static void setup_bans(void)
+{
+  char mask[64];
+  struct Ban *ban;
+  int ii;
+
+  if (ban_list)
+    return;
+  setup_client();
+  ban_list = make_ban("*!*@dsl-203-0-113-*.example.net");
+  for (ii = 0; ii < 16; ii++) {
+    ircd_snprintf(0, mask, sizeof(mask), "*!*@*.isp%d.example.org", ii);
+    ban = make_ban(mask);
+    ban->next = ban_list;
+    ban_list = ban;
+  }
+  for (ii = 0; ii < 3; ii++) {
+    ircd_snprintf(0, mask, sizeof(mask), "*!*@198.51.100.%d/30", ii * 4);
+    ban = make_ban(mask);
+    ban->next = ban_list;
+    ban_list = ban;
+  }
+}
+
+static void bench_find_ban(unsigned long n)
+{
+  unsigned long ii;
+
+  setup_bans();
+  for (ii = 0; ii < n; ii++)
+    sink += (unsigned long)find_ban(&bench_client, ban_list);
+}
+
+#define MEMBER_CHANNELS 6000
+
+static struct Channel *big_channel;
+static struct Client member_service, member_user;
+static struct User member_service_user, member_user_user;
+static struct Channel **member_channels;
+
+/** Put a channel service and #HASH_CLIENTS users on one channel, and a
+ * plain user on #MEMBER_CHANNELS channels. */
+static void setup_members(void)
+{
+  unsigned int ii;
+
+  if (big_channel)
+    return;
+  setup_hash();
+  cli_user(&member_service) = &member_service_user;
+  cli_status(&member_service) = STAT_USER;
+  SetChannelService(&member_service);
+  big_channel = calloc(1, sizeof(struct Channel));
+  add_user_to_channel(big_channel, &member_service, 0, 0);
+  for (ii = 0; ii < HASH_CLIENTS; ii++) {
+    cli_user(&hash_clients[ii]) = calloc(1, sizeof(struct User));
+    add_user_to_channel(big_channel, &hash_clients[ii], 0, 0);
+  }
+
+  cli_user(&member_user) = &member_user_user;
+  cli_status(&member_user) = STAT_USER;
+  member_channels = calloc(MEMBER_CHANNELS, sizeof(*member_channels));
+  for (ii = 0; ii < MEMBER_CHANNELS; ii++) {
+    member_channels[ii] = calloc(1, sizeof(struct Channel));
+    add_user_to_channel(member_channels[ii], &member_user, 0, 0);
+  }
+}
+
+static void bench_member_big_channel(unsigned long n)
+{
+  unsigned long ii;
+
+  setup_members();
+  for (ii = 0; ii < n; ii++)
+    sink += (unsigned long)find_member_link(big_channel, &member_service);
+}
+
+static void bench_member_many_channels(unsigned long n)
+{
+  unsigned long ii;
+
+  setup_members();
+  for (ii = 0; ii < n; ii++)
+    sink += (unsigned long)find_member_link(member_channels[ii & 1023],
+                                            &member_user);
+}
+
+#define BURST_USERS 400
+#define BURST_BANS 45
+#define BURST_LINES 16
+
+static struct Client burst_server;
+static struct Connection burst_con;
+static struct Server burst_serv;
+static struct Client *burst_users;
+static char burst_lines[BURST_LINES][512];
+static int burst_nlines;
+
+/** Link a server with #BURST_USERS users and record the BURST it sends
+ * for one big channel: the users split over several messages (plain
+ * users first, then voices, then ops) and #BURST_BANS bans at the end.
+ */
+static void setup_burst(void)
+{
+  static const char *groups[] = { "", ":v", ":o" };
+  char yxx[6], *line = 0;
+  unsigned int ii, pos = 0, group, last = 0;
+
+  if (burst_users)
+    return;
+  setup_hash();
+  con_client(&burst_con) = &burst_server;
+  cli_connect(&burst_server) = &burst_con;
+  cli_serv(&burst_server) = &burst_serv;
+  cli_status(&burst_server) = STAT_SERVER;
+  ircd_strncpy(cli_name(&burst_server), "hub.example.net", HOSTLEN);
+  SetServerYXX(&burst_server, &burst_server, "ABAP]");
+
+  burst_users = calloc(BURST_USERS, sizeof(*burst_users));
+  for (ii = 0; ii < BURST_USERS; ii++) {
+    cli_connect(&burst_users[ii]) = &burst_con;
+    cli_user(&burst_users[ii]) = calloc(1, sizeof(struct User));
+    cli_user(&burst_users[ii])->server = &burst_server;
+    cli_status(&burst_users[ii]) = STAT_USER;
+    ircd_snprintf(0, cli_name(&burst_users[ii]), NICKLEN, "burst%u", ii);
+    yxx[0] = 'A';
+    yxx[1] = 'B';
+    inttobase64(yxx + 2, ii, 3);
+    SetRemoteNumNick(&burst_users[ii], yxx);
+  }
+
+  for (ii = 0; ii < BURST_USERS; ii++) {
+    if (!burst_nlines || pos > 440) {
+      line = burst_lines[burst_nlines++];
+      pos = ircd_snprintf(0, line, 512, "#burst 1700000000 %s",
+                          burst_nlines == 1 ? "+nt " : "");
+      last = 0;
+    } else
+      line[pos++] = ',';
+    group = ii < BURST_USERS - 40 ? 0 : ii < BURST_USERS - 20 ? 1 : 2;
+    pos += ircd_snprintf(0, line + pos, 512 - pos, "AB%s%s",
+                         cli_yxx(&burst_users[ii]),
+                         group != last ? groups[group] : "");
+    last = group;
+  }
+
+  for (ii = 0; ii < BURST_BANS; ii++) {
+    if (ii % 15 == 0) {
+      line = burst_lines[burst_nlines++];
+      pos = ircd_snprintf(0, line, 512, "#burst 1700000000 :%%");
+    } else
+      line[pos++] = ' ';
+    if (ii % 3 == 0)
+      pos += ircd_snprintf(0, line + pos, 512 - pos, "*!*@*.isp%u.example.org", ii);
+    else if (ii % 3 == 1)
+      pos += ircd_snprintf(0, line + pos, 512 - pos, "*!*@198.51.100.%u", ii);
+    else
+      pos += ircd_snprintf(0, line + pos, 512 - pos, "spam%u!*@*", ii);
+  }
+}
+
+/** Feed the recorded BURST to ms_burst(). */
+static void replay_burst(void)
+{
+  char buf[512], *parv[MAXPARA + 1], *p;
+  int ii, parc;
+
+  for (ii = 0; ii < burst_nlines; ii++) {
+    strcpy(buf, burst_lines[ii]);
+    parv[0] = cli_name(&burst_server);
+    for (parc = 1, p = buf; p && parc < MAXPARA; parc++) {
+      if (*p == ':') {
+        parv[parc++] = p + 1;
+        break;
+      }
+      parv[parc] = p;
+      if ((p = strchr(p, ' ')))
+        *p++ = '\0';
+    }
+    parv[parc] = 0;
+    ms_burst(&burst_server, &burst_server, parc, parv);
+  }
+}
+
+/* A netjoin: the channel is new on our side, so every user joins and
+ * every ban is added.  Each round parts the users again, which empties
+ * and destroys the channel. */
+static void bench_burst_join(unsigned long n)
+{
+  struct Channel *chptr;
+  unsigned long ii;
+  unsigned int jj;
+
+  setup_burst();
+  for (ii = 0; ii < n; ii++) {
+    replay_burst();
+    chptr = hSeekChannel("#burst");
+    for (jj = 0; jj < BURST_USERS; jj++)
+      remove_user_from_channel(&burst_users[jj], chptr);
+  }
+}
+
+/* A short split: both sides kept the channel, so the BURST repeats
+ * members and bans we already have. */
+static void bench_burst_merge(unsigned long n)
+{
+  unsigned long ii;
+
+  setup_burst();
+  if (!hSeekChannel("#burst"))
+    replay_burst();
+  for (ii = 0; ii < n; ii++)
+    replay_burst();
+}
+
+static void bench_msgq_make(unsigned long n)
+{
+  struct MsgBuf *mb;
+  unsigned long ii;
+
+  setup_client();
+  for (ii = 0; ii < n; ii++) {
+    mb = msgq_make(&bench_client, ":%s!%s@%s PRIVMSG %s :%s", "Sender",
+                   "~user", "host.example.net", "#channel",
+                   "Hello, world!  This is a typical line of chat text.");
+    sink += msgq_bufleft(mb);
+    msgq_clean(mb);
+  }
+}
+
+static void bench_msgq_add(unsigned long n)
+{
+  static struct MsgQ mq;
+  struct MsgBuf *mb;
+  unsigned long ii;
+
+  setup_client();
+  msgq_init(&mq);
+  mb = msgq_make(&bench_client, ":Sender!~user@host.example.net PRIVMSG "
+                 "#channel :Hello, world!");
+  for (ii = 0; ii < n; ii++) {
+    msgq_add(&mq, mb, 0);
+    if (MsgQLength(&mq) > 64 * 1024)
+      msgq_delete(&mq, MsgQLength(&mq));
+  }
+  msgq_delete(&mq, MsgQLength(&mq));
+  msgq_clean(mb);
+}
+
+static void bench_snprintf(unsigned long n)
+{
+  char buf[512];
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++)
+    sink += ircd_snprintf(0, buf, sizeof(buf), ":%s %03d %s %s %lu :%s",
+                          "irc.example.net", 317, "Nick", "Other",
+                          (unsigned long)ii, "seconds idle, signon time");
+}
+
+static void bench_send_reply(unsigned long n)
+{
+  unsigned long ii;
+
+  setup_client();
+  ircd_strncpy(cli_name(&me), "irc.example.net", HOSTLEN);
+  cli_status(&me) = STAT_ME;
+  cli_from(&bench_client) = &bench_client;
+  reply_init();
+  for (ii = 0; ii < n; ii++) {
+    send_reply(&bench_client, RPL_WHOISUSER, "Other", "~other",
+               "host.example.net", "Some Body");
+    send_reply(&bench_client, RPL_WHOISIDLE, "Other", (long)ii,
+               1234567890L);
+  }
+}
+
+static void bench_dbuf(unsigned long n)
+{
+  static const char line[] =
+    "PRIVMSG #channel :Hello, world!  This is a typical line of chat.\r\n";
+  static struct DBuf dyn;
+  char buf[512];
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++) {
+    dbuf_put(&dyn, line, sizeof(line) - 1);
+    sink += dbuf_getmsg(&dyn, buf, sizeof(buf));
+  }
+}
+
+static const char tag_text[] =
+  "@time=2024-01-01T00:00:00.000Z;account=someone;+draft/reply=abc123;"
+  "+example.com/custom=with\\sspaces;msgid=AAAABBBBCCCC ";
+
+static void bench_tag_parse(unsigned long n)
+{
+  char buf[sizeof(tag_text)];
+  unsigned long ii;
+
+  for (ii = 0; ii < n; ii++) {
+    memcpy(buf, tag_text, sizeof(tag_text));
+    sink += (unsigned long)msg_tag_parse(buf + 1, buf + sizeof(tag_text) - 2);
+  }
+}
+
+static void bench_tag_format(unsigned long n)
+{
+  char parsed[sizeof(tag_text)], buf[512];
+  struct MsgTag *tags;
+  unsigned long ii;
+
+  setup_client();
+  memcpy(parsed, tag_text, sizeof(tag_text));
+  tags = msg_tag_parse(parsed + 1, parsed + sizeof(tag_text) - 2);
+  for (ii = 0; ii < n; ii++)
+    sink += msg_tag_format(buf, sizeof(buf), &bench_client, 0, tags,
+                           1700000000);
+}
+
+static void bench_ws_frame(unsigned long n)
+{
+  static const char line[] =
+    "PRIVMSG #channel :Hello, world!  This is a typical line of chat.";
+  unsigned char frame[sizeof(line) + 8];
+  unsigned long ii;
+  size_t len = sizeof(line) - 1;
+  int res = 0;
+
+  setup_client();
+  frame[0] = 0x81;
+  frame[1] = 0x80 | len;
+  memcpy(frame + 2, "\x12\x34\x56\x78", 4);
+  for (ii = 0; ii < len; ii++)
+    frame[6 + ii] = line[ii] ^ frame[2 + ii % 4];
+  for (ii = 0; ii < n; ii++) {
+    res = websocket_parse_frame(&bench_client, (const char *)frame, len + 6);
+    sink += res;
+    dbuf_delete(&cli_recvQ(&bench_client), DBufLength(&cli_recvQ(&bench_client)));
+  }
+  if (res != (int)len + 6)
+    fprintf(stderr, "websocket_parse_frame returned %d\n", res);
+}
+
+/** One benchmark. */
+struct Bench {
+  const char *name;
+  void (*run)(unsigned long n);
+};
+
+static const struct Bench benches[] = {
+  { "MatchLiteral", bench_match_literal },
+  { "MatchWildcard", bench_match_wild },
+  { "MatchBacktrack", bench_match_miss },
+  { "MatchLongChunk", bench_match_chunk },
+  { "Matchexec", bench_matchexec },
+  { "MatchexecBacktrack", bench_matchexec_miss },
+  { "MatchexecLongChunk", bench_matchexec_chunk },
+  { "HashSeekClient", bench_hash_seek },
+  { "HashSeekClientMiss", bench_hash_miss },
+  { "StrCaseCmp", bench_strcasecmp },
+  { "FindBan", bench_find_ban },
+  { "FindMemberBigChannel", bench_member_big_channel },
+  { "FindMemberManyChannels", bench_member_many_channels },
+  { "BurstReplayJoin", bench_burst_join },
+  { "BurstReplayMerge", bench_burst_merge },
+  { "MsgqMake", bench_msgq_make },
+  { "MsgqAdd", bench_msgq_add },
+  { "IrcdSnprintf", bench_snprintf },
+  { "SendReply", bench_send_reply },
+  { "DbufPutGetmsg", bench_dbuf },
+  { "MsgTagParse", bench_tag_parse },
+  { "MsgTagFormat", bench_tag_format },
+  { "WebsocketParseFrame", bench_ws_frame },
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Time \a b for at least \a mintime seconds and print the result. */
+static void measure(const struct Bench *b, double mintime)
+{
+  unsigned long n = 1, next;
+  double start, elapsed;
+
+  for (;;) {
+    start = now();
+    b->run(n);
+    elapsed = now() - start;
+    if (elapsed >= mintime || n >= 1000000000ul)
+      break;
+    /* Aim 20% past the target, growing at most a hundredfold. */
+    next = elapsed > 0 ? (unsigned long)(n * mintime * 1.2 / elapsed) : n * 100;
+    if (next > n * 100)
+      next = n * 100;
+    n = next > n ? next : n + 1;
+  }
+  printf("Benchmark%s\t%10lu\t%12.2f ns/op\n", b->name, n, elapsed * 1e9 / n);
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+  double mintime = 0.5;
+  int count = 1, ii, jj, kk, selected;
+
+  for (ii = 1; ii < argc; ii++) {
+    if (!strcmp(argv[ii], "-t") && ii + 1 < argc)
+      mintime = atof(argv[++ii]);
+    else if (!strcmp(argv[ii], "-c") && ii + 1 < argc)
+      count = atoi(argv[++ii]);
+    else if (argv[ii][0] == '-') {
+      fprintf(stderr, "Usage: %s [-t seconds] [-c count] [name ...]\n",
+              argv[0]);
+      return 2;
+    } else
+      break;
+  }
+
+  for (jj = 0; jj < (int)(sizeof(benches) / sizeof(benches[0])); jj++) {
+    selected = (ii == argc);
+    for (kk = ii; kk < argc && !selected; kk++)
+      selected = strstr(benches[jj].name, argv[kk]) != 0;
+    if (!selected)
+      continue;
+    for (kk = 0; kk < count; kk++)
+      measure(&benches[jj], mintime);
+  }
+  return 0;
+}
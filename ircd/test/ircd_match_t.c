@@ -2,12 +2,14 @@
  * ircd_match_t.c - test cases for irc glob matching
  */
 
+#include "ircd_alloc.h"
 #include "ircd_log.h"
 #include "match.h"
 
 #include <errno.h>    /* errno */
 #include <fcntl.h>    /* O_RDONLY */
 #include <stdio.h>
+#include <stdlib.h>   /* random() */
 #include <string.h>
 #include <sys/mman.h> /* mmap(), munmap() */
 #include <unistd.h>   /* sysconf() */
@@ -62,6 +64,12 @@ const struct match_test match_tests[] = {
   { "*\\\\[*!~*",
     "har\\[dy!~boy\0",
     "dark\\s|de!pimp\0joe\\[mama\0" },
+  { "*\\Bc*",
+    "aBcd\0Bc\0aBC\0",
+    "abcd\0bc\0" },
+  { "a\\b",
+    "ab\0Ab\0",
+    "aB\0" },
   { NULL, NULL, NULL }
 };
 
@@ -128,6 +136,35 @@ int test_match(const char glob[], const char name[])
   return match(test_glob, test_name);
 }
 
+/* Check a compiled mask against a string at the end of a page. */
+int test_matchmask(const char glob[], const char name[])
+{
+  static char *page;
+  struct MatchMask *mm;
+  size_t length;
+  int res;
+
+  if (!page)
+  {
+    size_t page_size = sysconf(_SC_PAGE_SIZE);
+    page = mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED)
+    {
+      fprintf(stderr, "Unable to map pages: %s\n", strerror(errno));
+      assert(0);
+    }
+    munmap(page + page_size, page_size);
+    page += page_size;
+  }
+
+  length = strlen(name) + 1;
+  memcpy(page - length, name, length);
+  mm = matchmask_make(glob);
+  res = matchmask(mm, page - length);
+  MyFree(mm);
+  return res;
+}
+
 int do_match_test(const struct match_test *test)
 {
   const char *candidate;
@@ -144,6 +181,11 @@ int do_match_test(const struct match_test *test)
       fprintf(stderr, "\"%s\" failed to match \"%s\".\n", test->glob, candidate);
       any_failed = 1;
     }
+    res = test_matchmask(test->glob, candidate);
+    if (res != 0) {
+      fprintf(stderr, "compiled \"%s\" failed to match \"%s\".\n", test->glob, candidate);
+      any_failed = 1;
+    }
   }
 
   for (candidate = test->shouldnt_match, not_matched = 0;
@@ -154,6 +196,11 @@ int do_match_test(const struct match_test *test)
       fprintf(stderr, "\"%s\" incorrectly matched \"%s\".\n", test->glob, candidate);
       any_failed = 1;
     }
+    res = test_matchmask(test->glob, candidate);
+    if (res == 0) {
+      fprintf(stderr, "compiled \"%s\" incorrectly matched \"%s\".\n", test->glob, candidate);
+      any_failed = 1;
+    }
   }
 
   if (!any_failed) {
@@ -164,6 +211,120 @@ int do_match_test(const struct match_test *test)
   return any_failed;
 }
 
+/* Compare compiled masks with match() on random masks and strings. */
+int do_random_test(void)
+{
+  static const char mask_chars[] = "aAb?*\\";
+  static const char name_chars[] = "aAbB?*\\";
+  char glob[16], name[16];
+  unsigned int ii, jj, len;
+  int any_failed = 0;
+
+  srandom(1);
+  for (ii = 0; ii < 200000 && !any_failed; ++ii) {
+    len = random() % 12;
+    for (jj = 0; jj < len; ++jj)
+      glob[jj] = mask_chars[random() % (sizeof(mask_chars) - 1)];
+    /* match() reads past a trailing backslash. */
+    while (len && glob[len - 1] == '\\')
+      --len;
+    glob[len] = '\0';
+    len = random() % 14;
+    for (jj = 0; jj < len; ++jj)
+      name[jj] = name_chars[random() % (sizeof(name_chars) - 1)];
+    name[len] = '\0';
+    if (!test_match(glob, name) != !test_matchmask(glob, name)) {
+      fprintf(stderr, "match() and compiled \"%s\" disagree about \"%s\".\n",
+              glob, name);
+      any_failed = 1;
+    }
+  }
+
+  if (!any_failed)
+    printf("Passed: %u random masks\n", ii);
+  return any_failed;
+}
+
+/** Pair of masks for mmatch(). */
+struct mmatch_test {
+  const char *old_mask;
+  const char *new_mask;
+  int superset; /**< Non-zero if old_mask covers new_mask. */
+};
+
+const struct mmatch_test mmatch_tests[] = {
+  { "*!*@*.example.org", "*!*@*.isp.example.org", 1 },
+  { "*!*@*.EXAMPLE.org", "nick!*@host.example.org", 1 },
+  { "*!*@*.example.org", "*!*@*.example.net", 0 },
+  { "*bc", "a\\*bc", 1 },
+  { "*c", "a\\*", 0 },
+  { "*\\*", "ab*", 0 },
+  { "a?c", "abc", 1 },
+  { "abc", "xabc", 0 },
+  { "*abc", "bc", 0 },
+  { "*.org", "*", 0 },
+  { NULL, NULL, 0 }
+};
+
+int do_mmatch_test(void)
+{
+  const struct mmatch_test *test;
+  int any_failed = 0;
+
+  for (test = mmatch_tests; test->old_mask; ++test) {
+    if (!mmatch(test->old_mask, test->new_mask) != test->superset) {
+      fprintf(stderr, "mmatch(\"%s\", \"%s\") should be %s.\n",
+              test->old_mask, test->new_mask,
+              test->superset ? "a superset" : "no superset");
+      any_failed = 1;
+    }
+  }
+
+  if (!any_failed)
+    printf("Passed: %u mask pairs\n", (unsigned int)(test - mmatch_tests));
+  return any_failed;
+}
+
+/* Masks that make a backtracking matcher retry at every position. */
+int do_adversarial_test(void)
+{
+  char glob[512], name[4096];
+  size_t len;
+  int any_failed = 0;
+
+  memset(name, 'a', sizeof(name) - 1);
+  name[sizeof(name) - 1] = '\0';
+
+  /* Many stars, and a final chunk that never matches. */
+  strcpy(glob, "*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b");
+  if (!test_matchmask(glob, name))
+    any_failed = 1;
+  name[sizeof(name) - 2] = 'b';
+  if (test_matchmask(glob, name))
+    any_failed = 1;
+
+  /* Chunks just under, at and over the bit-parallel limit, with '?'. */
+  for (len = 63; len <= 66; ++len) {
+    glob[0] = '*';
+    memset(glob + 1, 'a', len);
+    glob[2] = '?';
+    glob[len] = 'b';
+    strcpy(glob + len + 1, "*");
+    if (test_matchmask(glob, name) || test_match(glob, name))
+      any_failed = 1;
+    name[sizeof(name) - 2] = 'a';
+    if (!test_matchmask(glob, name))
+      any_failed = 1;
+    name[sizeof(name) - 2] = 'b';
+  }
+
+  if (any_failed)
+    fprintf(stderr, "Adversarial masks gave wrong answers.\n");
+  else
+    printf("Passed: adversarial masks\n");
+  return any_failed;
+}
+
 int main(int argc, char *argv[])
 {
   const struct match_test *match;
@@ -174,5 +335,9 @@ int main(int argc, char *argv[])
   for (match = match_tests; match->glob; ++match)
     any_failed = do_match_test(match) || any_failed;
 
+  any_failed = do_random_test() || any_failed;
+  any_failed = do_mmatch_test() || any_failed;
+  any_failed = do_adversarial_test() || any_failed;
+
   return any_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,117 @@
+/*
+ * ircd_snprintf_t.c - test cases for compiled formats
+ *
+ * Each format is run both parsed (from a copy of the string, which is
+ * never compiled) and compiled, into every buffer size up to one past
+ * the expected length; both must agree byte for byte and on the
+ * returned length, and the last must give the expected text.
+ */
+
+#include "client.h"
+#include "channel.h"
+#include "ircd_snprintf.h"
+#include "ircd_string.h"
+#include "struct.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+static struct Client user_client;
+static struct User user_user;
+static struct Channel *channel;
+
+/** Format \a format both ways and compare against \a expect. */
+static void
+check(int compiles, const char *expect, const char *format, ...)
+{
+  char copy[256], parsed[256], compiled[256];
+  size_t len, explen = strlen(expect);
+  int r1, r2;
+  va_list vl;
+
+  if (ircd_format_compile(format) != compiles) {
+    printf("format \"%s\" %s compile\n", format,
+           compiles ? "did not" : "should not");
+    failures++;
+  }
+  strcpy(copy, format);
+
+  for (len = 1; len <= explen + 1; len++) {
+    memset(parsed, 'x', sizeof(parsed));
+    memset(compiled, 'x', sizeof(compiled));
+    va_start(vl, format);
+    r1 = ircd_vsnprintf(0, parsed, len, copy, vl);
+    va_end(vl);
+    va_start(vl, format);
+    r2 = ircd_vsnprintf(0, compiled, len, format, vl);
+    va_end(vl);
+
+    if (r1 != r2 || memcmp(parsed, compiled, sizeof(parsed))
+        || (len == explen + 1 && (r2 != (int)explen
+                                  || strcmp(compiled, expect)))) {
+      printf("format \"%s\" size %u: expected \"%s\" (%u), parsed \"%s\" "
+             "(%d), compiled \"%s\" (%d)\n", format, (unsigned int)len,
+             expect, (unsigned int)explen, parsed, r1, compiled, r2);
+      failures++;
+      return;
+    }
+  }
+}
+
+/** Format \a pattern through a %v field with precision \a prec. */
+static void
+check_varargs(int compiles, const char *expect, int prec,
+              const char *pattern, ...)
+{
+  struct VarData vd;
+
+  vd.vd_format = pattern;
+  va_start(vd.vd_args, pattern);
+  if (prec < 0)
+    check(compiles, expect, "<%v>", &vd);
+  else
+    check(compiles, expect, "<%.5v>", &vd);
+  va_end(vd.vd_args);
+}
+
+int
+main(int argc, char *argv[])
+{
+  cli_status(&user_client) = STAT_USER;
+  cli_user(&user_client) = &user_user;
+  ircd_strncpy(cli_name(&user_client), "Nick", NICKLEN);
+  ircd_strncpy(user_user.username, "~user", USERLEN);
+  ircd_strncpy(user_user.host, "host.example.net", HOSTLEN);
+  channel = calloc(1, sizeof(*channel) + 8);
+  strcpy(channel->chname, "#chan");
+
+  check(1, "plain text", "plain text");
+  check(1, "100% sure", "100%% sure");
+  check(1, "%", "%%");
+  check(1, ":irc.example.net 311 Nick ~user host * :Some Body",
+        ":%s %s %s %s %s * :%s", "irc.example.net", "311", "Nick", "~user",
+        "host", "Some Body");
+  check(1, "a -12 34 0x1f 017 |  ab| |ab  | 007",
+        "a %d %u %#x %#o |%4s| |%-4s| %03d", -12, 34u, 31u, 15u, "ab",
+        "ab", 7);
+  check(1, "long 1234567890 time 42", "long %ld time %Tu", 1234567890L,
+        (time_t)42);
+  check(1, "abc (null)", "%.3s %s", "abcdef", (char *)0);
+  check(1, "c=x", "c=%c", 'x');
+  check(1, ":Nick!~user@host.example.net JOIN #chan", "%:#C JOIN %H",
+        &user_client, channel);
+  check(1, "[   Nick]", "[%7C]", &user_client);
+  check(0, "width    x", "width%*s", 5, "x");
+  check(0, "bad (Unsupported: %N)", "bad %N");
+
+  check_varargs(1, "<n=5 x>", -1, "n=%d %s", 5, "x");
+  check_varargs(1, "<n=5 x>", 5, "n=%d %s", 5, "xyz");
+
+  if (failures)
+    printf("%d failures\n", failures);
+  return failures != 0;
+}
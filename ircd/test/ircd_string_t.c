@@ -1,11 +1,82 @@
 /*
  * ircd_string_t.c - string test program
  */
+#include "ircd_chattr.h"
 #include "ircd_string.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/** Reference case insensitive comparison, one character at a time. */
+static int ref_strncmp(const char *a, const char *b, size_t n)
+{
+  for (; n; --n, ++a, ++b) {
+    if (ToLower(*a) != ToLower(*b))
+      return ToLower(*a) - ToLower(*b);
+    if (!*a)
+      break;
+  }
+  return 0;
+}
+
+/** Check the comparisons of \a a and \a b against the reference. */
+static void check_pair(const char *a, const char *b)
+{
+  size_t len = strlen(a) + 2, n;
+  int ref = ref_strncmp(a, b, (size_t)-1);
+
+  if (ircd_strcmp(a, b) != ref) {
+    fprintf(stderr, "ircd_strcmp(\"%s\", \"%s\") = %d, expected %d\n",
+            a, b, ircd_strcmp(a, b), ref);
+    exit(1);
+  }
+  for (n = 0; n < len; ++n)
+    if (ircd_strncmp(a, b, n) != ref_strncmp(a, b, n)) {
+      fprintf(stderr, "ircd_strncmp(\"%s\", \"%s\", %zu) = %d, expected %d\n",
+              a, b, n, ircd_strncmp(a, b, n), ref_strncmp(a, b, n));
+      exit(1);
+    }
+}
+
+/** Compare random strings with case changes, different characters
+ * and different lengths. */
+static void check_compare(void)
+{
+  static const char chars[] = "aAbB[{]}\\|^~xX\xc0\xe0\xd7\xf7\xde\xfe\xff";
+  char a[64], b[64];
+  unsigned int ii, jj, len, pos;
+  int c;
+
+  /* Every character equals its lower case form. */
+  for (c = 1; c < 256; ++c) {
+    a[0] = c;
+    a[1] = '\0';
+    b[0] = ToLower((char)c);
+    b[1] = '\0';
+    if (ircd_strcmp(a, b)) {
+      fprintf(stderr, "character %#x does not equal its lower case\n", c);
+      exit(1);
+    }
+  }
+
+  srandom(1);
+  for (ii = 0; ii < 200000; ++ii) {
+    len = random() % 40;
+    for (jj = 0; jj < len; ++jj)
+      a[jj] = chars[random() % (sizeof(chars) - 1)];
+    a[len] = '\0';
+    memcpy(b, a, len + 1);
+    pos = len ? random() % len : 0;
+    switch (random() % 4) {
+    case 0: b[pos] = ToUpper(b[pos]); break;
+    case 1: b[pos] = chars[random() % (sizeof(chars) - 1)]; break;
+    case 2: b[pos] = '\0'; break;
+    }
+    check_pair(a, b);
+    check_pair(b, a);
+  }
+}
+
 int main(void)
 {
   char* vector[20];
@@ -13,6 +84,8 @@ int main(void)
   int count;
   int i;
 
+  check_compare();
+
   names = strdup(",,,a,b,a,X,ne,blah,A,z,#foo,&Bar,foo,,crud,Foo,z,x,bzet,,");
   printf("input: %s\n", names);
   count = unique_name_vector(names, ',', vector, 20);
@@ -53,6 +126,7 @@ int main(void)
   printf("\n");
   free(names);
 
+  printf("Case insensitive comparison tests passed.\n");
   return 0;
 }
   
@@ -0,0 +1,128 @@
+/*
+ * random_t.c - pseudo-random number generator test program
+ *
+ * Run with "-b [count]" to time the generator instead.
+ */
+#include "random.h"
+#include "ircd_reply.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int need_more_params(struct Client *cptr, const char *cmd)
+{
+  return 0;
+}
+
+/* RFC 7539, section 2.3.2. */
+static const unsigned char block_expected[CHACHA20_BLOCK] = {
+  0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15,
+  0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+  0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03,
+  0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+  0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09,
+  0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+  0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9,
+  0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+};
+
+static int test_block(void)
+{
+  unsigned char key[32], out[CHACHA20_BLOCK];
+  static const unsigned char nonce[12] = {
+    0, 0, 0, 0x09, 0, 0, 0, 0x4a, 0, 0, 0, 0
+  };
+  int i;
+
+  for (i = 0; i < 32; i++)
+    key[i] = i;
+  chacha20_block(out, key, 1, nonce);
+  if (memcmp(out, block_expected, sizeof(out))) {
+    printf("chacha20_block: output does not match test vector\n");
+    return 1;
+  }
+  printf("chacha20_block: ok\n");
+  return 0;
+}
+
+static int test_output(void)
+{
+  static unsigned char buf[65536];
+  unsigned int counts[256], ii, min, max, first, same;
+  size_t pos, len;
+
+  /* Odd-sized requests exercise the pool refill boundary. */
+  memset(buf, 0, sizeof(buf));
+  for (pos = 0, len = 1; pos < sizeof(buf); pos += len, len = len * 3 % 997 + 1) {
+    if (len > sizeof(buf) - pos)
+      len = sizeof(buf) - pos;
+    random_bytes(buf + pos, len);
+  }
+
+  memset(counts, 0, sizeof(counts));
+  for (pos = 0; pos < sizeof(buf); pos++)
+    counts[buf[pos]]++;
+  for (ii = 0, min = ~0u, max = 0; ii < 256; ii++) {
+    if (counts[ii] < min)
+      min = counts[ii];
+    if (counts[ii] > max)
+      max = counts[ii];
+  }
+  /* Each byte value is expected 256 times; allow a wide margin. */
+  if (min < 150 || max > 370) {
+    printf("random_bytes: skewed output (min %u, max %u)\n", min, max);
+    return 1;
+  }
+
+  first = ircrandom();
+  for (ii = same = 0; ii < 64; ii++)
+    if (ircrandom() == first)
+      same++;
+  if (same > 1) {
+    printf("ircrandom: repeated output\n");
+    return 1;
+  }
+  printf("random_bytes: ok\n");
+  return 0;
+}
+
+static double elapsed(const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void benchmark(unsigned long count)
+{
+  static unsigned char buf[4096];
+  struct timespec start;
+  unsigned long ii;
+  unsigned int sum = 0;
+  double secs;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ii = 0; ii < count; ii++)
+    sum += ircrandom();
+  secs = elapsed(&start);
+  printf("ircrandom: %lu calls in %.3f s, %.1f ns/call (%08x)\n",
+         count, secs, secs * 1e9 / count, sum);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ii = 0; ii < count / 64; ii++)
+    random_bytes(buf, sizeof(buf));
+  secs = elapsed(&start);
+  printf("random_bytes: %.1f MB/s\n",
+         (double) sizeof(buf) * (count / 64) / secs / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1 && !strcmp(argv[1], "-b")) {
+    benchmark(argc > 2 ? strtoul(argv[2], 0, 10) : 10000000);
+    return 0;
+  }
+  return test_block() || test_output();
+}
@@ -24,9 +24,13 @@
 
 #include "ircd_tls.h"
 #include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_events.h"
 #include "ircd_log.h"
+#include "ircd_reply.h"
 #include "ircd_string.h"
 #include "client.h"
+#include "numeric.h"
 #include "s_auth.h"
 #include "send.h"
 #include "s_conf.h"
@@ -58,6 +62,262 @@ const char *ircd_tls_version = "gnutls " GNUTLS_VERSION;
 static gnutls_priority_t tls_priority;
 static gnutls_certificate_credentials_t tls_cert;
 
+/*
+ * Session resumption for client listeners.
+ *
+ * Inbound sessions on client ports with the default certificate checks
+ * share one session database and one ticket key, so a client can
+ * resume on any such port, including after a rehash.
+ * gnutls only takes a single ticket key per session (it derives
+ * short-lived keys from it on its own), so a rotation makes older
+ * tickets fall back to a full handshake.  gnutls has no session ID
+ * context to keep other ports' sessions apart, so server ports and
+ * ports with their own CA settings never resume.
+ */
+
+/** Number of hash buckets in the session cache. */
+#define TLS_CACHE_BUCKETS 4096
+
+/** A session held in the shared cache. */
+struct TlsCacheEntry {
+  struct TlsCacheEntry *hnext;        /**< Next entry in hash bucket. */
+  struct TlsCacheEntry *lru_prev;     /**< More recently used entry. */
+  struct TlsCacheEntry *lru_next;     /**< Less recently used entry. */
+  time_t expires;                     /**< When the session times out. */
+  unsigned int key_len;               /**< Length of session key. */
+  unsigned int data_len;              /**< Length of session data. */
+  unsigned char *data;                /**< Session data (after key). */
+  unsigned char key[1];               /**< Session key, then data. */
+};
+
+/** Session cache hash table. */
+static struct TlsCacheEntry *tls_cache[TLS_CACHE_BUCKETS];
+/** Most recently used cached session. */
+static struct TlsCacheEntry *tls_cache_head;
+/** Least recently used cached session. */
+static struct TlsCacheEntry *tls_cache_tail;
+/** Number of cached sessions. */
+static unsigned int tls_cache_count;
+
+/** Current session ticket key. */
+static gnutls_datum_t ticket_key;
+/** Timer that rotates #ticket_key. */
+static struct Timer ticket_timer;
+/** When #ticket_key was last rotated. */
+static time_t ticket_rotated;
+
+/** Resumption counters, reported by /stats tls. */
+static struct {
+  unsigned long full;         /**< Full inbound handshakes. */
+  unsigned long resumed;      /**< Abbreviated inbound handshakes. */
+  unsigned long cache_hits;   /**< Cache lookups that found a session. */
+  unsigned long cache_misses; /**< Cache lookups that did not. */
+  unsigned long cache_evicted; /**< Sessions dropped for space. */
+  unsigned long cache_expired; /**< Sessions dropped for age. */
+  unsigned long rotations;    /**< Ticket key rotations. */
+} tls_stats;
+
+/** Pick the hash bucket for a session key. */
+static unsigned int tls_cache_hash(const unsigned char *key, unsigned int len)
+{
+  unsigned int hash = 0;
+
+  while (len--)
+    hash = (hash << 5) + hash + *key++;
+  return hash % TLS_CACHE_BUCKETS;
+}
+
+/** Find the cache entry for a session key. */
+static struct TlsCacheEntry *tls_cache_find(const gnutls_datum_t *key)
+{
+  struct TlsCacheEntry *entry;
+
+  for (entry = tls_cache[tls_cache_hash(key->data, key->size)]; entry;
+       entry = entry->hnext)
+    if (entry->key_len == key->size
+        && !memcmp(entry->key, key->data, key->size))
+      return entry;
+  return NULL;
+}
+
+/** Unlink \a entry from the LRU list. */
+static void tls_cache_lru_unlink(struct TlsCacheEntry *entry)
+{
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    tls_cache_head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    tls_cache_tail = entry->lru_prev;
+}
+
+/** Put \a entry at the most recently used end of the LRU list. */
+static void tls_cache_lru_push(struct TlsCacheEntry *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = tls_cache_head;
+  if (tls_cache_head)
+    tls_cache_head->lru_prev = entry;
+  else
+    tls_cache_tail = entry;
+  tls_cache_head = entry;
+}
+
+/** Remove \a entry from the cache and free it. */
+static void tls_cache_drop(struct TlsCacheEntry *entry)
+{
+  struct TlsCacheEntry **pp;
+
+  for (pp = &tls_cache[tls_cache_hash(entry->key, entry->key_len)];
+       *pp != entry; pp = &(*pp)->hnext)
+    ;
+  *pp = entry->hnext;
+  tls_cache_lru_unlink(entry);
+  --tls_cache_count;
+  MyFree(entry);
+}
+
+/** gnutls callback to store a session in the shared cache. */
+static int gnutls_cache_store(void *ptr, gnutls_datum_t key,
+                              gnutls_datum_t data)
+{
+  struct TlsCacheEntry *entry;
+  unsigned int limit = feature_int(FEAT_TLS_SESSION_CACHE);
+
+  if (!limit || !key.size)
+    return -1;
+
+  if ((entry = tls_cache_find(&key)) != NULL)
+    tls_cache_drop(entry);
+  while (tls_cache_count >= limit && tls_cache_tail)
+  {
+    ++tls_stats.cache_evicted;
+    tls_cache_drop(tls_cache_tail);
+  }
+
+  entry = MyMalloc(sizeof(*entry) + key.size + data.size);
+  entry->expires = CurrentTime + feature_int(FEAT_TLS_SESSION_TIMEOUT);
+  entry->key_len = key.size;
+  entry->data_len = data.size;
+  entry->data = entry->key + key.size;
+  memcpy(entry->key, key.data, key.size);
+  memcpy(entry->data, data.data, data.size);
+  entry->hnext = tls_cache[tls_cache_hash(key.data, key.size)];
+  tls_cache[tls_cache_hash(key.data, key.size)] = entry;
+  tls_cache_lru_push(entry);
+  ++tls_cache_count;
+  return 0;
+}
+
+/** gnutls callback to look up a session in the shared cache. */
+static gnutls_datum_t gnutls_cache_retrieve(void *ptr, gnutls_datum_t key)
+{
+  struct TlsCacheEntry *entry;
+  gnutls_datum_t res = { NULL, 0 };
+
+  entry = tls_cache_find(&key);
+  if (entry && entry->expires <= CurrentTime)
+  {
+    ++tls_stats.cache_expired;
+    tls_cache_drop(entry);
+    entry = NULL;
+  }
+  if (!entry)
+  {
+    ++tls_stats.cache_misses;
+    return res;
+  }
+
+  /* gnutls frees the copy it is given. */
+  res.data = gnutls_malloc(entry->data_len);
+  if (!res.data)
+    return res;
+  memcpy(res.data, entry->data, entry->data_len);
+  res.size = entry->data_len;
+  ++tls_stats.cache_hits;
+  tls_cache_lru_unlink(entry);
+  tls_cache_lru_push(entry);
+  return res;
+}
+
+/** gnutls callback to forget a session that must not be resumed. */
+static int gnutls_cache_remove(void *ptr, gnutls_datum_t key)
+{
+  struct TlsCacheEntry *entry;
+
+  if (!(entry = tls_cache_find(&key)))
+    return -1;
+  tls_cache_drop(entry);
+  return 0;
+}
+
+/** Replace the session ticket key. */
+static void gnutls_rotate_ticket_key(void)
+{
+  gnutls_datum_t new_key;
+  int res;
+
+  res = gnutls_session_ticket_key_generate(&new_key);
+  if (res < 0)
+  {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to generate session ticket"
+              " key: %s", gnutls_strerror(res));
+    return;
+  }
+  if (ticket_key.data)
+    gnutls_free(ticket_key.data);
+  ticket_key = new_key;
+  ticket_rotated = CurrentTime;
+  ++tls_stats.rotations;
+}
+
+/** Rotate the ticket key when #ticket_timer expires. */
+static void ticket_timer_callback(struct Event *ev)
+{
+  int interval;
+
+  if (ev_type(ev) != ET_EXPIRE)
+    return;
+  gnutls_rotate_ticket_key();
+  interval = feature_int(FEAT_TLS_TICKET_ROTATE);
+  if (interval > 0)
+    timer_add(&ticket_timer, ticket_timer_callback, 0, TT_RELATIVE, interval);
+}
+
+/** Start, retime or stop #ticket_timer to match TLS_TICKET_ROTATE. */
+static void ticket_timer_update(void)
+{
+  int interval = feature_int(FEAT_TLS_TICKET_ROTATE);
+
+  if (interval <= 0)
+  {
+    if (t_active(&ticket_timer))
+      timer_del(&ticket_timer);
+  }
+  else if (!t_active(&ticket_timer))
+    timer_add(timer_init(&ticket_timer), ticket_timer_callback, 0,
+              TT_RELATIVE, interval);
+  else if (t_value(&ticket_timer) != interval)
+    timer_chg(&ticket_timer, TT_RELATIVE, interval);
+}
+
+/** Let inbound session \a tls resume, or be resumed later. */
+static void gnutls_enable_resumption(gnutls_session_t tls)
+{
+  if (feature_int(FEAT_TLS_SESSION_CACHE) > 0)
+  {
+    gnutls_db_set_retrieve_function(tls, gnutls_cache_retrieve);
+    gnutls_db_set_store_function(tls, gnutls_cache_store);
+    gnutls_db_set_remove_function(tls, gnutls_cache_remove);
+    gnutls_db_set_ptr(tls, NULL);
+    gnutls_db_set_cache_expiration(tls, feature_int(FEAT_TLS_SESSION_TIMEOUT));
+  }
+  if (feature_int(FEAT_TLS_TICKET_ROTATE) > 0 && ticket_key.data)
+    gnutls_session_ticket_enable_server(tls, &ticket_key);
+}
+
 static int gnutls_load_ca(gnutls_certificate_credentials_t cred,
                           const char *cacertfile, const char *cacertdir,
                           int systemca)
@@ -173,7 +433,9 @@ int ircd_tls_init(void)
     if (gnutls_global_init() != GNUTLS_E_SUCCESS)
       return 1;
 #endif
+    gnutls_rotate_ticket_key();
   }
+  ticket_timer_update();
 
   str = feature_str(FEAT_TLS_CIPHERS);
   if (str)
@@ -220,7 +482,7 @@ int ircd_tls_init(void)
 
 static void *tls_create(int flag, int fd, const char *name, const char *tls_ciphers,
                         gnutls_certificate_credentials_t cred,
-                        int require_peer, int verify_ca)
+                        int require_peer, int verify_ca, int resume)
 {
   gnutls_session_t tls;
   gnutls_certificate_credentials_t use_cred = cred ? cred : tls_cert;
@@ -273,6 +535,11 @@ static void *tls_create(int flag, int fd, const char *name, const char *tls_ciph
   {
     gnutls_certificate_server_set_request(tls,
       require_peer ? GNUTLS_CERT_REQUIRE : GNUTLS_CERT_IGNORE);
+    /* A resumed session skips certificate checks, so only resume
+     * where there are none.
+     */
+    if (resume && !require_peer && !verify_ca)
+      gnutls_enable_resumption(tls);
   }
   else if (verify_ca && name)
     gnutls_session_set_verify_cert(tls, name, 0);
@@ -284,6 +551,18 @@ static void *tls_create(int flag, int fd, const char *name, const char *tls_ciph
   return tls;
 }
 
+/** Check whether sessions on \a listener may be resumed.
+ * @param[in] listener Listener that accepted the connection.
+ * @return Non-zero for a client port with the default certificate checks.
+ */
+static int listener_resumes(const struct Listener *listener)
+{
+  return listener && !listener_server(listener)
+    && EmptyString(listener->tls_cacertfile)
+    && EmptyString(listener->tls_cacertdir)
+    && listener->tls_systemca == LISTENER_TLS_SYSTEMCA_DEFAULT;
+}
+
 void *ircd_tls_accept(struct Listener *listener, int fd)
 {
   gnutls_certificate_credentials_t cred = NULL;
@@ -295,7 +574,8 @@ void *ircd_tls_accept(struct Listener *listener, int fd)
   return tls_create(GNUTLS_SERVER, fd, NULL,
                     listener ? listener->tls_ciphers : NULL, cred,
                     listener && ircd_tls_listener_peer_cert_required(listener),
-                    listener && ircd_tls_listener_verify_ca(listener));
+                    listener && ircd_tls_listener_verify_ca(listener),
+                    listener_resumes(listener));
 }
 
 void *ircd_tls_connect(struct ConfItem *aconf, int fd)
@@ -308,7 +588,7 @@ void *ircd_tls_connect(struct ConfItem *aconf, int fd)
   return tls_create(GNUTLS_CLIENT, fd, aconf ? aconf->name : NULL,
                     aconf ? aconf->tls_ciphers : NULL, cred,
                     aconf && ircd_tls_connect_peer_cert_required(aconf),
-                    aconf && ircd_tls_connect_verify_ca(aconf));
+                    aconf && ircd_tls_connect_verify_ca(aconf), 0);
 }
 
 void ircd_tls_conf_free(struct ConfItem *aconf)
@@ -376,7 +656,9 @@ int ircd_tls_check_peer_hostname(struct Client *cptr, const char *name)
 
 void ircd_tls_close(void *ctx, const char *message)
 {
-  gnutls_bye(ctx, GNUTLS_SHUT_RDWR);
+  /* gnutls_bye() crashes if the peer left before a version was agreed. */
+  if (gnutls_protocol_get_version(ctx) != GNUTLS_VERSION_UNKNOWN)
+    gnutls_bye(ctx, GNUTLS_SHUT_RDWR);
   gnutls_deinit(ctx);
 }
 
@@ -448,6 +730,13 @@ int ircd_tls_negotiate(struct Client *cptr)
     return 0;
 
   case GNUTLS_E_SUCCESS:
+    if (cli_listener(cptr))
+    {
+      if (gnutls_session_is_resumed(tls))
+        ++tls_stats.resumed;
+      else
+        ++tls_stats.full;
+    }
     datum = gnutls_certificate_get_peers(tls, NULL);
     if (ircd_tls_peer_cert_required(cptr) && (!datum || datum->size == 0))
     {
@@ -656,6 +945,30 @@ IOResult ircd_tls_sendv(struct Client *cptr, struct MsgQ *buf,
   return result;
 }
 
+void ircd_tls_report_stats(struct Client *sptr, const struct StatDesc *sd,
+                           char *param)
+{
+  unsigned long total = tls_stats.full + tls_stats.resumed;
+
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":TLS handshakes: %lu full, %lu resumed (%lu%%)",
+             tls_stats.full, tls_stats.resumed,
+             total ? tls_stats.resumed * 100 / total : 0);
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":TLS session cache: %u of %d entries, %lu hits, %lu misses, "
+             "%lu evicted, %lu expired", tls_cache_count,
+             feature_int(FEAT_TLS_SESSION_CACHE), tls_stats.cache_hits,
+             tls_stats.cache_misses, tls_stats.cache_evicted,
+             tls_stats.cache_expired);
+  if (feature_int(FEAT_TLS_TICKET_ROTATE) > 0 && ticket_key.data)
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":TLS tickets: %lu rotations, last %Tu seconds ago",
+               tls_stats.rotations, CurrentTime - ticket_rotated);
+  else
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":TLS tickets: disabled");
+}
+
 int ircd_tls_sha1_base64(const void *data, size_t len, char *out, size_t outlen)
 {
   unsigned char digest[20];
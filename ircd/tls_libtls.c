@@ -25,9 +25,11 @@
 #include "ircd_features.h"
 #include "ircd.h"
 #include "ircd_log.h"
+#include "ircd_reply.h"
 #include "ircd_string.h"
 #include "ircd_tls.h"
 #include "listener.h"
+#include "numeric.h"
 #include "s_auth.h"
 #include "send.h"
 #include "s_conf.h"
@@ -665,6 +667,14 @@ IOResult ircd_tls_sendv(struct Client *cptr, struct MsgQ *buf,
   return result;
 }
 
+void ircd_tls_report_stats(struct Client *sptr, const struct StatDesc *sd,
+                           char *param)
+{
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":TLS session resumption is not managed with %s",
+             ircd_tls_version);
+}
+
 int ircd_tls_sha1_base64(const void *data, size_t len, char *out, size_t outlen)
 {
   return ircd_sha1_base64(data, len, out, outlen);
@@ -24,6 +24,8 @@
 #include "ircd_tls.h"
 #include "ircd_sha1.h"
 #include "client.h"
+#include "ircd_reply.h"
+#include "numeric.h"
 #include <stddef.h>
 #include <string.h>
 
@@ -102,6 +104,13 @@ IOResult ircd_tls_sendv(struct Client *cptr, struct MsgQ *buf,
   return os_sendv_nonb(cli_fd(cptr), buf, count_in, count_out);
 }
 
+void ircd_tls_report_stats(struct Client *sptr, const struct StatDesc *sd,
+                           char *param)
+{
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":TLS is not supported by this server");
+}
+
 int ircd_tls_sha1_base64(const void *data, size_t len, char *out, size_t outlen)
 {
   return ircd_sha1_base64(data, len, out, outlen);
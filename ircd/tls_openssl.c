@@ -23,12 +23,16 @@
 #include "config.h"
 #include "client.h"
 #include "ircd_alloc.h"
+#include "ircd_events.h"
 #include "ircd_features.h"
 #include "ircd_log.h"
+#include "ircd_reply.h"
+#include "ircd_snprintf.h"
 #include "ircd_string.h"
 #include "ircd_tls.h"
 #include "ircd.h"
 #include "listener.h"
+#include "numeric.h"
 #include "s_conf.h"
 #include "s_debug.h"
 #include "s_auth.h"
@@ -36,12 +40,18 @@
 #include "s_bsd.h"
 
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 #include <sys/uio.h> /* IOV_MAX */
 #include <unistd.h> /* write() on failure of ssl_accept() */
 
@@ -222,6 +232,407 @@ static void openssl_apply_verify_policy(SSL *tls, int require_peer, int verify_c
   SSL_set_verify(tls, mode, verify_ca ? NULL : openssl_fingerprint_verify_callback);
 }
 
+/*
+ * Session resumption for client listeners.
+ *
+ * All client-facing server contexts share one session cache and one
+ * set of ticket keys, so a client can resume on any port with the same
+ * verification policy, and resume after a rehash rebuilds the
+ * contexts.  Tickets (stateless) are preferred; the cache covers
+ * TLSv1.2 clients without ticket support and TLSv1.3 when tickets are
+ * turned off.  Server ports always get a context of their own, with
+ * resumption turned off.
+ */
+
+/** Number of hash buckets in the session cache. */
+#define TLS_CACHE_BUCKETS 4096
+/** Length of a ticket key name. */
+#define TICKET_NAME_LEN 16
+/** Length of a ticket AES-256 key. */
+#define TICKET_AES_LEN 32
+/** Length of a ticket HMAC-SHA256 key. */
+#define TICKET_HMAC_LEN 32
+
+/** A session held in the shared cache. */
+struct TlsCacheEntry {
+  struct TlsCacheEntry *hnext;        /**< Next entry in hash bucket. */
+  struct TlsCacheEntry *lru_prev;     /**< More recently used entry. */
+  struct TlsCacheEntry *lru_next;     /**< Less recently used entry. */
+  SSL_SESSION *session;               /**< Cached session (owned). */
+  time_t expires;                     /**< When the session times out. */
+  unsigned int id_len;                /**< Length of session ID. */
+  unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH]; /**< Session ID. */
+};
+
+/** A session ticket key. */
+struct TicketKey {
+  unsigned char name[TICKET_NAME_LEN]; /**< Name sent in the ticket. */
+  unsigned char aes[TICKET_AES_LEN];   /**< Ticket encryption key. */
+  unsigned char hmac[TICKET_HMAC_LEN]; /**< Ticket MAC key. */
+  int valid;                           /**< Non-zero if key is usable. */
+};
+
+/** Session cache hash table. */
+static struct TlsCacheEntry *tls_cache[TLS_CACHE_BUCKETS];
+/** Most recently used cached session. */
+static struct TlsCacheEntry *tls_cache_head;
+/** Least recently used cached session. */
+static struct TlsCacheEntry *tls_cache_tail;
+/** Number of cached sessions. */
+static unsigned int tls_cache_count;
+
+/** Current ticket key (0) and the one it replaced (1). */
+static struct TicketKey ticket_keys[2];
+/** Timer that rotates the ticket keys. */
+static struct Timer ticket_timer;
+/** When the ticket keys were last rotated. */
+static time_t ticket_rotated;
+
+/** Resumption counters, reported by /stats tls. */
+static struct {
+  unsigned long full;         /**< Full inbound handshakes. */
+  unsigned long resumed;      /**< Abbreviated inbound handshakes. */
+  unsigned long cache_hits;   /**< Cache lookups that found a session. */
+  unsigned long cache_misses; /**< Cache lookups that did not. */
+  unsigned long cache_evicted; /**< Sessions dropped for space. */
+  unsigned long cache_expired; /**< Sessions dropped for age. */
+  unsigned long tickets_issued; /**< Tickets encrypted. */
+  unsigned long tickets_current; /**< Tickets decrypted with current key. */
+  unsigned long tickets_renewed; /**< Tickets decrypted with old key. */
+  unsigned long tickets_unknown; /**< Tickets with an unknown key. */
+  unsigned long rotations;    /**< Ticket key rotations. */
+} tls_stats;
+
+/** Pick the hash bucket for a session ID. */
+static unsigned int tls_cache_hash(const unsigned char *id, unsigned int len)
+{
+  unsigned int hash = 0;
+
+  while (len--)
+    hash = (hash << 5) + hash + *id++;
+  return hash % TLS_CACHE_BUCKETS;
+}
+
+/** Find the cache entry for a session ID. */
+static struct TlsCacheEntry *tls_cache_find(const unsigned char *id,
+                                            unsigned int len)
+{
+  struct TlsCacheEntry *entry;
+
+  for (entry = tls_cache[tls_cache_hash(id, len)]; entry; entry = entry->hnext)
+    if (entry->id_len == len && !memcmp(entry->id, id, len))
+      return entry;
+  return NULL;
+}
+
+/** Unlink \a entry from the LRU list. */
+static void tls_cache_lru_unlink(struct TlsCacheEntry *entry)
+{
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    tls_cache_head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    tls_cache_tail = entry->lru_prev;
+}
+
+/** Put \a entry at the most recently used end of the LRU list. */
+static void tls_cache_lru_push(struct TlsCacheEntry *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = tls_cache_head;
+  if (tls_cache_head)
+    tls_cache_head->lru_prev = entry;
+  else
+    tls_cache_tail = entry;
+  tls_cache_head = entry;
+}
+
+/** Remove \a entry from the cache and release its session. */
+static void tls_cache_drop(struct TlsCacheEntry *entry)
+{
+  struct TlsCacheEntry **pp;
+
+  for (pp = &tls_cache[tls_cache_hash(entry->id, entry->id_len)];
+       *pp != entry; pp = &(*pp)->hnext)
+    ;
+  *pp = entry->hnext;
+  tls_cache_lru_unlink(entry);
+  --tls_cache_count;
+  SSL_SESSION_free(entry->session);
+  MyFree(entry);
+}
+
+/** OpenSSL callback to store a new session in the shared cache. */
+static int openssl_cache_new(SSL *tls, SSL_SESSION *session)
+{
+  struct TlsCacheEntry *entry;
+  const unsigned char *id;
+  unsigned int len;
+  unsigned int limit = feature_int(FEAT_TLS_SESSION_CACHE);
+
+  id = SSL_SESSION_get_id(session, &len);
+  if (!limit || !len || len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+    return 0;
+  /* Stateless TLSv1.3 tickets are never looked up here. */
+  if (SSL_version(tls) >= TLS1_3_VERSION
+      && !(SSL_get_options(tls) & SSL_OP_NO_TICKET))
+    return 0;
+
+  if ((entry = tls_cache_find(id, len)) != NULL)
+    tls_cache_drop(entry);
+  while (tls_cache_count >= limit && tls_cache_tail)
+  {
+    ++tls_stats.cache_evicted;
+    tls_cache_drop(tls_cache_tail);
+  }
+
+  entry = MyMalloc(sizeof(*entry));
+  entry->session = session;
+  entry->expires = SSL_SESSION_get_time(session)
+    + SSL_SESSION_get_timeout(session);
+  entry->id_len = len;
+  memcpy(entry->id, id, len);
+  entry->hnext = tls_cache[tls_cache_hash(id, len)];
+  tls_cache[tls_cache_hash(id, len)] = entry;
+  tls_cache_lru_push(entry);
+  ++tls_cache_count;
+  return 1; /* we keep the reference */
+}
+
+/** OpenSSL callback to look up a session in the shared cache. */
+static SSL_SESSION *openssl_cache_get(SSL *tls, const unsigned char *id,
+                                      int len, int *copy)
+{
+  struct TlsCacheEntry *entry;
+
+  *copy = 0;
+  entry = tls_cache_find(id, len);
+  if (entry && entry->expires <= CurrentTime)
+  {
+    ++tls_stats.cache_expired;
+    tls_cache_drop(entry);
+    entry = NULL;
+  }
+  if (!entry)
+  {
+    ++tls_stats.cache_misses;
+    return NULL;
+  }
+
+  ++tls_stats.cache_hits;
+  tls_cache_lru_unlink(entry);
+  tls_cache_lru_push(entry);
+  *copy = 1; /* OpenSSL takes its own reference */
+  return entry->session;
+}
+
+/** OpenSSL callback to forget a session that must not be resumed. */
+static void openssl_cache_remove(SSL_CTX *ctx, SSL_SESSION *session)
+{
+  struct TlsCacheEntry *entry;
+  const unsigned char *id;
+  unsigned int len;
+
+  id = SSL_SESSION_get_id(session, &len);
+  if ((entry = tls_cache_find(id, len)) != NULL)
+    tls_cache_drop(entry);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX ticket_mac_ctx;
+
+/** Key the ticket MAC with \a key. */
+static int ticket_mac_init(EVP_MAC_CTX *hctx, unsigned char *key)
+{
+  OSSL_PARAM params[3];
+
+  params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key,
+                                                TICKET_HMAC_LEN);
+  params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                               "SHA256", 0);
+  params[2] = OSSL_PARAM_construct_end();
+  return EVP_MAC_CTX_set_params(hctx, params);
+}
+#else
+typedef HMAC_CTX ticket_mac_ctx;
+
+/** Key the ticket MAC with \a key. */
+static int ticket_mac_init(HMAC_CTX *hctx, unsigned char *key)
+{
+  return HMAC_Init_ex(hctx, key, TICKET_HMAC_LEN, EVP_sha256(), NULL);
+}
+#endif
+
+/** OpenSSL callback to encrypt or decrypt a session ticket.
+ * \returns 1 to use the ticket, 2 to use it and issue a fresh one, 0
+ *   if no ticket can be issued or the key is unknown, -1 on error.
+ */
+static int openssl_ticket_key(SSL *tls, unsigned char *name,
+                              unsigned char *iv, EVP_CIPHER_CTX *ectx,
+                              ticket_mac_ctx *hctx, int enc)
+{
+  struct TicketKey *key;
+  int ii;
+
+  if (enc)
+  {
+    key = &ticket_keys[0];
+    if (!key->valid)
+      return 0;
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+      return -1;
+    memcpy(name, key->name, TICKET_NAME_LEN);
+    if (EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key->aes, iv) != 1
+        || ticket_mac_init(hctx, key->hmac) != 1)
+      return -1;
+    ++tls_stats.tickets_issued;
+    return 1;
+  }
+
+  for (ii = 0; ii < 2; ++ii)
+  {
+    key = &ticket_keys[ii];
+    if (key->valid && !memcmp(name, key->name, TICKET_NAME_LEN))
+      break;
+  }
+  if (ii == 2)
+  {
+    ++tls_stats.tickets_unknown;
+    return 0;
+  }
+
+  if (ticket_mac_init(hctx, key->hmac) != 1
+      || EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key->aes, iv) != 1)
+    return -1;
+  if (ii)
+  {
+    ++tls_stats.tickets_renewed;
+    return 2;
+  }
+  ++tls_stats.tickets_current;
+  return 1;
+}
+
+/** Make a fresh current ticket key, keeping the old one for decryption
+ * so that outstanding tickets are renewed rather than rejected.
+ */
+static void openssl_rotate_ticket_keys(void)
+{
+  struct TicketKey *key = &ticket_keys[0];
+
+  ticket_keys[1] = ticket_keys[0];
+  if (RAND_bytes(key->name, sizeof(key->name)) != 1
+      || RAND_bytes(key->aes, sizeof(key->aes)) != 1
+      || RAND_bytes(key->hmac, sizeof(key->hmac)) != 1)
+  {
+    ssl_log_error("unable to generate session ticket key");
+    key->valid = 0;
+    return;
+  }
+  key->valid = 1;
+  ticket_rotated = CurrentTime;
+  ++tls_stats.rotations;
+}
+
+/** Rotate the ticket keys when #ticket_timer expires. */
+static void ticket_timer_callback(struct Event *ev)
+{
+  int interval;
+
+  if (ev_type(ev) != ET_EXPIRE)
+    return;
+  openssl_rotate_ticket_keys();
+  interval = feature_int(FEAT_TLS_TICKET_ROTATE);
+  if (interval > 0)
+    timer_add(&ticket_timer, ticket_timer_callback, 0, TT_RELATIVE, interval);
+}
+
+/** Start, retime or stop #ticket_timer to match TLS_TICKET_ROTATE. */
+static void ticket_timer_update(void)
+{
+  int interval = feature_int(FEAT_TLS_TICKET_ROTATE);
+
+  if (interval <= 0)
+  {
+    if (t_active(&ticket_timer))
+      timer_del(&ticket_timer);
+  }
+  else if (!t_active(&ticket_timer))
+    timer_add(timer_init(&ticket_timer), ticket_timer_callback, 0,
+              TT_RELATIVE, interval);
+  else if (t_value(&ticket_timer) != interval)
+    timer_chg(&ticket_timer, TT_RELATIVE, interval);
+}
+
+/** Enable shared session caching and tickets on a client server context.
+ * The session ID context is derived from the verification policy, so
+ * a session is only resumed where its peer would have been accepted.
+ */
+static int openssl_enable_resumption(SSL_CTX *ctx, const char *cacertfile,
+                                     const char *cacertdir, int require_peer,
+                                     int verify_ca, int systemca)
+{
+  unsigned char sid_ctx[SHA256_DIGEST_LENGTH];
+  char policy[BUFSIZE];
+
+  ircd_snprintf(0, policy, sizeof(policy), "%d %d %d %s %s", require_peer,
+                verify_ca, systemca, cacertfile ? cacertfile : "",
+                cacertdir ? cacertdir : "");
+  SHA256((const unsigned char *)policy, strlen(policy), sid_ctx);
+  if (SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx)) != 1)
+  {
+    ssl_log_error("unable to set session ID context");
+    return 0;
+  }
+
+  SSL_CTX_set_timeout(ctx, feature_int(FEAT_TLS_SESSION_TIMEOUT));
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+  /* Clients that drop without close_notify (most of them) would
+   * otherwise have their sessions thrown out of the cache.
+   */
+  SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+  if (feature_int(FEAT_TLS_SESSION_CACHE) > 0)
+  {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER
+                                   | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ctx, openssl_cache_new);
+    SSL_CTX_sess_set_get_cb(ctx, openssl_cache_get);
+    SSL_CTX_sess_set_remove_cb(ctx, openssl_cache_remove);
+  }
+  else
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+  if (feature_int(FEAT_TLS_TICKET_ROTATE) > 0)
+  {
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, openssl_ticket_key);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, openssl_ticket_key);
+#endif
+  }
+  else
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+  return 1;
+}
+
+/** Turn off OpenSSL's default session cache and tickets on a server
+ * link context, so every link does a full handshake.
+ */
+static void openssl_disable_resumption(SSL_CTX *ctx)
+{
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+  SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#ifdef TLS1_3_VERSION
+  SSL_CTX_set_num_tickets(ctx, 0);
+#endif
+}
+
 static int openssl_configure_server_ctx(SSL_CTX *ctx, const char *ciphers,
                                         const char *cacertfile,
                                         const char *cacertdir,
@@ -404,6 +815,7 @@ int ircd_tls_init(void)
     }
 
     fp_digest = EVP_sha256();
+    openssl_rotate_ticket_keys();
   }
 
   /* Create server context */
@@ -467,6 +879,11 @@ int ircd_tls_init(void)
   ssl_set_ciphers(new_server_ctx, NULL, str);
   ssl_set_ciphers(new_client_ctx, NULL, str);
 
+  if (!openssl_enable_resumption(new_server_ctx, NULL, NULL, 0, 0,
+                                 LISTENER_TLS_SYSTEMCA_DEFAULT))
+    goto fail;
+  ticket_timer_update();
+
 done:
   if (server_ctx)
     SSL_CTX_free(server_ctx);
@@ -518,6 +935,8 @@ void *ircd_tls_accept(struct Listener *listener, int fd)
 
   if (listener && listener->tls_ctx)
     ctx = (SSL_CTX *)listener->tls_ctx;
+  else if (listener && listener_server(listener))
+    ctx = NULL; /* server_ctx resumes sessions */
 
   if (!ctx)
   {
@@ -657,6 +1076,7 @@ int ircd_tls_listen(struct Listener *listener)
   if (!listener)
     return 1;
 
+  /* Plain client ports share server_ctx; server ports never do. */
   if (!listener_needs_custom_ctx(listener))
     return 0;
 
@@ -669,6 +1089,21 @@ int ircd_tls_listen(struct Listener *listener)
   if (!new_ctx)
     return 1;
 
+  /* Server links always do a full handshake, so their certificates
+   * are checked every time.
+   */
+  if (listener_server(listener))
+    openssl_disable_resumption(new_ctx);
+  else if (!openssl_enable_resumption(new_ctx, listener->tls_cacertfile,
+                                      listener->tls_cacertdir,
+                                      ircd_tls_listener_peer_cert_required(listener),
+                                      ircd_tls_listener_verify_ca(listener),
+                                      listener->tls_systemca))
+  {
+    SSL_CTX_free(new_ctx);
+    return 1;
+  }
+
   ircd_tls_listen_free(listener);
   listener->tls_ctx = new_ctx;
   return 0;
@@ -715,6 +1150,8 @@ static IOResult ssl_handle_error(struct Client *cptr, SSL *tls, int res, int ori
   case SSL_ERROR_SYSCALL:
     if (orig_errno == EINTR || orig_errno == EAGAIN || orig_errno == EWOULDBLOCK)
       return IO_BLOCKED;
+    /* The peer just went away; keep its session resumable. */
+    SSL_set_shutdown(tls, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
     break;
   case SSL_ERROR_ZERO_RETURN:
     Debug((DEBUG_DEBUG, "SSL_ERROR_ZERO_RETURN: peer closed connection for %C", cptr));
@@ -796,6 +1233,13 @@ int ircd_tls_negotiate(struct Client *cptr)
     }
 
     Debug((DEBUG_DEBUG, "SSL handshake success for fd=%d", cli_fd(cptr)));
+    if (SSL_is_server(tls))
+    {
+      if (SSL_session_reused(tls))
+        ++tls_stats.resumed;
+      else
+        ++tls_stats.full;
+    }
     if (cert)
     {
       Debug((DEBUG_DEBUG, "SSL_get_peer_certificate success for fd=%d", cli_fd(cptr)));
@@ -934,6 +1378,33 @@ IOResult ircd_tls_sendv(struct Client *cptr, struct MsgQ *buf,
   return result;
 }
 
+void ircd_tls_report_stats(struct Client *sptr, const struct StatDesc *sd,
+                           char *param)
+{
+  unsigned long total = tls_stats.full + tls_stats.resumed;
+
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":TLS handshakes: %lu full, %lu resumed (%lu%%)",
+             tls_stats.full, tls_stats.resumed,
+             total ? tls_stats.resumed * 100 / total : 0);
+  send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":TLS session cache: %u of %d entries, %lu hits, %lu misses, "
+             "%lu evicted, %lu expired", tls_cache_count,
+             feature_int(FEAT_TLS_SESSION_CACHE), tls_stats.cache_hits,
+             tls_stats.cache_misses, tls_stats.cache_evicted,
+             tls_stats.cache_expired);
+  if (feature_int(FEAT_TLS_TICKET_ROTATE) > 0 && ticket_keys[0].valid)
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":TLS tickets: %lu issued, %lu accepted, %lu renewed, "
+               "%lu unknown key; %lu rotations, last %Tu seconds ago",
+               tls_stats.tickets_issued, tls_stats.tickets_current,
+               tls_stats.tickets_renewed, tls_stats.tickets_unknown,
+               tls_stats.rotations, CurrentTime - ticket_rotated);
+  else
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":TLS tickets: disabled");
+}
+
 int ircd_tls_sha1_base64(const void *data, size_t len, char *out, size_t outlen)
 {
   unsigned char digest[SHA_DIGEST_LENGTH];
@@ -34,6 +34,7 @@ class Scenario(str, Enum):
     TC_AAAA_EMPTY = "tc_aaaa_empty"
     SLOW_A = "slow_a"
     TC_TCP_BADID = "tc_tcp_badid"
+    PTR_NODATA = "ptr_nodata"
 
 
 class State:
@@ -88,6 +89,7 @@ def scenario_ptr_name() -> str:
         Scenario.TC_AAAA_EMPTY: "client.ok.test",
         Scenario.SLOW_A: "client.slow.test",
         Scenario.TC_TCP_BADID: "client.badid.test",
+        Scenario.PTR_NODATA: "client.ok.test",
     }[STATE.scenario]
 
 
@@ -182,6 +184,9 @@ def answer_for_query(query: bytes, qname: str, qtype: int, transport: str) -> by
         observed = ptr_to_ipv4(qname_norm)
         if observed is not None:
             STATE.client_ipv4 = observed
+            if STATE.scenario == Scenario.PTR_NODATA:
+                # The name exists but has no PTR record.
+                return build_response(query, [], tc=False)
             return build_response(
                 query,
                 [build_rr(qname_norm, T_PTR, encode_name(host))],
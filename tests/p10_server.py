@@ -9,6 +9,7 @@ import asyncio
 import logging
 import ssl
 import time
+import zlib
 
 logger = logging.getLogger("p10_server")
 
@@ -93,13 +94,21 @@ class P10Server:
         max_clients: int = 64,
         description: str = "Test Services",
         server_flags: str = "s",
+        compress: bool = False,
     ):
         self.name = name
         self.numeric = numeric
         self.password = password
         self.max_clients = max_clients
         self.description = description
-        self.server_flags = server_flags
+        # Offering compression is the 'c' server flag; the link is only
+        # compressed if the ircd's SERVER line offers it too.
+        self.server_flags = server_flags + ("c" if compress else "")
+        self.compress = compress
+        self.compressed = False
+        self._inflate = None
+        self._deflate = None
+        self._zbuf = b""
 
         self._reader: asyncio.StreamReader | None = None
         self._writer: asyncio.StreamWriter | None = None
@@ -180,19 +189,50 @@ class P10Server:
         if not self._writer:
             raise ConnectionError("Not connected")
         logger.debug(">> %s", line)
-        self._writer.write((line + "\r\n").encode("utf-8"))
+        data = (line + "\r\n").encode("utf-8")
+        if self._deflate:
+            data = self._deflate.compress(data) + self._deflate.flush(zlib.Z_SYNC_FLUSH)
+        self._writer.write(data)
         await self._writer.drain()
 
+    async def _read_inflated_line(self) -> bytes:
+        """Read one line from the decompressed stream."""
+        while b"\n" not in self._zbuf:
+            chunk = await self._reader.read(4096)
+            if not chunk:
+                return b""
+            self._zbuf += self._inflate.decompress(chunk)
+        raw, self._zbuf = self._zbuf.split(b"\n", 1)
+        return raw + b"\n"
+
+    def _maybe_start_compression(self, line: str):
+        """Switch to a compressed link after the ircd's SERVER line.
+
+        Both ends compress everything after their SERVER lines when both
+        offered the 'c' flag.
+        """
+        parts = line.split()
+        if (self.compress and len(parts) > 7 and parts[0] == "SERVER"
+                and parts[7].startswith("+") and "c" in parts[7]):
+            self._inflate = zlib.decompressobj()
+            self._deflate = zlib.compressobj()
+            self.compressed = True
+
     async def _recv_raw(self, timeout: float = 10.0) -> str:
         """Read one raw line from the ircd."""
         if not self._reader:
             raise ConnectionError("Not connected")
-        raw = await asyncio.wait_for(self._reader.readline(), timeout=timeout)
+        if self._inflate:
+            raw = await asyncio.wait_for(self._read_inflated_line(), timeout=timeout)
+        else:
+            raw = await asyncio.wait_for(self._reader.readline(), timeout=timeout)
         if not raw:
             raise ConnectionError("Connection closed by server")
         line = raw.decode("utf-8", errors="replace").strip()
         logger.debug("<< %s", line)
         self.received.append(line)
+        if not self._inflate:
+            self._maybe_start_compression(line)
         return line
 
     async def _recv(self, timeout: float = 10.0) -> str:
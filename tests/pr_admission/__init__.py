@@ -0,0 +1 @@
+# Registration admission queue tests
@@ -0,0 +1,282 @@
+"""Tests for the registration admission queue.
+
+With ADMIT_MAX_PENDING set to 1, only one connection at a time may be
+doing its DNS, ident and iauth checks.  An iauth stub that answers
+only once a client has sent NICK and USER keeps the first connection's
+checks running.  A second connection is not read from, and gets no
+reply, until those checks finish; if it waits longer than
+ADMIT_QUEUE_TIMEOUT it is told to try again later, unless that is 0.
+A connection whose checks are done gives its slot back even if it
+never registers.  /stats admission reports what happened.
+
+These tests run the locally built ircd.  They need ircd/ircd compiled
+for this host (run `make` first); they skip if it is missing.
+"""
+
+import asyncio
+import socket
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+import pytest
+
+
+REPO_ROOT = Path(__file__).resolve().parents[2]
+IRCD_BIN = REPO_ROOT / "ircd" / "ircd"
+IAUTH_STUB = REPO_ROOT / "tests" / "pr_iauthverify" / "iauth_stub.py"
+
+pytestmark = pytest.mark.skipif(
+    not IRCD_BIN.exists(), reason="local ircd binary not built"
+)
+
+
+def _free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def _spath():
+    """Read the compiled-in SPATH from config.h (ircd checks it on boot)."""
+    for line in (REPO_ROOT / "config.h").read_text().splitlines():
+        if line.startswith("#define SPATH "):
+            return Path(line.split('"')[1])
+    return None
+
+
+@pytest.fixture
+def ensure_spath():
+    """ircd refuses to start unless SPATH exists; symlink it if missing."""
+    spath = _spath()
+    created = False
+    if spath and not spath.exists() and spath.parent.is_dir():
+        spath.symlink_to(IRCD_BIN)
+        created = True
+    yield
+    if created:
+        spath.unlink(missing_ok=True)
+
+
+CONF_TEMPLATE = """\
+General {{
+        name = "admission.example.net";
+        vhost = "127.0.0.1";
+        description = "admission test server";
+        numeric = 97;
+}};
+Admin {{
+        Location = "test";
+        Location = "test";
+        Contact = "test@example.net";
+}};
+Class {{
+        name = "Local";
+        pingfreq = 90 seconds;
+        sendq = 160000;
+        maxlinks = 100;
+}};
+Client {{ ip = "127.*"; class = "Local"; }};
+Operator {{ local = no; class = "Local"; host = "*@127.*"; password = "$PLAIN$oper"; name = "oper"; }};
+Port {{ port = {port}; }};
+{iauth}features {{
+        "ADMIT_MAX_PENDING" = "1";
+        "ADMIT_QUEUE_TIMEOUT" = "{timeout}";
+        "IPCHECK_CLONE_LIMIT" = "100";
+}};
+"""
+
+IAUTH_TEMPLATE = 'IAuth {{ program = "{python}" "{stub}" "{log}"; }};\n'
+
+
+def _run_ircd(tmp_path, timeout=3, iauth=True):
+    """Spawn a local ircd that lets one connection in at a time."""
+    port = _free_port()
+    conf = tmp_path / "ircd.conf"
+    conf.write_text(
+        CONF_TEMPLATE.format(
+            port=port,
+            timeout=timeout,
+            iauth=IAUTH_TEMPLATE.format(
+                python=sys.executable,
+                stub=IAUTH_STUB,
+                log=tmp_path / "iauth.log",
+            ) if iauth else "",
+        )
+    )
+    proc = subprocess.Popen(
+        [str(IRCD_BIN), "-n", "-f", str(conf), "-d", str(tmp_path)],
+        cwd=tmp_path,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+    )
+    try:
+        deadline = time.time() + 10
+        while time.time() < deadline:
+            if proc.poll() is not None:
+                raise RuntimeError("ircd exited during startup")
+            try:
+                with socket.create_connection(("127.0.0.1", port), 0.2):
+                    break
+            except OSError:
+                time.sleep(0.1)
+        else:
+            raise RuntimeError("ircd did not start listening")
+        # Let the server notice that the probe above went away.
+        time.sleep(0.5)
+        yield {"port": port}
+    finally:
+        proc.terminate()
+        try:
+            proc.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+
+
+@pytest.fixture
+def local_ircd(tmp_path, ensure_spath):
+    """An ircd whose iauth holds each client until NICK and USER."""
+    yield from _run_ircd(tmp_path)
+
+
+@pytest.fixture
+def patient_ircd(tmp_path, ensure_spath):
+    """Like local_ircd, but connections may wait forever."""
+    yield from _run_ircd(tmp_path, timeout=0)
+
+
+@pytest.fixture
+def plain_ircd(tmp_path, ensure_spath):
+    """An ircd without iauth, so checks end without client input."""
+    yield from _run_ircd(tmp_path, iauth=False)
+
+
+class Conn:
+    """Line-based client connection that records everything received."""
+
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+        self.lines = []
+
+    @classmethod
+    async def open(cls, port):
+        reader, writer = await asyncio.open_connection("127.0.0.1", port)
+        return cls(reader, writer)
+
+    async def send(self, line):
+        self.writer.write((line + "\r\n").encode())
+        await self.writer.drain()
+
+    async def expect(self, pred, timeout=10):
+        """Read lines until one satisfies `pred`; return it."""
+        deadline = asyncio.get_event_loop().time() + timeout
+        while True:
+            remaining = deadline - asyncio.get_event_loop().time()
+            raw = await asyncio.wait_for(self.reader.readline(), remaining)
+            if not raw:
+                raise ConnectionError("server closed connection")
+            line = raw.decode(errors="replace").strip()
+            self.lines.append(line)
+            if line.startswith("PING"):
+                await self.send("PONG " + line.split(" ", 1)[1])
+            if pred(line):
+                return line
+
+    async def silent_for(self, seconds):
+        """Return True if nothing arrives within `seconds`."""
+        try:
+            raw = await asyncio.wait_for(self.reader.readline(), seconds)
+        except asyncio.TimeoutError:
+            return True
+        self.lines.append(raw.decode(errors="replace").strip())
+        return False
+
+    async def register(self, nick):
+        await self.send(f"NICK {nick}")
+        await self.send("USER testuser 0 * :Test User")
+        return await self.expect(lambda line: line.split()[1:2] == ["001"])
+
+    def close(self):
+        self.writer.close()
+
+
+def _numeric(num):
+    return lambda line: line.split()[1:2] == [num]
+
+
+async def test_waiting_connection_admitted_after_registration(local_ircd):
+    """A second connection is held back until the first registers."""
+    first = await Conn.open(local_ircd["port"])
+    await asyncio.sleep(0.3)
+    second = await Conn.open(local_ircd["port"])
+    await second.send("NICK second")
+    await second.send("USER testuser 0 * :Test User")
+    assert await second.silent_for(1.0)
+
+    await first.register("first")
+    await second.expect(_numeric("001"))
+
+    await first.send("OPER oper oper")
+    await first.expect(_numeric("381"))
+    await first.send("STATS admission")
+    await first.expect(_numeric("219"))
+    summary = [line for line in first.lines if " :Admission: " in line]
+    assert len(summary) == 1
+    assert "1 after waiting" in summary[0]
+    assert "0 expired" in summary[0]
+    first.close()
+    second.close()
+
+
+async def test_waiting_too_long_is_rejected(local_ircd):
+    """A connection that cannot be admitted in time is disconnected."""
+    first = await Conn.open(local_ircd["port"])
+    await asyncio.sleep(0.3)
+    second = await Conn.open(local_ircd["port"])
+    line = await second.expect(lambda line: line.startswith("ERROR"), 8)
+    assert "Server busy" in line
+    second.close()
+
+    await first.register("first")
+    await first.send("OPER oper oper")
+    await first.expect(_numeric("381"))
+    await first.send("STATS admission")
+    await first.expect(_numeric("219"))
+    summary = [line for line in first.lines if " :Admission: " in line]
+    assert "1 expired" in summary[0]
+    first.close()
+
+
+async def test_zero_timeout_waits_forever(patient_ircd):
+    """With ADMIT_QUEUE_TIMEOUT 0, waiting connections are not rejected."""
+    first = await Conn.open(patient_ircd["port"])
+    await asyncio.sleep(0.3)
+    second = await Conn.open(patient_ircd["port"])
+    await second.send("NICK second")
+    await second.send("USER testuser 0 * :Test User")
+    assert await second.silent_for(3.0)
+
+    await first.register("first")
+    await second.expect(_numeric("001"))
+    first.close()
+    second.close()
+
+
+async def test_idle_connection_gives_slot_back(plain_ircd):
+    """A connection that never registers does not hold its slot."""
+    idle = await Conn.open(plain_ircd["port"])
+    await asyncio.sleep(0.3)
+    second = await Conn.open(plain_ircd["port"])
+    await second.register("second")
+
+    await second.send("OPER oper oper")
+    await second.expect(_numeric("381"))
+    await second.send("STATS admission")
+    await second.expect(_numeric("219"))
+    summary = [line for line in second.lines if " :Admission: " in line]
+    assert " 0 checking " in summary[0]
+    assert "0 expired" in summary[0]
+    idle.close()
+    second.close()
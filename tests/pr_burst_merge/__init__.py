@@ -0,0 +1 @@
+# BURST merge tests
@@ -0,0 +1,175 @@
+"""Channel BURSTs merged into channels we already have.
+
+A fake P10 server links to the hub and bursts channels that a local
+client already holds.  Bans the BURST repeats (in any case) must not be
+announced or added again, new ones must be added once, and an older
+BURST must still wipe out the bans it does not carry.  A long member
+list exercises the pre-sized member hash.
+"""
+
+from __future__ import annotations
+
+import asyncio
+
+import pytest
+
+from irc_client import IRCClient
+from p10_server import P10Server
+
+pytestmark = pytest.mark.single_server
+
+
+@pytest.fixture
+async def services(ircd_hub):
+    """Link a fake P10 server to the hub."""
+    # the numnick mask must be one less than a power of two
+    srv = P10Server(name="services.test.net", numeric=4, password="testpass",
+                    max_clients=127)
+    await srv.connect(ircd_hub["host"], ircd_hub["server_port"])
+    await srv.handshake()
+    yield srv
+    await srv.disconnect()
+
+
+async def connect(ircd_hub, nick: str) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(nick, "burst", "Burst Test")
+    return client
+
+
+async def make_channel(client: IRCClient, channel: str, bans: list[str]) -> int:
+    """Create channel with the given bans and return its timestamp."""
+    await client.send(f"JOIN {channel}")
+    await client.wait_for("366")
+    for ban in bans:
+        await client.send(f"MODE {channel} +b {ban}")
+        await client.wait_for("MODE")
+    await client.send(f"MODE {channel}")
+    while True:
+        msg = await client.wait_for("329")
+        if msg.params[1] == channel:
+            return int(msg.params[2])
+
+
+async def ban_list(client: IRCClient, channel: str) -> list[str]:
+    await client.send(f"MODE {channel} +b")
+    replies = await client.collect_until("368", timeout=5.0)
+    return [msg.params[2] for msg in replies
+            if msg.command == "367" and msg.params[1] == channel]
+
+
+async def names(client: IRCClient, channel: str) -> set[str]:
+    """Return the nicks NAMES reports for channel, without prefixes."""
+    await client.send(f"NAMES {channel}")
+    replies = await client.collect_until("366", timeout=5.0)
+    found: set[str] = set()
+    for msg in replies:
+        if msg.command == "353":
+            found.update(nick.lstrip("@+") for nick in msg.params[-1].split())
+    return found
+
+
+async def mode_changes(client: IRCClient, channel: str,
+                       timeout: float = 2.0) -> list[tuple[str, str]]:
+    """Collect (change, argument) pairs from MODE messages for channel."""
+    changes: list[tuple[str, str]] = []
+    loop = asyncio.get_running_loop()
+    deadline = loop.time() + timeout
+    while (remaining := deadline - loop.time()) > 0:
+        try:
+            msg = await client.wait_for("MODE", timeout=remaining)
+        except asyncio.TimeoutError:
+            break
+        if msg.params[0] != channel:
+            continue
+        args = list(msg.params[2:])
+        sign = "+"
+        for ch in msg.params[1]:
+            if ch in "+-":
+                sign = ch
+            elif ch in "bovk" or (ch == "l" and sign == "+"):
+                changes.append((sign + ch, args.pop(0) if args else ""))
+            else:
+                changes.append((sign + ch, ""))
+    return changes
+
+
+async def test_repeated_bans_not_readded(ircd_hub, services):
+    """Bans we already have are dropped from an equal-TS BURST."""
+    chan = "#burstmerge"
+    op = await connect(ircd_hub, "burstop1")
+    try:
+        ts = await make_channel(op, chan, ["*!*@spam.example.org",
+                                           "*!*@*.badisp.example.net"])
+        users = [await services.introduce_user(f"bm{ii}") for ii in range(3)]
+        await services._send(
+            f"{services.server_numnick} B {chan} {ts} "
+            f"{users[1]},{users[2]},{users[0]}:o "
+            ":%*!*@SPAM.example.org *!*@*.badisp.example.net "
+            "*!*@new.example.org *!*@spam.example.org")
+
+        changes = await mode_changes(op, chan)
+        bans = [change for change in changes if change[0][1] == "b"]
+        assert bans == [("+b", "*!*@new.example.org")], changes
+        assert sorted(await ban_list(op, chan)) == [
+            "*!*@*.badisp.example.net", "*!*@new.example.org",
+            "*!*@spam.example.org"]
+    finally:
+        await op.disconnect()
+
+
+async def test_older_burst_wipes_missing_bans(ircd_hub, services):
+    """An older BURST keeps the bans it repeats and removes the rest."""
+    chan = "#burstwipe"
+    op = await connect(ircd_hub, "burstop2")
+    try:
+        ts = await make_channel(op, chan, ["*!*@spam.example.org",
+                                           "*!*@*.badisp.example.net"])
+        user = await services.introduce_user("bw0")
+        await services._send(
+            f"{services.server_numnick} B {chan} {ts - 100} +nt {user}:o "
+            ":%*!*@Spam.Example.Org *!*@other.example.org")
+
+        changes = await mode_changes(op, chan)
+        bans = sorted(change for change in changes if change[0][1] == "b")
+        assert bans == [("+b", "*!*@other.example.org"),
+                        ("-b", "*!*@*.badisp.example.net")], changes
+        assert sorted(await ban_list(op, chan)) == [
+            "*!*@other.example.org", "*!*@spam.example.org"]
+    finally:
+        await op.disconnect()
+
+
+async def test_long_member_list(ircd_hub, services):
+    """A BURST with more members than MEMBER_HASH_MIN joins them all."""
+    chan = "#burstbig"
+    op = await connect(ircd_hub, "burstop3")
+    try:
+        ts = await make_channel(op, chan, [])
+        users = [await services.introduce_user(f"bb{ii}") for ii in range(50)]
+        # the last user appears twice and must only join once
+        await services._send(
+            f"{services.server_numnick} B {chan} {ts} "
+            f"{','.join(users + users[-1:])}")
+
+        joins = 0
+        loop = asyncio.get_running_loop()
+        deadline = loop.time() + 3.0
+        while (remaining := deadline - loop.time()) > 0:
+            try:
+                msg = await op.wait_for("JOIN", timeout=remaining)
+            except asyncio.TimeoutError:
+                break
+            if msg.prefix.startswith("bb"):
+                joins += 1
+        assert joins == 50
+        assert await names(op, chan) == {"burstop3"} | {
+            f"bb{ii}" for ii in range(50)}
+
+        # the link going away takes every member along with it
+        await services.disconnect()
+        await asyncio.sleep(1.0)
+        assert await names(op, chan) == {"burstop3"}
+    finally:
+        await op.disconnect()
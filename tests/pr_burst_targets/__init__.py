@@ -0,0 +1 @@
+# Incremental burst: users named as message targets are introduced first
@@ -0,0 +1,221 @@
+"""Users named by a message relayed to a server still receiving our burst.
+
+The burst is sent a slice at a time as the new link's sendQ drains.  A
+fake server with a tiny receive window links and then stops reading,
+so the burst stalls part way through the users.  A KILL of a remote
+user the burst has not reached yet names that user only as its target,
+and must not overtake the user's N line, or the peer would see a
+numnick it has never heard of.
+
+These tests run the locally built ircd.  They need ircd/ircd compiled
+for this host (run `make` first); they skip if it is missing.
+"""
+
+import asyncio
+import socket
+import subprocess
+import time
+from pathlib import Path
+
+import pytest
+
+from irc_client import IRCClient
+from p10_server import P10Server
+
+
+REPO_ROOT = Path(__file__).resolve().parents[2]
+IRCD_BIN = REPO_ROOT / "ircd" / "ircd"
+
+pytestmark = pytest.mark.skipif(
+    not IRCD_BIN.exists(), reason="local ircd binary not built"
+)
+
+FILLERS = 250
+
+
+def _free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def _spath():
+    """Read the compiled-in SPATH from config.h (ircd checks it on boot)."""
+    for line in (REPO_ROOT / "config.h").read_text().splitlines():
+        if line.startswith("#define SPATH "):
+            return Path(line.split('"')[1])
+    return None
+
+
+@pytest.fixture
+def ensure_spath():
+    """ircd refuses to start unless SPATH exists; symlink it if missing."""
+    spath = _spath()
+    created = False
+    if spath and not spath.exists() and spath.parent.is_dir():
+        spath.symlink_to(IRCD_BIN)
+        created = True
+    yield
+    if created:
+        spath.unlink(missing_ok=True)
+
+
+CONF_TEMPLATE = """\
+General {{
+        name = "burst.example.net";
+        vhost = "127.0.0.1";
+        description = "burst test server";
+        numeric = 96;
+}};
+Admin {{
+        Location = "test";
+        Location = "test";
+        Contact = "test@example.net";
+}};
+Class {{
+        name = "Server";
+        pingfreq = 90 seconds;
+        sendq = 9 megabytes;
+        maxlinks = 10;
+}};
+Class {{
+        name = "Local";
+        pingfreq = 90 seconds;
+        sendq = 160000;
+        maxlinks = 300;
+}};
+Client {{ ip = "127.*"; class = "Local"; }};
+Operator {{ local = no; class = "Local"; host = "*@127.*"; password = "$PLAIN$oper"; name = "oper"; }};
+Connect {{ name = "services.test.net"; host = "127.0.0.1"; password = "testpass"; class = "Server"; autoconnect = no; }};
+Connect {{ name = "stall.example.net"; host = "127.0.0.1"; password = "testpass"; class = "Server"; autoconnect = no; }};
+Port {{ server = yes; port = {server_port}; }};
+Port {{ port = {port}; }};
+features {{
+        "BURST_SENDQ" = "1";
+        "SOCKSENDBUF" = "4096";
+        "IPCHECK_CLONE_LIMIT" = "300";
+        "NODNS" = "TRUE";
+        "HUB" = "TRUE";
+}};
+"""
+
+
+@pytest.fixture
+def local_ircd(tmp_path, ensure_spath):
+    """An ircd that bursts one user at a time."""
+    port = _free_port()
+    server_port = _free_port()
+    conf = tmp_path / "ircd.conf"
+    conf.write_text(CONF_TEMPLATE.format(port=port, server_port=server_port))
+    proc = subprocess.Popen(
+        [str(IRCD_BIN), "-n", "-f", str(conf), "-d", str(tmp_path)],
+        cwd=tmp_path,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+    )
+    try:
+        deadline = time.time() + 10
+        while time.time() < deadline:
+            if proc.poll() is not None:
+                raise RuntimeError("ircd exited during startup")
+            try:
+                with socket.create_connection(("127.0.0.1", port), 0.2):
+                    break
+            except OSError:
+                time.sleep(0.1)
+        else:
+            raise RuntimeError("ircd did not start listening")
+        time.sleep(0.5)
+        yield {"port": port, "server_port": server_port}
+    finally:
+        proc.terminate()
+        try:
+            proc.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+
+
+async def connect(info, nick: str) -> IRCClient:
+    client = IRCClient()
+    await client.connect("127.0.0.1", info["port"])
+    await client.register(nick, "burst", "Burst Target Test " + "x" * 30)
+    return client
+
+
+def stalled_link(info) -> socket.socket:
+    """Link a fake server that reads almost nothing until told to."""
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1024)
+    sock.connect(("127.0.0.1", info["server_port"]))
+    now = int(time.time())
+    sock.sendall(
+        b"PASS :testpass\r\n"
+        + f"SERVER stall.example.net 1 {now} {now} J10 AFAAD +s "
+          f":Stalled server\r\n".encode())
+    return sock
+
+
+def read_until_eb(sock: socket.socket) -> list[str]:
+    """Read everything the ircd sent up to its END_OF_BURST, untagged."""
+    sock.settimeout(10)
+    data = b""
+    lines: list[str] = []
+    while True:
+        chunk = sock.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+        *complete, data = data.split(b"\r\n")
+        for line in complete:
+            line = line.decode(errors="replace")
+            if line.startswith("@"):
+                line = line.split(" ", 1)[1]
+            lines.append(line)
+        if any(line.split()[1:2] == ["EB"] for line in lines):
+            break
+    return lines
+
+
+async def test_kill_target_introduced_first(local_ircd):
+    """A KILL of a not-yet-burst user follows that user's N line."""
+    oper = await connect(local_ircd, "burstoper")
+    fillers = []
+    try:
+        await oper.send("OPER oper oper")
+        await oper.wait_for("381")
+        away = "gone " * 30
+        for ii in range(FILLERS):
+            client = await connect(local_ircd, f"filler{ii}")
+            await client.send(f"AWAY :{away}")
+            await client.wait_for("306")
+            fillers.append(client)
+        services = P10Server(max_clients=7)
+        await services.connect("127.0.0.1", local_ircd["server_port"])
+        await services.handshake()
+        victim = await services.introduce_user("burstvictim")
+
+        sock = stalled_link(local_ircd)
+        try:
+            await asyncio.sleep(1)
+            await oper.send("KILL burstvictim :test")
+            await asyncio.sleep(0.5)
+            lines = await asyncio.to_thread(read_until_eb, sock)
+        finally:
+            sock.close()
+            await services.disconnect()
+    finally:
+        for client in fillers:
+            await client.disconnect()
+        await oper.disconnect()
+
+    known: set[str] = set()
+    kills = 0
+    for line in lines:
+        words = line.split()
+        if words[1:2] == ["N"] and len(words) > 3:
+            known.add(line.split(" :", 1)[0].split()[-1])
+        elif words[1:2] == ["D"]:
+            kills += 1
+            assert words[2] in known, f"KILL before N for {words[2]}"
+    assert kills == 1
+    assert victim in known
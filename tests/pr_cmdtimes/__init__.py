@@ -0,0 +1 @@
+# Command latency statistics tests
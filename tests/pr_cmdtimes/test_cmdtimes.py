@@ -0,0 +1,101 @@
+"""Per-command handler latency (/STATS M).
+
+parse_client() and parse_server() time every handler call and keep a
+log2 microsecond histogram for each command and handler type.  /STATS M
+reports them, with a "*" line per handler type, and /STATS M <server> reset
+clears them.
+"""
+
+from __future__ import annotations
+
+import random
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+BUCKETS = 16
+
+
+async def make_oper(ircd_hub) -> IRCClient:
+    oper = IRCClient()
+    await oper.connect(ircd_hub["host"], ircd_hub["port"])
+    await oper.register(f"cmdt{random.randint(0, 999_999)}", "cmdt", "Cmd Times")
+    await oper.send("OPER testoper operpass")
+    await oper.wait_for("381", timeout=10.0)
+    return oper
+
+
+async def cmdtimes(client: IRCClient, param: str = "") -> dict[tuple[str, str], list[int]]:
+    """Return {(command, handler): [calls, total, max, *buckets]}."""
+    await client.send(f"STATS M * {param}" if param else "STATS M")
+    replies = await client.collect_until("219", timeout=10.0)
+    rows = {}
+    for msg in replies:
+        if msg.command != "249":
+            continue
+        fields = msg.params[-1].split()
+        if len(fields) != 5 + BUCKETS or not fields[2].isdigit():
+            continue
+        rows[(fields[0], fields[1])] = [int(f) for f in fields[2:]]
+    return rows
+
+
+@pytest.mark.asyncio
+async def test_commands_are_timed(ircd_hub):
+    """Handler calls show up with a consistent histogram."""
+    oper = await make_oper(ircd_hub)
+    try:
+        before = (await cmdtimes(oper)).get(("VERSION", "oper"), [0])[0]
+        for _ in range(3):
+            await oper.send("VERSION")
+            await oper.wait_for("351", timeout=10.0)
+        rows = await cmdtimes(oper)
+        calls, total, slowest, *buckets = rows[("VERSION", "oper")]
+        assert calls == before + 3
+        assert sum(buckets) == calls
+        assert slowest <= total
+        # The STATS call that produced this report is not finished yet,
+        # but the OPER that preceded it is.
+        star = rows[("*", "oper")]
+        assert star[0] >= calls
+        assert ("OPER", "client") in rows
+    finally:
+        await oper.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_filter_by_command(ircd_hub):
+    """A mask parameter limits the per-command lines but not the totals."""
+    oper = await make_oper(ircd_hub)
+    try:
+        rows = await cmdtimes(oper, "OPER")
+        assert ("OPER", "client") in rows
+        assert not [key for key in rows if key[0] not in ("OPER", "*")]
+    finally:
+        await oper.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_reset(ircd_hub):
+    """Resetting /STATS M needs an operator and clears every counter."""
+    user = IRCClient()
+    await user.connect(ircd_hub["host"], ircd_hub["port"])
+    await user.register(f"cmdu{random.randint(0, 999_999)}", "cmdu", "Cmd User")
+    oper = await make_oper(ircd_hub)
+    try:
+        await user.send("STATS M * reset")
+        await user.wait_for("481", timeout=10.0)
+
+        await oper.send("STATS M * reset")
+        await oper.wait_for("219", timeout=10.0)
+        rows = await cmdtimes(oper)
+        # Of the oper's commands, only the reset itself has run since.
+        assert rows[("STATS", "oper")][0] == 1
+        assert ("OPER", "client") not in rows
+        assert ("STATS", "client") not in rows
+    finally:
+        await user.disconnect()
+        await oper.disconnect()
@@ -0,0 +1 @@
+# Compiled ban and silence mask tests
@@ -0,0 +1,116 @@
+"""Bans and silences matched through compiled masks.
+
+Ban and silence masks are compiled once when they are set and checked
+with a matcher that never backtracks.  Masks with many stars, '?' and
+mixed case must still match exactly what match() would.
+"""
+
+from __future__ import annotations
+
+import random
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+
+async def connect(ircd_hub, nick: str) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(nick, "masks", "Mask Test")
+    return client
+
+
+async def can_join(client: IRCClient, channel: str) -> bool:
+    """Try to join channel; return False if a ban kept us out."""
+    await client.send(f"JOIN {channel}")
+    await client.send("PING :joined")
+    replies = await client.collect_until("PONG", timeout=10.0)
+    if any(msg.command == "474" for msg in replies):
+        return False
+    await client.send_and_expect(f"PART {channel}", "PART")
+    return True
+
+
+@pytest.mark.asyncio
+async def test_many_star_ban(ircd_hub):
+    """A ban with many stars and '?' matches only the nicks it should."""
+    tag = random.randint(0, 999_999)
+    channel = f"#masks{tag}"
+    op = await connect(ircd_hub, f"mop{tag}")
+    caught = await connect(ircd_hub, f"xBaNnEd{tag}")
+    near = await connect(ircd_hub, f"xbannex{tag}")
+    clean = await connect(ircd_hub, f"clean{tag}")
+    try:
+        await op.send_and_expect(f"JOIN {channel}", "366")
+        await op.send_and_expect(f"MODE {channel} +b *b*a*n*?e*d*!*@*", "MODE")
+
+        assert not await can_join(caught, channel)
+        assert await can_join(near, channel)
+        assert await can_join(clean, channel)
+
+        await op.send_and_expect(f"MODE {channel} -b *b*a*n*?e*d*!*@*", "MODE")
+        assert await can_join(caught, channel)
+    finally:
+        for client in (op, caught, near, clean):
+            await client.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_silence_mask_ignores_case(ircd_hub):
+    """A silence mask written in upper case still silences the sender."""
+    tag = random.randint(0, 999_999)
+    target = await connect(ircd_hub, f"quiet{tag}")
+    sender = await connect(ircd_hub, f"noisy{tag}")
+    try:
+        await target.send_and_expect("SILENCE +*O?S*!*@*", "SILENCE")
+        await sender.send(f"PRIVMSG {target.nick} :hushed")
+        await sender.send_and_expect("PING :sync", "PONG")
+        await target.send_and_expect("SILENCE -*O?S*!*@*", "SILENCE")
+        await sender.send(f"PRIVMSG {target.nick} :heard")
+        msg = await target.wait_for("PRIVMSG", timeout=10.0)
+        assert msg.params[-1] == "heard"
+    finally:
+        await target.disconnect()
+        await sender.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_escaped_uppercase_ban(ircd_hub):
+    """A ban that escapes an uppercase letter matches that case only."""
+    tag = random.randint(0, 999_999)
+    channel = f"#masks{tag}"
+    op = await connect(ircd_hub, f"mop{tag}")
+    caught = await connect(ircd_hub, f"xLame{tag}")
+    other = await connect(ircd_hub, f"ylame{tag}")
+    try:
+        await op.send_and_expect(f"JOIN {channel}", "366")
+        await op.send_and_expect(f"MODE {channel} +b *\\Lame{tag}!*@*", "MODE")
+
+        assert not await can_join(caught, channel)
+        assert await can_join(other, channel)
+    finally:
+        for client in (op, caught, other):
+            await client.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_escaped_uppercase_who(ircd_hub):
+    """WHO with an escaped uppercase letter lists only that case."""
+    tag = random.randint(0, 999_999)
+    asker = await connect(ircd_hub, f"who{tag}")
+    upper = await connect(ircd_hub, f"xLame{tag}")
+    lower = await connect(ircd_hub, f"ylame{tag}")
+    try:
+        # Leave a different mask behind from an earlier WHO.
+        await asker.send(f"WHO *lame{tag}")
+        await asker.collect_until("315", timeout=10.0)
+        await asker.send(f"WHO *\\Lame{tag}")
+        replies = await asker.collect_until("315", timeout=10.0)
+        nicks = {msg.params[5] for msg in replies if msg.command == "352"}
+        assert nicks == {upper.nick}
+    finally:
+        for client in (asker, upper, lower):
+            await client.disconnect()
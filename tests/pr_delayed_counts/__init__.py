@@ -0,0 +1 @@
+# Delayed-join member count tests
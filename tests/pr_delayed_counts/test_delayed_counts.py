@@ -0,0 +1,115 @@
+"""Channel mode +d tracking of hidden (delayed-join) members.
+
+Each channel counts its join-delayed and zombie members, so deciding
+whether +d is still needed no longer walks the member list.  Members
+are hidden by +D, revealed by speaking, and leave by parting or being
+kicked; +d must go away exactly when the last hidden member does.
+"""
+
+from __future__ import annotations
+
+import random
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+
+async def connect(ircd_hub, nick: str) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(nick, "delayed", "Delayed Test")
+    return client
+
+
+async def hidden_channel(ircd_hub, tag: int, count: int):
+    """Return an op and count members who joined while the channel was +D,
+    after the op has set -D so the channel is left +d."""
+    channel = f"#dly{tag}"
+    op = await connect(ircd_hub, f"dop{tag}")
+    members = [await connect(ircd_hub, f"dm{tag}x{ii}") for ii in range(count)]
+    await op.send_and_expect(f"JOIN {channel}", "366")
+    await op.send_and_expect(f"MODE {channel} +D", "MODE")
+    for member in members:
+        await member.send_and_expect(f"JOIN {channel}", "366")
+    await op.send_and_expect(f"MODE {channel} -D", "MODE")
+    assert "d" in await op.chan_modes(channel)
+    return channel, op, members
+
+
+@pytest.mark.asyncio
+async def test_reveal_and_part_clear_d(ircd_hub):
+    """+d stays while any member is hidden and clears with the last one."""
+    tag = random.randint(0, 999_999)
+    channel, op, members = await hidden_channel(ircd_hub, tag, 3)
+    try:
+        await members[0].send(f"PRIVMSG {channel} :hello")
+        msg = await op.wait_for("JOIN", timeout=10.0)
+        while not msg.prefix.startswith(members[0].nick + "!"):
+            msg = await op.wait_for("JOIN", timeout=10.0)
+        assert "d" in await op.chan_modes(channel)
+
+        await members[1].send_and_expect(f"PART {channel}", "PART")
+        assert "d" in await op.chan_modes(channel)
+
+        # Parting and rejoining without +D leaves a visible member.
+        await members[0].send_and_expect(f"PART {channel}", "PART")
+        await members[0].send_and_expect(f"JOIN {channel}", "366")
+        assert "d" in await op.chan_modes(channel)
+
+        await members[2].send(f"PART {channel}")
+        msg = await op.wait_for("MODE", timeout=10.0)
+        while msg.params[1:] != ["-d"]:
+            msg = await op.wait_for("MODE", timeout=10.0)
+        assert "d" not in await op.chan_modes(channel)
+    finally:
+        await op.disconnect()
+        for member in members:
+            await member.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_kick_last_hidden_clears_d(ircd_hub):
+    """Kicking the last hidden member clears +d."""
+    tag = random.randint(0, 999_999)
+    channel, op, members = await hidden_channel(ircd_hub, tag, 2)
+    try:
+        await op.send_and_expect(f"KICK {channel} {members[0].nick} :one", "KICK")
+        assert "d" in await op.chan_modes(channel)
+
+        await op.send(f"KICK {channel} {members[1].nick} :two")
+        msg = await op.wait_for("MODE", timeout=10.0)
+        while msg.params[1:] != ["-d"]:
+            msg = await op.wait_for("MODE", timeout=10.0)
+        await members[1].send(f"TOPIC {channel} :after kick")
+        assert (await members[1].wait_for("442", timeout=10.0)).command == "442"
+    finally:
+        await op.disconnect()
+        for member in members:
+            await member.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_hidden_members_leave_without_breaking_counts(ircd_hub):
+    """Hidden members parting and quitting keep the counts consistent.
+
+    Debug builds check the counts whenever +d is looked at, so a hidden
+    member leaving must not be seen while it is half removed."""
+    tag = random.randint(0, 999_999)
+    channel, op, members = await hidden_channel(ircd_hub, tag, 3)
+    try:
+        await members[0].send_and_expect(f"PART {channel}", "PART")
+        await members[1].send("QUIT :bye")
+        assert "d" in await op.chan_modes(channel)
+
+        await members[2].send("QUIT :last")
+        msg = await op.wait_for("MODE", timeout=10.0)
+        while msg.params[1:] != ["-d"]:
+            msg = await op.wait_for("MODE", timeout=10.0)
+        assert "d" not in await op.chan_modes(channel)
+    finally:
+        await op.disconnect()
+        for member in members:
+            await member.disconnect()
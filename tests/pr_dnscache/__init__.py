@@ -0,0 +1 @@
+# Resolver cache tests
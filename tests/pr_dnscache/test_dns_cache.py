@@ -0,0 +1,120 @@
+"""Resolver answer cache.
+
+The ircd caches the answers to its PTR and A/AAAA queries for the
+record TTL (capped by DNS_CACHE_MAXTTL), and failed lookups for
+DNS_CACHE_NEGTTL, so clients reconnecting from the same address do not
+cause new queries.
+
+The DNS hub runs with DNS_CACHE_SIZE = 0 so the other resolver tests
+see every query on the wire; these tests turn the cache on with SET
+and off again when they finish.
+"""
+
+from __future__ import annotations
+
+import random
+import re
+import time
+
+import pytest
+import pytest_asyncio
+
+from irc_client import IRCClient
+from pr81_dns_tcp.helpers import (
+    AUTH_FAIL,
+    AUTH_FOUND,
+    get_stats,
+    notice_blob,
+    register_collect_auth_notices,
+    trigger_oper_connect,
+)
+
+pytestmark = pytest.mark.dns
+
+
+@pytest_asyncio.fixture
+async def dns_cache(ircd_dns_hub):
+    """Enable the resolver cache for one test."""
+    oper = IRCClient()
+    await oper.connect(ircd_dns_hub["host"], ircd_dns_hub["port"])
+    await oper.register(f"cacheop{random.randint(0, 999_999)}", "cacheop", "Cache Oper")
+    await oper.send("OPER testoper operpass")
+    await oper.wait_for("381", timeout=10.0)
+    await oper.send("SET DNS_CACHE_SIZE 1048576")
+    await oper.wait_for("284", timeout=10.0)
+    try:
+        yield oper
+    finally:
+        # Shrinking the cache to nothing also empties it.
+        await oper.send("SET DNS_CACHE_SIZE 0")
+        await oper.wait_for("284", timeout=10.0)
+        await oper.disconnect()
+
+
+async def cache_stats(oper: IRCClient) -> dict[str, int]:
+    """Return the counters from the cache line of /STATS a."""
+    await oper.send("STATS a")
+    replies = await oper.collect_until("219", timeout=10.0)
+    lines = [" ".join(msg.params[1:]) for msg in replies if msg.command == "226"]
+    cache = [line for line in lines if line.startswith("cache ")]
+    assert cache, f"no cache line in STATS a: {lines!r}"
+    return {name: int(count) for count, name in re.findall(r"(\d+) ([a-z ]+?)(?:,|$)", cache[0])}
+
+
+async def connect_and_resolve(ircd_dns_hub) -> None:
+    """Register one client and check that its hostname was found."""
+    nick = f"dnsc{random.randint(0, 999_999)}"
+    notices = await register_collect_auth_notices(
+        ircd_dns_hub["host"], ircd_dns_hub["port"], nick,
+    )
+    blob = notice_blob(notices)
+    assert AUTH_FOUND in blob, f"expected hostname success, got: {blob!r}"
+
+
+@pytest.mark.asyncio
+async def test_reconnect_answered_from_cache(ircd_dns_hub, dns_control, dns_cache):
+    """A second client from the same address sends no new queries."""
+    dns_control("ok_udp")
+    await connect_and_resolve(ircd_dns_hub)
+    first = get_stats()["udp_queries"]
+    assert first >= 2, "first client should query PTR and A"
+    before = await cache_stats(dns_cache)
+    assert before["entries"] >= 2
+
+    await connect_and_resolve(ircd_dns_hub)
+    assert get_stats()["udp_queries"] == first, "second client was not cached"
+    after = await cache_stats(dns_cache)
+    assert after["hits"] == before["hits"] + 2
+
+
+@pytest.mark.asyncio
+async def test_failed_lookup_cached(ircd_dns_hub, dns_control, dns_cache):
+    """NXDOMAIN for a server name is cached, so a retry sends nothing."""
+    dns_control("ok_udp")
+    # aaaa.tc.test has no AAAA record over UDP in this scenario.
+    await trigger_oper_connect(ircd_dns_hub["host"], ircd_dns_hub["port"], "aaaa.tc.test")
+    first = get_stats()["udp_queries"]
+    before = await cache_stats(dns_cache)
+    await trigger_oper_connect(ircd_dns_hub["host"], ircd_dns_hub["port"], "aaaa.tc.test")
+    assert get_stats()["udp_queries"] == first
+    after = await cache_stats(dns_cache)
+    assert after["negative hits"] == before["negative hits"] + 1
+
+
+@pytest.mark.asyncio
+async def test_empty_answer_fails_at_once(ircd_dns_hub, dns_control, dns_cache):
+    """An empty PTR answer fails the lookup straight away, cached or not."""
+    dns_control("ptr_nodata")
+    before = await cache_stats(dns_cache)
+    for _ in range(2):
+        start = time.monotonic()
+        notices = await register_collect_auth_notices(
+            ircd_dns_hub["host"], ircd_dns_hub["port"],
+            f"dnsn{random.randint(0, 999_999)}", stop_on=AUTH_FAIL,
+        )
+        # IRCD_RES_TIMEOUT is 4 seconds.
+        assert time.monotonic() - start < 3.0
+        assert AUTH_FAIL in notice_blob(notices)
+    assert get_stats()["udp_queries"] == 1
+    after = await cache_stats(dns_cache)
+    assert after["negative hits"] == before["negative hits"] + 1
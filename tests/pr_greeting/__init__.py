@@ -0,0 +1 @@
+# Pre-rendered connect greeting tests
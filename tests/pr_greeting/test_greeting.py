@@ -0,0 +1,98 @@
+"""Pre-rendered connect greeting (RPL_ISUPPORT and the MOTD).
+
+The server formats the ISUPPORT and MOTD lines once and copies them to
+each client, filling in only the recipient's nick.  These tests check
+that every client still gets its own, current copy.
+"""
+
+from __future__ import annotations
+
+import random
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+
+def isupport(msgs):
+    return [m.params[1:] for m in msgs if m.command == "005"]
+
+
+def nick():
+    return f"greet{random.randint(0, 999_999)}"
+
+
+async def connect(ircd_hub):
+    """Register a fresh client; return it with its registration burst."""
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    msgs = await client.register(nick(), "greet", "Greeting Test")
+    return client, msgs
+
+
+def tokens(msgs):
+    return " ".join(" ".join(params) for params in isupport(msgs))
+
+
+@pytest.mark.asyncio
+async def test_isupport_addressed_to_each_client(ircd_hub):
+    """Two clients get the same ISUPPORT tokens, each addressed to them."""
+    first, first_msgs = await connect(ircd_hub)
+    second, second_msgs = await connect(ircd_hub)
+    msgs = {first: first_msgs, second: second_msgs}
+    try:
+        for client in (first, second):
+            lines = [m for m in msgs[client] if m.command == "005"]
+            assert len(lines) == 2
+            assert all(m.params[0] == client.nick for m in lines)
+        assert isupport(msgs[first]) == isupport(msgs[second])
+
+        await first.send("VERSION")
+        replies = await first.collect_until("005")
+        replies.append(await first.wait_for("005"))
+        assert isupport(replies) == isupport(msgs[first])
+    finally:
+        await first.disconnect()
+        await second.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_isupport_follows_set(ircd_hub, make_client):
+    """Changing a reported feature changes ISUPPORT for later clients."""
+    oper = await make_client(nick())
+    await oper.send("OPER testoper operpass")
+    await oper.wait_for("381", timeout=10.0)
+    await oper.send("SET MAXBANS 42")
+    await oper.wait_for("284", timeout=10.0)
+    try:
+        client, msgs = await connect(ircd_hub)
+        await client.disconnect()
+        assert "MAXBANS=42" in tokens(msgs).split()
+    finally:
+        await oper.send("RESET MAXBANS")
+        await oper.wait_for("284", timeout=10.0)
+
+    client, msgs = await connect(ircd_hub)
+    await client.disconnect()
+    assert "MAXBANS=100" in tokens(msgs).split()
+
+
+@pytest.mark.asyncio
+async def test_motd_addressed_to_each_client(make_client):
+    """Every MOTD line carries the requesting client's nick."""
+    bodies = []
+    for _ in range(2):
+        client = await make_client(nick())
+        await client.send("MOTD")
+        replies = [await client.recv(timeout=10.0)]
+        while replies[-1].command not in ("376", "422"):
+            replies.append(await client.recv(timeout=10.0))
+        if replies[-1].command == "422":
+            pytest.skip("hub has no MOTD file")
+        lines = [m for m in replies if m.command in ("375", "372", "376")]
+        assert lines[0].command == "375" and lines[-1].command == "376"
+        assert all(m.params[0] == client.nick for m in lines)
+        bodies.append([m.params[1:] for m in lines if m.command == "372"])
+    assert bodies[0] == bodies[1]
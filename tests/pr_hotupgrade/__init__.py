@@ -0,0 +1 @@
+# Hot upgrade (RESTART UPGRADE) tests
@@ -0,0 +1,190 @@
+"""RESTART UPGRADE: restart the server without dropping its users.
+
+The oper command saves the state of every plaintext local user to the
+file named by the UPATH feature, starts the new binary with "-U file",
+and the new process picks the open sockets back up.  Server links are
+dropped and re-established, so the rest of the network sees the users
+quit and come back in the burst.
+
+These tests upgrade leaf2 while users are connected to it and check
+that their connections, channels, modes and half-sent lines survive.
+"""
+
+import asyncio
+
+import pytest
+
+from irc_client import IRCClient
+
+
+pytestmark = pytest.mark.multi_server
+
+
+async def make_client(server, nick):
+    client = IRCClient()
+    await client.connect(server["host"], server["port"])
+    await client.register(nick, "testuser", "Test User")
+    return client
+
+
+async def send_bytes(client, data):
+    """Write octets without appending a line ending."""
+    client._writer.write(data)
+    await client._writer.drain()
+
+
+async def upgrade(oper):
+    """Run RESTART UPGRADE and wait for the new process to report back."""
+    await oper.send("RESTART UPGRADE")
+    loop = asyncio.get_running_loop()
+    deadline = loop.time() + 30
+    while True:
+        msg = await oper.wait_for("NOTICE", timeout=deadline - loop.time())
+        if "Server upgrade complete" in msg.params[-1]:
+            return
+
+
+async def test_users_survive_upgrade(ircd_network):
+    """Users, channel state and a partial line survive the upgrade."""
+    leaf2 = ircd_network["leaf2"]
+    alice = await make_client(leaf2, "upalice")
+    bob = await make_client(leaf2, "upbob")
+    oper = await make_client(leaf2, "upoper")
+    try:
+        await alice.send("JOIN #upgrade")
+        await alice.wait_for("366")
+        await alice.send("MODE #upgrade +nt")
+        await alice.send("TOPIC #upgrade :kept across upgrades")
+        await alice.wait_for("TOPIC")
+        await bob.send("JOIN #upgrade")
+        await bob.wait_for("366")
+        await alice.send("AWAY :gone fishing")
+        await alice.wait_for("306")
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381")
+
+        # Half a line is in the recvQ when the server restarts.
+        await send_bytes(alice, b"PRIVMSG #upgrade :half")
+        await upgrade(oper)
+        await send_bytes(alice, b" a line\r\n")
+        msg = await bob.wait_for_message_with_text("PRIVMSG", "half a line")
+        assert msg.prefix.startswith("upalice!")
+
+        await bob.send("NAMES #upgrade")
+        names = await bob.wait_for("353")
+        assert "@upalice" in names.params[-1].split()
+        assert "upbob" in names.params[-1].split()
+
+        await bob.send("TOPIC #upgrade")
+        topic = await bob.wait_for("332")
+        assert topic.params[-1] == "kept across upgrades"
+
+        await bob.send("MODE #upgrade")
+        modes = await bob.wait_for("324")
+        assert "n" in modes.params[2] and "t" in modes.params[2]
+
+        await bob.send("WHOIS upalice")
+        away = await bob.wait_for("301")
+        assert away.params[-1] == "gone fishing"
+
+        await bob.send("WHOIS upoper")
+        await bob.wait_for("313")
+    finally:
+        await alice.disconnect()
+        await bob.disconnect()
+        await oper.disconnect()
+
+
+async def test_network_sees_user_after_upgrade(ircd_network):
+    """After relinking, the hub learns about the kept user again."""
+    leaf2 = ircd_network["leaf2"]
+    user = await make_client(leaf2, "upcarol")
+    oper = await make_client(leaf2, "upoper2")
+    watcher = await make_client(ircd_network["hub"], "upwatch")
+    try:
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381")
+        await upgrade(oper)
+
+        # Wait for leaf2 to relink and burst its users.
+        loop = asyncio.get_running_loop()
+        deadline = loop.time() + 60
+        while loop.time() < deadline:
+            await watcher.send("ISON upcarol")
+            ison = await watcher.wait_for("303")
+            if ison.params[-1].strip() == "upcarol":
+                break
+            await asyncio.sleep(1)
+        else:
+            pytest.fail("leaf2 did not relink after the upgrade")
+
+        await watcher.send("PRIVMSG upcarol :welcome back")
+        msg = await user.wait_for_message_with_text("PRIVMSG", "welcome back")
+        assert msg.prefix.startswith("upwatch!")
+    finally:
+        await user.disconnect()
+        await oper.disconnect()
+        await watcher.disconnect()
+
+
+async def test_silences_and_invites_survive_upgrade(ircd_network):
+    """A kept user's SILENCE list and pending invites are restored."""
+    leaf2 = ircd_network["leaf2"]
+    alice = await make_client(leaf2, "upsilent")
+    bob = await make_client(leaf2, "upinviter")
+    oper = await make_client(leaf2, "upoper3")
+    try:
+        await alice.send("SILENCE +*!*@noisy.example")
+        await alice.wait_for("SILENCE")
+        await bob.send("JOIN #upinvite")
+        await bob.wait_for("366")
+        await bob.send("MODE #upinvite +i")
+        await bob.send("INVITE upsilent #upinvite")
+        await bob.wait_for("341")
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381")
+
+        await upgrade(oper)
+
+        await alice.send("SILENCE")
+        entry = await alice.wait_for("271")
+        assert entry.params[-1] == "*!*@noisy.example"
+
+        await alice.send("JOIN #upinvite")
+        await alice.wait_for("366")
+    finally:
+        await alice.disconnect()
+        await bob.disconnect()
+        await oper.disconnect()
+
+
+async def test_failed_save_keeps_everyone(ircd_network):
+    """If the upgrade file cannot be written, nobody is disconnected."""
+    leaf2 = ircd_network["leaf2"]
+    user = await make_client(leaf2, "upstays")
+    oper = await make_client(leaf2, "upoper4")
+    watcher = await make_client(ircd_network["hub"], "upwatch2")
+    try:
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381")
+        await oper.send("SET UPATH /nonexistent/ircd.upgrade")
+        await oper.wait_for("284")
+        await oper.send("RESTART UPGRADE")
+        await oper.send("PING :after")
+        await oper.wait_for("PONG")
+
+        # The server link survived, so the hub still sees the user.
+        await watcher.send("ISON upstays")
+        ison = await watcher.wait_for("303")
+        assert ison.params[-1].strip() == "upstays"
+        await watcher.send("PRIVMSG upstays :still here")
+        await user.wait_for_message_with_text("PRIVMSG", "still here")
+    finally:
+        try:
+            await oper.send("RESET UPATH")
+            await oper.wait_for("284")
+        except Exception:
+            pass
+        await user.disconnect()
+        await oper.disconnect()
+        await watcher.disconnect()
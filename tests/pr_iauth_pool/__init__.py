@@ -0,0 +1 @@
+# IAuth worker pool tests
@@ -0,0 +1,212 @@
+"""Tests for running several iauth workers from one IAuth block.
+
+With "workers = 2" the server spawns two copies of the iauth program
+and introduces each registering client to the one with the fewest
+clients waiting on it.  A worker that dies while holding a client must
+not strand it: the client is introduced again to a running worker and
+still registers.  /stats iauth reports one line per worker.
+
+These tests run the locally built ircd with an iauth stub that logs the
+raw message stream of every worker.  They need ircd/ircd compiled for
+this host (run `make` first); they skip if it is missing.
+"""
+
+import asyncio
+import socket
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+import pytest
+
+
+REPO_ROOT = Path(__file__).resolve().parents[2]
+IRCD_BIN = REPO_ROOT / "ircd" / "ircd"
+STUB = Path(__file__).resolve().parent / "iauth_pool_stub.py"
+
+pytestmark = pytest.mark.skipif(
+    not IRCD_BIN.exists(), reason="local ircd binary not built"
+)
+
+
+def _free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def _spath():
+    """Read the compiled-in SPATH from config.h (ircd checks it on boot)."""
+    for line in (REPO_ROOT / "config.h").read_text().splitlines():
+        if line.startswith("#define SPATH "):
+            return Path(line.split('"')[1])
+    return None
+
+
+@pytest.fixture
+def ensure_spath():
+    """ircd refuses to start unless SPATH exists; symlink it if missing."""
+    spath = _spath()
+    created = False
+    if spath and not spath.exists() and spath.parent.is_dir():
+        spath.symlink_to(IRCD_BIN)
+        created = True
+    yield
+    if created:
+        spath.unlink(missing_ok=True)
+
+
+CONF_TEMPLATE = """\
+General {{
+        name = "iauthpool.example.net";
+        vhost = "127.0.0.1";
+        description = "iauth pool test server";
+        numeric = 98;
+}};
+Admin {{
+        Location = "test";
+        Location = "test";
+        Contact = "test@example.net";
+}};
+Class {{
+        name = "Local";
+        pingfreq = 90 seconds;
+        sendq = 160000;
+        maxlinks = 100;
+}};
+Client {{ ip = "127.*"; class = "Local"; }};
+Operator {{ local = no; class = "Local"; host = "*@127.*"; password = "$PLAIN$oper"; name = "oper"; }};
+Port {{ port = {port}; }};
+IAuth {{ program = "{python}" "{stub}" "{log}"; workers = 2; }};
+"""
+
+
+@pytest.fixture
+def local_ircd(tmp_path, ensure_spath):
+    """Spawn a local ircd with two logging iauth workers attached."""
+    port = _free_port()
+    log = tmp_path / "iauth.log"
+    log.touch()
+    conf = tmp_path / "ircd.conf"
+    conf.write_text(
+        CONF_TEMPLATE.format(
+            port=port,
+            python=sys.executable,
+            stub=STUB,
+            log=log,
+        )
+    )
+    proc = subprocess.Popen(
+        [str(IRCD_BIN), "-n", "-f", str(conf), "-d", str(tmp_path)],
+        cwd=tmp_path,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+    )
+    try:
+        deadline = time.time() + 10
+        while time.time() < deadline:
+            if proc.poll() is not None:
+                raise RuntimeError("ircd exited during startup")
+            try:
+                with socket.create_connection(("127.0.0.1", port), 0.2):
+                    break
+            except OSError:
+                time.sleep(0.1)
+        else:
+            raise RuntimeError("ircd did not start listening")
+        # Give both workers time to start, then forget the probe
+        # connection above.
+        time.sleep(0.5)
+        log.write_text("")
+        yield {"port": port, "log": log}
+    finally:
+        proc.terminate()
+        try:
+            proc.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+
+
+async def _register(port, nick, after=()):
+    """Connect and register; send `after` lines once 001 arrives.
+
+    Returns every line received until the end of the exchange.
+    """
+    reader, writer = await asyncio.open_connection("127.0.0.1", port)
+    lines = []
+
+    async def send(line):
+        writer.write((line + "\r\n").encode())
+        await writer.drain()
+
+    await send(f"NICK {nick}")
+    await send("USER testuser 0 * :Test User")
+
+    deadline = asyncio.get_event_loop().time() + 15
+    try:
+        while True:
+            remaining = deadline - asyncio.get_event_loop().time()
+            raw = await asyncio.wait_for(reader.readline(), timeout=remaining)
+            if not raw:
+                raise ConnectionError("server closed connection")
+            line = raw.decode(errors="replace").strip()
+            lines.append(line)
+            if line.startswith("PING"):
+                await send("PONG " + line.split(" ", 1)[1])
+            parts = line.split()
+            if len(parts) > 1 and parts[1] == "001":
+                if not after:
+                    return lines
+                for cmd in after:
+                    await send(cmd)
+            if len(parts) > 1 and parts[1] == "219":
+                return lines
+    finally:
+        writer.write(b"QUIT :done\r\n")
+        try:
+            await writer.drain()
+        except OSError:
+            pass
+        writer.close()
+
+
+def _introductions(log_path):
+    """Return (worker pid, client id) for every "C" message logged."""
+    intros = []
+    for line in log_path.read_text().splitlines():
+        parts = line.split(" ")
+        if len(parts) >= 3 and parts[2] == "C":
+            intros.append((parts[0], parts[1]))
+    return intros
+
+
+async def test_clients_spread_over_workers(local_ircd):
+    """Clients registering one after another alternate between workers."""
+    for ii in range(4):
+        await _register(local_ircd["port"], f"pool{ii}")
+    await asyncio.sleep(0.5)
+    intros = _introductions(local_ircd["log"])
+    assert len(intros) == 4
+    assert len({pid for pid, _ in intros}) == 2
+
+
+async def test_dead_worker_hands_over_client(local_ircd):
+    """A client whose worker dies is introduced to another worker."""
+    await _register(local_ircd["port"], "crashme")
+    await asyncio.sleep(0.5)
+    intros = _introductions(local_ircd["log"])
+    assert len(intros) == 2
+    assert intros[0][1] == intros[1][1]
+    assert intros[0][0] != intros[1][0]
+
+    lines = await _register(
+        local_ircd["port"], "statsme", ["OPER oper oper", "STATS iauth"]
+    )
+    workers = [line for line in lines if " :Worker " in line]
+    assert len(workers) == 2
+    answered = [
+        int(line.split(" answered")[0].rsplit(" ", 1)[1]) for line in workers
+    ]
+    # The surviving worker answered for crashme as well as statsme.
+    assert sum(answered) == 2
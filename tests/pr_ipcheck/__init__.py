@@ -0,0 +1 @@
+# IP registry occupancy tests
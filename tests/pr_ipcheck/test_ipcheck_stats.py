@@ -0,0 +1,85 @@
+"""IP registry occupancy reporting.
+
+The registry's hash tables start small and grow with the number of
+addresses, and entries whose clients have all left wait on an idle
+list to expire.  /STATS z reports the table sizes and how full they
+are.
+"""
+
+from __future__ import annotations
+
+import random
+import re
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+IPCHECK = re.compile(
+    r"IPcheck (\d+)\((\d+)\) idle (\d+) buckets (\d+)/(\d+) chain (\d+) "
+    r"/48 (\d+) buckets (\d+)/(\d+) chain (\d+) expired (\d+)")
+
+
+async def oper(ircd_hub) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(f"ipcop{random.randint(0, 999_999)}", "ipcop", "IPcheck Oper")
+    await client.send("OPER testoper operpass")
+    await client.wait_for("381", timeout=10.0)
+    return client
+
+
+async def ipcheck_stats(client: IRCClient) -> dict[str, int]:
+    """Return the counters from the IPcheck line of /STATS z."""
+    await client.send("STATS z")
+    replies = await client.collect_until("219", timeout=10.0)
+    lines = [" ".join(msg.params[1:]) for msg in replies if msg.command == "249"]
+    found = [IPCHECK.search(line) for line in lines]
+    found = [match for match in found if match]
+    assert found, f"no IPcheck line in STATS z: {lines!r}"
+    names = ("entries", "bytes", "idle", "used", "buckets", "chain",
+             "entries48", "used48", "buckets48", "chain48", "expired")
+    return dict(zip(names, map(int, found[0].groups())))
+
+
+@pytest.mark.asyncio
+async def test_stats_reports_registry(ircd_hub):
+    """The oper's own address is in the registry and not idle."""
+    client = await oper(ircd_hub)
+    try:
+        stats = await ipcheck_stats(client)
+        assert stats["entries"] >= 1
+        assert stats["idle"] < stats["entries"]
+        for table in ("buckets", "buckets48"):
+            size = stats[table]
+            assert size >= 1024 and size & (size - 1) == 0, stats
+        assert 1 <= stats["used"] <= min(stats["entries"], stats["buckets"])
+        assert stats["chain"] >= 1
+        assert stats["used48"] <= stats["buckets48"]
+    finally:
+        await client.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_clients_from_one_address_share_an_entry(ircd_hub):
+    """More clients from the same address do not add entries."""
+    client = await oper(ircd_hub)
+    others = []
+    try:
+        before = await ipcheck_stats(client)
+        for _ in range(3):
+            other = IRCClient()
+            await other.connect(ircd_hub["host"], ircd_hub["port"])
+            await other.register(f"ipc{random.randint(0, 999_999)}", "ipc", "IPcheck Test")
+            others.append(other)
+        after = await ipcheck_stats(client)
+        # Other addresses may expire meanwhile; nothing else changes.
+        expired = after["expired"] - before["expired"]
+        assert after["entries"] + expired == before["entries"]
+        assert after["idle"] + expired == before["idle"]
+    finally:
+        for other in others:
+            await other.disconnect()
+        await client.disconnect()
@@ -0,0 +1 @@
+# Event loop timing tests
@@ -0,0 +1,82 @@
+"""Event loop timing (/STATS e).
+
+The engines mark the start and end of each wait for events, and every
+event callback is timed.  /STATS e reports the loop iteration totals
+and histogram, times by event type and by callback, and the number of
+callbacks slower than SLOW_CALLBACK_MSEC.
+"""
+
+from __future__ import annotations
+
+import random
+import re
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+
+async def make_client(ircd_hub, oper: bool) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(f"loop{random.randint(0, 999_999)}", "loop", "Loop Stats")
+    if oper:
+        await client.send("OPER testoper operpass")
+        await client.wait_for("381", timeout=10.0)
+    return client
+
+
+async def engine_stats(client: IRCClient) -> dict[str, str]:
+    """Return the /STATS e debug lines, keyed by their label."""
+    await client.send("STATS e")
+    replies = await client.collect_until("219", timeout=10.0)
+    assert any(msg.command == "237" for msg in replies), "no engine name"
+    lines = {}
+    for msg in replies:
+        if msg.command == "249":
+            label, _, rest = msg.params[-1].partition(":")
+            lines[label] = rest.strip()
+    return lines
+
+
+def loop_iterations(lines: dict[str, str]) -> int:
+    return int(re.match(r"(\d+) iterations", lines["Loop"]).group(1))
+
+
+@pytest.mark.asyncio
+async def test_loop_report(ircd_hub):
+    """The histogram covers every iteration and callbacks are listed."""
+    oper = await make_client(ircd_hub, oper=True)
+    try:
+        lines = await engine_stats(oper)
+        iterations = loop_iterations(lines)
+        assert iterations > 0
+        hist = [int(n) for n in lines["Loop histogram (<1us <2us <4us ...)"].split()]
+        assert len(hist) == 24
+        assert sum(hist) == iterations
+        assert int(re.match(r"(\d+) calls", lines["Event read"]).group(1)) > 0
+        assert any(label.startswith("Callback 0x") for label in lines)
+        assert re.match(r"\d+ \(SLOW_CALLBACK_MSEC \d+\)", lines["Slow callbacks"])
+    finally:
+        await oper.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_reset(ircd_hub):
+    """Only operators can reset the statistics, and a reset clears them."""
+    user = await make_client(ircd_hub, oper=False)
+    oper = await make_client(ircd_hub, oper=True)
+    try:
+        await user.send("STATS e * reset")
+        await user.wait_for("481", timeout=10.0)
+
+        before = loop_iterations(await engine_stats(oper))
+        await oper.send("STATS e * reset")
+        await oper.wait_for("219", timeout=10.0)
+        after = loop_iterations(await engine_stats(oper))
+        assert after < before
+    finally:
+        await user.disconnect()
+        await oper.disconnect()
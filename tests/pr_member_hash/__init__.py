@@ -0,0 +1 @@
+# Channel membership hash tests
@@ -0,0 +1,114 @@
+"""Membership lookups on big channels and for users on many channels.
+
+Channels with more than MEMBER_HASH_MIN (32) members, and users on more
+than 32 channels, get a hash of their memberships.  The hash is built,
+grown, shrunk and dropped as clients join and part; every membership
+check must keep giving the same answers as the plain lists.
+"""
+
+from __future__ import annotations
+
+import asyncio
+import random
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+MEMBERS = 40
+
+
+async def connect(ircd_hub, nick: str) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(nick, "members", "Member Test")
+    return client
+
+
+async def names(client: IRCClient, channel: str) -> set[str]:
+    """Return the nicks NAMES reports for channel, without prefixes."""
+    await client.send(f"NAMES {channel}")
+    replies = await client.collect_until("366", timeout=10.0)
+    found: set[str] = set()
+    for msg in replies:
+        if msg.command == "353":
+            found.update(nick.lstrip("@+") for nick in msg.params[-1].split())
+    return found
+
+
+@pytest.mark.asyncio
+async def test_big_channel_members(ircd_hub):
+    """Ops, voices, kicks and parts work on a channel past the threshold."""
+    tag = random.randint(0, 999_999)
+    channel = f"#big{tag}"
+    op = await connect(ircd_hub, f"bop{tag}")
+    members = await asyncio.gather(
+        *(connect(ircd_hub, f"bm{tag}x{ii}") for ii in range(MEMBERS)))
+    try:
+        await op.send_and_expect(f"JOIN {channel}", "366")
+        for member in members:
+            await member.send_and_expect(f"JOIN {channel}", "366")
+        assert await names(op, channel) == {op.nick} | {m.nick for m in members}
+
+        # The op is found in the channel's hash; the first member is not an op.
+        await op.send_and_expect(f"MODE {channel} +v {members[-1].nick}", "MODE")
+        await members[0].send(f"MODE {channel} +o {members[0].nick}")
+        assert (await members[0].wait_for("482", timeout=10.0)).command == "482"
+        await members[-1].send(f"PRIVMSG {channel} :voiced")
+        assert (await op.wait_for("PRIVMSG", timeout=10.0)).params[-1] == "voiced"
+
+        await op.send_and_expect(f"KICK {channel} {members[1].nick} :bye", "KICK")
+        await members[1].send(f"TOPIC {channel} :after kick")
+        assert (await members[1].wait_for("442", timeout=10.0)).command == "442"
+
+        # Part down past the point where the hash is dropped, then rejoin.
+        leaving = members[2:MEMBERS - 5]
+        for member in leaving:
+            await member.send_and_expect(f"PART {channel}", "PART")
+        expected = {op.nick, members[0].nick} | {m.nick for m in members[-5:]}
+        assert await names(op, channel) == expected
+        for member in leaving:
+            await member.send_and_expect(f"JOIN {channel}", "366")
+        expected |= {m.nick for m in leaving}
+        assert await names(op, channel) == expected
+        await members[-1].send(f"PRIVMSG {channel} :still voiced")
+        assert (await op.wait_for("PRIVMSG", timeout=10.0)).params[-1] == "still voiced"
+    finally:
+        await asyncio.gather(op.disconnect(), *(m.disconnect() for m in members))
+
+
+@pytest.mark.asyncio
+async def test_user_on_many_channels(ircd_hub):
+    """An oper on more than 32 channels still sees the right memberships."""
+    tag = random.randint(0, 999_999)
+    oper = await connect(ircd_hub, f"many{tag}")
+    other = await connect(ircd_hub, f"other{tag}")
+    try:
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381", timeout=10.0)
+        channels = [f"#many{tag}x{ii}" for ii in range(MEMBERS)]
+        for first in range(0, MEMBERS, 10):
+            await oper.send("JOIN " + ",".join(channels[first:first + 10]))
+        await oper.send("PING :joined")
+        replies = await oper.collect_until("PONG", timeout=20.0)
+        if any(msg.command == "405" for msg in replies):
+            pytest.skip("operator may not join enough channels")
+
+        await other.send_and_expect(f"JOIN {channels[0]}", "366")
+        await other.send_and_expect(f"JOIN {channels[-1]}", "366")
+        await oper.send_and_expect(f"MODE {channels[0]} +o {other.nick}", "MODE")
+        await other.send_and_expect(f"TOPIC {channels[0]} :from other", "TOPIC")
+
+        for first in range(1, MEMBERS, 10):
+            await oper.send("PART " + ",".join(channels[first:first + 10]))
+        await oper.send("PING :parted")
+        await oper.collect_until("PONG", timeout=20.0)
+        await oper.send(f"TOPIC {channels[0]} :last one")
+        assert (await other.wait_for("TOPIC", timeout=10.0)).params[-1] == "last one"
+        await oper.send(f"TOPIC {channels[-1]} :gone")
+        assert (await oper.wait_for("442", timeout=10.0)).command == "442"
+    finally:
+        await oper.disconnect()
+        await other.disconnect()
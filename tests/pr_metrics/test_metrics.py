@@ -0,0 +1,106 @@
+"""Prometheus metrics exporter (Port block with metrics = yes).
+
+The hub listens for HTTP scrapes on its metrics port and answers
+GET /metrics with counters in the Prometheus text exposition format.
+"""
+
+from __future__ import annotations
+
+import asyncio
+import random
+import re
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+SAMPLE = re.compile(r"^([a-z_:][a-z0-9_:]*)(\{[^}]*\})? (\S+)$")
+
+
+async def http_request(ircd_hub, request: bytes) -> tuple[int, dict[str, str], str]:
+    """Send a raw request to the metrics port and read the whole reply."""
+    reader, writer = await asyncio.open_connection(
+        ircd_hub["host"], ircd_hub["metrics_port"])
+    writer.write(request)
+    await writer.drain()
+    data = await asyncio.wait_for(reader.read(-1), timeout=10.0)
+    writer.close()
+    head, _, body = data.decode().partition("\r\n\r\n")
+    status_line, *header_lines = head.split("\r\n")
+    headers = {}
+    for line in header_lines:
+        name, _, value = line.partition(":")
+        headers[name.strip().lower()] = value.strip()
+    return int(status_line.split()[1]), headers, body
+
+
+async def scrape(ircd_hub) -> dict[str, float]:
+    status, headers, body = await http_request(
+        ircd_hub, b"GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n")
+    assert status == 200
+    assert headers["content-type"].startswith("text/plain")
+    samples = {}
+    for line in body.splitlines():
+        if not line or line.startswith("#"):
+            continue
+        match = SAMPLE.match(line)
+        assert match, f"malformed sample line: {line!r}"
+        samples[match.group(1) + (match.group(2) or "")] = float(match.group(3))
+    return samples
+
+
+@pytest.mark.asyncio
+async def test_metrics_format(ircd_hub):
+    """Every family has HELP and TYPE lines and its samples are contiguous."""
+    status, _, body = await http_request(
+        ircd_hub, b"GET /metrics HTTP/1.0\r\n\r\n")
+    assert status == 200
+    seen, current = set(), None
+    for line in body.splitlines():
+        if line.startswith("# HELP "):
+            name = line.split()[2]
+            assert name not in seen, f"family {name} is split"
+            seen.add(name)
+            current = name
+        elif line.startswith("# TYPE "):
+            assert line.split()[2] == current
+        elif line:
+            name = SAMPLE.match(line).group(1)
+            assert re.sub(r"_(bucket|sum|count)$", "", name) == current \
+                or name == current
+    assert "ircd_local_clients" in seen
+    assert "ircd_loop_iteration_seconds" in seen
+
+
+@pytest.mark.asyncio
+async def test_metrics_follow_state(ircd_hub):
+    """User and command counters move when a client registers."""
+    before = await scrape(ircd_hub)
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(f"prom{random.randint(0, 999_999)}", "prom", "Metrics")
+    try:
+        await client.send("PING :metrics")
+        await client.wait_for("PONG", timeout=10.0)
+        after = await scrape(ircd_hub)
+        assert after["ircd_local_clients"] >= 1
+        assert after["ircd_connections_accepted_total"] > before["ircd_connections_accepted_total"]
+        key = 'ircd_command_calls_total{command="PING",handler="client"}'
+        assert after[key] > before.get(key, 0)
+    finally:
+        await client.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_metrics_errors(ircd_hub):
+    """Unknown paths, other methods and oversized requests are refused."""
+    status, _, _ = await http_request(ircd_hub, b"GET /other HTTP/1.0\r\n\r\n")
+    assert status == 404
+    status, _, _ = await http_request(
+        ircd_hub, b"POST /metrics HTTP/1.0\r\n\r\n")
+    assert status == 405
+    status, _, _ = await http_request(
+        ircd_hub, b"GET /metrics HTTP/1.0\r\nX: " + b"a" * 4096 + b"\r\n\r\n")
+    assert status == 431
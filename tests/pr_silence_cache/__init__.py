@@ -0,0 +1 @@
+# Cached silence verdict tests
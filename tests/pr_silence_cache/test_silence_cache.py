@@ -0,0 +1,93 @@
+"""Cached SILENCE verdicts.
+
+is_silenced() remembers its last few verdicts for each target, keyed by
+a serial that changes whenever the sender's nick, host or account
+changes.  Changing the silence list forgets them.  /STATS t counts
+cache hits and misses.
+"""
+
+from __future__ import annotations
+
+import random
+import re
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+SILENCE_CACHE = re.compile(r"silence cache hits (\d+) misses (\d+)")
+
+
+async def connect(ircd_hub, nick: str) -> IRCClient:
+    client = IRCClient()
+    await client.connect(ircd_hub["host"], ircd_hub["port"])
+    await client.register(nick, "silence", "Silence Test")
+    return client
+
+
+async def cache_stats(client: IRCClient) -> tuple[int, int]:
+    """Return the silence cache hits and misses from /STATS t."""
+    await client.send("STATS t")
+    replies = await client.collect_until("219", timeout=10.0)
+    lines = [" ".join(msg.params[1:]) for msg in replies if msg.command == "249"]
+    found = [SILENCE_CACHE.search(line) for line in lines]
+    found = [match for match in found if match]
+    assert found, f"no silence cache line in STATS t: {lines!r}"
+    return int(found[0].group(1)), int(found[0].group(2))
+
+
+async def delivered(target: IRCClient, sender: IRCClient, marker: IRCClient,
+                    text: str) -> bool:
+    """Send text from sender to target and report whether it arrived.
+
+    A PING round trip makes sure the server has handled the message
+    before an unsilenced marker message is sent after it.
+    """
+    await sender.send(f"PRIVMSG {target.nick} :{text}")
+    await sender.send_and_expect("PING :sync", "PONG")
+    await marker.send(f"PRIVMSG {target.nick} :marker {text}")
+    seen = False
+    while True:
+        msg = await target.wait_for("PRIVMSG", timeout=10.0)
+        if msg.params[-1] == text:
+            seen = True
+        elif msg.params[-1] == f"marker {text}":
+            return seen
+
+
+@pytest.mark.asyncio
+async def test_verdict_follows_nick_and_list_changes(ircd_hub):
+    """Cached verdicts never outlive a nick or silence list change."""
+    tag = random.randint(0, 999_999)
+    target = await connect(ircd_hub, f"silt{tag}")
+    sender = await connect(ircd_hub, f"pest{tag}")
+    marker = await connect(ircd_hub, f"mark{tag}")
+    oper = await connect(ircd_hub, f"silop{tag}")
+    try:
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381", timeout=10.0)
+        hits, misses = await cache_stats(oper)
+
+        await target.send_and_expect("SILENCE +pest*!*@*", "SILENCE")
+        assert not await delivered(target, sender, marker, "one")
+        assert not await delivered(target, sender, marker, "two")
+
+        await sender.send_and_expect(f"NICK calm{tag}", "NICK")
+        sender.nick = f"calm{tag}"
+        assert await delivered(target, sender, marker, "three")
+
+        await sender.send_and_expect(f"NICK pest{tag}x", "NICK")
+        sender.nick = f"pest{tag}x"
+        assert not await delivered(target, sender, marker, "four")
+
+        await target.send_and_expect("SILENCE -pest*!*@*", "SILENCE")
+        assert await delivered(target, sender, marker, "five")
+
+        new_hits, new_misses = await cache_stats(oper)
+        assert new_hits - hits >= 1
+        assert new_misses - misses >= 4
+    finally:
+        for client in (target, sender, marker, oper):
+            await client.disconnect()
@@ -0,0 +1 @@
+# TLS session resumption tests
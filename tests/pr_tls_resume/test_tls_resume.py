@@ -0,0 +1,239 @@
+"""Tests for TLS session resumption on client ports.
+
+Client TLS ports share one session cache and one set of ticket keys, so
+a client that reconnects -- to the same port or to another one with the
+same certificate checks, even one with its own cipher list -- gets an
+abbreviated handshake.  This holds
+for session tickets and, with tickets turned off, for the session ID
+cache.  Server ports never resume: a link always does a full
+handshake, so its certificate is checked every time.  /stats tls
+reports how many handshakes were resumed.
+
+These tests run the locally built ircd.  They need ircd/ircd compiled
+for this host (run `make` first); they skip if it is missing.
+"""
+
+import socket
+import ssl
+import subprocess
+import time
+from pathlib import Path
+
+import pytest
+
+
+REPO_ROOT = Path(__file__).resolve().parents[2]
+IRCD_BIN = REPO_ROOT / "ircd" / "ircd"
+CERT_DIR = REPO_ROOT / "tests" / "docker" / "certs"
+
+pytestmark = pytest.mark.skipif(
+    not IRCD_BIN.exists(), reason="local ircd binary not built"
+)
+
+
+def _free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def _spath():
+    """Read the compiled-in SPATH from config.h (ircd checks it on boot)."""
+    for line in (REPO_ROOT / "config.h").read_text().splitlines():
+        if line.startswith("#define SPATH "):
+            return Path(line.split('"')[1])
+    return None
+
+
+@pytest.fixture
+def ensure_spath():
+    """ircd refuses to start unless SPATH exists; symlink it if missing."""
+    spath = _spath()
+    created = False
+    if spath and not spath.exists() and spath.parent.is_dir():
+        spath.symlink_to(IRCD_BIN)
+        created = True
+    yield
+    if created:
+        spath.unlink(missing_ok=True)
+
+
+CONF_TEMPLATE = """\
+General {{
+        name = "resume.example.net";
+        vhost = "127.0.0.1";
+        description = "TLS resumption test server";
+        numeric = 96;
+        tls certfile = "{cert}";
+        tls keyfile = "{key}";
+}};
+Admin {{
+        Location = "test";
+        Location = "test";
+        Contact = "test@example.net";
+}};
+Class {{
+        name = "Local";
+        pingfreq = 90 seconds;
+        sendq = 160000;
+        maxlinks = 100;
+}};
+Client {{ ip = "127.*"; class = "Local"; }};
+Operator {{ local = no; class = "Local"; host = "*@127.*"; password = "$PLAIN$oper"; name = "oper"; }};
+Port {{ port = {port}; }};
+Port {{ port = {tls1}; tls = yes; }};
+Port {{ port = {tls2}; tls = yes; tls ciphers = "HIGH"; }};
+Port {{ port = {checked}; tls = yes; tls cacertfile = "{ca}"; }};
+Port {{ port = {server}; tls = yes; server = yes; }};
+features {{
+        "IPCHECK_CLONE_LIMIT" = "100";
+}};
+"""
+
+
+@pytest.fixture
+def local_ircd(tmp_path, ensure_spath):
+    """Spawn a local ircd with three client TLS ports and a server one."""
+    ports = {name: _free_port()
+             for name in ("port", "tls1", "tls2", "checked", "server")}
+    conf = tmp_path / "ircd.conf"
+    conf.write_text(
+        CONF_TEMPLATE.format(
+            cert=CERT_DIR / "hub.pem",
+            key=CERT_DIR / "hub.key",
+            ca=CERT_DIR / "ca.pem",
+            **ports,
+        )
+    )
+    proc = subprocess.Popen(
+        [str(IRCD_BIN), "-n", "-f", str(conf), "-d", str(tmp_path)],
+        cwd=tmp_path,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+    )
+    try:
+        deadline = time.time() + 10
+        while time.time() < deadline:
+            if proc.poll() is not None:
+                raise RuntimeError("ircd exited during startup")
+            # Ports with their own TLS settings may open a little later.
+            try:
+                for port in ports.values():
+                    with socket.create_connection(("127.0.0.1", port), 0.2):
+                        pass
+                break
+            except OSError:
+                time.sleep(0.1)
+        else:
+            raise RuntimeError("ircd did not start listening")
+        yield ports
+    finally:
+        proc.terminate()
+        try:
+            proc.wait(timeout=5)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+
+
+def _client_context(version, tickets=True):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.check_hostname = False
+    ctx.verify_mode = ssl.CERT_NONE
+    ctx.minimum_version = ctx.maximum_version = version
+    if not tickets:
+        ctx.options |= ssl.OP_NO_TICKET
+    # Server ports insist on a client certificate.
+    ctx.load_cert_chain(CERT_DIR / "leaf.pem", CERT_DIR / "leaf.key")
+    return ctx
+
+
+def _connect(ctx, port, session=None):
+    """Handshake, QUIT, and wait for the server to close the link.
+
+    Returns (session_reused, session).  Waiting for the close lets
+    TLSv1.3 tickets, which follow the handshake, reach the client.
+    """
+    raw = socket.create_connection(("127.0.0.1", port), 5)
+    with ctx.wrap_socket(raw, session=session) as tls:
+        tls.sendall(b"QUIT\r\n")
+        while tls.recv(4096):
+            pass
+        return tls.session_reused, tls.session
+
+
+def _stats_tls(port):
+    """Register on the plain port and return the /stats tls lines."""
+    lines = []
+    with socket.create_connection(("127.0.0.1", port), 10) as s:
+        f = s.makefile("rb")
+        s.sendall(b"NICK statsme\r\nUSER test 0 * :Test\r\n")
+        for raw in f:
+            line = raw.decode(errors="replace").strip()
+            parts = line.split()
+            if parts[:1] == ["PING"]:
+                s.sendall(("PONG " + parts[1] + "\r\n").encode())
+            elif parts[1:2] == ["001"]:
+                s.sendall(b"OPER oper oper\r\n")
+            elif parts[1:2] == ["381"]:
+                s.sendall(b"STATS tls\r\n")
+            elif parts[1:2] == ["249"]:
+                lines.append(line)
+            elif parts[1:2] == ["219"]:
+                return lines
+    return lines
+
+
+@pytest.mark.parametrize(
+    "version,tickets",
+    [
+        (ssl.TLSVersion.TLSv1_2, True),
+        (ssl.TLSVersion.TLSv1_2, False),
+        (ssl.TLSVersion.TLSv1_3, True),
+    ],
+)
+def test_reconnect_resumes_on_any_client_port(local_ircd, version, tickets):
+    """A session from one TLS port resumes there and on another one."""
+    ctx = _client_context(version, tickets)
+    reused, session = _connect(ctx, local_ircd["tls1"])
+    assert not reused
+    reused, session = _connect(ctx, local_ircd["tls1"], session)
+    assert reused
+    reused, _ = _connect(ctx, local_ircd["tls2"], session)
+    assert reused
+
+    summary = [line for line in _stats_tls(local_ircd["port"])
+               if " :TLS handshakes: " in line]
+    assert len(summary) == 1
+    assert "1 full, 2 resumed" in summary[0]
+
+
+def test_no_resumption_across_verify_policy(local_ircd):
+    """A port with its own CA settings does not accept other sessions."""
+    ctx = _client_context(ssl.TLSVersion.TLSv1_2)
+    _, session = _connect(ctx, local_ircd["tls1"])
+    reused, _ = _connect(ctx, local_ircd["checked"], session)
+    assert not reused
+
+
+@pytest.mark.parametrize(
+    "version,tickets",
+    [
+        (ssl.TLSVersion.TLSv1_2, True),
+        (ssl.TLSVersion.TLSv1_2, False),
+        (ssl.TLSVersion.TLSv1_3, True),
+    ],
+)
+def test_server_port_never_resumes(local_ircd, version, tickets):
+    """Sessions are neither resumed on a server port nor taken there."""
+    ctx = _client_context(version, tickets)
+    reused, session = _connect(ctx, local_ircd["server"])
+    assert not reused
+    reused, _ = _connect(ctx, local_ircd["server"], session)
+    assert not reused
+    _, session = _connect(ctx, local_ircd["tls1"])
+    reused, _ = _connect(ctx, local_ircd["server"], session)
+    assert not reused
+
+    summary = [line for line in _stats_tls(local_ircd["port"])
+               if " :TLS handshakes: " in line]
+    assert "0 resumed" in summary[0]
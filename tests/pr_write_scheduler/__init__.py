@@ -0,0 +1 @@
+# Write scheduler tests
@@ -0,0 +1,92 @@
+"""Client output through the write scheduler (/STATS writes).
+
+Once per event loop pass the server writes queued client output in
+turns, limited by each connection class's writebudget (32 KB for the
+Local class in the test configuration).  Output over the budget waits
+for the next pass; none of it may be lost or reordered, and /STATS
+writes counts what each class sent.
+"""
+
+from __future__ import annotations
+
+import asyncio
+import random
+
+import pytest
+
+from irc_client import IRCClient
+
+pytestmark = pytest.mark.single_server
+
+REPEATS = 8
+
+
+async def make_oper(ircd_hub, nick: str) -> IRCClient:
+    oper = IRCClient()
+    await oper.connect(ircd_hub["host"], ircd_hub["port"])
+    await oper.register(nick, "writes", "Write Test")
+    await oper.send("OPER testoper operpass")
+    await oper.wait_for("381", timeout=10.0)
+    return oper
+
+
+async def class_writes(client: IRCClient) -> dict[str, dict[str, int]]:
+    """Return {class: {"budget": ..., "bytes": ..., ...}} from /STATS writes."""
+    await client.send("STATS writes")
+    replies = await client.collect_until("219", timeout=10.0)
+    rows = {}
+    for msg in replies:
+        fields = msg.params[-1].split()
+        if msg.command != "249" or len(fields) != 9 or fields[1] != "budget":
+            continue
+        rows[fields[0]] = {key: int(value)
+                           for key, value in zip(fields[1::2], fields[2::2])}
+    return rows
+
+
+async def features(client: IRCClient, count: int) -> list[list[str]]:
+    """Request /STATS F count times at once and return each report."""
+    for _ in range(count):
+        await client.send("STATS F")
+    reports: list[list[str]] = []
+    current: list[str] = []
+    while len(reports) < count:
+        msg = await client.recv(timeout=10.0)
+        if msg.command == "238":
+            current.append(" ".join(msg.params[1:]))
+        elif msg.command == "219":
+            reports.append(current)
+            current = []
+    return reports
+
+
+@pytest.mark.asyncio
+async def test_backlog_arrives_intact(ircd_hub):
+    """Several clients queueing more than a pass's budget get all of it."""
+    tag = random.randint(0, 999_999)
+    opers = [await make_oper(ircd_hub, f"wr{tag}x{ii}") for ii in range(4)]
+    try:
+        results = await asyncio.gather(*(features(o, REPEATS) for o in opers))
+        expected = results[0][0]
+        assert len(expected) > 50
+        for reports in results:
+            assert reports == [expected] * REPEATS
+    finally:
+        await asyncio.gather(*(o.disconnect() for o in opers))
+
+
+@pytest.mark.asyncio
+async def test_stats_writes_counts_bytes(ircd_hub):
+    """/STATS writes reports the bytes sent to each class."""
+    oper = await make_oper(ircd_hub, f"ws{random.randint(0, 999_999)}")
+    try:
+        before = await class_writes(oper)
+        assert before, "no /STATS writes lines"
+        reports = await features(oper, 2)
+        received = sum(len(line) for line in reports[0]) * 2
+        after = await class_writes(oper)
+        sent = sum(after[name]["bytes"] - before.get(name, {"bytes": 0})["bytes"]
+                   for name in after)
+        assert sent >= received
+    finally:
+        await oper.disconnect()
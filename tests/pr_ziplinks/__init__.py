@@ -0,0 +1 @@
+# Compressed server link tests
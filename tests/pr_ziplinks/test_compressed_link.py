@@ -0,0 +1,98 @@
+"""Compressed server-to-server links.
+
+A Connect block with "compress = yes;" makes the ircd offer the 'c'
+server flag.  When the peer offers it too, everything after the two
+SERVER lines is a zlib stream in each direction.
+
+These tests link a fake P10 server that speaks zlib to the hub and
+check that the burst, traffic in both directions and /STATS l work
+over the compressed link, and that a peer that does not offer
+compression still links uncompressed.
+"""
+
+import pytest
+
+from irc_client import IRCClient
+from p10_server import P10Server
+
+
+pytestmark = pytest.mark.single_server
+
+
+def _zipped(compress: bool = True) -> P10Server:
+    return P10Server(
+        name="zipped.test.net",
+        numeric=7,
+        password="testpass",
+        description="Compressed Link",
+        server_flags="",
+        compress=compress,
+    )
+
+
+@pytest.fixture
+async def zipped(ircd_hub):
+    """Link a fake server that offers compression to the hub."""
+    srv = _zipped()
+    await srv.connect(ircd_hub["host"], ircd_hub["server_port"])
+    await srv.handshake()
+    yield srv
+    await srv.disconnect()
+
+
+async def test_link_is_compressed(zipped):
+    """Both ends offered 'c', so the burst arrived compressed."""
+    assert zipped.compressed
+    hub_server = [line for line in zipped.received if line.startswith("SERVER ")]
+    assert hub_server and "c" in hub_server[0].split()[7]
+    assert zipped.burst_complete
+
+
+async def test_traffic_both_directions(ircd_hub, zipped):
+    """Messages cross the compressed link in both directions."""
+    user = IRCClient()
+    await user.connect(ircd_hub["host"], ircd_hub["port"])
+    await user.register("zipusr", "zipusr", "Zip User")
+    try:
+        numnick = await zipped.wait_for_user("zipusr")
+        remote = await zipped.introduce_user("zipremote")
+
+        await zipped.send_privmsg(remote, numnick, "hello over zlib")
+        msg = await user.wait_for_message_with_text("PRIVMSG", "hello over zlib")
+        assert msg.prefix.startswith("zipremote!")
+
+        await user.send("PRIVMSG zipremote :hello back")
+        line = await zipped.wait_for_token("P")
+        assert line.endswith(":hello back")
+    finally:
+        await user.disconnect()
+
+
+async def test_stats_l_reports_compression(ircd_hub, zipped):
+    """/STATS l shows the byte counts of a compressed link."""
+    oper = IRCClient()
+    await oper.connect(ircd_hub["host"], ircd_hub["port"])
+    await oper.register("zipoper", "zipoper", "Zip Oper")
+    try:
+        await oper.send("OPER testoper operpass")
+        await oper.wait_for("381")
+        await oper.send("STATS l")
+        replies = await oper.collect_until("219")
+        stats = [m for m in replies if m.command == "249"
+                 and "zipped.test.net compression:" in m.params[-1]]
+        assert len(stats) == 1
+        assert "saved" in stats[0].params[-1]
+    finally:
+        await oper.disconnect()
+
+
+async def test_peer_without_compression_links_plain(ircd_hub):
+    """A peer that does not offer 'c' gets an ordinary link."""
+    srv = _zipped(compress=False)
+    await srv.connect(ircd_hub["host"], ircd_hub["server_port"])
+    try:
+        await srv.handshake()
+        assert not srv.compressed
+        assert srv.burst_complete
+    finally:
+        await srv.disconnect()
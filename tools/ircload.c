@@ -0,0 +1,1238 @@
+/*
+ * IRC - Internet Relay Chat, tools/ircload.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/** @file
+ * @brief Load generator and delivery latency benchmark.
+ *
+ * ircload opens a number of client connections to one server (plain,
+ * TLS or WebSocket), joins each of them to channels picked from a Zipf
+ * distribution, and then sends PRIVMSG, JOIN/PART and NICK traffic at
+ * fixed aggregate rates.  Every PRIVMSG carries the time it was sent,
+ * so each copy the server delivers back to another load client gives
+ * one end-to-end latency sample.  A line of statistics is printed every
+ * second and a summary with latency percentiles at the end.
+ *
+ * All clients come from one address, and an ordinary client is only
+ * allowed about one command per second before the server starts to
+ * delay its input.  For meaningful numbers, point ircload at a Port
+ * whose Client block puts it in a class with maxflood above
+ * CLIENT_FLOOD, and exempt the source address from connection
+ * throttling with an IPCheck block (see doc/example.conf); otherwise
+ * keep the message rate below the number of clients.
+ */
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef IRCLOAD_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+/** Most channels one load client may be joined to. */
+#define LOAD_MAXJOINS		32
+/** Size of each connection's input buffer, including a terminating NUL. */
+#define LOAD_RBUF		8192
+/** Size of each connection's output buffer. */
+#define LOAD_WBUF		4096
+/** Longest nickname ircload generates. */
+#define LOAD_NICKLEN		15
+/** Sub-buckets per power of two in a latency histogram. */
+#define HIST_SUB_BITS		4
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+/** Number of latency histogram buckets (enough for any 64-bit value). */
+#define HIST_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+/** Marker that starts the text of every timed PRIVMSG. */
+#define LOAD_MARKER		"ircload "
+
+/** Lifecycle of one load connection. */
+enum ConnState {
+  CS_IDLE,		/**< not yet started */
+  CS_CONNECTING,	/**< waiting for the TCP connection */
+  CS_TLS,		/**< running the TLS handshake */
+  CS_WEBSOCKET,		/**< waiting for the WebSocket handshake reply */
+  CS_REGISTER,		/**< sent NICK and USER; waiting for 001 */
+  CS_READY,		/**< registered and generating traffic */
+  CS_DEAD		/**< failed or disconnected */
+};
+
+/** One load client. */
+struct Conn {
+  int fd;				/**< socket, or -1 */
+  enum ConnState state;			/**< where the connection is */
+  unsigned int id;			/**< index in the client array */
+  unsigned int nickgen;			/**< nickname changes so far */
+  char nick[LOAD_NICKLEN + 1];		/**< current nickname */
+  unsigned int nchans;			/**< entries used in chans */
+  int chans[LOAD_MAXJOINS];		/**< channels wanted, by index */
+  unsigned char joined[LOAD_MAXJOINS];	/**< non-zero once JOIN echoed */
+  uint64_t started;			/**< when the connect began */
+  size_t rlen;				/**< bytes in rbuf, before a NUL */
+  size_t wlen;				/**< bytes in wbuf */
+  char rbuf[LOAD_RBUF];			/**< unprocessed input */
+  char wbuf[LOAD_WBUF];			/**< output not yet sent */
+#ifdef IRCLOAD_TLS
+  SSL *ssl;				/**< TLS session, if any */
+  int tls_want_write;			/**< TLS needs the socket writable */
+#endif
+};
+
+/** Latency histogram with a fixed relative error. */
+struct Hist {
+  uint64_t count;			/**< samples recorded */
+  uint64_t max;				/**< largest sample */
+  uint64_t sum;				/**< sum of all samples */
+  uint64_t buckets[HIST_BUCKETS];	/**< samples per bucket */
+};
+
+/** Traffic counters, kept both per interval and for the whole run. */
+struct Counters {
+  uint64_t privmsg;			/**< timed PRIVMSGs sent */
+  uint64_t joins;			/**< JOIN commands sent */
+  uint64_t parts;			/**< PART commands sent */
+  uint64_t nicks;			/**< NICK changes sent */
+  uint64_t dropped;			/**< commands skipped: output full */
+  uint64_t delivered;			/**< timed PRIVMSGs received */
+  uint64_t expected;			/**< deliveries the sends should cause */
+  uint64_t errors;			/**< error numerics received */
+  struct Hist latency;			/**< delivery latency */
+};
+
+/** Command line settings. */
+static struct {
+  const char *host;
+  const char *port;
+  const char *bind;
+  const char *password;
+  const char *wspath;
+  const char *prefix;
+  unsigned int clients;
+  double connect_rate;
+  unsigned int channels;
+  unsigned int joins;
+  double zipf;
+  double msg_rate;
+  unsigned int msg_len;
+  double churn_rate;
+  double nick_rate;
+  unsigned int duration;
+  int tls;
+  int quiet;
+  unsigned long seed;
+} opt = {
+  "127.0.0.1", "6667", 0, 0, 0, "load",
+  100, 200.0, 10, 2, 1.0, 100.0, 64, 0.0, 0.0, 30, 0, 0, 0
+};
+
+static struct Conn *conns;		/**< all load clients */
+static unsigned int *members;		/**< our clients in each channel */
+static double *chan_cdf;		/**< Zipf CDF over the channels */
+static struct addrinfo *target;		/**< resolved server address */
+static struct addrinfo *source;		/**< resolved bind address */
+static uint64_t start_time;		/**< monotonic time at startup */
+static uint64_t rng_state;		/**< xorshift generator state */
+static volatile sig_atomic_t interrupted;
+static struct Counters total;		/**< counters for the traffic phase */
+static struct Counters interval;	/**< counters for the current second */
+static struct Hist reg_latency;		/**< connect to 001 */
+static unsigned int n_ready;		/**< connections in CS_READY */
+static unsigned int n_failed;		/**< never reached CS_READY */
+static unsigned int n_lost;		/**< died after CS_READY */
+static int measuring;			/**< counting traffic into total */
+#ifdef IRCLOAD_TLS
+static SSL_CTX *tls_ctx;		/**< client TLS context */
+#endif
+
+/** Return the monotonic clock in nanoseconds. */
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/** Return a pseudo-random 64-bit number (xorshift64*). */
+static uint64_t rng(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/** Return a pseudo-random number in [0, \a n). */
+static unsigned int rng_below(unsigned int n)
+{
+  return (unsigned int)(rng() % n);
+}
+
+/** Map a sample to its histogram bucket. */
+static unsigned int hist_bucket(uint64_t v)
+{
+  unsigned int shift;
+
+  if (v < HIST_SUB)
+    return (unsigned int)v;
+  for (shift = 0; (v >> shift) >= 2 * HIST_SUB; shift++)
+    ;
+  return (shift + 1) * HIST_SUB + (unsigned int)((v >> shift) - HIST_SUB);
+}
+
+/** Return the smallest value that falls in a histogram bucket. */
+static uint64_t hist_value(unsigned int bucket)
+{
+  unsigned int shift;
+
+  if (bucket < HIST_SUB)
+    return bucket;
+  shift = bucket / HIST_SUB - 1;
+  return (uint64_t)(HIST_SUB + bucket % HIST_SUB) << shift;
+}
+
+/** Record one sample. */
+static void hist_add(struct Hist *h, uint64_t v)
+{
+  h->count++;
+  h->sum += v;
+  if (v > h->max)
+    h->max = v;
+  h->buckets[hist_bucket(v)]++;
+}
+
+/** Return the value below which a fraction \a q of the samples fall. */
+static uint64_t hist_quantile(const struct Hist *h, double q)
+{
+  uint64_t want, seen = 0;
+  unsigned int ii;
+
+  if (!h->count)
+    return 0;
+  want = (uint64_t)ceil(q * h->count);
+  if (want < 1)
+    want = 1;
+  for (ii = 0; ii < HIST_BUCKETS; ii++) {
+    seen += h->buckets[ii];
+    if (seen >= want)
+      return hist_value(ii) < h->max ? hist_value(ii) : h->max;
+  }
+  return h->max;
+}
+
+/** Format a duration in nanoseconds for humans. */
+static const char *fmt_ns(char *buf, size_t len, uint64_t ns)
+{
+  if (ns < 1000000)
+    snprintf(buf, len, "%.1fus", ns / 1e3);
+  else if (ns < 1000000000)
+    snprintf(buf, len, "%.2fms", ns / 1e6);
+  else
+    snprintf(buf, len, "%.2fs", ns / 1e9);
+  return buf;
+}
+
+/** Print the usual percentiles of a histogram. */
+static void hist_print(const char *label, const struct Hist *h)
+{
+  static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  static const char *names[] = { "p50", "p90", "p99", "p99.9" };
+  char buf[32];
+  unsigned int ii;
+
+  printf("%-14s", label);
+  if (!h->count) {
+    printf("no samples\n");
+    return;
+  }
+  for (ii = 0; ii < sizeof(quantiles) / sizeof(quantiles[0]); ii++)
+    printf(" %s %s", names[ii],
+           fmt_ns(buf, sizeof(buf), hist_quantile(h, quantiles[ii])));
+  printf(" max %s", fmt_ns(buf, sizeof(buf), h->max));
+  printf(" mean %s\n", fmt_ns(buf, sizeof(buf), h->sum / h->count));
+}
+
+/** Pick a channel index from the Zipf distribution. */
+static int pick_channel(void)
+{
+  double r = (double)(rng() >> 11) / (double)(1ULL << 53);
+  unsigned int lo = 0, hi = opt.channels - 1;
+
+  while (lo < hi) {
+    unsigned int mid = (lo + hi) / 2;
+    if (chan_cdf[mid] < r)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/** Pick a channel that \a c does not already want. */
+static int pick_new_channel(const struct Conn *c)
+{
+  unsigned int tries, ii;
+  int chan;
+
+  for (tries = 0; tries < 32; tries++) {
+    chan = pick_channel();
+    for (ii = 0; ii < c->nchans; ii++)
+      if (c->chans[ii] == chan)
+        break;
+    if (ii == c->nchans)
+      return chan;
+  }
+  return -1;
+}
+
+/** Queue raw bytes for a connection.
+ * @return Non-zero if they fit in the output buffer.
+ */
+static int conn_put(struct Conn *c, const void *data, size_t len)
+{
+  if (c->wlen + len > sizeof(c->wbuf))
+    return 0;
+  memcpy(c->wbuf + c->wlen, data, len);
+  c->wlen += len;
+  return 1;
+}
+
+/** Queue a masked WebSocket frame.
+ * @return Non-zero if it fits in the output buffer.
+ */
+static int ws_put_frame(struct Conn *c, int opcode, const char *data,
+                        size_t len)
+{
+  unsigned char hdr[8], mask[4];
+  size_t hlen, ii;
+  uint32_t key = (uint32_t)rng();
+
+  hdr[0] = 0x80 | opcode;
+  if (len < 126) {
+    hdr[1] = 0x80 | len;
+    hlen = 2;
+  } else {
+    hdr[1] = 0x80 | 126;
+    hdr[2] = len >> 8;
+    hdr[3] = len & 0xff;
+    hlen = 4;
+  }
+  memcpy(mask, &key, 4);
+  memcpy(hdr + hlen, mask, 4);
+  hlen += 4;
+  if (c->wlen + hlen + len > sizeof(c->wbuf))
+    return 0;
+  conn_put(c, hdr, hlen);
+  for (ii = 0; ii < len; ii++)
+    c->wbuf[c->wlen + ii] = data[ii] ^ mask[ii % 4];
+  c->wlen += len;
+  return 1;
+}
+
+/** Queue one IRC line (without CRLF) for a connection.
+ * @return Non-zero if it was queued.
+ */
+static int conn_line(struct Conn *c, const char *fmt, ...)
+{
+  char line[1024];
+  va_list args;
+  int len;
+
+  va_start(args, fmt);
+  len = vsnprintf(line, sizeof(line) - 2, fmt, args);
+  va_end(args);
+  if (len < 0 || (size_t)len >= sizeof(line) - 2)
+    return 0;
+  if (opt.wspath)
+    return ws_put_frame(c, 0x1, line, len);
+  line[len++] = '\r';
+  line[len++] = '\n';
+  return conn_put(c, line, len);
+}
+
+/** Close a connection and update the totals. */
+static void conn_kill(struct Conn *c)
+{
+  unsigned int ii;
+
+  if (c->state == CS_DEAD || c->state == CS_IDLE)
+    return;
+  if (c->state == CS_READY) {
+    n_ready--;
+    n_lost++;
+  } else
+    n_failed++;
+  for (ii = 0; ii < c->nchans; ii++)
+    if (c->joined[ii])
+      members[c->chans[ii]]--;
+#ifdef IRCLOAD_TLS
+  if (c->ssl) {
+    SSL_free(c->ssl);
+    c->ssl = 0;
+  }
+#endif
+  close(c->fd);
+  c->fd = -1;
+  c->state = CS_DEAD;
+}
+
+/** Start connecting one load client. */
+static void conn_start(struct Conn *c)
+{
+  int one = 1;
+
+  c->started = now_ns();
+  c->state = CS_CONNECTING;
+  c->fd = socket(target->ai_family, SOCK_STREAM, 0);
+  if (c->fd < 0) {
+    if (errno == EMFILE || errno == ENFILE)
+      fprintf(stderr, "ircload: out of file descriptors\n");
+    c->state = CS_DEAD;
+    n_failed++;
+    return;
+  }
+  fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+  setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (source && bind(c->fd, source->ai_addr, source->ai_addrlen) < 0) {
+    conn_kill(c);
+    return;
+  }
+  if (connect(c->fd, target->ai_addr, target->ai_addrlen) < 0
+      && errno != EINPROGRESS)
+    conn_kill(c);
+}
+
+/** Send the registration commands. */
+static void conn_register(struct Conn *c)
+{
+  c->state = CS_REGISTER;
+  snprintf(c->nick, sizeof(c->nick), "%s%u", opt.prefix, c->id);
+  if (opt.password)
+    conn_line(c, "PASS :%s", opt.password);
+  conn_line(c, "NICK %s", c->nick);
+  conn_line(c, "USER %s 0 * :ircload client %u", opt.prefix, c->id);
+}
+
+/** Start the WebSocket opening handshake. */
+static void conn_websocket(struct Conn *c)
+{
+  char head[512];
+  unsigned char key[16];
+  char key64[25];
+  static const char b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  unsigned int ii, jj;
+  int len;
+
+  for (ii = 0; ii < sizeof(key); ii++)
+    key[ii] = (unsigned char)rng();
+  for (ii = jj = 0; ii < 15; ii += 3) {
+    uint32_t v = (key[ii] << 16) | (key[ii + 1] << 8) | key[ii + 2];
+    key64[jj++] = b64[v >> 18];
+    key64[jj++] = b64[(v >> 12) & 63];
+    key64[jj++] = b64[(v >> 6) & 63];
+    key64[jj++] = b64[v & 63];
+  }
+  key64[jj++] = b64[key[15] >> 2];
+  key64[jj++] = b64[(key[15] & 3) << 4];
+  key64[jj++] = '=';
+  key64[jj++] = '=';
+  key64[jj] = '\0';
+
+  c->state = CS_WEBSOCKET;
+  len = snprintf(head, sizeof(head),
+                 "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+                 "Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n"
+                 "Sec-WebSocket-Version: 13\r\n"
+                 "Sec-WebSocket-Protocol: text.ircv3.net\r\n\r\n",
+                 opt.wspath, opt.host, key64);
+  conn_put(c, head, len);
+}
+
+/** Move a freshly connected socket to its next protocol step. */
+static void conn_connected(struct Conn *c)
+{
+#ifdef IRCLOAD_TLS
+  if (opt.tls) {
+    c->state = CS_TLS;
+    if (!(c->ssl = SSL_new(tls_ctx)) || !SSL_set_fd(c->ssl, c->fd)) {
+      conn_kill(c);
+      return;
+    }
+    SSL_set_tlsext_host_name(c->ssl, opt.host);
+    return;
+  }
+#endif
+  if (opt.wspath)
+    conn_websocket(c);
+  else
+    conn_register(c);
+}
+
+#ifdef IRCLOAD_TLS
+/** Map a TLS result to errno, updating tls_want_write.
+ * @return 0 (errno EAGAIN) if the operation should be retried later,
+ *   -1 (errno ECONNRESET) on failure.
+ */
+static int tls_retry(struct Conn *c, int res)
+{
+  switch (SSL_get_error(c->ssl, res)) {
+  case SSL_ERROR_WANT_READ:
+    c->tls_want_write = 0;
+    errno = EAGAIN;
+    return 0;
+  case SSL_ERROR_WANT_WRITE:
+    c->tls_want_write = 1;
+    errno = EAGAIN;
+    return 0;
+  default:
+    errno = ECONNRESET;
+    return -1;
+  }
+}
+
+/** Continue the TLS handshake. */
+static void conn_tls(struct Conn *c)
+{
+  int res = SSL_connect(c->ssl);
+
+  if (res == 1) {
+    c->tls_want_write = 0;
+    if (opt.wspath)
+      conn_websocket(c);
+    else
+      conn_register(c);
+  } else if (tls_retry(c, res) < 0)
+    conn_kill(c);
+}
+#endif
+
+/** Read from a connection.
+ * @return Bytes read, 0 at end of file, or -1 with errno set.
+ */
+static ssize_t conn_recv(struct Conn *c, char *buf, size_t len)
+{
+#ifdef IRCLOAD_TLS
+  if (c->ssl) {
+    int res = SSL_read(c->ssl, buf, len);
+    if (res > 0)
+      return res;
+    if (SSL_get_error(c->ssl, res) == SSL_ERROR_ZERO_RETURN)
+      return 0;
+    tls_retry(c, res);
+    return -1;
+  }
+#endif
+  return recv(c->fd, buf, len, 0);
+}
+
+/** Write to a connection.
+ * @return Bytes written, or -1 with errno set.
+ */
+static ssize_t conn_send(struct Conn *c, const char *buf, size_t len)
+{
+#ifdef IRCLOAD_TLS
+  if (c->ssl) {
+    int res = SSL_write(c->ssl, buf, len);
+    if (res > 0)
+      return res;
+    tls_retry(c, res);
+    return -1;
+  }
+#endif
+  return send(c->fd, buf, len, 0);
+}
+
+/** Flush as much queued output as the socket takes. */
+static void conn_flush(struct Conn *c)
+{
+  ssize_t res;
+
+  while (c->wlen > 0) {
+    res = conn_send(c, c->wbuf, c->wlen);
+    if (res < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        conn_kill(c);
+      return;
+    }
+    memmove(c->wbuf, c->wbuf + res, c->wlen - res);
+    c->wlen -= res;
+  }
+}
+
+/** Find which of a connection's channel slots holds a channel name. */
+static int conn_slot(const struct Conn *c, const char *name)
+{
+  unsigned int ii;
+  size_t plen = strlen(opt.prefix);
+  int chan;
+
+  if (*name != '#' || strncasecmp(name + 1, opt.prefix, plen))
+    return -1;
+  chan = atoi(name + 1 + plen);
+  for (ii = 0; ii < c->nchans; ii++)
+    if (c->chans[ii] == chan)
+      return ii;
+  return -1;
+}
+
+/** Send the JOIN for every channel the client wants. */
+static void conn_join_all(struct Conn *c)
+{
+  char list[LOAD_MAXJOINS * 24];
+  size_t pos = 0;
+  unsigned int ii;
+
+  if (!c->nchans)
+    return;
+  for (ii = 0; ii < c->nchans; ii++)
+    pos += snprintf(list + pos, sizeof(list) - pos, "%s#%s%d",
+                    ii ? "," : "", opt.prefix, c->chans[ii]);
+  conn_line(c, "JOIN %s", list);
+}
+
+/** Handle one line from the server. */
+static void conn_handle(struct Conn *c, char *line)
+{
+  char *source = 0, *cmd, *params, *text = 0, *bang;
+  int slot;
+
+  if (*line == '@' && !(line = strchr(line, ' ')))
+    return;
+  while (*line == ' ')
+    line++;
+  if (*line == ':') {
+    source = line + 1;
+    if (!(line = strchr(line, ' ')))
+      return;
+    *line++ = '\0';
+    if ((bang = strchr(source, '!')))
+      *bang = '\0';
+  }
+  cmd = line;
+  if ((params = strchr(line, ' '))) {
+    *params++ = '\0';
+    if ((text = strstr(params, " :")))
+      *text++ = '\0', text++;
+    else if (*params == ':')
+      text = params + 1;
+  }
+
+  if (!strcmp(cmd, "PRIVMSG")) {
+    if (text && !strncmp(text, LOAD_MARKER, sizeof(LOAD_MARKER) - 1)) {
+      uint64_t sent = strtoull(text + sizeof(LOAD_MARKER) - 1, 0, 16);
+      uint64_t now = now_ns() - start_time;
+      if (measuring && now >= sent) {
+        total.delivered++;
+        hist_add(&total.latency, now - sent);
+      }
+      interval.delivered++;
+      if (now >= sent)
+        hist_add(&interval.latency, now - sent);
+    }
+  } else if (!strcmp(cmd, "PING")) {
+    conn_line(c, "PONG :%s", text ? text : (params ? params : ""));
+  } else if (!strcmp(cmd, "001")) {
+    if (c->state == CS_REGISTER) {
+      c->state = CS_READY;
+      n_ready++;
+      hist_add(&reg_latency, now_ns() - c->started);
+      conn_join_all(c);
+    }
+  } else if (!strcmp(cmd, "433") || !strcmp(cmd, "432")) {
+    if (c->state == CS_REGISTER) {
+      snprintf(c->nick, sizeof(c->nick), "%s%ux%u", opt.prefix, c->id,
+               rng_below(1000));
+      conn_line(c, "NICK %s", c->nick);
+    }
+  } else if (source && !strcasecmp(source, c->nick)) {
+    char *chan = params && *params && *params != ':' ? params : text;
+    char *end;
+
+    if (chan && (end = strpbrk(chan, " ,")))
+      *end = '\0';
+    if (!strcmp(cmd, "JOIN") && chan) {
+      if ((slot = conn_slot(c, chan)) >= 0 && !c->joined[slot]) {
+        c->joined[slot] = 1;
+        members[c->chans[slot]]++;
+      }
+    } else if (!strcmp(cmd, "PART") && chan) {
+      /* The slot was already reused for the new channel. */
+      size_t plen = strlen(opt.prefix);
+      if (*chan == '#' && !strncasecmp(chan + 1, opt.prefix, plen))
+        members[atoi(chan + 1 + plen)]--;
+    } else if (!strcmp(cmd, "NICK") && (chan = text ? text : params)) {
+      snprintf(c->nick, sizeof(c->nick), "%s", chan);
+    }
+  } else if (!strcmp(cmd, "ERROR")) {
+    conn_kill(c);
+  } else if (cmd[0] >= '4' && cmd[0] <= '5' && strlen(cmd) == 3
+             && strcmp(cmd, "422")) { /* a missing MOTD is no error */
+    if (measuring)
+      total.errors++;
+    interval.errors++;
+  }
+}
+
+/** Process complete WebSocket frames in the input buffer.
+ * @return Bytes consumed.
+ */
+static size_t ws_input(struct Conn *c)
+{
+  size_t pos = 0, hlen, plen;
+  unsigned char *p;
+  char line[LOAD_RBUF];
+
+  while (c->state != CS_DEAD && c->rlen - pos >= 2) {
+    p = (unsigned char *)c->rbuf + pos;
+    plen = p[1] & 0x7f;
+    hlen = 2;
+    if (plen == 126) {
+      if (c->rlen - pos < 4)
+        break;
+      plen = (p[2] << 8) | p[3];
+      hlen = 4;
+    } else if (plen == 127) {
+      conn_kill(c);		/* never sent for IRC lines */
+      break;
+    }
+    if (c->rlen - pos < hlen + plen)
+      break;
+    switch (p[0] & 0x0f) {
+    case 0x1:
+    case 0x2:
+      if (plen >= sizeof(line))
+        plen = sizeof(line) - 1;
+      memcpy(line, p + hlen, plen);
+      line[plen] = '\0';
+      line[strcspn(line, "\r\n")] = '\0';
+      conn_handle(c, line);
+      break;
+    case 0x8:
+      conn_kill(c);
+      break;
+    case 0x9:
+      ws_put_frame(c, 0xa, (char *)p + hlen, plen);
+      break;
+    }
+    pos += hlen + plen;
+  }
+  return pos;
+}
+
+/** Process complete lines in the input buffer.
+ * @return Bytes consumed.
+ */
+static size_t irc_input(struct Conn *c)
+{
+  size_t pos = 0;
+  char *nl;
+
+  while (c->state != CS_DEAD
+         && (nl = memchr(c->rbuf + pos, '\n', c->rlen - pos))) {
+    *nl = '\0';
+    if (nl > c->rbuf + pos && nl[-1] == '\r')
+      nl[-1] = '\0';
+    conn_handle(c, c->rbuf + pos);
+    pos = nl + 1 - c->rbuf;
+  }
+  return pos;
+}
+
+/** Read everything available on a connection and act on it. */
+static void conn_input(struct Conn *c)
+{
+  ssize_t res;
+  size_t used;
+  char *end;
+
+  for (;;) {
+    if (c->rlen == sizeof(c->rbuf) - 1) {
+      conn_kill(c);		/* a line or frame longer than the buffer */
+      return;
+    }
+    res = conn_recv(c, c->rbuf + c->rlen, sizeof(c->rbuf) - 1 - c->rlen);
+    if (res == 0 || (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+                     && errno != EINTR)) {
+      conn_kill(c);
+      return;
+    }
+    if (res < 0)
+      return;
+    c->rlen += res;
+    c->rbuf[c->rlen] = '\0';
+
+    if (c->state == CS_WEBSOCKET) {
+      if (!(end = strstr(c->rbuf, "\r\n\r\n")))
+        continue;
+      if (strncmp(c->rbuf, "HTTP/1.1 101", 12)) {
+        conn_kill(c);
+        return;
+      }
+      used = end + 4 - c->rbuf;
+      memmove(c->rbuf, c->rbuf + used, c->rlen - used);
+      c->rlen -= used;
+      conn_register(c);
+    }
+    if (c->state == CS_WEBSOCKET)
+      continue;
+    used = opt.wspath ? ws_input(c) : irc_input(c);
+    if (c->state == CS_DEAD)
+      return;
+    memmove(c->rbuf, c->rbuf + used, c->rlen - used);
+    c->rlen -= used;
+  }
+}
+
+/** Return a random registered client, or NULL if none could be found. */
+static struct Conn *random_ready(void)
+{
+  unsigned int tries;
+  struct Conn *c;
+
+  if (!n_ready)
+    return 0;
+  for (tries = 0; tries < 16; tries++) {
+    c = &conns[rng_below(opt.clients)];
+    if (c->state == CS_READY)
+      return c;
+  }
+  return 0;
+}
+
+/** Send one timed PRIVMSG from a random client. */
+static void send_privmsg(void)
+{
+  static char pad[512];
+  struct Conn *c = random_ready();
+  unsigned int ii, tries;
+  int padlen;
+
+  if (!pad[0])
+    memset(pad, 'x', sizeof(pad) - 1);
+  if (!c || !c->nchans)
+    return;
+  for (tries = 0; tries < 4; tries++) {
+    ii = rng_below(c->nchans);
+    if (c->joined[ii])
+      break;
+  }
+  if (!c->joined[ii])
+    return;
+  padlen = (int)opt.msg_len - (int)sizeof(LOAD_MARKER) - 16;
+  if (padlen < 0)
+    padlen = 0;
+  if (padlen > (int)sizeof(pad) - 1)
+    padlen = sizeof(pad) - 1;
+  if (!conn_line(c, "PRIVMSG #%s%d :" LOAD_MARKER "%016llx %.*s", opt.prefix,
+                 c->chans[ii], (unsigned long long)(now_ns() - start_time),
+                 padlen, pad)) {
+    total.dropped += measuring;
+    interval.dropped++;
+    return;
+  }
+  total.privmsg += measuring;
+  total.expected += measuring ? members[c->chans[ii]] - 1 : 0;
+  interval.privmsg++;
+  interval.expected += members[c->chans[ii]] - 1;
+}
+
+/** Move a random client from one of its channels to another. */
+static void send_churn(void)
+{
+  struct Conn *c = random_ready();
+  unsigned int ii;
+  int chan;
+
+  if (!c || !c->nchans)
+    return;
+  ii = rng_below(c->nchans);
+  if (!c->joined[ii] || (chan = pick_new_channel(c)) < 0)
+    return;
+  if (!conn_line(c, "PART #%s%d", opt.prefix, c->chans[ii])) {
+    total.dropped += measuring;
+    interval.dropped++;
+    return;
+  }
+  c->chans[ii] = chan;
+  c->joined[ii] = 0;
+  conn_line(c, "JOIN #%s%d", opt.prefix, chan);
+  total.parts += measuring;
+  total.joins += measuring;
+  interval.parts++;
+  interval.joins++;
+}
+
+/** Change the nickname of a random client. */
+static void send_nick(void)
+{
+  struct Conn *c = random_ready();
+
+  if (!c)
+    return;
+  if (!conn_line(c, "NICK %s%un%u", opt.prefix, c->id, ++c->nickgen % 100000)) {
+    total.dropped += measuring;
+    interval.dropped++;
+    return;
+  }
+  total.nicks += measuring;
+  interval.nicks++;
+}
+
+/** Print the statistics for the last second and reset them. */
+static void report_interval(unsigned int second, const char *phase)
+{
+  char p50[32], p99[32], max[32];
+
+  if (!opt.quiet) {
+    printf("%4us %-7s ready %u msgs %llu/s deliveries %llu/s",
+           second, phase, n_ready, (unsigned long long)interval.privmsg,
+           (unsigned long long)interval.delivered);
+    if (interval.latency.count)
+      printf(" latency p50 %s p99 %s max %s",
+             fmt_ns(p50, sizeof(p50), hist_quantile(&interval.latency, 0.5)),
+             fmt_ns(p99, sizeof(p99), hist_quantile(&interval.latency, 0.99)),
+             fmt_ns(max, sizeof(max), interval.latency.max));
+    if (interval.dropped)
+      printf(" dropped %llu", (unsigned long long)interval.dropped);
+    if (interval.errors)
+      printf(" errors %llu", (unsigned long long)interval.errors);
+    printf("\n");
+    fflush(stdout);
+  }
+  memset(&interval, 0, sizeof(interval));
+}
+
+/** Print the final summary. */
+static void report_total(double seconds)
+{
+  printf("\nclients:       %u ready, %u failed, %u lost after registering\n",
+         n_ready, n_failed, n_lost);
+  hist_print("registration:", &reg_latency);
+  printf("sent:          %llu PRIVMSG (%.1f/s), %llu JOIN, %llu PART, "
+         "%llu NICK, %llu dropped\n",
+         (unsigned long long)total.privmsg, total.privmsg / seconds,
+         (unsigned long long)total.joins, (unsigned long long)total.parts,
+         (unsigned long long)total.nicks, (unsigned long long)total.dropped);
+  printf("delivered:     %llu (%.1f/s), %.2f%% of expected",
+         (unsigned long long)total.delivered, total.delivered / seconds,
+         total.expected ? 100.0 * total.delivered / total.expected : 100.0);
+  if (total.errors)
+    printf(", %llu error replies", (unsigned long long)total.errors);
+  printf("\n");
+  hist_print("latency:", &total.latency);
+}
+
+/** Run the event loop until \a until or until interrupted.
+ * @param[in] until Monotonic deadline, in nanoseconds.
+ * @param[in] traffic Non-zero to generate traffic.
+ * @param[in] phase Name printed in the per-second lines.
+ * @param[in] ramp Non-zero to start connections and stop once they
+ *   have all registered or failed.
+ */
+static void run_loop(uint64_t until, int traffic, const char *phase, int ramp)
+{
+  static struct pollfd *pfds;
+  static unsigned int *pidx;
+  static uint64_t next_report;
+  uint64_t begin = now_ns(), now;
+  uint64_t done_msg = 0, done_churn = 0, done_nick = 0, due;
+  unsigned int launched = 0, npfd, ii;
+  double elapsed;
+  struct Conn *c;
+
+  if (!pfds) {
+    pfds = calloc(opt.clients, sizeof(*pfds));
+    pidx = calloc(opt.clients, sizeof(*pidx));
+    next_report = begin + 1000000000u;
+  }
+  if (ramp)
+    for (ii = 0; ii < opt.clients; ii++)
+      if (conns[ii].state != CS_IDLE)
+        launched++;
+
+  while (!interrupted && (now = now_ns()) < until) {
+    elapsed = (now - begin) / 1e9;
+
+    if (ramp) {
+      due = (uint64_t)(elapsed * opt.connect_rate) + 1;
+      while (launched < opt.clients && launched < due)
+        conn_start(&conns[launched++]);
+      if (launched == opt.clients
+          && n_ready + n_failed + n_lost == opt.clients)
+        break;
+    }
+    if (traffic) {
+      for (due = (uint64_t)(elapsed * opt.msg_rate); done_msg < due; done_msg++)
+        send_privmsg();
+      for (due = (uint64_t)(elapsed * opt.churn_rate); done_churn < due;
+           done_churn++)
+        send_churn();
+      for (due = (uint64_t)(elapsed * opt.nick_rate); done_nick < due;
+           done_nick++)
+        send_nick();
+    }
+
+    for (ii = npfd = 0; ii < opt.clients; ii++) {
+      c = &conns[ii];
+      if (c->state == CS_IDLE || c->state == CS_DEAD)
+        continue;
+      if (c->wlen && c->state != CS_CONNECTING && c->state != CS_TLS)
+        conn_flush(c);
+      if (c->state == CS_DEAD)
+        continue;
+      pfds[npfd].fd = c->fd;
+      pfds[npfd].events = POLLIN;
+      if (c->state == CS_CONNECTING || c->wlen)
+        pfds[npfd].events |= POLLOUT;
+#ifdef IRCLOAD_TLS
+      if (c->tls_want_write)
+        pfds[npfd].events |= POLLOUT;
+#endif
+      pfds[npfd].revents = 0;
+      pidx[npfd++] = ii;
+    }
+
+    if (poll(pfds, npfd, traffic || ramp ? 1 : 50) < 0 && errno != EINTR) {
+      perror("ircload: poll");
+      exit(1);
+    }
+
+    for (ii = 0; ii < npfd; ii++) {
+      if (!pfds[ii].revents)
+        continue;
+      c = &conns[pidx[ii]];
+      if (c->state == CS_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+          conn_kill(c);
+          continue;
+        }
+        conn_connected(c);
+      }
+#ifdef IRCLOAD_TLS
+      if (c->state == CS_TLS) {
+        conn_tls(c);
+        if (c->state == CS_TLS)
+          continue;
+      }
+#endif
+      if (c->state == CS_DEAD)
+        continue;
+      if (pfds[ii].revents & (POLLIN | POLLHUP | POLLERR))
+        conn_input(c);
+      if (c->state != CS_DEAD && c->wlen)
+        conn_flush(c);
+    }
+
+    if ((now = now_ns()) >= next_report) {
+      report_interval((unsigned int)((now - start_time) / 1000000000u), phase);
+      next_report += 1000000000u;
+    }
+  }
+}
+
+static void handle_signal(int sig)
+{
+  interrupted = 1;
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "Usage: ircload [options]\n"
+          "  -s host     server to connect to (default 127.0.0.1)\n"
+          "  -p port     port (default 6667)\n"
+          "  -b address  local address to connect from\n"
+          "  -P pass     connection password\n"
+          "  -t          use TLS\n"
+          "  -w path     use WebSocket, requesting this path (e.g. /)\n"
+          "  -c count    number of clients (default 100)\n"
+          "  -r rate     connections started per second (default 200)\n"
+          "  -C count    number of channels (default 10)\n"
+          "  -J count    channels joined per client (default 2, max %d)\n"
+          "  -z s        Zipf exponent of channel popularity; 0 is uniform"
+          " (default 1)\n"
+          "  -m rate     PRIVMSGs per second, all clients together"
+          " (default 100)\n"
+          "  -l bytes    approximate PRIVMSG length (default 64)\n"
+          "  -j rate     PART/JOIN moves per second (default 0)\n"
+          "  -n rate     NICK changes per second (default 0)\n"
+          "  -d seconds  length of the traffic phase (default 30)\n"
+          "  -x prefix   nickname and channel prefix (default load)\n"
+          "  -S seed     random seed\n"
+          "  -q          print only the summary\n",
+          LOAD_MAXJOINS);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  struct addrinfo hints;
+  struct rlimit rl;
+  uint64_t phase_start;
+  double seconds, weight;
+  unsigned int ii, jj;
+  int ch, res;
+
+  while ((ch = getopt(argc, argv, "s:p:b:P:tw:c:r:C:J:z:m:l:j:n:d:x:S:qh"))
+         != -1) {
+    switch (ch) {
+    case 's': opt.host = optarg; break;
+    case 'p': opt.port = optarg; break;
+    case 'b': opt.bind = optarg; break;
+    case 'P': opt.password = optarg; break;
+    case 't': opt.tls = 1; break;
+    case 'w': opt.wspath = optarg; break;
+    case 'c': opt.clients = strtoul(optarg, 0, 10); break;
+    case 'r': opt.connect_rate = atof(optarg); break;
+    case 'C': opt.channels = strtoul(optarg, 0, 10); break;
+    case 'J': opt.joins = strtoul(optarg, 0, 10); break;
+    case 'z': opt.zipf = atof(optarg); break;
+    case 'm': opt.msg_rate = atof(optarg); break;
+    case 'l': opt.msg_len = strtoul(optarg, 0, 10); break;
+    case 'j': opt.churn_rate = atof(optarg); break;
+    case 'n': opt.nick_rate = atof(optarg); break;
+    case 'd': opt.duration = strtoul(optarg, 0, 10); break;
+    case 'x': opt.prefix = optarg; break;
+    case 'S': opt.seed = strtoul(optarg, 0, 10); break;
+    case 'q': opt.quiet = 1; break;
+    default: usage();
+    }
+  }
+  if (optind != argc || !opt.clients || !opt.channels
+      || opt.joins > LOAD_MAXJOINS || opt.joins > opt.channels
+      || opt.connect_rate <= 0 || opt.msg_rate < 0 || opt.churn_rate < 0
+      || opt.nick_rate < 0 || strlen(opt.prefix) > 8)
+    usage();
+#ifndef IRCLOAD_TLS
+  if (opt.tls) {
+    fprintf(stderr, "ircload: built without TLS support\n");
+    return 2;
+  }
+#else
+  if (opt.tls) {
+    SSL_library_init();
+    SSL_load_error_strings();
+    if (!(tls_ctx = SSL_CTX_new(SSLv23_client_method()))) {
+      fprintf(stderr, "ircload: cannot create TLS context\n");
+      return 1;
+    }
+    SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_NONE, 0);
+  }
+#endif
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_socktype = SOCK_STREAM;
+  if ((res = getaddrinfo(opt.host, opt.port, &hints, &target))) {
+    fprintf(stderr, "ircload: %s: %s\n", opt.host, gai_strerror(res));
+    return 1;
+  }
+  hints.ai_family = target->ai_family;
+  if (opt.bind && (res = getaddrinfo(opt.bind, 0, &hints, &source))) {
+    fprintf(stderr, "ircload: %s: %s\n", opt.bind, gai_strerror(res));
+    return 1;
+  }
+
+  /* Each client needs a descriptor; raise the soft limit as far as we may. */
+  if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < opt.clients + 16)
+    fprintf(stderr, "ircload: warning: descriptor limit %lu is below the "
+            "client count\n", (unsigned long)rl.rlim_cur);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  start_time = now_ns();
+  rng_state = opt.seed ? opt.seed : start_time ^ ((uint64_t)getpid() << 32);
+  if (!rng_state)
+    rng_state = 1;
+
+  conns = calloc(opt.clients, sizeof(*conns));
+  members = calloc(opt.channels, sizeof(*members));
+  chan_cdf = calloc(opt.channels, sizeof(*chan_cdf));
+  if (!conns || !members || !chan_cdf) {
+    fprintf(stderr, "ircload: out of memory\n");
+    return 1;
+  }
+  for (ii = 0, weight = 0; ii < opt.channels; ii++)
+    chan_cdf[ii] = weight += 1.0 / pow(ii + 1, opt.zipf);
+  for (ii = 0; ii < opt.channels; ii++)
+    chan_cdf[ii] /= weight;
+  for (ii = 0; ii < opt.clients; ii++) {
+    conns[ii].fd = -1;
+    conns[ii].id = ii;
+    for (jj = 0; jj < opt.joins; jj++) {
+      int chan = pick_new_channel(&conns[ii]);
+      if (chan >= 0)
+        conns[ii].chans[conns[ii].nchans++] = chan;
+    }
+  }
+
+  printf("ircload: %u %s clients to %s port %s, %u channels, %u joins each\n",
+         opt.clients, opt.tls ? (opt.wspath ? "WSS" : "TLS")
+         : (opt.wspath ? "WebSocket" : "plain"), opt.host, opt.port,
+         opt.channels, opt.joins);
+  if (opt.msg_rate > opt.clients)
+    printf("ircload: note: %.1f messages per client per second needs a "
+           "flood-exempt class\n", opt.msg_rate / opt.clients);
+
+  /* Connect everyone, then give the JOINs a moment to settle. */
+  run_loop(now_ns() + (uint64_t)((opt.clients / opt.connect_rate + 60) * 1e9),
+           0, "connect", 1);
+  run_loop(now_ns() + 1000000000u, 0, "join", 0);
+  if (!n_ready) {
+    fprintf(stderr, "ircload: no client registered\n");
+    return 1;
+  }
+
+  measuring = 1;
+  phase_start = now_ns();
+  run_loop(phase_start + (uint64_t)opt.duration * 1000000000u, 1, "traffic",
+           0);
+  seconds = (now_ns() - phase_start) / 1e9;
+  /* Let deliveries still in flight arrive; they still count. */
+  run_loop(now_ns() + 2000000000u, 0, "drain", 0);
+  measuring = 0;
+
+  report_total(seconds > 0 ? seconds : 1);
+  for (ii = 0; ii < opt.clients; ii++)
+    if (conns[ii].state != CS_IDLE && conns[ii].state != CS_DEAD)
+      close(conns[ii].fd);
+  return 0;
+}